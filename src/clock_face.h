@@ -0,0 +1,164 @@
+#pragma once
+
+#include "hal.h"
+#include "compositor.h"
+
+// Local time as the clock face needs it, already reduced to the dial.
+struct ClockFaceTime {
+  uint8_t hour12;  // 0..11
+  uint8_t minute;  // 0..59
+  uint8_t second;  // 0..59
+  uint32_t microsecond;
+};
+
+struct ClockFaceStyle {
+  uint32_t markerColor;
+  uint32_t hourColor;
+  uint32_t minuteColor;
+  uint32_t secondColor;
+  uint8_t markerCount;  // 0, 4 or 12
+  bool continuousHour;  // Hour hand moves with the minutes
+  bool smooth;          // Sub-second, anti-aliased hands
+};
+
+// Each part of the face goes to its own layer (pixels indexed by strip
+// LED, see compositor.h), so overlapping hands can be blended instead of
+// hiding each other. The layers must be cleared before drawing.
+struct ClockFaceLayers {
+  uint32_t* markers;
+  uint32_t* hour;
+  uint32_t* minute;
+  uint32_t* second;
+};
+
+// Draws the clock face onto one ring of the LED strip. Implemented by
+// ClockFace<> for each ring geometry; the list of rings in main.cpp holds
+// them through this interface.
+class ClockFaceRenderer {
+ public:
+  virtual void draw(const ClockFaceLayers& layers, const ClockFaceTime& time, const ClockFaceStyle& style) const = 0;
+  virtual uint16_t ledCount() const = 0;
+  virtual uint16_t firstLed() const = 0;
+};
+
+// Positions on a ring are Q8 fixed point (1/256 LED). Tick positions are
+// rounded down, so their whole-LED part is exactly tick * leds / ticks in
+// integer maths.
+constexpr uint16_t tickPositionQ8(uint32_t tick, uint32_t ticks, uint32_t leds) {
+  return (uint16_t)(tick * leds * 256 / ticks);
+}
+
+// Q8 advance per unit of `period` units per revolution, as a multiplier
+// for (elapsed * scale) >> 40; rounded up so a whole tick never lands one
+// LED short.
+constexpr uint64_t ringPositionScale(uint32_t leds, uint64_t period) {
+  return (((uint64_t)leds * 256 << 40) + period - 1) / period;
+}
+
+inline uint32_t ringPositionQ8(uint32_t elapsed, uint64_t scale) {
+  return (uint32_t)(((uint64_t)elapsed * scale) >> 40);
+}
+
+// Q8 positions of `Ticks` evenly spaced ticks around a ring of `leds` LEDs,
+// rotated so that tick 0 is at LED `topLed`.
+template <uint16_t Ticks>
+struct RingTickTable {
+  uint16_t q8[Ticks];
+};
+
+template <uint16_t Ticks>
+constexpr RingTickTable<Ticks> makeRingTickTable(uint16_t leds, uint16_t topLed) {
+  RingTickTable<Ticks> table{};
+  for (uint32_t tick = 0; tick < Ticks; tick++) {
+    uint32_t q8 = tickPositionQ8(tick, Ticks, leds) + (uint32_t)topLed * 256;
+    table.q8[tick] = (uint16_t)(q8 >= (uint32_t)leds * 256 ? q8 - (uint32_t)leds * 256 : q8);
+  }
+  return table;
+}
+
+// One ring of `LedCount` LEDs starting at strip LED `FirstLed`, with LED
+// `TopLed` of the ring at 12 o'clock. All geometry is resolved at compile
+// time: tick positions come from flash tables and sub-tick motion from a
+// multiply and shift, so a frame does no divisions or modulos.
+template <uint16_t LedCount, uint16_t FirstLed = 0, uint16_t TopLed = 0>
+class ClockFace : public ClockFaceRenderer {
+ public:
+  static_assert(LedCount >= 4 && LedCount <= 255, "ring positions are stored as uint16_t Q8");
+  static_assert(TopLed < LedCount, "the top LED must be on the ring");
+
+  void draw(const ClockFaceLayers& layers, const ClockFaceTime& time, const ClockFaceStyle& style) const override {
+    if (style.markerCount != 0) {
+      uint8_t step = style.markerCount == 4 ? 3 : 1;
+      for (uint8_t i = 0; i < 12; i += step) {
+        layers.markers[led(tick(HOUR_TICKS.q8, i) >> 8)] = withAlpha(style.markerColor, 255);
+      }
+    }
+
+    uint32_t hourQ8 = style.continuousHour ? tick(HOUR_MINUTE_TICKS.q8, time.hour12 * 60 + time.minute)
+                                           : tick(HOUR_TICKS.q8, time.hour12) & ~0xFFu;
+    uint32_t minuteQ8 = tick(MINUTE_TICKS.q8, time.minute);
+    uint32_t secondQ8 = tick(MINUTE_TICKS.q8, time.second);
+
+    if (!style.smooth) {
+      // Hour hand 3 LEDs wide, minute and second hands 1 LED.
+      uint16_t hour = hourQ8 >> 8;
+      uint32_t hourColor = withAlpha(style.hourColor, 255);
+      layers.hour[led(hour + LedCount - 1)] = hourColor;
+      layers.hour[led(hour)] = hourColor;
+      layers.hour[led(hour + 1)] = hourColor;
+      layers.minute[led(minuteQ8 >> 8)] = withAlpha(style.minuteColor, 255);
+      layers.second[led(secondQ8 >> 8)] = withAlpha(style.secondColor, 255);
+      return;
+    }
+
+    uint32_t secondUs = (uint32_t)time.second * 1000000UL + time.microsecond;
+    secondQ8 += ringPositionQ8(time.microsecond, SECOND_SCALE);
+    minuteQ8 += ringPositionQ8(secondUs, MINUTE_SCALE);
+    if (style.continuousHour) {
+      hourQ8 += ringPositionQ8(time.second, HOUR_SCALE);
+    }
+    drawSpan(layers.hour, hourQ8 + ((uint32_t)LedCount << 8) - 256, 3, style.hourColor);
+    drawSpan(layers.minute, minuteQ8, 1, style.minuteColor);
+    drawSpan(layers.second, secondQ8, 1, style.secondColor);
+  }
+
+  uint16_t ledCount() const override { return LedCount; }
+  uint16_t firstLed() const override { return FirstLed; }
+
+ private:
+  static uint32_t tick(const uint16_t* table, uint16_t index) { return pgm_read_word(&table[index]); }
+
+  // Strip LED of a ring position; positions past the end of the ring (by
+  // less than two turns) wrap with a subtraction.
+  static uint16_t led(uint16_t ringIndex) {
+    while (ringIndex >= LedCount) {
+      ringIndex -= LedCount;
+    }
+    return FirstLed + ringIndex;
+  }
+
+  // Draws a hand `widthLeds` wide starting at a Q8 position: the alpha of
+  // the first and last LEDs is the part of them the hand covers, the ones
+  // between are opaque.
+  static void drawSpan(uint32_t* layer, uint32_t startQ8, uint8_t widthLeds, uint32_t color) {
+    uint16_t index = startQ8 >> 8;
+    uint8_t frac = startQ8 & 0xFF;
+    layer[led(index)] = withAlpha(color, 255 - frac);
+    for (uint8_t i = 1; i < widthLeds; i++) {
+      layer[led(index + i)] = withAlpha(color, 255);
+    }
+    if (frac != 0) {
+      layer[led(index + widthLeds)] = withAlpha(color, frac);
+    }
+  }
+
+  // Minute/second ticks, hour ticks, and hour + minute ticks (720 per turn).
+  static constexpr RingTickTable<60> MINUTE_TICKS PROGMEM = makeRingTickTable<60>(LedCount, TopLed);
+  static constexpr RingTickTable<12> HOUR_TICKS PROGMEM = makeRingTickTable<12>(LedCount, TopLed);
+  static constexpr RingTickTable<720> HOUR_MINUTE_TICKS PROGMEM = makeRingTickTable<720>(LedCount, TopLed);
+
+  // Motion within one tick: a second in us, a minute in us, a minute in s.
+  static constexpr uint64_t SECOND_SCALE = ringPositionScale(LedCount, 60000000ULL);
+  static constexpr uint64_t MINUTE_SCALE = ringPositionScale(LedCount, 3600000000ULL);
+  static constexpr uint64_t HOUR_SCALE = ringPositionScale(LedCount, 43200ULL);
+};
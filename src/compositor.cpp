@@ -0,0 +1,97 @@
+#include "compositor.h"
+
+const char* const BLEND_MODE_NAMES[BLEND_MODE_COUNT] = {"over", "add", "max", "screen"};
+
+namespace {
+
+// Two 8-bit channels in 16-bit lanes: R and B of 0x00RRGGBB as they are,
+// G after a shift by 8 (with the alpha byte in the other lane, masked
+// out at the end). The spare byte above each channel absorbs carries.
+const uint32_t LANES = 0x00FF00FF;
+const uint32_t LANE_CARRY = 0x01000100;
+
+// 0xFF in every lane whose bit 8 is set, 0 elsewhere.
+inline uint32_t laneMask(uint32_t carries) {
+  return carries - (carries >> 8);
+}
+
+// Alpha 0..255 as a 0..256 multiplier, so that 255 is fully opaque.
+inline uint32_t alphaWeight(uint32_t pixel) {
+  uint32_t alpha = pixel >> 24;
+  return alpha + (alpha >> 7);
+}
+
+// below + (layer - below) * weight / 256 in both lanes. Per lane the
+// difference may borrow from the lane above, but the borrow is undone by
+// adding `below` back, so only the final mask is needed.
+inline uint32_t overLanes(uint32_t below, uint32_t layer, uint32_t weight) {
+  return ((((layer - below) * weight) >> 8) + below) & LANES;
+}
+
+inline uint32_t scaleLanes(uint32_t lanes, uint32_t weight) {
+  return ((lanes * weight) >> 8) & LANES;
+}
+
+// Lane-wise saturating add of two values that are at most 0xFF per lane.
+inline uint32_t addLanes(uint32_t a, uint32_t b) {
+  uint32_t sum = a + b;
+  return (sum | laneMask(sum & LANE_CARRY)) & LANES;
+}
+
+// Lane-wise max: a - b keeps bit 8 of a lane set where a >= b.
+inline uint32_t maxLanes(uint32_t a, uint32_t b) {
+  uint32_t keepA = laneMask(((a | LANE_CARRY) - b) & LANE_CARRY);
+  return (a & keepA) | (b & ~keepA);
+}
+
+// x * y / 255 for 8-bit x and y, rounded.
+inline uint32_t mul255(uint32_t x, uint32_t y) {
+  uint32_t v = x * y + 128;
+  return (v + (v >> 8)) >> 8;
+}
+
+// a + b - a b / 255 per lane. The product needs a multiply per channel;
+// the rest is done on both lanes at once.
+inline uint32_t screenLanes(uint32_t a, uint32_t b) {
+  uint32_t product = (mul255(a >> 16, b >> 16) << 16) | mul255(a & 0xFF, b & 0xFF);
+  return a + b - product;
+}
+
+inline uint32_t join(uint32_t rb, uint32_t ag) {
+  return rb | ((ag & 0xFF) << 8);
+}
+
+}  // namespace
+
+uint32_t blendPixel(uint32_t below, uint32_t layer, BlendMode mode) {
+  uint32_t weight = alphaWeight(layer);
+  uint32_t belowRb = below & LANES;
+  uint32_t belowG = (below >> 8) & 0xFF;
+  uint32_t layerRb = layer & LANES;
+  uint32_t layerAg = (layer >> 8) & LANES;
+  switch (mode) {
+    case BLEND_ADD:
+      return join(addLanes(belowRb, scaleLanes(layerRb, weight)), addLanes(belowG, scaleLanes(layerAg, weight) & 0xFF));
+    case BLEND_MAX:
+      return join(maxLanes(belowRb, scaleLanes(layerRb, weight)), maxLanes(belowG, scaleLanes(layerAg, weight) & 0xFF));
+    case BLEND_SCREEN:
+      return join(screenLanes(belowRb, scaleLanes(layerRb, weight)), screenLanes(belowG, scaleLanes(layerAg, weight) & 0xFF));
+    default:
+      return join(overLanes(belowRb, layerRb, weight), overLanes(belowG, layerAg & 0xFF, weight));
+  }
+}
+
+void compositeLayers(const Layer* layers, uint8_t layerCount, uint16_t pixelCount, uint32_t* out) {
+  memset(out, 0, pixelCount * sizeof(uint32_t));
+  for (uint8_t l = 0; l < layerCount; l++) {
+    const uint32_t* pixels = layers[l].pixels;
+    BlendMode mode = layers[l].mode;
+    for (uint16_t i = 0; i < pixelCount; i++) {
+      // Hands and markers cover a few LEDs, so most layer pixels are
+      // transparent and cost one test.
+      if (pixels[i] >> 24 != 0) {
+        out[i] = blendPixel(out[i], pixels[i], mode);
+      }
+    }
+  }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "hal.h"
+
+// Layer pixels are 0xAARRGGBB: an Adafruit_NeoPixel::Color() with the
+// pixel's alpha in the top byte. Alpha 0 is transparent and skipped.
+inline uint32_t withAlpha(uint32_t color, uint8_t alpha) {
+  return (color & 0xFFFFFF) | ((uint32_t)alpha << 24);
+}
+
+enum BlendMode : uint8_t {
+  BLEND_OVER,    // Mix towards the layer by its alpha
+  BLEND_ADD,     // Add the layer scaled by alpha, saturating at 255
+  BLEND_MAX,     // Brighter of the two, per channel
+  BLEND_SCREEN,  // 1 - (1 - below)(1 - layer): brightens like two lights
+  BLEND_MODE_COUNT
+};
+
+extern const char* const BLEND_MODE_NAMES[BLEND_MODE_COUNT];
+
+struct Layer {
+  const uint32_t* pixels;
+  BlendMode mode;
+};
+
+// Blends `layerCount` layers bottom to top onto black and writes the
+// opaque result (0x00RRGGBB) to `out`. Channels are blended in pairs in
+// one 32-bit word (R and B, then G), so most modes need two multiplies per
+// pixel instead of three.
+void compositeLayers(const Layer* layers, uint8_t layerCount, uint16_t pixelCount, uint32_t* out);
+
+// One pixel of compositeLayers(), for callers that blend a single value.
+uint32_t blendPixel(uint32_t below, uint32_t layer, BlendMode mode);
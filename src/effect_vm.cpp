@@ -0,0 +1,313 @@
+#include "effect_vm.h"
+
+namespace {
+
+const int32_t FIXED_ONE = 65536;
+
+// Operand bytes and stack effect of every opcode, checked before it runs.
+struct OpInfo {
+  uint8_t operandBytes;
+  uint8_t pops;
+  uint8_t pushes;
+};
+
+const OpInfo OP_INFO[OP_COUNT_] = {
+  {0, 0, 0},  // END
+  {2, 0, 1},  // PUSH
+  {4, 0, 1},  // PUSHF
+  {0, 0, 1},  // INDEX
+  {0, 0, 1},  // COUNT
+  {0, 0, 1},  // STEP
+  {0, 0, 1},  // FRAMES
+  {0, 1, 2},  // DUP
+  {0, 1, 0},  // DROP
+  {0, 2, 2},  // SWAP
+  {0, 2, 3},  // OVER
+  {0, 2, 1},  // ADD
+  {0, 2, 1},  // SUB
+  {0, 2, 1},  // MUL
+  {0, 2, 1},  // DIV
+  {0, 2, 1},  // MOD
+  {0, 1, 1},  // NEG
+  {0, 1, 1},  // ABS
+  {0, 2, 1},  // MIN
+  {0, 2, 1},  // MAX
+  {0, 2, 1},  // LT
+  {0, 2, 1},  // GT
+  {0, 2, 1},  // EQ
+  {0, 1, 1},  // NOT
+  {0, 3, 1},  // SEL
+  {0, 1, 1},  // SIN
+  {1, 1, 0},  // JZ
+  {1, 0, 0},  // JMP
+  {0, 3, 0},  // RGB
+  {0, 3, 0},  // HSV
+};
+
+bool endsPixel(uint8_t op) {
+  return op == OP_END || op == OP_RGB || op == OP_HSV || op == OP_JMP;
+}
+
+constexpr double constexprSin(double turns) {
+  double x = (turns - (int)turns) * 6.283185307179586;
+  if (x > 3.141592653589793) {
+    x -= 6.283185307179586;
+  }
+  double term = x;
+  double sum = 0.0;
+  for (int n = 1; n < 30; n += 2) {
+    sum += term;
+    term *= -x * x / ((n + 1) * (n + 2));
+  }
+  return sum;
+}
+
+// sin(2 pi k / 256) in Q15.
+struct SineTable {
+  int16_t value[256];
+};
+
+constexpr SineTable makeSineTable() {
+  SineTable table{};
+  for (int i = 0; i < 256; i++) {
+    double s = constexprSin(i / 256.0) * 32767.0;
+    table.value[i] = (int16_t)(s < 0 ? s - 0.5 : s + 0.5);
+  }
+  return table;
+}
+
+constexpr SineTable SINE_TABLE PROGMEM = makeSineTable();
+
+int32_t toFixed(uint32_t integer) {
+  return (int32_t)(integer << 16);
+}
+
+int32_t sineTurns(int32_t turns) {
+  return (int32_t)(int16_t)pgm_read_word(&SINE_TABLE.value[(turns >> 8) & 0xFF]) * 2;
+}
+
+// Colour channel: an integer 0..255, clamped.
+uint8_t channelByte(int32_t value) {
+  if (value <= 0) return 0;
+  if (value >= 255 * FIXED_ONE) return 255;
+  return value >> 16;
+}
+
+// Saturation/value: 0..1 scaled to 0..255, clamped.
+uint8_t unitByte(int32_t value) {
+  if (value <= 0) return 0;
+  if (value >= FIXED_ONE) return 255;
+  return ((uint32_t)value * 255) >> 16;
+}
+
+void hsvToRgb(int32_t hue, uint8_t s, uint8_t v, uint8_t* r, uint8_t* g, uint8_t* b) {
+  uint32_t sector = (uint32_t)(hue & 0xFFFF) * 6;
+  uint8_t f = (sector >> 8) & 0xFF;
+  uint8_t p = (v * (255 - s)) >> 8;
+  uint8_t q = (v * (255 - ((s * f) >> 8))) >> 8;
+  uint8_t t = (v * (255 - ((s * (255 - f)) >> 8))) >> 8;
+  switch (sector >> 16) {
+    case 0: *r = v; *g = t; *b = p; break;
+    case 1: *r = q; *g = v; *b = p; break;
+    case 2: *r = p; *g = v; *b = t; break;
+    case 3: *r = p; *g = q; *b = v; break;
+    case 4: *r = t; *g = p; *b = v; break;
+    default: *r = v; *g = p; *b = q; break;
+  }
+}
+
+uint16_t readU16(const uint8_t* p) {
+  return p[0] | (p[1] << 8);
+}
+
+}  // namespace
+
+const char* EffectPlayer::verify(const uint8_t* data, size_t len) {
+  if (len <= EFFECT_HEADER_SIZE || len > MAX_SIZE) {
+    return "bad size";
+  }
+  if (data[0] != 'F' || data[1] != 'X' || data[2] != EFFECT_VERSION) {
+    return "not an effect (or unsupported version)";
+  }
+  if (readU16(data + 4) == 0 || readU16(data + 6) == 0) {
+    return "frame interval and frame count must not be 0";
+  }
+
+  const uint8_t* code = data + EFFECT_HEADER_SIZE;
+  size_t codeLen = len - EFFECT_HEADER_SIZE;
+  uint8_t starts[MAX_SIZE / 8] = {};
+  size_t pc = 0;
+  uint8_t op = OP_END;
+  while (pc < codeLen) {
+    op = code[pc];
+    if (op >= OP_COUNT_) {
+      return "unknown opcode";
+    }
+    starts[pc / 8] |= 1 << (pc % 8);
+    pc += 1 + OP_INFO[op].operandBytes;
+  }
+  if (pc != codeLen) {
+    return "truncated operand";
+  }
+  if (!endsPixel(op)) {
+    return "code must end with END, RGB, HSV or JMP";
+  }
+
+  for (pc = 0; pc < codeLen; pc += 1 + OP_INFO[code[pc]].operandBytes) {
+    if (code[pc] != OP_JZ && code[pc] != OP_JMP) {
+      continue;
+    }
+    long target = (long)pc + 2 + (int8_t)code[pc + 1];
+    if (target < 0 || target >= (long)codeLen || !(starts[target / 8] & (1 << (target % 8)))) {
+      return "jump outside the code";
+    }
+  }
+  return nullptr;
+}
+
+bool EffectPlayer::start(const uint8_t* data, size_t len, bool progmem) {
+  length_ = 0;
+  error_ = nullptr;
+  if (len > MAX_SIZE) {
+    error_ = "bad size";
+    return false;
+  }
+  if (progmem) {
+    memcpy_P(program_, data, len);
+  } else {
+    memcpy(program_, data, len);
+  }
+  error_ = verify(program_, len);
+  if (error_ != nullptr) {
+    return false;
+  }
+  length_ = len;
+  flags_ = program_[3];
+  frameMs_ = readU16(program_ + 4);
+  frames_ = readU16(program_ + 6);
+  return true;
+}
+
+uint16_t EffectPlayer::renderFrame(Adafruit_NeoPixel& canvas, uint32_t step) {
+  uint16_t count = canvas.numPixels();
+  uint32_t frames = (flags_ & EFFECT_FLAG_FRAMES_PER_LED) ? (uint32_t)frames_ * count : frames_;
+  if (length_ == 0 || step >= frames) {
+    return 0;
+  }
+  if (flags_ & EFFECT_FLAG_CLEAR) {
+    canvas.clear();
+  }
+  uint32_t budget = FRAME_BUDGET;
+  for (uint16_t i = 0; i < count; i++) {
+    if (!runPixel(canvas, i, step, &budget)) {
+      length_ = 0;
+      return 0;
+    }
+  }
+  lastFrameInstructions_ = FRAME_BUDGET - budget;
+  return frameMs_;
+}
+
+bool EffectPlayer::runPixel(Adafruit_NeoPixel& canvas, uint16_t index, int32_t step, uint32_t* budget) {
+  const uint8_t* code = program_ + EFFECT_HEADER_SIZE;
+  int32_t stack[STACK_DEPTH];
+  uint8_t sp = 0;
+  size_t pc = 0;
+  uint32_t remaining = *budget;
+
+  for (;;) {
+    if (remaining == 0) {
+      error_ = "instruction budget exceeded";
+      return false;
+    }
+    remaining--;
+    uint8_t op = code[pc++];
+    const OpInfo& info = OP_INFO[op];
+    if (sp < info.pops || sp - info.pops + info.pushes > STACK_DEPTH) {
+      error_ = sp < info.pops ? "stack underflow" : "stack overflow";
+      return false;
+    }
+    int32_t* top = stack + sp;  // One past the top of the stack
+    int32_t a, b;
+    switch (op) {
+      case OP_END:
+        *budget = remaining;
+        return true;
+      case OP_PUSH:
+        stack[sp++] = (int32_t)(int16_t)readU16(code + pc) * FIXED_ONE;
+        pc += 2;
+        break;
+      case OP_PUSHF:
+        stack[sp++] = (int32_t)(readU16(code + pc) | ((uint32_t)readU16(code + pc + 2) << 16));
+        pc += 4;
+        break;
+      case OP_INDEX: stack[sp++] = toFixed(index); break;
+      case OP_COUNT: stack[sp++] = toFixed(canvas.numPixels()); break;
+      case OP_STEP: stack[sp++] = toFixed(step); break;
+      case OP_FRAMES:
+        stack[sp++] = toFixed((flags_ & EFFECT_FLAG_FRAMES_PER_LED) ? frames_ * canvas.numPixels() : frames_);
+        break;
+      case OP_DUP: top[0] = top[-1]; sp++; break;
+      case OP_DROP: sp--; break;
+      case OP_SWAP: a = top[-1]; top[-1] = top[-2]; top[-2] = a; break;
+      case OP_OVER: top[0] = top[-2]; sp++; break;
+      case OP_NEG: top[-1] = (int32_t)(0u - (uint32_t)top[-1]); break;
+      case OP_ABS: top[-1] = top[-1] < 0 ? (int32_t)(0u - (uint32_t)top[-1]) : top[-1]; break;
+      case OP_NOT: top[-1] = top[-1] == 0 ? FIXED_ONE : 0; break;
+      case OP_SIN: top[-1] = sineTurns(top[-1]); break;
+      case OP_SEL:
+        sp -= 2;
+        top[-3] = top[-3] != 0 ? top[-2] : top[-1];
+        break;
+      case OP_JZ:
+        sp--;
+        if (top[-1] == 0) {
+          pc += (int8_t)code[pc];
+        }
+        pc++;
+        break;
+      case OP_JMP:
+        pc += 1 + (int8_t)code[pc];
+        break;
+      case OP_RGB:
+        canvas.setPixelColor(index, channelByte(top[-3]), channelByte(top[-2]), channelByte(top[-1]));
+        *budget = remaining;
+        return true;
+      case OP_HSV: {
+        uint8_t r, g, bl;
+        hsvToRgb(top[-3], unitByte(top[-2]), unitByte(top[-1]), &r, &g, &bl);
+        canvas.setPixelColor(index, r, g, bl);
+        *budget = remaining;
+        return true;
+      }
+      default:
+        // Binary operators: pop b, replace a with the result.
+        b = top[-1];
+        a = top[-2];
+        sp--;
+        switch (op) {
+          case OP_ADD: a = (int32_t)((uint32_t)a + (uint32_t)b); break;
+          case OP_SUB: a = (int32_t)((uint32_t)a - (uint32_t)b); break;
+          case OP_MUL: a = (int32_t)(((int64_t)a * b) >> 16); break;
+          case OP_DIV: a = b == 0 ? 0 : (int32_t)((int64_t)a * 65536 / b); break;
+          case OP_MOD:  // x % -1 is 0 anyway, and INT32_MIN % -1 traps
+            if (b == 0 || b == -1) {
+              a = 0;
+            } else {
+              a %= b;
+              if (a != 0 && (a < 0) != (b < 0)) {
+                a += b;
+              }
+            }
+            break;
+          case OP_MIN: a = a < b ? a : b; break;
+          case OP_MAX: a = a > b ? a : b; break;
+          case OP_LT: a = a < b ? FIXED_ONE : 0; break;
+          case OP_GT: a = a > b ? FIXED_ONE : 0; break;
+          case OP_EQ: a = a == b ? FIXED_ONE : 0; break;
+        }
+        top[-2] = a;
+        break;
+    }
+  }
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "hal.h"
+
+// Effects are small programs for a stack machine that runs once per LED
+// per frame and leaves the LED's colour. Values are Q16.16 fixed point.
+//
+// File layout (little-endian):
+//   0  'F' 'X'
+//   2  version (1)
+//   3  flags (EFFECT_FLAG_*)
+//   4  uint16 frame interval in ms
+//   6  uint16 number of frames
+//   8  code
+//
+// tools/fxasm.py assembles the text form (see effects/) into this layout.
+enum EffectOp : uint8_t {
+  OP_END = 0,   // Leave the LED as it is
+  OP_PUSH,      // int16 operand: push an integer
+  OP_PUSHF,     // int32 operand: push a raw Q16.16 value
+  OP_INDEX,     // LED index on the strip
+  OP_COUNT,     // Number of LEDs
+  OP_STEP,      // Frame number, from 0
+  OP_FRAMES,    // Number of frames
+  OP_DUP,
+  OP_DROP,
+  OP_SWAP,
+  OP_OVER,
+  OP_ADD,
+  OP_SUB,
+  OP_MUL,
+  OP_DIV,       // x / 0 is 0
+  OP_MOD,       // Result has the sign of the divisor; x % 0 is 0
+  OP_NEG,
+  OP_ABS,
+  OP_MIN,
+  OP_MAX,
+  OP_LT,        // Comparisons push 1 or 0
+  OP_GT,
+  OP_EQ,
+  OP_NOT,
+  OP_SEL,       // c a b -> c ? a : b
+  OP_SIN,       // Sine of an angle in turns (1.0 = 360 degrees)
+  OP_JZ,        // int8 operand: pop, jump relative to the next op if zero
+  OP_JMP,       // int8 operand: jump relative to the next op
+  OP_RGB,       // r g b (0..255) -> set the LED and end
+  OP_HSV,       // h (turns) s v (0..1) -> set the LED and end
+  OP_COUNT_
+};
+
+const uint8_t EFFECT_VERSION = 1;
+const uint8_t EFFECT_FLAG_CLEAR = 0x01;           // Clear the canvas before each frame
+const uint8_t EFFECT_FLAG_FRAMES_PER_LED = 0x02;  // Frames = frames field * LED count
+const size_t EFFECT_HEADER_SIZE = 8;
+
+// For effects written as byte arrays in the source.
+#define FX_U16(v) (uint8_t)((v) & 0xFF), (uint8_t)(((v) >> 8) & 0xFF)
+#define FX_HEADER(flags, frameMs, frames) 'F', 'X', EFFECT_VERSION, (flags), FX_U16(frameMs), FX_U16(frames)
+#define FX_PUSH(v) OP_PUSH, FX_U16((uint16_t)(v))
+#define FX_PUSHF(v) OP_PUSHF, FX_U16((uint32_t)(v)), FX_U16((uint32_t)(v) >> 16)
+
+// Runs one effect. A frame is bounded by FRAME_BUDGET instructions over
+// all LEDs; an effect that exceeds it (or under/overflows the stack) is
+// stopped, so a bad upload costs at most one frame's budget of CPU time.
+class EffectPlayer {
+ public:
+  static const size_t MAX_SIZE = 256;
+  static const uint8_t STACK_DEPTH = 16;
+  static const uint16_t FRAME_BUDGET = 8192;
+
+  // Returns nullptr for a well-formed effect, otherwise what is wrong:
+  // header, unknown opcodes, truncated operands, jumps outside the code or
+  // into an operand, or code that can run off its end.
+  static const char* verify(const uint8_t* data, size_t len);
+
+  // Verifies and copies an effect (from PROGMEM when `progmem` is set).
+  bool start(const uint8_t* data, size_t len, bool progmem);
+  // Renders frame `step` into the canvas. Returns the delay in ms before
+  // the next frame, or 0 once the effect has finished or was stopped.
+  uint16_t renderFrame(Adafruit_NeoPixel& canvas, uint32_t step);
+
+  // Why the last effect was stopped, or nullptr.
+  const char* error() const { return error_; }
+  uint32_t lastFrameInstructions() const { return lastFrameInstructions_; }
+
+ private:
+  bool runPixel(Adafruit_NeoPixel& canvas, uint16_t index, int32_t step, uint32_t* budget);
+
+  uint8_t program_[MAX_SIZE];
+  size_t length_ = 0;
+  uint8_t flags_ = 0;
+  uint16_t frameMs_ = 0;
+  uint16_t frames_ = 0;
+  const char* error_ = nullptr;
+  uint32_t lastFrameInstructions_ = 0;
+};
@@ -0,0 +1,97 @@
+#include "event_stream.h"
+
+namespace {
+
+const unsigned long KEEP_ALIVE_INTERVAL_MS = 15000;
+
+const char STREAM_HEADER[] PROGMEM =
+  "HTTP/1.1 200 OK\r\n"
+  "Content-Type: text/event-stream\r\n"
+  "Cache-Control: no-cache\r\n"
+  "Connection: keep-alive\r\n"
+  "Access-Control-Allow-Origin: *\r\n"
+  "\r\n"
+  "retry: 3000\n\n";
+
+}  // namespace
+
+int EventStream::accept(WiFiClient& client) {
+  for (int slot = 0; slot < MAX_CLIENTS; slot++) {
+    if (active_[slot]) {
+      continue;
+    }
+    char header[sizeof(STREAM_HEADER)];
+    memcpy_P(header, STREAM_HEADER, sizeof(STREAM_HEADER));
+    clients_[slot] = client;
+    clients_[slot].setNoDelay(true);
+    active_[slot] = true;
+    count_++;
+    if (!write(slot, header, sizeof(STREAM_HEADER) - 1)) {
+      return -1;
+    }
+    return slot;
+  }
+  return -1;
+}
+
+void EventStream::drop(int slot) {
+  clients_[slot].stop();
+  clients_[slot] = WiFiClient();
+  active_[slot] = false;
+  count_--;
+  dropped_++;
+}
+
+bool EventStream::write(int slot, const char* data, size_t len) {
+  if (!active_[slot]) {
+    return false;
+  }
+  if (!clients_[slot].connected() || clients_[slot].availableForWrite() < len ||
+      clients_[slot].write((const uint8_t*)data, len) != len) {
+    drop(slot);
+    return false;
+  }
+  bytesSent_ += len;
+  return true;
+}
+
+bool EventStream::send(int slot, const char* event, const char* data) {
+  char frame[MAX_EVENT_SIZE];
+  int len = snprintf(frame, sizeof(frame), "event: %s\ndata: %s\n\n", event, data);
+  if (len <= 0 || (size_t)len >= sizeof(frame)) {
+    return false;
+  }
+  if (!write(slot, frame, len)) {
+    return false;
+  }
+  eventsSent_++;
+  return true;
+}
+
+void EventStream::broadcast(const char* event, const char* data) {
+  for (int slot = 0; slot < MAX_CLIENTS; slot++) {
+    if (active_[slot]) {
+      send(slot, event, data);
+    }
+  }
+}
+
+void EventStream::service() {
+  if (count_ == 0) {
+    return;
+  }
+  bool keepAlive = millis() - lastKeepAliveMs_ >= KEEP_ALIVE_INTERVAL_MS;
+  if (keepAlive) {
+    lastKeepAliveMs_ = millis();
+  }
+  for (int slot = 0; slot < MAX_CLIENTS; slot++) {
+    if (!active_[slot]) {
+      continue;
+    }
+    if (!clients_[slot].connected()) {
+      drop(slot);
+    } else if (keepAlive) {
+      write(slot, ":\n\n", 3);
+    }
+  }
+}
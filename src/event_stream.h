@@ -0,0 +1,39 @@
+#pragma once
+
+#include "hal.h"
+
+// Server-Sent Events fan-out. accept() takes over the connection of the
+// request being handled (the WiFiClient copy keeps it open after the web
+// server lets go of it) and answers with a text/event-stream header; events
+// are then written to every subscriber without blocking. A subscriber that
+// cannot take a whole event is dropped rather than sent a partial stream,
+// and its EventSource reconnects and receives a fresh snapshot.
+class EventStream {
+ public:
+  static const uint8_t MAX_CLIENTS = 3;
+  static const size_t MAX_EVENT_SIZE = 800;
+
+  // Returns the subscriber slot, or -1 when all slots are taken.
+  int accept(WiFiClient& client);
+  void broadcast(const char* event, const char* data);
+  bool send(int slot, const char* event, const char* data);
+  // Drops closed connections and sends a keep-alive comment every 15 s.
+  void service();
+
+  uint8_t clientCount() const { return count_; }
+  uint32_t eventsSent() const { return eventsSent_; }
+  uint32_t bytesSent() const { return bytesSent_; }
+  uint32_t clientsDropped() const { return dropped_; }
+
+ private:
+  bool write(int slot, const char* data, size_t len);
+  void drop(int slot);
+
+  WiFiClient clients_[MAX_CLIENTS];
+  bool active_[MAX_CLIENTS] = {};
+  uint8_t count_ = 0;
+  unsigned long lastKeepAliveMs_ = 0;
+  uint32_t eventsSent_ = 0;
+  uint32_t bytesSent_ = 0;
+  uint32_t dropped_ = 0;
+};
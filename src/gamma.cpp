@@ -0,0 +1,94 @@
+#include "gamma.h"
+
+namespace {
+
+// Natural log for the table generator; argument reduced to [0.5, 1) so the
+// atanh series converges in a few dozen terms.
+constexpr double constexprLog(double x) {
+  int exponent = 0;
+  while (x >= 1.0) {
+    x *= 0.5;
+    exponent++;
+  }
+  while (x < 0.5) {
+    x *= 2.0;
+    exponent--;
+  }
+  double z = (x - 1.0) / (x + 1.0);
+  double z2 = z * z;
+  double term = z;
+  double sum = 0.0;
+  for (int n = 1; n < 60; n += 2) {
+    sum += term / n;
+    term *= z2;
+  }
+  return 2.0 * sum + exponent * 0.69314718055994530942;
+}
+
+// exp(x) for x <= 0: halve until small, Taylor series, then square back.
+constexpr double constexprExp(double x) {
+  int halvings = 0;
+  while (x < -0.5) {
+    x *= 0.5;
+    halvings++;
+  }
+  double sum = 1.0;
+  double term = 1.0;
+  for (int n = 1; n < 30; n++) {
+    term *= x / n;
+    sum += term;
+  }
+  while (halvings-- > 0) {
+    sum *= sum;
+  }
+  return sum;
+}
+
+// Output level of each 8-bit input in Q8.8 (0..65280 = 0.0..255.0).
+struct GammaTable {
+  uint16_t level[256];
+};
+
+constexpr GammaTable makeGammaTable(uint8_t fullScale) {
+  GammaTable table{};
+  for (int i = 1; i < 256; i++) {
+    double linear = constexprExp(GAMMA_EXPONENT * constexprLog(i / 255.0));
+    table.level[i] = (uint16_t)(linear * fullScale * 256.0 + 0.5);
+  }
+  return table;
+}
+
+// Indexed in NEO_GRB byte order.
+constexpr GammaTable GAMMA_TABLES[3] PROGMEM = {
+  makeGammaTable(COLOR_CORRECTION_G),
+  makeGammaTable(COLOR_CORRECTION_R),
+  makeGammaTable(COLOR_CORRECTION_B),
+};
+
+static_assert(GAMMA_TABLES[1].level[255] == COLOR_CORRECTION_R * 256, "full input must map to full scale");
+
+}  // namespace
+
+bool gammaCorrectFrame(const uint8_t* in, uint8_t* out, uint8_t* residual, size_t bytes,
+                       uint8_t brightness, bool dither) {
+  bool fractional = false;
+  // 0..255 as a 0..256 multiplier, so that 0 is off and 255 is full.
+  uint32_t scale = (uint32_t)brightness + (brightness >> 7);
+  uint8_t channel = 0;
+  for (size_t i = 0; i < bytes; i++) {
+    uint32_t level = pgm_read_word(&GAMMA_TABLES[channel].level[in[i]]);
+    level = (level * scale) >> 8;
+    if (dither && (level >> 8) < DITHER_MAX_LEVEL) {
+      uint32_t sum = level + residual[i];
+      out[i] = sum >> 8;
+      residual[i] = sum & 0xFF;
+      fractional |= (level & 0xFF) != 0;
+    } else {
+      uint32_t rounded = (level + 128) >> 8;
+      out[i] = rounded > 255 ? 255 : rounded;
+      residual[i] = 0;
+    }
+    channel = (channel == 2) ? 0 : channel + 1;
+  }
+  return fractional;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "hal.h"
+
+// Output gamma, same exponent as Adafruit_NeoPixel::gamma8().
+constexpr double GAMMA_EXPONENT = 2.6;
+
+// Optional colour-temperature correction: full-scale output of each channel.
+// 255/255/255 leaves colours untouched; 255/176/240 matches the usual
+// correction for 5050 WS2812 packages (cooler whites look neutral).
+constexpr uint8_t COLOR_CORRECTION_R = 255;
+constexpr uint8_t COLOR_CORRECTION_G = 255;
+constexpr uint8_t COLOR_CORRECTION_B = 255;
+
+// Output levels below this are temporally dithered to reach sub-LSB
+// precision; brighter levels are rounded, so static frames stay static.
+constexpr uint8_t DITHER_MAX_LEVEL = 32;
+
+// Converts `bytes` GRB canvas bytes into LED output values: gamma and colour
+// correction through 16-bit flash tables, global brightness (0 = off, 255 =
+// full), then temporal dithering of dim channels. `residual` holds one byte
+// of carried error per channel between frames. Cost is one table lookup per
+// byte.
+//
+// Returns true if any dithered channel has a fractional level, i.e. the
+// output changes from frame to frame and should be refreshed every tick.
+bool gammaCorrectFrame(const uint8_t* in, uint8_t* out, uint8_t* residual, size_t bytes,
+                       uint8_t brightness, bool dither);
@@ -0,0 +1,112 @@
+#pragma once
+
+// Hardware abstraction layer. On the ESP8266 this pulls in the Arduino core
+// and the libraries the firmware uses; on the host (env:native) the same API
+// is provided by hal_native.h on top of POSIX, so the clock and animation
+// code builds and runs unchanged on Linux.
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <Adafruit_NeoPixel.h>
+#include <ESP8266WiFi.h>
+#include <ESP8266WebServer.h>
+#include <WiFiUdp.h>
+#include <WiFiManager.h>
+#include <LittleFS.h>
+#else
+#include "hal_native.h"
+#endif
+
+#include <sys/time.h>
+#include <time.h>
+
+// Monotonic microseconds since boot, without the 71-minute wrap of micros().
+uint64_t halMicros64();
+
+// Reads a battery-backed real-time clock, if the platform has one, as UTC
+// microseconds. The ESP8266 has none; the host reports its own clock.
+bool halReadRtc(int64_t* utcUs);
+
+// State kept through a warm reset (watchdog, exception, ESP.restart()) but
+// not through a power cycle or the reset pin. halRtcTicks() is a counter
+// that keeps running across such resets (the ESP8266 RTC timer, ~150 kHz);
+// halRtcTicksToUs() converts the difference of two readings, taken less
+// than a wrap (~8 h) apart, to microseconds. halRtcMemRead/Write access
+// HAL_RTC_MEM_SIZE bytes of RTC user memory in whole words, from a byte
+// offset that is a multiple of 4; after a power cycle it holds garbage. The host keeps the memory in CLOCK_RTC_MEM_FILE
+// (default native-rtcmem.bin) and counts CLOCK_MONOTONIC, so restarting
+// the process is a warm reset and deleting the file a cold one.
+const size_t HAL_RTC_MEM_SIZE = 64;
+const size_t RTC_MEM_WARM_START = 0;  // WarmStart's record, up to 32 bytes
+const size_t RTC_MEM_WIFI_LINK = 32;  // WifiLink's access point cache
+uint32_t halRtcTicks();
+uint64_t halRtcTicksToUs(uint32_t ticks);
+bool halRtcMemRead(size_t offset, uint32_t* data, size_t len);
+bool halRtcMemWrite(size_t offset, const uint32_t* data, size_t len);
+
+// Non-blocking host name lookup. Returns HAL_DNS_PENDING while the query is
+// in flight (call again with the same host), then HAL_DNS_DONE with *out set
+// or HAL_DNS_FAILED. Numeric addresses complete immediately.
+enum HalDnsResult {
+  HAL_DNS_PENDING,
+  HAL_DNS_DONE,
+  HAL_DNS_FAILED
+};
+HalDnsResult halResolveHost(const char* host, IPAddress* out);
+
+// Raw access to the two 4 KB flash sectors that hold the settings
+// journal: sector 0 is the one the Arduino EEPROM emulation would use,
+// sector 1 the one just below it (on 4 MB boards the spare sector between
+// the filesystem and EEPROM; halFsBegin() keeps the filesystem clear of it).
+// Offsets and lengths must be multiples of 4. Like NOR flash, a write can
+// only clear bits; erase sets the whole sector back to 0xFF.
+const uint32_t HAL_SETTINGS_SECTOR_SIZE = 4096;
+const uint8_t HAL_SETTINGS_SECTOR_COUNT = 2;
+bool halSettingsRead(uint8_t sector, uint32_t offset, uint32_t* data, size_t len);
+bool halSettingsWrite(uint8_t sector, uint32_t offset, const uint32_t* data, size_t len);
+bool halSettingsErase(uint8_t sector);
+
+// Small files on the flash filesystem: LittleFS on the ESP8266, the
+// directory CLOCK_FS_DIR (default native-fs/) on the host. Paths are
+// absolute, e.g. "/effects/rainbow.fx". halFsRead() returns the number of
+// bytes read or -1; files longer than maxLen are not read.
+bool halFsBegin();
+int32_t halFsRead(const char* path, uint8_t* data, size_t maxLen);
+bool halFsWrite(const char* path, const uint8_t* data, size_t len);
+bool halFsRemove(const char* path);
+// Calls fn for every file in a directory, with its name (no path).
+typedef void (*HalFsListFn)(const char* name, size_t size, void* context);
+void halFsList(const char* dir, HalFsListFn fn, void* context);
+
+// WS2812 output by I2S DMA instead of Adafruit_NeoPixel::show(), which
+// bit-bangs with interrupts off for ~30 us per LED. On the ESP8266 the data
+// pin is GPIO3 (RX). The frame is encoded (ws2812_i2s.h) into one of two
+// buffers and queued behind the one on the wire, so halLedDmaShow() returns
+// in microseconds and the CPU is free while the frame is sent. It returns
+// false, leaving the LEDs as they are, while the previous frame has not yet
+// been handed to the I2S FIFO; try again on the next tick. The host encodes
+// the frame and drops it.
+//
+// LED_OUTPUT_DMA=1 selects this output. The register setup has not been
+// verified on hardware yet, so it is off by default; without it the
+// ESP8266 build leaves the I2S and SLC registers alone and
+// halLedDmaBegin() returns false.
+#ifndef LED_OUTPUT_DMA
+#define LED_OUTPUT_DMA 0
+#endif
+
+bool halLedDmaBegin(size_t pixelBytes);
+bool halLedDmaShow(const uint8_t* pixels);
+
+// Free heap in bytes. The host build reports a notional 48 KB heap (about
+// what the ESP8266 has left once Wi-Fi is up) minus its live allocations.
+uint32_t halFreeHeap();
+
+// Largest allocation that would currently succeed, and heap fragmentation
+// in percent (0 = all free memory is one block). The host heap is not
+// fragmented: it reports the free heap and 0.
+uint32_t halMaxFreeBlock();
+uint8_t halHeapFragmentation();
+
+// Number of heap allocations since boot. Only the host build hooks the
+// allocator; on the ESP8266 this always returns 0.
+uint32_t halAllocationCount();
@@ -0,0 +1,341 @@
+#ifdef ARDUINO
+
+#include "hal.h"
+#include "ws2812_i2s.h"
+
+#include <lwip/dns.h>
+#include <user_interface.h>
+
+#if LED_OUTPUT_DMA
+#include <i2s_reg.h>
+#endif
+
+uint64_t halMicros64() {
+  return micros64();
+}
+
+bool halReadRtc(int64_t* utcUs) {
+  (void)utcUs;
+  return false;
+}
+
+// The first 128 bytes of RTC user memory hold eboot's OTA command.
+static const uint32_t RTC_MEM_FIRST_BLOCK = 32;
+
+uint32_t halRtcTicks() {
+  return system_get_rtc_time();
+}
+
+// The RTC clock runs from an uncalibrated RC oscillator; the SDK measures
+// its period against the crystal as microseconds << 12.
+uint64_t halRtcTicksToUs(uint32_t ticks) {
+  return ((uint64_t)ticks * system_rtc_clock_cali_proc()) >> 12;
+}
+
+bool halRtcMemRead(size_t offset, uint32_t* data, size_t len) {
+  return offset % 4 == 0 && offset + len <= HAL_RTC_MEM_SIZE &&
+         ESP.rtcUserMemoryRead(RTC_MEM_FIRST_BLOCK + offset / 4, data, len);
+}
+
+bool halRtcMemWrite(size_t offset, const uint32_t* data, size_t len) {
+  return offset % 4 == 0 && offset + len <= HAL_RTC_MEM_SIZE &&
+         ESP.rtcUserMemoryWrite(RTC_MEM_FIRST_BLOCK + offset / 4, (uint32_t*)data, len);
+}
+
+// One lookup in flight at a time. The generation number passed to lwIP
+// lets a late callback for an abandoned lookup be ignored.
+static volatile HalDnsResult dnsState = HAL_DNS_FAILED;
+static volatile uint32_t dnsGeneration = 0;
+static bool dnsInFlight = false;
+static char dnsHost[64];
+static IPAddress dnsAddress;
+
+static void dnsFoundCallback(const char* name, const ip_addr_t* addr, void* arg) {
+  (void)name;
+  if ((uint32_t)(uintptr_t)arg != dnsGeneration) {
+    return;
+  }
+  if (addr != nullptr) {
+    dnsAddress = IPAddress(addr);
+    dnsState = HAL_DNS_DONE;
+  } else {
+    dnsState = HAL_DNS_FAILED;
+  }
+}
+
+HalDnsResult halResolveHost(const char* host, IPAddress* out) {
+  if (out->fromString(host)) {
+    return HAL_DNS_DONE;
+  }
+
+  if (!dnsInFlight || strcmp(host, dnsHost) != 0) {
+    strncpy(dnsHost, host, sizeof(dnsHost));
+    dnsHost[sizeof(dnsHost) - 1] = '\0';
+    dnsGeneration++;
+    ip_addr_t addr;
+    err_t err = dns_gethostbyname(dnsHost, &addr, dnsFoundCallback, (void*)(uintptr_t)dnsGeneration);
+    if (err == ERR_OK) {
+      *out = IPAddress(&addr);
+      dnsInFlight = false;
+      return HAL_DNS_DONE;
+    }
+    if (err != ERR_INPROGRESS) {
+      dnsInFlight = false;
+      return HAL_DNS_FAILED;
+    }
+    dnsState = HAL_DNS_PENDING;
+    dnsInFlight = true;
+    return HAL_DNS_PENDING;
+  }
+
+  HalDnsResult result = dnsState;
+  if (result == HAL_DNS_DONE) {
+    *out = dnsAddress;
+  }
+  if (result != HAL_DNS_PENDING) {
+    dnsInFlight = false;
+  }
+  return result;
+}
+
+extern "C" uint32_t _EEPROM_start;
+
+static uint32_t settingsSectorAddress(uint8_t sector) {
+  return (uint32_t)&_EEPROM_start - 0x40200000 - sector * HAL_SETTINGS_SECTOR_SIZE;
+}
+
+bool halSettingsRead(uint8_t sector, uint32_t offset, uint32_t* data, size_t len) {
+  return ESP.flashRead(settingsSectorAddress(sector) + offset, data, len);
+}
+
+bool halSettingsWrite(uint8_t sector, uint32_t offset, const uint32_t* data, size_t len) {
+  return ESP.flashWrite(settingsSectorAddress(sector) + offset, data, len);
+}
+
+bool halSettingsErase(uint8_t sector) {
+  return ESP.flashEraseSector(settingsSectorAddress(sector) / HAL_SETTINGS_SECTOR_SIZE);
+}
+
+// LittleFS over the FS area of the flash layout, minus any blocks that
+// overlap the settings journal (only layouts without the 4 KB gap before
+// EEPROM have any).
+static FS* fileSystem = nullptr;
+
+bool halFsBegin() {
+  if (fileSystem != nullptr) {
+    return true;
+  }
+  uint32_t size = FS_PHYS_SIZE;
+  uint32_t journalStart = settingsSectorAddress(HAL_SETTINGS_SECTOR_COUNT - 1);
+  if (FS_PHYS_ADDR + size > journalStart) {
+    size = (journalStart - FS_PHYS_ADDR) / FS_PHYS_BLOCK * FS_PHYS_BLOCK;
+  }
+  if (size == 0) {
+    return false;
+  }
+  FS* fs = new FS(FSImplPtr(new littlefs_impl::LittleFSImpl(FS_PHYS_ADDR, size, FS_PHYS_PAGE, FS_PHYS_BLOCK, 2)));
+  if (!fs->begin()) {
+    delete fs;
+    return false;
+  }
+  fileSystem = fs;
+  return true;
+}
+
+int32_t halFsRead(const char* path, uint8_t* data, size_t maxLen) {
+  if (fileSystem == nullptr) {
+    return -1;
+  }
+  File file = fileSystem->open(path, "r");
+  if (!file || file.size() > maxLen) {
+    return -1;
+  }
+  return file.read(data, file.size());
+}
+
+bool halFsWrite(const char* path, const uint8_t* data, size_t len) {
+  if (fileSystem == nullptr) {
+    return false;
+  }
+  File file = fileSystem->open(path, "w");
+  return file && file.write(data, len) == len;
+}
+
+bool halFsRemove(const char* path) {
+  return fileSystem != nullptr && fileSystem->remove(path);
+}
+
+void halFsList(const char* dir, HalFsListFn fn, void* context) {
+  if (fileSystem == nullptr) {
+    return;
+  }
+  Dir entries = fileSystem->openDir(dir);
+  while (entries.next()) {
+    if (entries.isFile()) {
+      fn(entries.fileName().c_str(), entries.fileSize(), context);
+    }
+  }
+}
+
+#if LED_OUTPUT_DMA
+
+// I2S DMA LED output. The SLC DMA engine feeds the I2S FIFO from a chain
+// of descriptors (counter-intuitively through its RX link). Each of the two
+// frame buffers is a chain of data blocks ending in a block of zeros (the
+// latch) that links to itself, so the line idles low after a frame. Queuing
+// the other buffer is one store into the idle block's link; the DMA takes
+// it at the end of the current pass.
+struct SlcDescriptor {
+  uint32_t blocksize : 12;
+  uint32_t datalen : 12;
+  uint32_t unused : 5;
+  uint32_t subSof : 1;
+  uint32_t eof : 1;
+  uint32_t owner : 1;
+  const void* buffer;
+  SlcDescriptor* next;
+};
+
+static const uint8_t LED_DMA_PIN = 3;               // I2S0 data out (RX)
+static const size_t LED_DMA_MAX_BLOCK = 4092;       // 12-bit length, whole words
+static const uint32_t LED_DMA_BCK_DIV = 5;          // 160 MHz / (5 * 10) = 3.2 MHz
+static const uint32_t LED_DMA_CLKM_DIV = 10;
+
+static uint32_t ledDmaZeros[WS2812_I2S_RESET_BYTES / 4];
+static uint16_t* ledDmaBuffers[2];
+static SlcDescriptor* ledDmaChains[2];  // Data blocks, then the idle block
+static uint8_t ledDmaBlocks = 0;        // Data blocks per buffer
+static size_t ledDmaPixelBytes = 0;
+static uint8_t ledDmaCurrent = 1;       // Buffer the DMA is on or idling after
+static uint32_t ledDmaQueued = 0;       // Frames queued since begin
+static volatile uint32_t ledDmaRead = 0;  // Frames whose last block was read
+
+// The last data block of each frame has eof set; its interrupt means the
+// whole frame is in the FIFO and the DMA has moved on to the idle block.
+static void IRAM_ATTR ledDmaIsr(void*) {
+  uint32_t status = SLCIS;
+  SLCIC = 0xFFFFFFFF;
+  if (status & SLCIRXEOF) {
+    ledDmaRead++;
+  }
+}
+
+static SlcDescriptor* ledDmaIdle(uint8_t buffer) {
+  return &ledDmaChains[buffer][ledDmaBlocks];
+}
+
+bool halLedDmaBegin(size_t pixelBytes) {
+  size_t encodedSize = ws2812I2sEncodedSize(pixelBytes);
+  ledDmaPixelBytes = pixelBytes;
+  ledDmaBlocks = (encodedSize + LED_DMA_MAX_BLOCK - 1) / LED_DMA_MAX_BLOCK;
+  for (uint8_t b = 0; b < 2; b++) {
+    ledDmaBuffers[b] = (uint16_t*)calloc(1, encodedSize);
+    ledDmaChains[b] = (SlcDescriptor*)calloc(ledDmaBlocks + 1, sizeof(SlcDescriptor));
+    if (ledDmaBuffers[b] == nullptr || ledDmaChains[b] == nullptr) {
+      return false;
+    }
+    const uint8_t* data = (const uint8_t*)ledDmaBuffers[b];
+    for (uint8_t i = 0; i < ledDmaBlocks; i++) {
+      size_t offset = i * LED_DMA_MAX_BLOCK;
+      size_t length = encodedSize - offset < LED_DMA_MAX_BLOCK ? encodedSize - offset : LED_DMA_MAX_BLOCK;
+      SlcDescriptor& block = ledDmaChains[b][i];
+      block.owner = 1;
+      block.blocksize = length;
+      block.datalen = length;
+      block.eof = (i == ledDmaBlocks - 1);
+      block.buffer = data + offset;
+      block.next = &ledDmaChains[b][i + 1];
+    }
+    SlcDescriptor* idle = ledDmaIdle(b);
+    idle->owner = 1;
+    idle->blocksize = sizeof(ledDmaZeros);
+    idle->datalen = sizeof(ledDmaZeros);
+    idle->buffer = ledDmaZeros;
+    idle->next = idle;
+  }
+  ledDmaCurrent = 1;
+  ledDmaQueued = 0;
+  ledDmaRead = 0;
+
+  // SLC: reset, DMA mode 1, start on buffer 1's idle block. The TX link is
+  // unused but must point at a valid descriptor.
+  ETS_SLC_INTR_DISABLE();
+  SLCC0 |= SLCRXLR | SLCTXLR;
+  SLCC0 &= ~(SLCRXLR | SLCTXLR);
+  SLCIC = 0xFFFFFFFF;
+  SLCC0 &= ~(SLCMM << SLCM);
+  SLCC0 |= (1 << SLCM);
+  SLCRXDC |= SLCBINR | SLCBTNR;
+  SLCRXDC &= ~(SLCBRXFE | SLCBRXEM | SLCBRXFM);
+  SLCTXL &= ~(SLCTXLAM << SLCTXLA);
+  SLCTXL |= (uint32_t)ledDmaIdle(0) << SLCTXLA;
+  SLCRXL &= ~(SLCRXLAM << SLCRXLA);
+  SLCRXL |= (uint32_t)ledDmaIdle(1) << SLCRXLA;
+  ETS_SLC_INTR_ATTACH(ledDmaIsr, NULL);
+  SLCIE = SLCIRXEOF;
+  ETS_SLC_INTR_ENABLE();
+  SLCTXL |= SLCTXLS;
+  SLCRXL |= SLCRXLS;
+
+  // I2S: transmit 16-bit words from the DMA at 3.2 MHz.
+  pinMode(LED_DMA_PIN, FUNCTION_1);
+  I2S_CLK_ENABLE();
+  I2SIC = 0x3F;
+  I2SIE = 0;
+  I2SC &= ~(I2SRST);
+  I2SC |= I2SRST;
+  I2SC &= ~(I2SRST);
+  I2SFC &= ~(I2SDE | (I2STXFMM << I2STXFM) | (I2SRXFMM << I2SRXFM));
+  I2SFC |= I2SDE;
+  I2SCC &= ~((I2STXCMM << I2STXCM) | (I2SRXCMM << I2SRXCM));
+  I2SC &= ~(I2STSM | I2SRSM | (I2SBMM << I2SBM) | (I2SBDM << I2SBD) | (I2SCDM << I2SCD));
+  I2SC |= I2SRF | I2SMR | I2SRSM | I2SRMS | (LED_DMA_BCK_DIV << I2SBD) | (LED_DMA_CLKM_DIV << I2SCD);
+  I2SC |= I2STXS;
+  return true;
+}
+
+bool halLedDmaShow(const uint8_t* pixels) {
+  if (ledDmaBlocks == 0 || ledDmaRead != ledDmaQueued) {
+    return false;
+  }
+  // The current frame has been read, so the DMA loops on its idle block
+  // and is past the other buffer, which can be rewritten and relinked.
+  uint8_t next = ledDmaCurrent ^ 1;
+  ledDmaIdle(next)->next = ledDmaIdle(next);
+  ws2812EncodeI2s(pixels, ledDmaPixelBytes, ledDmaBuffers[next]);
+  ledDmaQueued++;
+  __sync_synchronize();  // The frame must be in RAM before the DMA can reach it
+  ledDmaIdle(ledDmaCurrent)->next = &ledDmaChains[next][0];
+  ledDmaCurrent = next;
+  return true;
+}
+
+#else  // LED_OUTPUT_DMA
+
+bool halLedDmaBegin(size_t) {
+  return false;
+}
+
+bool halLedDmaShow(const uint8_t*) {
+  return false;
+}
+
+#endif  // LED_OUTPUT_DMA
+
+uint32_t halFreeHeap() {
+  return ESP.getFreeHeap();
+}
+
+uint32_t halMaxFreeBlock() {
+  return ESP.getMaxFreeBlockSize();
+}
+
+uint8_t halHeapFragmentation() {
+  return ESP.getHeapFragmentation();
+}
+
+uint32_t halAllocationCount() {
+  return 0;
+}
+
+#endif
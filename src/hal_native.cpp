@@ -0,0 +1,1079 @@
+#ifndef ARDUINO
+
+#include "hal.h"
+#include "ws2812_i2s.h"
+
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cctype>
+#include <chrono>
+#include <cerrno>
+#include <cstdarg>
+#include <new>
+#include <thread>
+
+void setup();
+void loop();
+
+HardwareSerial Serial;
+WiFiClass WiFi;
+
+static const size_t NATIVE_HEAP_SIZE = 48 * 1024;
+static uint32_t allocationCount = 0;
+static size_t liveHeapBytes = 0;
+
+void* operator new(size_t size) {
+  allocationCount++;
+  void* p = malloc(size ? size : 1);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  liveHeapBytes += malloc_usable_size(p);
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  if (p != nullptr) {
+    liveHeapBytes -= malloc_usable_size(p);
+  }
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  operator delete(p);
+}
+
+uint32_t halFreeHeap() {
+  return liveHeapBytes < NATIVE_HEAP_SIZE ? (uint32_t)(NATIVE_HEAP_SIZE - liveHeapBytes) : 0;
+}
+
+uint32_t halMaxFreeBlock() {
+  return halFreeHeap();
+}
+
+uint8_t halHeapFragmentation() {
+  return 0;
+}
+
+uint32_t halAllocationCount() {
+  return allocationCount;
+}
+
+// ---------------------------------------------------------------------------
+// Arduino core
+
+static const std::chrono::steady_clock::time_point bootTime = std::chrono::steady_clock::now();
+
+unsigned long millis() {
+  return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - bootTime).count();
+}
+
+unsigned long micros() {
+  return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - bootTime).count();
+}
+
+uint64_t halMicros64() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - bootTime).count();
+}
+
+static const uint8_t NATIVE_AP_CHANNEL = 6;
+static uint8_t nativeApBssid[6] = {0x02, 0x00, 0x5E, 0xC1, 0x0C, 0x01};
+
+static unsigned long envMs(const char* name, unsigned long fallback) {
+  const char* value = getenv(name);
+  return value != nullptr ? strtoul(value, nullptr, 10) : fallback;
+}
+
+wl_status_t WiFiClass::begin() {
+  return begin(SSID().c_str(), psk().c_str());
+}
+
+wl_status_t WiFiClass::begin(const char*, const char*, int32_t channel, const uint8_t* bssid, bool) {
+  unsigned long scanMs = envMs("CLOCK_NATIVE_WIFI_JOIN_MS", 0);
+  bool direct = channel > 0 && bssid != nullptr;
+  joining_ = true;
+  joinStartMs_ = millis();
+  joinMs_ = direct ? envMs("CLOCK_NATIVE_WIFI_DIRECT_MS", scanMs) : scanMs;
+  targetChannel_ = direct ? channel : 0;
+  status_ = WL_DISCONNECTED;
+  return status();
+}
+
+wl_status_t WiFiClass::status() {
+  unsigned long now = millis();
+  uint8_t apChannel;
+  if (status_ == WL_CONNECTED && !accessPointUp(now, &apChannel)) {
+    status_ = WL_DISCONNECTED;
+  } else if (joining_ && now - joinStartMs_ >= joinMs_) {
+    joining_ = false;
+    bool found = accessPointUp(now, &apChannel) && (targetChannel_ == 0 || targetChannel_ == apChannel);
+    status_ = found ? WL_CONNECTED : WL_NO_SSID_AVAIL;
+    channel_ = apChannel;
+  }
+  return status_;
+}
+
+uint8_t* WiFiClass::BSSID() {
+  return nativeApBssid;
+}
+
+bool WiFiClass::accessPointUp(unsigned long ms, uint8_t* channel) const {
+  *channel = NATIVE_AP_CHANNEL;
+  const char* drops = getenv("CLOCK_NATIVE_WIFI_DROPS");
+  while (drops != nullptr && *drops != '\0') {
+    char* end;
+    unsigned long at = strtoul(drops, &end, 10);
+    unsigned long length = *end == '+' ? strtoul(end + 1, &end, 10) : 0;
+    unsigned long newChannel = *end == '@' ? strtoul(end + 1, &end, 10) : 0;
+    if (ms >= at && ms - at < length) {
+      return false;
+    }
+    if (ms >= at && newChannel != 0) {
+      *channel = (uint8_t)newChannel;
+    }
+    drops = *end == ',' ? end + 1 : nullptr;
+  }
+  return true;
+}
+
+bool WiFiManager::autoConnect(const char*) {
+  WiFi.begin();
+  while (WiFi.status() != WL_CONNECTED) {
+    delay(10);
+  }
+  return true;
+}
+
+// The host clock stands in for an RTC. CLOCK_NATIVE_RTC_SKEW_MS offsets it
+// (to exercise NTP stepping/slewing); CLOCK_NATIVE_NO_RTC=1 hides it.
+bool halReadRtc(int64_t* utcUs) {
+  if (getenv("CLOCK_NATIVE_NO_RTC") != nullptr) {
+    return false;
+  }
+  timeval tv;
+  gettimeofday(&tv, nullptr);
+  const char* skew = getenv("CLOCK_NATIVE_RTC_SKEW_MS");
+  *utcUs = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec + (skew ? atoll(skew) * 1000 : 0);
+  return true;
+}
+
+// CLOCK_MONOTONIC keeps counting when the process restarts, like the RTC
+// timer through a warm reset.
+uint32_t halRtcTicks() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+uint64_t halRtcTicksToUs(uint32_t ticks) {
+  return ticks;
+}
+
+static const char* rtcMemPath() {
+  const char* path = getenv("CLOCK_RTC_MEM_FILE");
+  return path ? path : "native-rtcmem.bin";
+}
+
+// The whole memory is read and written back, so each user's words keep
+// their place in the file.
+static void readRtcMem(uint8_t* memory) {
+  memset(memory, 0xFF, HAL_RTC_MEM_SIZE); // "Power-on" contents when there is no file yet
+  FILE* f = fopen(rtcMemPath(), "rb");
+  if (f != nullptr) {
+    size_t n = fread(memory, 1, HAL_RTC_MEM_SIZE, f);
+    (void)n;
+    fclose(f);
+  }
+}
+
+bool halRtcMemRead(size_t offset, uint32_t* data, size_t len) {
+  if (offset % 4 != 0 || offset + len > HAL_RTC_MEM_SIZE) {
+    return false;
+  }
+  uint8_t memory[HAL_RTC_MEM_SIZE];
+  readRtcMem(memory);
+  memcpy(data, memory + offset, len);
+  return true;
+}
+
+bool halRtcMemWrite(size_t offset, const uint32_t* data, size_t len) {
+  if (offset % 4 != 0 || offset + len > HAL_RTC_MEM_SIZE) {
+    return false;
+  }
+  uint8_t memory[HAL_RTC_MEM_SIZE];
+  readRtcMem(memory);
+  memcpy(memory + offset, data, len);
+  FILE* f = fopen(rtcMemPath(), "wb");
+  if (f == nullptr) {
+    return false;
+  }
+  bool ok = fwrite(memory, 1, sizeof(memory), f) == sizeof(memory);
+  return fclose(f) == 0 && ok;
+}
+
+// Blocking getaddrinfo() is fast enough on the host; the result is
+// reported as already done.
+HalDnsResult halResolveHost(const char* host, IPAddress* out) {
+  if (out->fromString(host)) {
+    return HAL_DNS_DONE;
+  }
+  addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  addrinfo* result = nullptr;
+  if (getaddrinfo(host, nullptr, &hints, &result) != 0 || result == nullptr) {
+    return HAL_DNS_FAILED;
+  }
+  *out = IPAddress((uint32_t)((sockaddr_in*)result->ai_addr)->sin_addr.s_addr);
+  freeaddrinfo(result);
+  return HAL_DNS_DONE;
+}
+
+void delay(unsigned long ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void yield() {
+}
+
+void String::trim() {
+  size_t start = 0;
+  while (start < s_.size() && isspace((unsigned char)s_[start])) {
+    start++;
+  }
+  size_t end = s_.size();
+  while (end > start && isspace((unsigned char)s_[end - 1])) {
+    end--;
+  }
+  s_ = s_.substr(start, end - start);
+}
+
+void String::toCharArray(char* buf, unsigned int size) const {
+  if (size == 0) {
+    return;
+  }
+  size_t n = std::min((size_t)size - 1, s_.size());
+  memcpy(buf, s_.data(), n);
+  buf[n] = '\0';
+}
+
+bool IPAddress::fromString(const char* s) {
+  in_addr addr;
+  if (inet_pton(AF_INET, s, &addr) != 1) {
+    return false;
+  }
+  *this = IPAddress((uint32_t)addr.s_addr);
+  return true;
+}
+
+String IPAddress::toString() const {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%u.%u.%u.%u", octets_[0], octets_[1], octets_[2], octets_[3]);
+  return String(buf);
+}
+
+int HardwareSerial::printf(const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  int n = vprintf(fmt, args);
+  va_end(args);
+  fflush(stdout);
+  return n;
+}
+
+// ---------------------------------------------------------------------------
+// Adafruit_NeoPixel
+
+Adafruit_NeoPixel::Adafruit_NeoPixel(uint16_t n, int16_t, uint16_t)
+    : numLEDs_(n), pixels_(n * 3, 0) {
+}
+
+void Adafruit_NeoPixel::setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b) {
+  if (n >= numLEDs_) {
+    return;
+  }
+  if (brightness_) {
+    r = (r * brightness_) >> 8;
+    g = (g * brightness_) >> 8;
+    b = (b * brightness_) >> 8;
+  }
+  uint8_t* p = &pixels_[n * 3];
+  p[0] = g;
+  p[1] = r;
+  p[2] = b;
+}
+
+void Adafruit_NeoPixel::setPixelColor(uint16_t n, uint32_t c) {
+  setPixelColor(n, (uint8_t)(c >> 16), (uint8_t)(c >> 8), (uint8_t)c);
+}
+
+uint32_t Adafruit_NeoPixel::getPixelColor(uint16_t n) const {
+  if (n >= numLEDs_) {
+    return 0;
+  }
+  const uint8_t* p = &pixels_[n * 3];
+  uint8_t g = p[0];
+  uint8_t r = p[1];
+  uint8_t b = p[2];
+  if (brightness_) {
+    r = (r << 8) / brightness_;
+    g = (g << 8) / brightness_;
+    b = (b << 8) / brightness_;
+  }
+  return Color(r, g, b);
+}
+
+void Adafruit_NeoPixel::fill(uint32_t c, uint16_t first, uint16_t count) {
+  if (first >= numLEDs_) {
+    return;
+  }
+  uint16_t end = (count == 0) ? numLEDs_ : std::min<uint16_t>(numLEDs_, first + count);
+  for (uint16_t i = first; i < end; i++) {
+    setPixelColor(i, c);
+  }
+}
+
+// Mirrors the library: existing pixel data is rescaled in place, which is
+// lossy when dimming.
+void Adafruit_NeoPixel::setBrightness(uint8_t b) {
+  uint8_t newBrightness = b + 1;
+  if (newBrightness == brightness_) {
+    return;
+  }
+  uint8_t oldBrightness = brightness_ - 1;
+  uint16_t scale;
+  if (oldBrightness == 0) {
+    scale = 0;
+  } else if (b == 255) {
+    scale = 65535 / oldBrightness;
+  } else {
+    scale = (((uint16_t)newBrightness << 8) - 1) / oldBrightness;
+  }
+  for (uint8_t& c : pixels_) {
+    c = (c * scale) >> 8;
+  }
+  brightness_ = newBrightness;
+}
+
+// ---------------------------------------------------------------------------
+// I2S DMA LED output: there is no I2S here, but the frame is still encoded
+// so the host build runs the same per-frame work.
+
+static std::vector<uint16_t> ledDmaBuffer;
+static size_t ledDmaPixelBytes = 0;
+
+bool halLedDmaBegin(size_t pixelBytes) {
+  ledDmaPixelBytes = pixelBytes;
+  ledDmaBuffer.assign(ws2812I2sEncodedSize(pixelBytes) / sizeof(uint16_t), 0);
+  return true;
+}
+
+bool halLedDmaShow(const uint8_t* pixels) {
+  ws2812EncodeI2s(pixels, ledDmaPixelBytes, ledDmaBuffer.data());
+  return true;
+}
+
+// ---------------------------------------------------------------------------
+// Settings flash sectors (persisted to CLOCK_EEPROM_FILE, default
+// native-eeprom.bin, so settings saved by older builds are migrated).
+
+static std::vector<uint8_t> settingsFlash;
+
+static const char* settingsPath() {
+  const char* path = getenv("CLOCK_EEPROM_FILE");
+  return path ? path : "native-eeprom.bin";
+}
+
+static void loadSettingsFlash() {
+  if (!settingsFlash.empty()) {
+    return;
+  }
+  settingsFlash.assign(HAL_SETTINGS_SECTOR_SIZE * HAL_SETTINGS_SECTOR_COUNT, 0xFF);
+  FILE* f = fopen(settingsPath(), "rb");
+  if (f != nullptr) {
+    size_t n = fread(settingsFlash.data(), 1, settingsFlash.size(), f);
+    (void)n;
+    fclose(f);
+  }
+}
+
+static bool storeSettingsFlash() {
+  FILE* f = fopen(settingsPath(), "wb");
+  if (f == nullptr) {
+    return false;
+  }
+  bool ok = fwrite(settingsFlash.data(), 1, settingsFlash.size(), f) == settingsFlash.size();
+  fclose(f);
+  return ok;
+}
+
+bool halSettingsRead(uint8_t sector, uint32_t offset, uint32_t* data, size_t len) {
+  loadSettingsFlash();
+  if (sector >= HAL_SETTINGS_SECTOR_COUNT || offset + len > HAL_SETTINGS_SECTOR_SIZE) {
+    return false;
+  }
+  memcpy(data, settingsFlash.data() + sector * HAL_SETTINGS_SECTOR_SIZE + offset, len);
+  return true;
+}
+
+// CLOCK_FLASH_TEAR_AFTER=<n> simulates a power cut: the first write stops
+// after n bytes and the process exits.
+bool halSettingsWrite(uint8_t sector, uint32_t offset, const uint32_t* data, size_t len) {
+  loadSettingsFlash();
+  if (sector >= HAL_SETTINGS_SECTOR_COUNT || offset + len > HAL_SETTINGS_SECTOR_SIZE) {
+    return false;
+  }
+  offset += sector * HAL_SETTINGS_SECTOR_SIZE;
+  const char* tear = getenv("CLOCK_FLASH_TEAR_AFTER");
+  size_t written = tear ? std::min(len, (size_t)atol(tear)) : len;
+  const uint8_t* bytes = (const uint8_t*)data;
+  for (size_t i = 0; i < written; i++) {
+    settingsFlash[offset + i] &= bytes[i];
+  }
+  if (tear != nullptr) {
+    storeSettingsFlash();
+    fprintf(stderr, "Simulated power cut after %zu of %zu bytes\n", written, len);
+    _exit(1);
+  }
+  return storeSettingsFlash();
+}
+
+bool halSettingsErase(uint8_t sector) {
+  loadSettingsFlash();
+  if (sector >= HAL_SETTINGS_SECTOR_COUNT) {
+    return false;
+  }
+  auto begin = settingsFlash.begin() + sector * HAL_SETTINGS_SECTOR_SIZE;
+  std::fill(begin, begin + HAL_SETTINGS_SECTOR_SIZE, 0xFF);
+  return storeSettingsFlash();
+}
+
+// ---------------------------------------------------------------------------
+// Filesystem: a host directory (CLOCK_FS_DIR, default native-fs).
+
+static std::string fsPath(const char* path) {
+  const char* root = getenv("CLOCK_FS_DIR");
+  return std::string(root ? root : "native-fs") + path;
+}
+
+bool halFsBegin() {
+  std::string root = fsPath("");
+  return mkdir(root.c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+int32_t halFsRead(const char* path, uint8_t* data, size_t maxLen) {
+  FILE* f = fopen(fsPath(path).c_str(), "rb");
+  if (f == nullptr) {
+    return -1;
+  }
+  size_t n = fread(data, 1, maxLen, f);
+  bool tooLong = fgetc(f) != EOF;
+  fclose(f);
+  return tooLong ? -1 : (int32_t)n;
+}
+
+bool halFsWrite(const char* path, const uint8_t* data, size_t len) {
+  // Create parent directories, as LittleFS does.
+  std::string full = fsPath(path);
+  for (size_t slash = full.find('/', 1); slash != std::string::npos; slash = full.find('/', slash + 1)) {
+    mkdir(full.substr(0, slash).c_str(), 0755);
+  }
+  FILE* f = fopen(full.c_str(), "wb");
+  if (f == nullptr) {
+    return false;
+  }
+  bool ok = fwrite(data, 1, len, f) == len;
+  return fclose(f) == 0 && ok;
+}
+
+bool halFsRemove(const char* path) {
+  return unlink(fsPath(path).c_str()) == 0;
+}
+
+void halFsList(const char* dir, HalFsListFn fn, void* context) {
+  std::string full = fsPath(dir);
+  DIR* d = opendir(full.c_str());
+  if (d == nullptr) {
+    return;
+  }
+  while (dirent* entry = readdir(d)) {
+    struct stat st;
+    if (stat((full + "/" + entry->d_name).c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+      fn(entry->d_name, st.st_size, context);
+    }
+  }
+  closedir(d);
+}
+
+// ---------------------------------------------------------------------------
+// WiFiUDP
+
+uint8_t WiFiUDP::begin(uint16_t port) {
+  stop();
+  fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd_ < 0) {
+    return 0;
+  }
+  int yes = 1;
+  setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(fd_, (sockaddr*)&addr, sizeof(addr)) != 0) {
+    stop();
+    return 0;
+  }
+  fcntl(fd_, F_SETFL, O_NONBLOCK);
+  return 1;
+}
+
+uint8_t WiFiUDP::beginMulticast(IPAddress interfaceAddr, IPAddress multicast, uint16_t port) {
+  stop();
+  fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd_ < 0) {
+    return 0;
+  }
+  int yes = 1;
+  setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  setsockopt(fd_, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  ip_mreq membership = {};
+  membership.imr_multiaddr.s_addr = (uint32_t)multicast;
+  membership.imr_interface.s_addr = (uint32_t)interfaceAddr;
+  if (bind(fd_, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+      setsockopt(fd_, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) != 0) {
+    stop();
+    return 0;
+  }
+  fcntl(fd_, F_SETFL, O_NONBLOCK);
+  return 1;
+}
+
+void WiFiUDP::stop() {
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+  rx_.clear();
+  rxPos_ = 0;
+}
+
+int WiFiUDP::beginPacket(IPAddress ip, uint16_t port) {
+  if (fd_ < 0 && !begin(0)) {
+    return 0;
+  }
+  txIP_ = ip;
+  txPort_ = port;
+  tx_.clear();
+  return 1;
+}
+
+int WiFiUDP::beginPacketMulticast(IPAddress multicastAddress, uint16_t port, IPAddress interfaceAddress, int ttl) {
+  if (!beginPacket(multicastAddress, port)) {
+    return 0;
+  }
+  in_addr interface = {};
+  interface.s_addr = (uint32_t)interfaceAddress;
+  unsigned char hops = (unsigned char)ttl;
+  unsigned char loop = 1;
+  setsockopt(fd_, IPPROTO_IP, IP_MULTICAST_IF, &interface, sizeof(interface));
+  setsockopt(fd_, IPPROTO_IP, IP_MULTICAST_TTL, &hops, sizeof(hops));
+  setsockopt(fd_, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+  return 1;
+}
+
+size_t WiFiUDP::write(const uint8_t* buffer, size_t size) {
+  tx_.insert(tx_.end(), buffer, buffer + size);
+  return size;
+}
+
+int WiFiUDP::endPacket() {
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = (uint32_t)txIP_;
+  addr.sin_port = htons(txPort_);
+  ssize_t n = sendto(fd_, tx_.data(), tx_.size(), 0, (sockaddr*)&addr, sizeof(addr));
+  tx_.clear();
+  return n >= 0 ? 1 : 0;
+}
+
+int WiFiUDP::parsePacket() {
+  rx_.clear();
+  rxPos_ = 0;
+  if (fd_ < 0) {
+    return 0;
+  }
+  uint8_t buf[1500];
+  sockaddr_in from = {};
+  socklen_t fromLen = sizeof(from);
+  ssize_t n = recvfrom(fd_, buf, sizeof(buf), 0, (sockaddr*)&from, &fromLen);
+  if (n <= 0) {
+    return 0;
+  }
+  rx_.assign(buf, buf + n);
+  remoteIP_ = IPAddress((uint32_t)from.sin_addr.s_addr);
+  remotePort_ = ntohs(from.sin_port);
+  return (int)n;
+}
+
+int WiFiUDP::read(uint8_t* buffer, size_t len) {
+  size_t n = std::min(len, rx_.size() - rxPos_);
+  memcpy(buffer, rx_.data() + rxPos_, n);
+  rxPos_ += n;
+  return (int)n;
+}
+
+// ---------------------------------------------------------------------------
+// WiFiClient
+
+WiFiClient::Socket::~Socket() {
+  close(fd);
+}
+
+WiFiClient::WiFiClient(int fd) : socket_(std::make_shared<Socket>(fd)) {}
+
+bool WiFiClient::connected() const {
+  if (!socket_) {
+    return false;
+  }
+  char c;
+  ssize_t n = recv(socket_->fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+  return n > 0 || (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+}
+
+size_t WiFiClient::availableForWrite() const {
+  if (!socket_) {
+    return 0;
+  }
+  int sndbuf = 0;
+  int queued = 0;
+  socklen_t len = sizeof(sndbuf);
+  getsockopt(socket_->fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, &len);
+  ioctl(socket_->fd, TIOCOUTQ, &queued);
+  return sndbuf > queued ? (size_t)(sndbuf - queued) : 0;
+}
+
+size_t WiFiClient::write(const uint8_t* data, size_t len) {
+  if (!socket_) {
+    return 0;
+  }
+  ssize_t n = ::send(socket_->fd, data, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+  return n > 0 ? (size_t)n : 0;
+}
+
+void WiFiClient::setNoDelay(bool noDelay) {
+  if (socket_) {
+    int flag = noDelay ? 1 : 0;
+    setsockopt(socket_->fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+  }
+}
+
+void WiFiClient::stop() {
+  if (socket_) {
+    shutdown(socket_->fd, SHUT_RDWR);
+  }
+  socket_.reset();
+}
+
+// ---------------------------------------------------------------------------
+// ESP8266WebServer
+
+static const char* reasonPhrase(int code) {
+  switch (code) {
+    case 200: return "OK";
+    case 202: return "Accepted";
+    case 204: return "No Content";
+    case 303: return "See Other";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 413: return "Payload Too Large";
+    case 503: return "Service Unavailable";
+    default: return "Unknown";
+  }
+}
+
+static std::string urlDecode(const std::string& in) {
+  std::string out;
+  for (size_t i = 0; i < in.size(); i++) {
+    if (in[i] == '+') {
+      out += ' ';
+    } else if (in[i] == '%' && i + 2 < in.size() && isxdigit((unsigned char)in[i + 1]) &&
+               isxdigit((unsigned char)in[i + 2])) {
+      out += (char)strtol(in.substr(i + 1, 2).c_str(), nullptr, 16);
+      i += 2;
+    } else {
+      out += in[i];
+    }
+  }
+  return out;
+}
+
+ESP8266WebServer::ESP8266WebServer(int port) : port_(port) {
+  const char* envPort = getenv("CLOCK_HTTP_PORT");
+  if (envPort != nullptr) {
+    port_ = atoi(envPort);
+  } else if (port_ < 1024) {
+    port_ += 8000;
+  }
+}
+
+void ESP8266WebServer::on(const String& uri, HTTPMethod method, THandlerFunction handler) {
+  routes_.push_back({uri.c_str(), method, handler, nullptr});
+}
+
+void ESP8266WebServer::on(const String& uri, HTTPMethod method, THandlerFunction handler,
+                          THandlerFunction uploadHandler) {
+  routes_.push_back({uri.c_str(), method, handler, uploadHandler});
+}
+
+void ESP8266WebServer::begin() {
+  listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
+  int yes = 1;
+  setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port_);
+  if (bind(listenFd_, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listenFd_, 8) != 0) {
+    fprintf(stderr, "HTTP server: cannot listen on port %d\n", port_);
+    close(listenFd_);
+    listenFd_ = -1;
+    return;
+  }
+  fcntl(listenFd_, F_SETFL, O_NONBLOCK);
+  printf("HTTP server listening on port %d\n", port_);
+}
+
+void ESP8266WebServer::parseArgs(const std::string& encoded) {
+  size_t pos = 0;
+  while (pos < encoded.size()) {
+    size_t amp = encoded.find('&', pos);
+    if (amp == std::string::npos) {
+      amp = encoded.size();
+    }
+    std::string pair = encoded.substr(pos, amp - pos);
+    size_t eq = pair.find('=');
+    if (!pair.empty()) {
+      if (eq == std::string::npos) {
+        args_.push_back({urlDecode(pair), ""});
+      } else {
+        args_.push_back({urlDecode(pair.substr(0, eq)), urlDecode(pair.substr(eq + 1))});
+      }
+    }
+    pos = amp + 1;
+  }
+}
+
+// Accepts at most one connection per call, reads the whole request (the
+// host has no reason to stream it) and dispatches it to the matching route.
+// Quoted or bare parameter `key` (e.g. "name=") of a header value.
+static std::string headerParam(const std::string& value, const char* key) {
+  size_t start = value.find(key);
+  if (start == std::string::npos) {
+    return std::string();
+  }
+  start += strlen(key);
+  if (start < value.size() && value[start] == '"') {
+    return value.substr(start + 1, value.find('"', start + 1) - start - 1);
+  }
+  return value.substr(start, value.find_first_of("; \r", start) - start);
+}
+
+// Form fields become args; file parts go to the upload handler in chunks,
+// as the ESP8266 server does.
+void ESP8266WebServer::parseMultipart(const std::string& contentType, const std::string& body,
+                                      const THandlerFunction& uploadHandler) {
+  std::string delimiter = "--" + headerParam(contentType, "boundary=");
+  size_t pos = body.find(delimiter);
+  while (pos != std::string::npos) {
+    size_t partStart = pos + delimiter.size();
+    if (body.compare(partStart, 2, "--") == 0) {
+      break;
+    }
+    partStart += 2;  // CRLF after the delimiter
+    size_t headersEnd = body.find("\r\n\r\n", partStart);
+    size_t next = body.find("\r\n" + delimiter, partStart);
+    if (headersEnd == std::string::npos || next == std::string::npos || headersEnd > next) {
+      break;
+    }
+    std::string headers = body.substr(partStart, headersEnd - partStart);
+    std::string content = body.substr(headersEnd + 4, next - headersEnd - 4);
+    std::string name = headerParam(headers, " name=");
+    if (headers.find("filename=") == std::string::npos) {
+      args_.push_back({name, content});
+    } else if (uploadHandler) {
+      upload_.filename = String(headerParam(headers, "filename="));
+      upload_.name = String(name);
+      size_t type = headers.find("Content-Type:");
+      upload_.type = type == std::string::npos ? String() : String(headers.substr(type + 14));
+      upload_.totalSize = 0;
+      upload_.currentSize = 0;
+      upload_.status = UPLOAD_FILE_START;
+      uploadHandler();
+      for (size_t offset = 0; offset < content.size(); offset += HTTP_UPLOAD_BUFLEN) {
+        upload_.currentSize = std::min(content.size() - offset, (size_t)HTTP_UPLOAD_BUFLEN);
+        memcpy(upload_.buf, content.data() + offset, upload_.currentSize);
+        upload_.status = UPLOAD_FILE_WRITE;
+        uploadHandler();
+        upload_.totalSize += upload_.currentSize;
+      }
+      upload_.currentSize = 0;
+      upload_.status = UPLOAD_FILE_END;
+      uploadHandler();
+    }
+    pos = next + 2;
+  }
+}
+
+void ESP8266WebServer::handleClient() {
+  if (listenFd_ < 0) {
+    return;
+  }
+  int fd = accept(listenFd_, nullptr, nullptr);
+  if (fd < 0) {
+    return;
+  }
+  timeval timeout = {2, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  client_ = WiFiClient(fd);
+
+  std::string request;
+  char buf[1024];
+  size_t headerEnd = std::string::npos;
+  while (headerEnd == std::string::npos) {
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0) {
+      client_ = WiFiClient();
+      return;
+    }
+    request.append(buf, n);
+    headerEnd = request.find("\r\n\r\n");
+  }
+
+  size_t contentLength = 0;
+  std::string lower = request.substr(0, headerEnd);
+  std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+  size_t cl = lower.find("content-length:");
+  if (cl != std::string::npos) {
+    contentLength = strtoul(lower.c_str() + cl + 15, nullptr, 10);
+  }
+  std::string body = request.substr(headerEnd + 4);
+  while (body.size() < contentLength) {
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0) {
+      break;
+    }
+    body.append(buf, n);
+  }
+
+  size_t sp1 = request.find(' ');
+  size_t sp2 = request.find(' ', sp1 + 1);
+  std::string target = request.substr(sp1 + 1, sp2 - sp1 - 1);
+  std::string path = target;
+  std::string methodName = request.substr(0, sp1);
+  static const char* const METHOD_NAMES[] = {"", "GET", "HEAD", "POST", "PUT", "PATCH", "DELETE", "OPTIONS"};
+  method_ = HTTP_ANY;
+  for (int i = HTTP_GET; i <= HTTP_OPTIONS; i++) {
+    if (methodName == METHOD_NAMES[i]) {
+      method_ = (HTTPMethod)i;
+    }
+  }
+  args_.clear();
+  headers_.clear();
+  size_t lineStart = request.find("\r\n") + 2;
+  while (lineStart < headerEnd) {
+    size_t lineEnd = request.find("\r\n", lineStart);
+    size_t colon = request.find(':', lineStart);
+    if (colon < lineEnd) {
+      std::string name = lower.substr(lineStart, colon - lineStart);
+      size_t valueStart = request.find_first_not_of(' ', colon + 1);
+      for (const std::string& collected : collectedHeaders_) {
+        if (collected == name) {
+          headers_.push_back({name, request.substr(valueStart, lineEnd - valueStart)});
+        }
+      }
+    }
+    lineStart = lineEnd + 2;
+  }
+  pendingHeaders_.clear();
+  contentLength_ = CONTENT_LENGTH_NOT_SET;
+  chunked_ = false;
+  size_t q = target.find('?');
+  if (q != std::string::npos) {
+    path = target.substr(0, q);
+    parseArgs(target.substr(q + 1));
+  }
+  uri_ = String(path);
+  const Route* matched = nullptr;
+  for (const Route& route : routes_) {
+    if (route.uri == path && (route.method == HTTP_ANY || route.method == method_)) {
+      matched = &route;
+      break;
+    }
+  }
+
+  size_t contentType = lower.find("content-type:");
+  if (lower.find("application/x-www-form-urlencoded") != std::string::npos) {
+    parseArgs(body);
+  } else if (contentType != std::string::npos && lower.compare(contentType + 13, 20, " multipart/form-data") == 0) {
+    std::string value = request.substr(contentType + 13, request.find("\r\n", contentType) - contentType - 13);
+    parseMultipart(value, body, matched != nullptr ? matched->uploadHandler : nullptr);
+  } else if (!body.empty()) {
+    args_.push_back({"plain", body});
+  }
+
+  if (matched != nullptr) {
+    matched->handler();
+  } else {
+    send(404, "text/plain", "Not found");
+  }
+
+  // Closes the connection unless a handler kept a copy of client().
+  client_ = WiFiClient();
+}
+
+bool ESP8266WebServer::hasArg(const String& name) const {
+  for (const Arg& a : args_) {
+    if (a.name == name.c_str()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+String ESP8266WebServer::arg(const String& name) const {
+  for (const Arg& a : args_) {
+    if (a.name == name.c_str()) {
+      return String(a.value);
+    }
+  }
+  return String();
+}
+
+void ESP8266WebServer::collectHeaders(const char* headerKeys[], size_t headerKeysCount) {
+  collectedHeaders_.clear();
+  for (size_t i = 0; i < headerKeysCount; i++) {
+    std::string name = headerKeys[i];
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    collectedHeaders_.push_back(name);
+  }
+}
+
+bool ESP8266WebServer::hasHeader(const String& name) const {
+  std::string lower = name.c_str();
+  std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+  for (const Arg& h : headers_) {
+    if (h.name == lower) {
+      return true;
+    }
+  }
+  return false;
+}
+
+String ESP8266WebServer::header(const String& name) const {
+  std::string lower = name.c_str();
+  std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+  for (const Arg& h : headers_) {
+    if (h.name == lower) {
+      return String(h.value);
+    }
+  }
+  return String();
+}
+
+void ESP8266WebServer::sendHeader(const String& name, const String& value) {
+  pendingHeaders_ += std::string(name.c_str()) + ": " + value.c_str() + "\r\n";
+}
+
+void ESP8266WebServer::writeAll(const char* data, size_t len) {
+  size_t sent = 0;
+  while (sent < len) {
+    ssize_t n = ::send(client_.fd(), data + sent, len - sent, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return;
+    }
+    sent += n;
+  }
+}
+
+void ESP8266WebServer::send(int code, const char* contentType, const String& content) {
+  if (client_.fd() < 0) {
+    return;
+  }
+  char status[96];
+  snprintf(status, sizeof(status), "HTTP/1.1 %d %s\r\n", code, reasonPhrase(code));
+  std::string response = status;
+  response += std::string("Content-Type: ") + contentType + "\r\n";
+  if (contentLength_ == CONTENT_LENGTH_UNKNOWN) {
+    response += "Transfer-Encoding: chunked\r\n";
+    chunked_ = true;
+  } else {
+    size_t length = contentLength_ == CONTENT_LENGTH_NOT_SET ? content.length() : contentLength_;
+    response += "Content-Length: " + std::to_string(length) + "\r\n";
+  }
+  response += pendingHeaders_;
+  response += "Connection: close\r\n\r\n";
+  pendingHeaders_.clear();
+  writeAll(response.data(), response.size());
+  if (content.length() > 0) {
+    sendContent(content);
+  }
+}
+
+void ESP8266WebServer::send_P(int code, PGM_P contentType, PGM_P content, size_t contentLength) {
+  setContentLength(contentLength);
+  send(code, contentType, "");
+  sendContent(content, contentLength);
+}
+
+void ESP8266WebServer::sendContent(const char* content, size_t size) {
+  if (client_.fd() < 0) {
+    return;
+  }
+  if (!chunked_) {
+    writeAll(content, size);
+    return;
+  }
+  char header[16];
+  snprintf(header, sizeof(header), "%zx\r\n", size);
+  writeAll(header, strlen(header));
+  writeAll(content, size);
+  writeAll("\r\n", 2);
+  if (size == 0) {
+    chunked_ = false;
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Entry point: the Arduino setup()/loop() contract on top of a host process.
+// `pio test` links its own main() from test/ instead.
+
+#ifndef UNIT_TEST
+int main() {
+  setup();
+  for (;;) {
+    loop();
+    std::this_thread::sleep_for(std::chrono::microseconds(500));
+  }
+}
+#endif  // UNIT_TEST
+
+#endif
@@ -0,0 +1,379 @@
+#pragma once
+
+// Host (env:native) implementation of the subset of the Arduino core,
+// Adafruit_NeoPixel, ESP8266WiFi, ESP8266WebServer and WiFiManager APIs
+// used by the firmware. Timing maps onto the monotonic clock, the LED ring
+// onto an in-memory buffer, the settings flash sector onto a file and the
+// web server onto a plain TCP socket.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// Arduino core
+
+#define D1 5
+
+// Flash (PROGMEM) data is ordinary memory on the host.
+#define PROGMEM
+#define PGM_P const char*
+#define PSTR(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_word(addr) (*(const uint16_t*)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t*)(addr))
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strncpy_P strncpy
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+
+class String {
+ public:
+  String() {}
+  String(const char* s) : s_(s ? s : "") {}
+  String(const std::string& s) : s_(s) {}
+  String(char c) : s_(1, c) {}
+  template <typename T, typename std::enable_if<std::is_integral<T>::value, int>::type = 0>
+  String(T value) : s_(std::to_string(value)) {}
+
+  unsigned int length() const { return (unsigned int)s_.size(); }
+  const char* c_str() const { return s_.c_str(); }
+  char& operator[](unsigned int i) { return s_[i]; }
+  char operator[](unsigned int i) const { return s_[i]; }
+
+  String& operator+=(const String& rhs) { s_ += rhs.s_; return *this; }
+  String& operator+=(const char* rhs) { s_ += rhs; return *this; }
+  String& operator+=(char c) { s_ += c; return *this; }
+  template <typename T, typename std::enable_if<std::is_integral<T>::value, int>::type = 0>
+  String& operator+=(T value) { s_ += std::to_string(value); return *this; }
+
+  bool operator==(const String& rhs) const { return s_ == rhs.s_; }
+  bool operator==(const char* rhs) const { return s_ == rhs; }
+  bool operator!=(const String& rhs) const { return s_ != rhs.s_; }
+  bool operator!=(const char* rhs) const { return s_ != rhs; }
+
+  long toInt() const { return strtol(s_.c_str(), nullptr, 10); }
+  void trim();
+  void toCharArray(char* buf, unsigned int size) const;
+
+ private:
+  std::string s_;
+};
+
+inline String operator+(const String& lhs, const String& rhs) { String r(lhs); r += rhs; return r; }
+inline String operator+(const String& lhs, const char* rhs) { String r(lhs); r += rhs; return r; }
+inline String operator+(const char* lhs, const String& rhs) { String r(lhs); r += rhs; return r; }
+inline String operator+(const String& lhs, char rhs) { String r(lhs); r += rhs; return r; }
+template <typename T, typename std::enable_if<std::is_integral<T>::value, int>::type = 0>
+String operator+(const String& lhs, T rhs) { String r(lhs); r += rhs; return r; }
+
+class IPAddress {
+ public:
+  IPAddress() {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : octets_{a, b, c, d} {}
+  // Network byte order, first octet in the low byte (as on the ESP8266).
+  IPAddress(uint32_t address) { memcpy(octets_, &address, 4); }
+  operator uint32_t() const {
+    uint32_t address;
+    memcpy(&address, octets_, 4);
+    return address;
+  }
+  bool operator==(const IPAddress& rhs) const { return memcmp(octets_, rhs.octets_, 4) == 0; }
+  bool operator!=(const IPAddress& rhs) const { return !(*this == rhs); }
+  uint8_t operator[](int index) const { return octets_[index]; }
+  bool isSet() const { return (uint32_t)(*this) != 0; }
+  bool fromString(const char* s);
+  String toString() const;
+
+ private:
+  uint8_t octets_[4] = {0, 0, 0, 0};
+};
+
+class HardwareSerial {
+ public:
+  void begin(unsigned long) {}
+  void print(const char* s) { fputs(s, stdout); }
+  void print(const String& s) { print(s.c_str()); }
+  void print(const IPAddress& ip) { print(ip.toString()); }
+  void println() { fputs("\n", stdout); fflush(stdout); }
+  template <typename T>
+  void println(const T& value) { print(value); println(); }
+  int printf(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+  // stdout never makes the caller wait; report a FIFO's worth of room.
+  int availableForWrite() const { return 128; }
+  size_t write(const uint8_t* data, size_t len) { fwrite(data, 1, len, stdout); fflush(stdout); return len; }
+};
+
+extern HardwareSerial Serial;
+
+// ---------------------------------------------------------------------------
+// Adafruit_NeoPixel
+
+#define NEO_GRB ((1 << 6) | (1 << 4) | (0 << 2) | (2))
+#define NEO_KHZ800 0x0000
+
+class Adafruit_NeoPixel {
+ public:
+  Adafruit_NeoPixel(uint16_t n, int16_t pin, uint16_t type);
+
+  void begin() {}
+  void show() { showCount_++; }
+  void clear() { std::fill(pixels_.begin(), pixels_.end(), 0); }
+  void setPixelColor(uint16_t n, uint32_t c);
+  void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b);
+  uint32_t getPixelColor(uint16_t n) const;
+  void fill(uint32_t c = 0, uint16_t first = 0, uint16_t count = 0);
+  void setBrightness(uint8_t b);
+  uint8_t getBrightness() const { return brightness_ - 1; }
+  uint16_t numPixels() const { return numLEDs_; }
+  uint8_t* getPixels() { return pixels_.data(); }
+  static uint32_t Color(uint8_t r, uint8_t g, uint8_t b) {
+    return ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+  }
+
+  // Host only: number of show() calls since boot.
+  uint32_t showCount() const { return showCount_; }
+
+ private:
+  uint16_t numLEDs_;
+  uint8_t brightness_ = 0;  // Stored +1 like the real library; 0 = unscaled
+  std::vector<uint8_t> pixels_;  // GRB byte order
+  uint32_t showCount_ = 0;
+};
+
+// ---------------------------------------------------------------------------
+// ESP8266WiFi
+
+enum wl_status_t {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_SCAN_COMPLETED = 2,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_WRONG_PASSWORD = 6,
+  WL_DISCONNECTED = 7
+};
+
+enum WiFiMode_t { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 };
+
+// The host joins a simulated access point, SSID "native" on channel 6.
+// A join takes CLOCK_NATIVE_WIFI_JOIN_MS=<ms> after begin() (default 0),
+// or CLOCK_NATIVE_WIFI_DIRECT_MS=<ms> when aimed at the access point's
+// BSSID and channel, which needs no scan (default: the same time).
+// CLOCK_NATIVE_WIFI_DROPS=<at>+<for>[@<channel>],... takes the access
+// point away <at> ms after start for <for> ms, then brings it back, on
+// <channel> if given. The station then reports WL_DISCONNECTED, and a join
+// due while the access point is away, or aimed at the wrong channel,
+// fails with WL_NO_SSID_AVAIL; the station does not retry by itself.
+class WiFiClass {
+ public:
+  bool mode(WiFiMode_t) { return true; }
+  void persistent(bool) {}
+  void setAutoReconnect(bool) {}
+  bool config(IPAddress, IPAddress, IPAddress, IPAddress = IPAddress()) { return true; }
+  wl_status_t begin();
+  wl_status_t begin(const char* ssid, const char* passphrase = nullptr, int32_t channel = 0,
+                    const uint8_t* bssid = nullptr, bool connect = true);
+  wl_status_t status();
+  String SSID() const { return "native"; }
+  String psk() const { return ""; }
+  uint8_t* BSSID();
+  int32_t channel() { return status() == WL_CONNECTED ? channel_ : 0; }
+  IPAddress localIP() const { return IPAddress(127, 0, 0, 1); }
+  IPAddress gatewayIP() const { return IPAddress(127, 0, 0, 1); }
+  IPAddress subnetMask() const { return IPAddress(255, 0, 0, 0); }
+  IPAddress dnsIP(uint8_t = 0) const { return IPAddress(127, 0, 0, 1); }
+
+ private:
+  bool accessPointUp(unsigned long ms, uint8_t* channel) const;
+
+  wl_status_t status_ = WL_IDLE_STATUS;
+  bool joining_ = false;
+  unsigned long joinStartMs_ = 0;
+  unsigned long joinMs_ = 0;
+  int32_t targetChannel_ = 0; // 0 = any, after a scan
+  uint8_t channel_ = 0;
+};
+
+extern WiFiClass WiFi;
+
+// Non-blocking UDP socket with the WiFiUDP packet API.
+class WiFiUDP {
+ public:
+  ~WiFiUDP() { stop(); }
+
+  uint8_t begin(uint16_t port);
+  // Joins `multicast` on the interface with address `interfaceAddr`. The
+  // port is shared, so several host instances can listen on loopback.
+  uint8_t beginMulticast(IPAddress interfaceAddr, IPAddress multicast, uint16_t port);
+  void stop();
+  int beginPacket(IPAddress ip, uint16_t port);
+  int beginPacketMulticast(IPAddress multicastAddress, uint16_t port, IPAddress interfaceAddress, int ttl = 1);
+  size_t write(const uint8_t* buffer, size_t size);
+  int endPacket();
+  // Receives the next datagram, if any; returns its size or 0.
+  int parsePacket();
+  int available() const { return (int)(rx_.size() - rxPos_); }
+  int read(uint8_t* buffer, size_t len);
+  int read(char* buffer, size_t len) { return read((uint8_t*)buffer, len); }
+  IPAddress remoteIP() const { return remoteIP_; }
+  uint16_t remotePort() const { return remotePort_; }
+
+ private:
+  int fd_ = -1;
+  IPAddress txIP_;
+  uint16_t txPort_ = 0;
+  std::vector<uint8_t> tx_;
+  std::vector<uint8_t> rx_;
+  size_t rxPos_ = 0;
+  IPAddress remoteIP_;
+  uint16_t remotePort_ = 0;
+};
+
+// ---------------------------------------------------------------------------
+// WiFiManager
+
+class WiFiManager {
+ public:
+  void setConfigPortalBlocking(bool) {}
+  void setConfigPortalTimeout(unsigned long) {}
+  bool getWiFiIsSaved() { return true; }
+  // Waits for the join, as the library does with saved credentials.
+  bool autoConnect(const char*);
+  bool startConfigPortal(const char*) { return false; }
+  bool process() { return false; }
+};
+
+// ---------------------------------------------------------------------------
+// WiFiClient: a TCP connection shared by reference count, closed when the
+// last copy goes away (as on the ESP8266), so a handler can keep the
+// connection of its request open after the web server is done with it.
+
+class WiFiClient {
+ public:
+  WiFiClient() {}
+  explicit WiFiClient(int fd);
+
+  bool connected() const;
+  size_t availableForWrite() const;
+  // Never blocks; returns the number of bytes the socket accepted.
+  size_t write(const uint8_t* data, size_t len);
+  void setNoDelay(bool noDelay);
+  void stop();
+  int fd() const { return socket_ ? socket_->fd : -1; }
+
+ private:
+  struct Socket {
+    explicit Socket(int fd) : fd(fd) {}
+    Socket(const Socket&) = delete;
+    Socket& operator=(const Socket&) = delete;
+    ~Socket();
+    int fd;
+  };
+  std::shared_ptr<Socket> socket_;
+};
+
+// ---------------------------------------------------------------------------
+// ESP8266WebServer (one request per connection, served from handleClient)
+
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+#define CONTENT_LENGTH_NOT_SET ((size_t)-2)
+
+enum HTTPMethod { HTTP_ANY, HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT, HTTP_PATCH, HTTP_DELETE, HTTP_OPTIONS };
+
+enum HTTPUploadStatus { UPLOAD_FILE_START, UPLOAD_FILE_WRITE, UPLOAD_FILE_END, UPLOAD_FILE_ABORTED };
+
+#define HTTP_UPLOAD_BUFLEN 2048
+
+struct HTTPUpload {
+  HTTPUploadStatus status;
+  String filename;
+  String name;
+  String type;
+  size_t totalSize;
+  size_t currentSize;
+  uint8_t buf[HTTP_UPLOAD_BUFLEN];
+};
+
+class ESP8266WebServer {
+ public:
+  typedef std::function<void(void)> THandlerFunction;
+
+  // Ports below 1024 are shifted to 8000+port so no privileges are needed;
+  // CLOCK_HTTP_PORT overrides the port entirely.
+  explicit ESP8266WebServer(int port);
+
+  void on(const String& uri, THandlerFunction handler) { on(uri, HTTP_ANY, handler); }
+  void on(const String& uri, HTTPMethod method, THandlerFunction handler);
+  // multipart/form-data file parts are passed to uploadHandler in
+  // HTTP_UPLOAD_BUFLEN chunks before handler runs.
+  void on(const String& uri, HTTPMethod method, THandlerFunction handler, THandlerFunction uploadHandler);
+  void begin();
+  void handleClient();
+
+  HTTPMethod method() const { return method_; }
+  const String& uri() const { return uri_; }
+  WiFiClient& client() { return client_; }
+  HTTPUpload& upload() { return upload_; }
+
+  bool hasArg(const String& name) const;
+  String arg(const String& name) const;
+  // As on the ESP8266, only request headers named here are kept.
+  void collectHeaders(const char* headerKeys[], size_t headerKeysCount);
+  bool hasHeader(const String& name) const;
+  String header(const String& name) const;
+  void sendHeader(const String& name, const String& value);
+  void send(int code, const char* contentType, const String& content);
+  void setContentLength(size_t contentLength) { contentLength_ = contentLength; }
+  // With CONTENT_LENGTH_UNKNOWN each call is sent as one chunk; an empty
+  // call terminates the response.
+  void sendContent(const char* content, size_t size);
+  void sendContent(const char* content) { sendContent(content, strlen(content)); }
+  void sendContent(const String& content) { sendContent(content.c_str(), content.length()); }
+  void send_P(int code, PGM_P contentType, PGM_P content, size_t contentLength);
+
+ private:
+  struct Route {
+    std::string uri;
+    HTTPMethod method;
+    THandlerFunction handler;
+    THandlerFunction uploadHandler;
+  };
+  struct Arg {
+    std::string name;
+    std::string value;
+  };
+
+  void parseArgs(const std::string& encoded);
+  void parseMultipart(const std::string& contentType, const std::string& body, const THandlerFunction& uploadHandler);
+  void writeAll(const char* data, size_t len);
+
+  int port_;
+  int listenFd_ = -1;
+  WiFiClient client_;
+  HTTPUpload upload_;
+  HTTPMethod method_ = HTTP_GET;
+  String uri_;
+  std::vector<Route> routes_;
+  std::vector<Arg> args_;
+  std::vector<std::string> collectedHeaders_;
+  std::vector<Arg> headers_;
+  std::string pendingHeaders_;
+  size_t contentLength_ = CONTENT_LENGTH_NOT_SET;
+  bool chunked_ = false;
+};
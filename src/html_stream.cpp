@@ -0,0 +1,133 @@
+#include "html_stream.h"
+
+#include <stdarg.h>
+
+void HtmlStream::begin(int code, const char* contentType) {
+  len_ = 0;
+  sent_ = 0;
+  heapLow_ = halFreeHeap();
+  server_.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server_.send(code, contentType, "");
+}
+
+void HtmlStream::end() {
+  flush();
+  server_.sendContent("");  // Terminating zero-length chunk
+}
+
+void HtmlStream::flush() {
+  if (len_ == 0) {
+    return;
+  }
+  server_.sendContent(buf_, len_);
+  sent_ += len_;
+  len_ = 0;
+  uint32_t freeHeap = halFreeHeap();
+  if (freeHeap < heapLow_) {
+    heapLow_ = freeHeap;
+  }
+}
+
+void HtmlStream::write(const char* data, size_t len) {
+  while (len > 0) {
+    size_t n = HTML_CHUNK_SIZE - len_;
+    if (n > len) {
+      n = len;
+    }
+    memcpy(buf_ + len_, data, n);
+    len_ += n;
+    data += n;
+    len -= n;
+    if (len_ == HTML_CHUNK_SIZE) {
+      flush();
+    }
+  }
+}
+
+void HtmlStream::print(const char* s) {
+  write(s, strlen(s));
+}
+
+void HtmlStream::print_P(PGM_P s) {
+  size_t len = strlen_P(s);
+  while (len > 0) {
+    size_t n = HTML_CHUNK_SIZE - len_;
+    if (n > len) {
+      n = len;
+    }
+    memcpy_P(buf_ + len_, s, n);
+    len_ += n;
+    s += n;
+    len -= n;
+    if (len_ == HTML_CHUNK_SIZE) {
+      flush();
+    }
+  }
+}
+
+void HtmlStream::printf(const char* fmt, ...) {
+  char tmp[96];
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(tmp, sizeof(tmp), fmt, args);
+  va_end(args);
+  if (n > 0) {
+    write(tmp, (size_t)n < sizeof(tmp) ? (size_t)n : sizeof(tmp) - 1);
+  }
+}
+
+void HtmlStream::printEscaped(const char* s) {
+  for (; *s; s++) {
+    switch (*s) {
+      case '&': print("&amp;"); break;
+      case '<': print("&lt;"); break;
+      case '>': print("&gt;"); break;
+      case '"': print("&quot;"); break;
+      case '\'': print("&#39;"); break;
+      default: write(s, 1); break;
+    }
+  }
+}
+
+void HtmlStream::printTemplate_P(PGM_P tpl, HtmlExpandFn expand) {
+  PGM_P runStart = tpl;
+  PGM_P p = tpl;
+  char c;
+  while ((c = pgm_read_byte(p)) != '\0') {
+    if (c != '{' || pgm_read_byte(p + 1) != '{') {
+      p++;
+      continue;
+    }
+
+    // Copy the static run preceding the placeholder straight from flash.
+    while (runStart < p) {
+      size_t n = HTML_CHUNK_SIZE - len_;
+      if (n > (size_t)(p - runStart)) {
+        n = p - runStart;
+      }
+      memcpy_P(buf_ + len_, runStart, n);
+      len_ += n;
+      runStart += n;
+      if (len_ == HTML_CHUNK_SIZE) {
+        flush();
+      }
+    }
+
+    char key[24];
+    size_t keyLen = 0;
+    p += 2;
+    while ((c = pgm_read_byte(p)) != '\0' && !(c == '}' && pgm_read_byte(p + 1) == '}')) {
+      if (keyLen < sizeof(key) - 1) {
+        key[keyLen++] = c;
+      }
+      p++;
+    }
+    key[keyLen] = '\0';
+    if (c != '\0') {
+      p += 2;
+    }
+    runStart = p;
+    expand(*this, key);
+  }
+  print_P(runStart);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "hal.h"
+
+// Size of the buffer a response is assembled in before it is sent as one
+// HTTP chunk. Heap/stack cost of a page is bounded by this, not the page.
+const size_t HTML_CHUNK_SIZE = 512;
+
+class HtmlStream;
+
+// Called for every {{key}} placeholder in a template; writes the value.
+typedef void (*HtmlExpandFn)(HtmlStream& out, const char* key);
+
+// Streams a response with chunked transfer encoding. Static text is copied
+// from flash into a fixed buffer, dynamic values are written straight into
+// the same buffer, and the buffer is sent whenever it fills up.
+class HtmlStream {
+ public:
+  explicit HtmlStream(ESP8266WebServer& server) : server_(server) {}
+
+  void begin(int code, const char* contentType);
+  void end();
+
+  void write(const char* data, size_t len);
+  void print(const char* s);
+  void print_P(PGM_P s);
+  void printf(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+  // Writes s with the characters that are unsafe in HTML text and quoted
+  // attribute values replaced by entities.
+  void printEscaped(const char* s);
+  // Copies a PROGMEM template, expanding each {{key}} through expand().
+  void printTemplate_P(PGM_P tpl, HtmlExpandFn expand);
+
+  size_t bytesSent() const { return sent_ + len_; }
+  // Lowest free heap seen at any chunk boundary since begin().
+  uint32_t heapLowWatermark() const { return heapLow_; }
+
+ private:
+  void flush();
+
+  ESP8266WebServer& server_;
+  char buf_[HTML_CHUNK_SIZE];
+  size_t len_ = 0;
+  size_t sent_ = 0;
+  uint32_t heapLow_ = 0;
+};
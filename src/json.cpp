@@ -0,0 +1,295 @@
+#include "json.h"
+
+#include <ctype.h>
+
+JsonWriter::JsonWriter(char* buf, size_t size) : buf_(buf), size_(size) {
+  first_[0] = true;
+  if (size_ > 0) {
+    buf_[0] = '\0';
+  }
+}
+
+void JsonWriter::raw(const char* s, size_t len) {
+  if (overflow_ || len_ + len >= size_) {
+    overflow_ = true;
+    return;
+  }
+  memcpy(buf_ + len_, s, len);
+  len_ += len;
+  buf_[len_] = '\0';
+}
+
+void JsonWriter::quoted(const char* s) {
+  raw("\"", 1);
+  const char* run = s;
+  for (; *s; s++) {
+    unsigned char c = (unsigned char)*s;
+    if (c != '"' && c != '\\' && c >= 0x20) {
+      continue;
+    }
+    raw(run, s - run);
+    run = s + 1;
+    char escaped[8];
+    switch (c) {
+      case '"': raw("\\\"", 2); break;
+      case '\\': raw("\\\\", 2); break;
+      case '\n': raw("\\n", 2); break;
+      case '\r': raw("\\r", 2); break;
+      case '\t': raw("\\t", 2); break;
+      default:
+        snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+        raw(escaped, 6);
+        break;
+    }
+  }
+  raw(run, s - run);
+  raw("\"", 1);
+}
+
+void JsonWriter::member(const char* key) {
+  if (!first_[depth_]) {
+    raw(",", 1);
+  }
+  first_[depth_] = false;
+  if (key != nullptr) {
+    quoted(key);
+    raw(":", 1);
+  }
+}
+
+void JsonWriter::beginObject(const char* key) {
+  member(key);
+  raw("{", 1);
+  if (depth_ < MAX_DEPTH) {
+    first_[++depth_] = true;
+  } else {
+    overflow_ = true;
+  }
+}
+
+void JsonWriter::endObject() {
+  raw("}", 1);
+  if (depth_ > 0) {
+    depth_--;
+  }
+}
+
+void JsonWriter::beginArray(const char* key) {
+  member(key);
+  raw("[", 1);
+  if (depth_ < MAX_DEPTH) {
+    first_[++depth_] = true;
+  } else {
+    overflow_ = true;
+  }
+}
+
+void JsonWriter::endArray() {
+  raw("]", 1);
+  if (depth_ > 0) {
+    depth_--;
+  }
+}
+
+void JsonWriter::add(const char* key, const char* value) {
+  member(key);
+  quoted(value);
+}
+
+void JsonWriter::add(const char* key, bool value) {
+  member(key);
+  raw(value ? "true" : "false");
+}
+
+void JsonWriter::add(const char* key, int32_t value) {
+  char num[12];
+  member(key);
+  raw(num, snprintf(num, sizeof(num), "%ld", (long)value));
+}
+
+void JsonWriter::add(const char* key, uint32_t value) {
+  char num[12];
+  member(key);
+  raw(num, snprintf(num, sizeof(num), "%lu", (unsigned long)value));
+}
+
+// Digits are produced here rather than with %lld, which not every printf
+// supports.
+void JsonWriter::add(const char* key, int64_t value) {
+  uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+  char num[21];
+  char* p = num + sizeof(num);
+  do {
+    *--p = (char)('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude != 0);
+  if (value < 0) {
+    *--p = '-';
+  }
+  member(key);
+  raw(p, num + sizeof(num) - p);
+}
+
+void JsonWriter::addFixed(const char* key, int32_t value, uint8_t decimals) {
+  static const int32_t POWERS[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+  if (decimals == 0 || decimals > 6) {
+    add(key, value);
+    return;
+  }
+  int32_t scale = POWERS[decimals];
+  uint32_t magnitude = value < 0 ? (uint32_t)(-(int64_t)value) : (uint32_t)value;
+  char num[16];
+  member(key);
+  raw(num, snprintf(num, sizeof(num), "%s%lu.%0*lu", value < 0 ? "-" : "", (unsigned long)(magnitude / scale),
+                    (int)decimals, (unsigned long)(magnitude % scale)));
+}
+
+void JsonWriter::addNull(const char* key) {
+  member(key);
+  raw("null");
+}
+
+namespace {
+
+const size_t TOKEN_SIZE = 64;
+
+const char* skipSpace(const char* p) {
+  while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+    p++;
+  }
+  return p;
+}
+
+int hexDigit(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// Reads a string starting after its opening quote; returns the position
+// after the closing quote or nullptr.
+const char* parseString(const char* p, char* out) {
+  size_t len = 0;
+  while (*p != '"') {
+    if (*p == '\0' || (unsigned char)*p < 0x20) {
+      return nullptr;
+    }
+    char c = *p++;
+    uint32_t code = (unsigned char)c;
+    if (c == '\\') {
+      c = *p++;
+      switch (c) {
+        case '"': case '\\': case '/': code = (unsigned char)c; break;
+        case 'b': code = '\b'; break;
+        case 'f': code = '\f'; break;
+        case 'n': code = '\n'; break;
+        case 'r': code = '\r'; break;
+        case 't': code = '\t'; break;
+        case 'u':
+          code = 0;
+          for (int i = 0; i < 4; i++) {
+            int d = hexDigit(*p++);
+            if (d < 0) {
+              return nullptr;
+            }
+            code = (code << 4) | d;
+          }
+          break;
+        default:
+          return nullptr;
+      }
+    }
+    // UTF-8 encode escapes; raw bytes are copied as they are.
+    char bytes[3];
+    size_t n = 0;
+    if (code < 0x80 || c != 'u') {
+      bytes[n++] = (char)code;
+    } else if (code < 0x800) {
+      bytes[n++] = (char)(0xC0 | (code >> 6));
+      bytes[n++] = (char)(0x80 | (code & 0x3F));
+    } else {
+      bytes[n++] = (char)(0xE0 | (code >> 12));
+      bytes[n++] = (char)(0x80 | ((code >> 6) & 0x3F));
+      bytes[n++] = (char)(0x80 | (code & 0x3F));
+    }
+    if (len + n >= TOKEN_SIZE) {
+      return nullptr;
+    }
+    memcpy(out + len, bytes, n);
+    len += n;
+  }
+  out[len] = '\0';
+  return p + 1;
+}
+
+const char* parseLiteral(const char* p, char* out, JsonType* type) {
+  static const char* const LITERALS[] = {"true", "false", "null"};
+  for (const char* literal : LITERALS) {
+    size_t n = strlen(literal);
+    if (strncmp(p, literal, n) == 0) {
+      strcpy(out, literal);
+      *type = (literal[0] == 'n') ? JSON_NULL : JSON_BOOL;
+      return p + n;
+    }
+  }
+  size_t len = 0;
+  while (isdigit((unsigned char)*p) || *p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E') {
+    if (len + 1 >= TOKEN_SIZE) {
+      return nullptr;
+    }
+    out[len++] = *p++;
+  }
+  if (len == 0) {
+    return nullptr;
+  }
+  out[len] = '\0';
+  *type = JSON_NUMBER;
+  return p;
+}
+
+}  // namespace
+
+JsonParseResult jsonParseObject(const char* json, JsonMemberFn fn, void* context) {
+  char key[TOKEN_SIZE];
+  char value[TOKEN_SIZE];
+  const char* p = skipSpace(json);
+  if (*p++ != '{') {
+    return JSON_SYNTAX_ERROR;
+  }
+  p = skipSpace(p);
+  if (*p == '}') {
+    return *skipSpace(p + 1) == '\0' ? JSON_OK : JSON_SYNTAX_ERROR;
+  }
+
+  for (;;) {
+    if (*p++ != '"' || (p = parseString(p, key)) == nullptr) {
+      return JSON_SYNTAX_ERROR;
+    }
+    p = skipSpace(p);
+    if (*p++ != ':') {
+      return JSON_SYNTAX_ERROR;
+    }
+    p = skipSpace(p);
+    JsonMember member = {key, JSON_STRING, value};
+    if (*p == '"') {
+      p = parseString(p + 1, value);
+    } else {
+      p = parseLiteral(p, value, &member.type);
+    }
+    if (p == nullptr) {
+      return JSON_SYNTAX_ERROR;
+    }
+    if (!fn(member, context)) {
+      return JSON_REJECTED;
+    }
+    p = skipSpace(p);
+    if (*p == '}') {
+      return *skipSpace(p + 1) == '\0' ? JSON_OK : JSON_SYNTAX_ERROR;
+    }
+    if (*p++ != ',') {
+      return JSON_SYNTAX_ERROR;
+    }
+    p = skipSpace(p);
+  }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "hal.h"
+
+// Serialises JSON straight into a caller-provided buffer: no String, no
+// heap. Commas and nesting are tracked by the writer; once the buffer is
+// full further output is dropped and overflowed() reports it.
+class JsonWriter {
+ public:
+  static const uint8_t MAX_DEPTH = 4;
+
+  JsonWriter(char* buf, size_t size);
+
+  // `key` is required inside objects and must be null inside arrays or at
+  // the top level.
+  void beginObject(const char* key = nullptr);
+  void endObject();
+  void beginArray(const char* key = nullptr);
+  void endArray();
+
+  void add(const char* key, const char* value);
+  void add(const char* key, bool value);
+  void add(const char* key, int32_t value);
+  void add(const char* key, uint32_t value);
+  void add(const char* key, int64_t value);
+  // Fixed-point value printed with `decimals` digits after the point.
+  void addFixed(const char* key, int32_t value, uint8_t decimals);
+  void addNull(const char* key);
+
+  const char* c_str() const { return buf_; }
+  size_t length() const { return len_; }
+  bool overflowed() const { return overflow_; }
+
+ private:
+  void member(const char* key);
+  void raw(const char* s, size_t len);
+  void raw(const char* s) { raw(s, strlen(s)); }
+  void quoted(const char* s);
+
+  char* buf_;
+  size_t size_;
+  size_t len_ = 0;
+  bool overflow_ = false;
+  uint8_t depth_ = 0;
+  bool first_[MAX_DEPTH + 1];
+};
+
+enum JsonType : uint8_t {
+  JSON_STRING,
+  JSON_NUMBER,
+  JSON_BOOL,
+  JSON_NULL,
+};
+
+// One member of a flat object. Strings are unescaped; numbers, true/false
+// and null keep their literal text.
+struct JsonMember {
+  const char* key;
+  JsonType type;
+  const char* value;
+};
+
+// Called for each member; return false to stop parsing.
+typedef bool (*JsonMemberFn)(const JsonMember& member, void* context);
+
+enum JsonParseResult : uint8_t {
+  JSON_OK,
+  JSON_SYNTAX_ERROR,  // Malformed, nested, or a key/value too long
+  JSON_REJECTED,      // The callback returned false
+};
+
+// Parses a flat JSON object ({"key": scalar, ...}) in one pass without
+// allocating. Keys and string values are limited to 63 bytes.
+JsonParseResult jsonParseObject(const char* json, JsonMemberFn fn, void* context);
@@ -0,0 +1,97 @@
+#include "logger.h"
+
+#include <stdarg.h>
+
+namespace {
+
+const char LEVEL_LETTERS[] = "-EWID";
+
+char buffer[LOG_BUFFER_SIZE];
+uint32_t head = 0;          // Bytes logged since boot
+uint32_t uartPosition = 0;  // Next byte for the UART
+uint32_t dropped = 0;
+
+uint32_t oldest() {
+  return head > LOG_BUFFER_SIZE ? head - LOG_BUFFER_SIZE : 0;
+}
+
+size_t contiguous(uint32_t position, size_t limit) {
+  size_t n = LOG_BUFFER_SIZE - position % LOG_BUFFER_SIZE;
+  if (n > head - position) {
+    n = head - position;
+  }
+  return n < limit ? n : limit;
+}
+
+void append(const char* data, size_t len) {
+  while (len > 0) {
+    size_t offset = head % LOG_BUFFER_SIZE;
+    size_t n = LOG_BUFFER_SIZE - offset < len ? LOG_BUFFER_SIZE - offset : len;
+    memcpy(buffer + offset, data, n);
+    head += n;
+    data += n;
+    len -= n;
+  }
+}
+
+}  // namespace
+
+// "<seconds since boot> <level letter> <message>\n"
+void logWrite(uint8_t level, const char* fmt, ...) {
+  char line[LOG_LINE_MAX];
+  uint32_t ms = millis();
+  int prefix = snprintf(line, sizeof(line), "%lu.%03lu %c ", (unsigned long)(ms / 1000), (unsigned long)(ms % 1000),
+                        LEVEL_LETTERS[level <= LOG_LEVEL_DEBUG ? level : 0]);
+  // One byte is kept for the newline.
+  size_t room = sizeof(line) - prefix - 1;
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(line + prefix, room, fmt, args);
+  va_end(args);
+  size_t len = prefix + (n < 0 ? 0 : ((size_t)n < room ? (size_t)n : room - 1));
+  line[len++] = '\n';
+  append(line, len);
+}
+
+void logService() {
+  uint32_t first = oldest();
+  if (uartPosition < first) {
+    dropped += first - uartPosition;
+    uartPosition = first;
+  }
+  size_t room = Serial.availableForWrite();
+  while (room > 0 && uartPosition != head) {
+    size_t n = contiguous(uartPosition, room);
+    Serial.write((const uint8_t*)buffer + uartPosition % LOG_BUFFER_SIZE, n);
+    uartPosition += n;
+    room -= n;
+  }
+}
+
+size_t logRead(uint32_t* position, char* out, size_t size) {
+  uint32_t first = oldest();
+  if (*position < first || *position > head) {
+    *position = first;
+    if (first > 0) {
+      // The oldest line has lost its start.
+      while (*position != head && buffer[(*position)++ % LOG_BUFFER_SIZE] != '\n') {
+      }
+    }
+  }
+  size_t copied = 0;
+  while (copied < size && *position != head) {
+    size_t n = contiguous(*position, size - copied);
+    memcpy(out + copied, buffer + *position % LOG_BUFFER_SIZE, n);
+    *position += n;
+    copied += n;
+  }
+  return copied;
+}
+
+uint32_t logPosition() {
+  return head;
+}
+
+uint32_t logDroppedBytes() {
+  return dropped;
+}
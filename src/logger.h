@@ -0,0 +1,60 @@
+#pragma once
+
+#include "hal.h"
+
+// Logging that never waits for the UART. LOG_*() formats the line into a
+// fixed ring buffer in RAM and returns; logService(), called from loop(),
+// hands the UART only as many bytes as its FIFO has room for. At 9600 baud
+// a println() that fills the FIFO used to stall the loop for ~1 ms per
+// byte. The buffer also keeps the latest lines for GET /log.
+//
+// Calls below CLOCK_LOG_LEVEL are compiled out, arguments included; build
+// with e.g. -DCLOCK_LOG_LEVEL=LOG_LEVEL_WARN. When the buffer is full the
+// oldest lines are overwritten; bytes the UART never got are counted.
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef CLOCK_LOG_LEVEL
+#define CLOCK_LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+const size_t LOG_BUFFER_SIZE = 2048;  // Power of two
+const size_t LOG_LINE_MAX = 160;      // Longer lines are cut
+
+// Prefer the LOG_*() macros.
+void logWrite(uint8_t level, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Sends buffered output to the UART without blocking.
+void logService();
+
+// Positions count the bytes logged since boot. Copies up to `size` bytes
+// from *position on and advances it; a position older than the buffer
+// moves to the oldest whole line. Returns the number of bytes copied.
+size_t logRead(uint32_t* position, char* out, size_t size);
+uint32_t logPosition();
+// Bytes overwritten before the UART had sent them.
+uint32_t logDroppedBytes();
+
+#if CLOCK_LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) logWrite(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do {} while (0)
+#endif
+#if CLOCK_LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) logWrite(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) do {} while (0)
+#endif
+#if CLOCK_LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) logWrite(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while (0)
+#endif
+#if CLOCK_LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) logWrite(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
@@ -1,14 +1,75 @@
 
-#include <Adafruit_NeoPixel.h>
-#include <ESP8266WiFi.h>
-#include <ESP8266WebServer.h>
-#include <WiFiManager.h>
-#include <time.h>
-#include <EEPROM.h>
+#include "hal.h"
+#include "clock_face.h"
+#include "compositor.h"
+#include "effect_vm.h"
+#include "event_stream.h"
+#include "gamma.h"
+#include "html_stream.h"
+#include "json.h"
+#include "logger.h"
+#include "metrics.h"
+#include "ntp_client.h"
+#include "phase_sync.h"
+#include "pixel_stream.h"
+#include "schedule.h"
+#include "settings_journal.h"
+#include "spsc_queue.h"
+#include "system_clock.h"
+#include "timezone.h"
+#include "tz_db.h"
+#include "warm_start.h"
+#include "web_assets.h"
+#include "wifi_link.h"
 
 #define PIN D1                 // Pin connected to WS2812 data pin
-#define NUM_LEDS 60            // Number of LEDs in the ring
+
+// LED_OUTPUT_DMA=1 (hal.h) sends frames by I2S DMA (halLedDmaShow())
+// instead of ring.show(), which keeps interrupts off for the whole frame.
+// The data line then has to be wired to RX (GPIO3) instead of PIN.
+
+// Rings on the LED strip, fixed at compile time so every ring gets its own
+// position tables. RING_LEDS is the first ring (12, 24, 60, 241, ...);
+// RING2_LEDS adds a second one chained after it on the same data line, e.g.
+// an inner ring of concentric rings. *_TOP_LED is the LED at 12 o'clock.
+// Set them with build_flags, e.g. -DRING_LEDS=24.
+#ifndef RING_LEDS
+#define RING_LEDS 60
+#endif
+#ifndef RING_TOP_LED
+#define RING_TOP_LED 0
+#endif
+#ifndef RING2_LEDS
+#define RING2_LEDS 0
+#endif
+#ifndef RING2_TOP_LED
+#define RING2_TOP_LED 0
+#endif
+#define NUM_LEDS (RING_LEDS + RING2_LEDS) // LEDs on the strip
+
+ClockFace<RING_LEDS, 0, RING_TOP_LED> ringFace;
+#if RING2_LEDS > 0
+ClockFace<RING2_LEDS, RING_LEDS, RING2_TOP_LED> ring2Face;
+#endif
+const ClockFaceRenderer* const CLOCK_FACES[] = {
+  &ringFace,
+#if RING2_LEDS > 0
+  &ring2Face,
+#endif
+};
+
 Adafruit_NeoPixel ring(NUM_LEDS, PIN, NEO_GRB + NEO_KHZ800);
+// Render target for the clock face and animations. It is never shown
+// directly: outputFrame() converts it into the ring's buffer.
+Adafruit_NeoPixel canvas(NUM_LEDS, -1, NEO_GRB + NEO_KHZ800);
+// The clock face is drawn into layers (markers, hour, minute, second)
+// that are composited into the canvas; see displayClock().
+const uint8_t CLOCK_LAYER_COUNT = 4;
+uint32_t clockLayers[CLOCK_LAYER_COUNT][NUM_LEDS];
+uint32_t composedFrame[NUM_LEDS];
+// Realtime DDP / E1.31 data from a lighting controller is read straight
+// into the canvas; while it streams, the clock and animations pause.
+PixelStream pixelStream(canvas.getPixels(), NUM_LEDS * 3);
 
 ESP8266WebServer server(80);
 WiFiManager wm;
@@ -16,24 +77,84 @@ WiFiManager wm;
 char ntpServer[64] = "pool.ntp.org";
 const char* NTP_SERVER_2 = "time.google.com";
 const char* NTP_SERVER_3 = "time.cloudflare.com";
-char tzInfo[64] = "CET-1CEST,M3.5.0/2,M10.5.0/3"; // Europe/Rome (DST automatic)
-const char* TZ_ROME = "CET-1CEST,M3.5.0/2,M10.5.0/3";
-const char* TZ_LONDON = "GMT0BST,M3.5.0/1,M10.5.0/2";
-const char* TZ_UTC = "UTC0";
-const char* TZ_NEWYORK = "EST5EDT,M3.2.0/2,M11.1.0/2";
-const char* TZ_LOSANGELES = "PST8PDT,M3.2.0/2,M11.1.0/2";
-const char* TZ_TOKYO = "JST-9";
-const char* TZ_SYDNEY = "AEST-10AEDT,M10.1.0/2,M4.1.0/3";
-const char* TZ_BERLIN = "CET-1CEST,M3.5.0,M10.5.0/3";
-const char* TZ_DUBAI = "GST-4";
-const char* TZ_KOLKATA = "IST-5:30";
-const char* TZ_SHANGHAI = "CST-8";
-const char* TZ_MOSCOW = "MSK-3";
-bool timeSynced = false;
-bool wifiConnectedHandled = false;
-unsigned long lastNtpRetryMs = 0;
+// Timezone: a zone of the IANA database in flash (tz_db.h) and its POSIX
+// rule, copied out when the zone is selected.
+const char* const DEFAULT_TZ_ZONE = "Europe/Rome";
+uint16_t tzZone = TZ_DB_NONE;
+char tzInfo[TZ_DB_RULE_MAX] = "UTC0";
+
+// The timezone presets of older builds, which stored the POSIX rule in the
+// settings; the JSON API also still accepts their short ids.
+struct LegacyTimezone {
+  const char* id;
+  const char* posix;
+  const char* zone;
+};
+const LegacyTimezone LEGACY_TIMEZONES[] = {
+  {"rome", "CET-1CEST,M3.5.0/2,M10.5.0/3", "Europe/Rome"},
+  {"london", "GMT0BST,M3.5.0/1,M10.5.0/2", "Europe/London"},
+  {"utc", "UTC0", "UTC"},
+  {"newyork", "EST5EDT,M3.2.0/2,M11.1.0/2", "America/New_York"},
+  {"losangeles", "PST8PDT,M3.2.0/2,M11.1.0/2", "America/Los_Angeles"},
+  {"tokyo", "JST-9", "Asia/Tokyo"},
+  {"sydney", "AEST-10AEDT,M10.1.0/2,M4.1.0/3", "Australia/Sydney"},
+  {"berlin", "CET-1CEST,M3.5.0,M10.5.0/3", "Europe/Berlin"},
+  {"dubai", "GST-4", "Asia/Dubai"},
+  {"kolkata", "IST-5:30", "Asia/Kolkata"},
+  {"shanghai", "CST-8", "Asia/Shanghai"},
+  {"moscow", "MSK-3", "Europe/Moscow"},
+};
+Timezone localZone; // Parsed form of tzInfo, see applyTimezone()
+// Alarms, chimes and night-mode brightness, in local time (schedule.h);
+// edited at /api/schedule and saved with the settings.
+Schedule schedule(localZone);
+SystemClock systemClock;
+NtpClient ntp(systemClock);
+PhaseSync phaseSync(systemClock); // Leader/follower beacons between clocks on the LAN
+// Joins and rejoins the saved network; while it is down the face keeps
+// running from the local clock.
+WifiLink wifiLink;
+
+// Boot: the animation plays while the station joins the saved network in
+// the background; if it has not joined after WIFI_JOIN_TIMEOUT_MS the
+// setup portal opens. After a warm reset the time comes back from RTC
+// memory and the face is shown straight away, without the animations,
+// until Wi-Fi is up and NTP takes over.
+const uint32_t WIFI_JOIN_TIMEOUT_MS = 20000;
+const uint32_t WARM_START_SAVE_MS = 1000;
+WarmStart warmStart;
+bool wifiJoining = false;
+uint32_t wifiJoinStartMs = 0;
+bool timeRestored = false;
+uint32_t lastWarmStartSaveMs = 0;
+uint32_t bootAnimationLastJob = 0; // Set while startup animations may still be waiting
+bool faceShown = false;
+uint32_t firstFaceMs = 0; // When the face was first drawn with a known time
 
 struct SavedSettings {
+  uint32_t magic;
+  uint32_t colorQuadrants;
+  uint32_t colorHourHand;
+  uint32_t colorMinuteHand;
+  uint32_t colorSecondHand;
+  uint8_t showQuadrants;
+  uint8_t quadrantMode;
+  uint8_t hourHandMode;
+  char ntpServer[64];
+  uint8_t handMotionMode;
+  uint8_t handBlend;
+  uint8_t syncRole;
+  uint16_t tzZone;     // Id in tz_db.h; ids move when the zone list is updated,
+  uint32_t tzZoneCrc;  // so the name's CRC identifies the zone
+  ScheduleEntry schedule[Schedule::MAX_ENTRIES];
+};
+
+const uint32_t SETTINGS_MAGIC = 0xC10C2032;
+static_assert(sizeof(SavedSettings) <= SettingsJournal::MAX_PAYLOAD, "settings do not fit a journal record");
+
+// Layout up to SETTINGS_MAGIC 0xC10C2031, with the POSIX rule itself in
+// tzInfo; records in it are converted on load.
+struct SavedSettingsV1 {
   uint32_t magic;
   uint32_t colorQuadrants;
   uint32_t colorHourHand;
@@ -44,31 +165,278 @@ struct SavedSettings {
   uint8_t hourHandMode;
   char ntpServer[64];
   char tzInfo[64];
+  uint8_t handMotionMode;
+  uint8_t handBlend;
+  uint8_t syncRole;
+};
+const uint32_t SETTINGS_MAGIC_V1 = 0xC10C2031;
+
+// Settings go to an append-only journal in two flash sectors, one of them
+// the sector the EEPROM emulation used. Saves from the web UI are coalesced: the record is
+// written once the settings have been quiet for SETTINGS_SAVE_DELAY_MS,
+// or at most SETTINGS_SAVE_MAX_DELAY_MS after the first change.
+SettingsJournal settingsJournal;
+
+// JSON API and Server-Sent Events (/api/events). Responses and events are
+// serialised into jsonBuffer; the web server and the event pump never run
+// at the same time, so one buffer serves both.
+const uint8_t SETTING_CHANGED_NTP = 0x01;
+const uint8_t SETTING_CHANGED_TZ = 0x02;
+const uint8_t SETTING_CHANGED_ANY = 0x80;
+// Settings requests apply the new values and return; the slower follow-up
+// work (timezone, NTP round, save, event push) runs once per loop for all
+// requests handled since, in serviceSettingsCommands().
+uint8_t pendingSettingChanges = 0;
+EventStream events;
+char jsonBuffer[768];
+SavedSettings publishedSettings; // Settings as last pushed to event clients
+time_t lastEventEpoch = 0;
+uint32_t publishedSyncCount = 0;
+bool publishedClockSet = false;
+const unsigned long SETTINGS_SAVE_DELAY_MS = 2000;
+const unsigned long SETTINGS_SAVE_MAX_DELAY_MS = 10000;
+bool settingsSavePending = false;
+unsigned long settingsFirstChangeMs = 0;
+unsigned long settingsLastChangeMs = 0;
+
+// Animations are effects (see effect_vm.h) played one frame at a time by
+// the frame scheduler: the built-in ones are in flash, ANIM_UPLOADED plays
+// one loaded from /effects/ on the filesystem.
+enum AnimationId : uint8_t {
+  ANIM_NONE = 0,
+  ANIM_ROTATING,
+  ANIM_PULSATING,
+  ANIM_PROGRESS,
+  ANIM_WIFI_SEARCHING,
+  ANIM_WIFI_CONNECTING,
+  ANIM_WIFI_CONNECTED,
+  ANIM_WIFI_FAILED,
+  ANIM_CHIME,
+  ANIM_ALARM,
+  ANIM_UPLOADED,
+  ANIM_COUNT
+};
+
+const uint8_t ANIMATION_QUEUE_SIZE = 4;
+const unsigned long FRAME_INTERVAL_US = 20000; // Scheduler tick (50 Hz, the smooth-hands frame rate)
+// The tick before a UTC second boundary is moved to SECOND_LEAD_US ahead
+// of it, and a tick that close to the boundary waits for it, so a new
+// second is drawn within render + show() time of the real one.
+const unsigned long SECOND_LEAD_US = 500;
+const unsigned long SECOND_SPIN_US = 1000;
+
+// Animation requests are jobs: the web handlers (and setup/Wi-Fi events)
+// push them, the frame scheduler pops one when the previous animation has
+// finished. A request for an animation that is already waiting returns
+// that job instead of queuing it twice. Jobs run in id order, so a job's
+// state follows from its id (see animationJobState()).
+struct AnimationJob {
+  uint32_t id;
+  AnimationId animation;
+};
+enum AnimationJobState : uint8_t {
+  JOB_UNKNOWN,
+  JOB_QUEUED,
+  JOB_RUNNING,
+  JOB_DONE
+};
+const char* const JOB_STATE_NAMES[] = {"unknown", "queued", "running", "done"};
+SpscQueue<AnimationJob, ANIMATION_QUEUE_SIZE> animationJobs;
+uint32_t lastAnimationJobId = 0;
+uint32_t currentAnimationJobId = 0;
+AnimationId currentAnimation = ANIM_NONE;
+uint32_t animationStep = 0;
+unsigned long animationNextFrameMs = 0;
+EffectPlayer effectPlayer;
+
+// The uploaded effect queued most recently; ANIM_UPLOADED plays this copy.
+const size_t EFFECT_NAME_MAX = 24;
+uint8_t queuedEffect[EffectPlayer::MAX_SIZE];
+size_t queuedEffectSize = 0;
+char queuedEffectName[EFFECT_NAME_MAX + 1];
+// POST /api/effects collects the uploaded file here.
+uint8_t uploadBuffer[EffectPlayer::MAX_SIZE];
+size_t uploadSize = 0;
+bool uploadTooLarge = false;
+char uploadName[EFFECT_NAME_MAX + 1];
+unsigned long nextFrameUs = 0;
+time_t lastClockEpoch = 0;
+bool clockNeedsRedraw = true;
+bool secondPhasePending = false; // displayClock() drew the next second
+
+unsigned long loopLatencyMaxUs = 0;   // Worst loop iteration in current report window
+unsigned long loopLatencyWorstUs = 0; // Worst loop iteration since boot
+unsigned long lastLatencyReportMs = 0;
+const unsigned long LATENCY_REPORT_INTERVAL_MS = 10000;
+
+#if CLOCK_METRICS
+// Latency histograms for /metrics.
+LatencyHistogram loopHistogram;
+LatencyHistogram clockRenderHistogram; // displayClock() frames
+LatencyHistogram showHistogram;        // ring.show()
+LatencyHistogram httpHistogram;        // server.handleClient()
+LatencyHistogram ntpHistogram;         // ntp.service()
+LatencyHistogram secondPhaseHistogram; // UTC second boundary -> shown
+LatencyHistogram wifiReconnectHistogram(10); // Wi-Fi lost -> joined again, from 1 ms
+#endif
+
+// Shadow copy of the last frame sent to the LEDs. outputFrame() compares
+// the converted frame against it and skips show() when nothing changed,
+// since every show() blocks interrupts for ~30 us per LED.
+uint8_t shownPixels[NUM_LEDS * 3];
+bool shownPixelsValid = false;
+bool canvasDirty = false;
+const bool TEMPORAL_DITHERING = true;
+uint8_t ditherResidual[NUM_LEDS * 3];
+bool ditherPending = false; // Dithered output still changes every frame
+uint32_t framesRendered = 0;
+uint32_t framesPushed = 0;
+uint32_t framesSkipped = 0; // Output frames identical to what was shown
+const uint32_t SHOW_US_PER_FRAME = NUM_LEDS * 30;
+
+// Per-renderer frame cost, indexed by AnimationId (ANIM_NONE is the clock face).
+struct RenderStats {
+  uint32_t frames;
+  uint32_t totalUs;
+  uint32_t maxUs;
+  uint32_t allocations;
+};
+RenderStats renderStats[ANIM_COUNT];
+const char* const RENDERER_NAMES[ANIM_COUNT] = {
+  "clock", "rotating", "pulsating", "progress",
+  "wifiSearching", "wifiConnecting", "wifiConnected", "wifiFailed", "chime", "alarm", "uploaded"
+};
+
+// Built-in effects, in flash; the instructions are described in
+// effect_vm.h. Uploaded effects are assembled by tools/fxasm.py instead.
+
+// One blue LED going round: index step eq 255 mul -> blue
+const uint8_t FX_ROTATING[] PROGMEM = {
+  FX_HEADER(EFFECT_FLAG_FRAMES_PER_LED, 50, 1),
+  FX_PUSH(0), FX_PUSH(0), OP_INDEX, OP_STEP, OP_EQ, FX_PUSH(255), OP_MUL, OP_RGB
+};
+// Blue ramping up and down by 5 per frame: min(5 step, 515 - 5 step)
+const uint8_t FX_PULSATING[] PROGMEM = {
+  FX_HEADER(0, 20, 104),
+  FX_PUSH(0), FX_PUSH(0), OP_STEP, FX_PUSH(5), OP_MUL, OP_DUP, FX_PUSH(515), OP_SWAP, OP_SUB, OP_MIN, OP_RGB
+};
+// Green bar growing by one LED per frame; the other LEDs are left alone.
+const uint8_t FX_PROGRESS[] PROGMEM = {
+  FX_HEADER(EFFECT_FLAG_FRAMES_PER_LED, 50, 1),
+  OP_INDEX, OP_STEP, OP_EQ, OP_JZ, 10, FX_PUSH(0), FX_PUSH(255), FX_PUSH(0), OP_RGB, OP_END
+};
+const uint8_t FX_WIFI_SEARCHING[] PROGMEM = {
+  FX_HEADER(EFFECT_FLAG_FRAMES_PER_LED, 100, 1),
+  FX_PUSH(0), FX_PUSH(0), OP_INDEX, OP_STEP, OP_EQ, FX_PUSH(255), OP_MUL, OP_RGB
+};
+// Cyan sine wave: 127 (sin(0.2 index rad) + 1); 2086 is 0.2 / 2 pi in Q16.16
+const uint8_t FX_WIFI_CONNECTING[] PROGMEM = {
+  FX_HEADER(0, 100, 20),
+  FX_PUSH(0), OP_INDEX, FX_PUSHF(2086), OP_MUL, OP_SIN, FX_PUSH(1), OP_ADD, FX_PUSH(127), OP_MUL, OP_DUP, OP_RGB
+};
+// Three green flashes: (step % 2 == 0) * 255
+const uint8_t FX_WIFI_CONNECTED[] PROGMEM = {
+  FX_HEADER(0, 200, 6),
+  FX_PUSH(0), OP_STEP, FX_PUSH(2), OP_MOD, FX_PUSH(0), OP_EQ, FX_PUSH(255), OP_MUL, FX_PUSH(0), OP_RGB
+};
+const uint8_t FX_WIFI_FAILED[] PROGMEM = {
+  FX_HEADER(0, 200, 6),
+  OP_STEP, FX_PUSH(2), OP_MOD, FX_PUSH(0), OP_EQ, FX_PUSH(255), OP_MUL, FX_PUSH(0), FX_PUSH(0), OP_RGB
+};
+// White flash fading out in half a second: 255 - 20 step
+const uint8_t FX_CHIME[] PROGMEM = {
+  FX_HEADER(0, 40, 13),
+  OP_STEP, FX_PUSH(20), OP_MUL, FX_PUSH(255), OP_SWAP, OP_SUB, OP_DUP, OP_DUP, OP_RGB
+};
+// Orange flashes for 30 s: r = (step % 2 == 0) * 255, g = r / 3
+const uint8_t FX_ALARM[] PROGMEM = {
+  FX_HEADER(0, 250, 120),
+  OP_STEP, FX_PUSH(2), OP_MOD, FX_PUSH(0), OP_EQ, FX_PUSH(255), OP_MUL, OP_DUP, FX_PUSH(3), OP_DIV, FX_PUSH(0), OP_RGB
 };
 
-const uint32_t SETTINGS_MAGIC = 0xC10C2031;
-const int EEPROM_SIZE = 512;
+struct BuiltinEffect {
+  const uint8_t* program;  // PROGMEM
+  uint8_t size;
+  const char* label;
+};
+// Indexed by AnimationId; the name is RENDERER_NAMES[id].
+const BuiltinEffect BUILTIN_EFFECTS[ANIM_COUNT] = {
+  {nullptr, 0, nullptr},
+  {FX_ROTATING, sizeof(FX_ROTATING), "Rotating Ring"},
+  {FX_PULSATING, sizeof(FX_PULSATING), "Pulsating Glow"},
+  {FX_PROGRESS, sizeof(FX_PROGRESS), "Progress Bar"},
+  {FX_WIFI_SEARCHING, sizeof(FX_WIFI_SEARCHING), "WiFi Searching"},
+  {FX_WIFI_CONNECTING, sizeof(FX_WIFI_CONNECTING), "WiFi Connecting"},
+  {FX_WIFI_CONNECTED, sizeof(FX_WIFI_CONNECTED), "WiFi Connected"},
+  {FX_WIFI_FAILED, sizeof(FX_WIFI_FAILED), "WiFi Failed"},
+  {FX_CHIME, sizeof(FX_CHIME), "Chime"},
+  {FX_ALARM, sizeof(FX_ALARM), "Alarm"},
+  {nullptr, 0, nullptr},
+};
 
 // Forward declarations
-void rotatingRingAnimation();
-void pulsatingGlowAnimation();
-void progressBarAnimation();
-void wifiSearchingAnimation();
-void wifiConnectingAnimation();
-void wifiConnectedAnimation();
-void wifiFailedAnimation();
-void displayClock();
+uint32_t queueAnimation(AnimationId id);
+AnimationJobState animationJobState(uint32_t job);
+void publishJobState(uint32_t job, AnimationJobState state);
+bool animationActive();
+bool serviceAnimation();
+void serviceFrame();
+void alignFrameToSecond();
+void serviceSchedule();
+void fireScheduledEvent(uint8_t slot, const ScheduleEntry& entry, void* context);
+void servicePixelStream();
+void recordRenderStats(uint8_t renderer, unsigned long startUs, uint32_t startAllocations);
+void reportRenderStats();
+void trackLoopLatency(unsigned long loopStartUs);
+void pushFrame();
+bool outputFrame();
+bool showFrame();
+bool displayClock();
+bool clockFaceAvailable();
+void wifiJoined();
+void serviceWifiJoin();
+void serviceWarmStart();
+void endBootAnimation();
 void handleRoot();
 void handleUpdate();
 void handleTestAnimation();
+bool effectPath(const char* name, char* path, size_t size);
+uint32_t queueNamedAnimation(const char* name, bool* busy);
+uint32_t queueUploadedEffect(const char* name, bool* busy);
+void sendJson(int code, const JsonWriter& json);
+void handleApiAnimations();
+void handleApiJobs();
+void handleApiEffects();
+void handleApiEffectUpload();
+void handleApiEffectUploadData();
+void handleApiEffectDelete();
 void applyTimezone();
-int wrapLedIndex(int index);
-uint32_t hexToColor(String hex);
-String colorToHex(uint32_t color);
-uint32_t applyGammaCorrection(uint32_t color);
-bool syncTimeWithNTP();
+void selectTimezone(uint16_t zone);
+void handleApiTimezones();
+void handleApiSchedule();
+void handleApiSchedulePut();
+void handleApiScheduleDelete();
+bool parseHexColor(const char* hex, uint32_t* color);
+void formatHexColor(uint32_t color, char* hex);
+bool applySetting(const char* key, const char* value, uint8_t* changes);
+void settingsUpdated(uint8_t changes);
+void handleApiSettings();
+void handleApiSettingsPatch();
+void handleApiStatus();
+void handleApiEvents();
+void handleMetrics();
+void handleLog();
+const WebAsset* findWebAsset(const char* name);
+void sendWebAsset(const WebAsset& asset);
+void serviceEvents();
+void publishSettings();
+void serviceTimeSync();
 void loadSettings();
 void saveSettings();
+void requestSettingsSave();
+void serviceSettingsSave();
+void serviceSettingsCommands();
+void packSettings(SavedSettings& s);
 
 // Default settings
 uint32_t colorQuadrants = ring.Color(255, 255, 255);   // Hour markers
@@ -78,460 +446,1678 @@ uint32_t colorSecondHand = ring.Color(0, 0, 255);      // Second hand
 bool showQuadrants = true;
 uint8_t quadrantMode = 12; // Allowed values: 4 or 12
 uint8_t hourHandMode = 0;  // 0 = step (hour only), 1 = continuous (hour+minute)
-// Keep brightness fixed at 255 to avoid user-side dimming artifacts and ensure
-// clear hand visibility in all overlap cases (hour/minute/second).
-const uint8_t BRIGHTNESS_FIXED = 255;
+uint8_t handMotionMode = 0; // 0 = tick (whole seconds), 1 = smooth (sub-second, anti-aliased)
+BlendMode handBlend = BLEND_OVER; // How each hand is blended onto the ones below it
+// Brightness is full (255) unless a schedule entry dims it, see serviceSchedule().
+uint8_t outputBrightness = Schedule::DEFAULT_BRIGHTNESS;
 
 void setup() {
   Serial.begin(9600);
-  applyTimezone();
 
-  EEPROM.begin(EEPROM_SIZE);
   loadSettings();
+  applyTimezone();
+  if (!halFsBegin()) {
+    LOG_WARN("Filesystem unavailable: uploaded effects disabled");
+  }
+  packSettings(publishedSettings);
+
+  int64_t rtcUs;
+  if (halReadRtc(&rtcUs)) {
+    systemClock.step(rtcUs);
+  } else if (warmStart.restore(&rtcUs)) {
+    systemClock.step(rtcUs);
+    timeRestored = true;
+    LOG_INFO("Warm reset: time restored, %lu ms since the last save", (unsigned long)warmStart.downtimeMs());
+  }
+  ntp.setServers(ntpServer, NTP_SERVER_2, NTP_SERVER_3);
 
   // Initialize NeoPixel Ring
+#if LED_OUTPUT_DMA
+  if (!halLedDmaBegin(sizeof(shownPixels))) {
+    LOG_ERROR("LED DMA buffers could not be allocated");
+  }
+#else
   ring.begin();
-  ring.setBrightness(BRIGHTNESS_FIXED);
-  ring.show();
+#endif
+  showFrame();
 
 
-  // Play startup animations
-  rotatingRingAnimation();
-  pulsatingGlowAnimation();
-  progressBarAnimation();
+  // Startup animations; loop() plays them while Wi-Fi joins.
+  if (!timeRestored) {
+    queueAnimation(ANIM_ROTATING);
+    queueAnimation(ANIM_PULSATING);
+    bootAnimationLastJob = queueAnimation(ANIM_PROGRESS);
+  }
   // Wi-Fi setup with captive portal (no hardcoded SSID/password)
   // Non-blocking mode keeps LED animations alive while portal is active.
   wm.setConfigPortalBlocking(false);
   wm.setConfigPortalTimeout(120); // Timeout after 3 minutes if not configured
 
-  Serial.println("Starting Wi-Fi auto connect...");
-  bool connected = wm.autoConnect("Clock-Setup");
-  if (connected) {
-    Serial.println("Wi-Fi connected");
-    Serial.print("IP Address: ");
-    Serial.println(WiFi.localIP());
-    wifiConnectedAnimation();
-    timeSynced = syncTimeWithNTP();
-    wifiConnectedHandled = true;
+  if (wm.getWiFiIsSaved()) {
+    // autoConnect() would wait here for the join; wifiLink does not.
+    LOG_INFO("Joining saved Wi-Fi...");
+    wifiLink.begin(millis());
+    wifiJoining = true;
+    wifiJoinStartMs = millis();
   } else {
-    Serial.println("Starting Web Portal (non-blocking)");
+    LOG_INFO("Starting Web Portal (non-blocking)");
+    wm.autoConnect("Clock-Setup");
   }
 
   // Setup web server routes
   server.on("/", handleRoot);
   server.on("/update", handleUpdate);
   server.on("/testAnimation", handleTestAnimation);
+  server.on("/api/settings", HTTP_GET, handleApiSettings);
+  server.on("/api/settings", HTTP_PATCH, handleApiSettingsPatch);
+  server.on("/api/status", HTTP_GET, handleApiStatus);
+  server.on("/api/events", HTTP_GET, handleApiEvents);
+  server.on("/api/animations", HTTP_POST, handleApiAnimations);
+  server.on("/api/jobs", HTTP_GET, handleApiJobs);
+  server.on("/api/timezones", HTTP_GET, handleApiTimezones);
+  server.on("/api/schedule", HTTP_GET, handleApiSchedule);
+  server.on("/api/schedule", HTTP_PUT, handleApiSchedulePut);
+  server.on("/api/schedule", HTTP_DELETE, handleApiScheduleDelete);
+  server.on("/api/effects", HTTP_GET, handleApiEffects);
+  server.on("/api/effects", HTTP_POST, handleApiEffectUpload, handleApiEffectUploadData);
+  server.on("/api/effects", HTTP_DELETE, handleApiEffectDelete);
+  server.on("/log", HTTP_GET, handleLog);
+#if CLOCK_METRICS
+  server.on("/metrics", HTTP_GET, handleMetrics);
+#endif
+  for (size_t i = 0; i < WEB_ASSET_COUNT; i++) {
+    const WebAsset& asset = WEB_ASSETS[i];
+    server.on(asset.url, HTTP_GET, [&asset]() { sendWebAsset(asset); });
+  }
+  static const char* const COLLECTED_HEADERS[] = {"If-None-Match"};
+  server.collectHeaders((const char**)COLLECTED_HEADERS, 1);
   server.begin();
-  Serial.println("Web server started");
+  LOG_INFO("Web server started");
 }
 
 void loop() {
+  unsigned long loopStartUs = micros();
   wm.process();
 
-  if (WiFi.status() == WL_CONNECTED) {
-    if (!wifiConnectedHandled) {
-      Serial.println("Wi-Fi connected");
-      Serial.print("IP Address: ");
-      Serial.println(WiFi.localIP());
-      wifiConnectedAnimation();
-      timeSynced = syncTimeWithNTP();
-      wifiConnectedHandled = true;
+  WifiLinkEvent linkEvent = wifiLink.service(millis());
+  if (linkEvent == WIFI_LINK_CONNECTED) {
+    wifiJoined();
+  } else if (linkEvent == WIFI_LINK_LOST) {
+    LOG_WARN("Wi-Fi lost, reconnecting");
+  }
+  if (wifiLink.connected()) {
+    serviceTimeSync();
+    if (bootAnimationLastJob != 0 && (ntp.synced() || phaseSync.following())) {
+      endBootAnimation();
     }
+  } else {
+    serviceWifiJoin();
+    if (!animationActive() && !clockFaceAvailable()) {
+      queueAnimation(ANIM_WIFI_SEARCHING);
+    }
+  }
+  serviceWarmStart();
+
+  servicePixelStream();
+  serviceFrame();
+  {
+    METRICS_TIME_SCOPE(httpHistogram);
+    server.handleClient();
+  }
+  serviceSettingsCommands();
+  serviceEvents();
+  serviceSettingsSave();
+  logService();
+  trackLoopLatency(loopStartUs);
+}
+
+// Called once per loop; renders at most one frame per scheduler tick and
+// never waits longer than SECOND_SPIN_US, so the web server and Wi-Fi
+// manager are serviced every loop.
+void serviceFrame() {
+  unsigned long nowUs = micros();
+  if ((long)(nowUs - nextFrameUs) < 0) {
+    return;
+  }
+  nextFrameUs += FRAME_INTERVAL_US;
+  if ((long)(nowUs - nextFrameUs) >= 0) {
+    nextFrameUs = nowUs + FRAME_INTERVAL_US; // Fell behind: resync instead of bursting
+  }
+  serviceSchedule();
+  if (!pixelStream.active() && !animationActive() && clockFaceAvailable()) {
+    alignFrameToSecond();
+    nowUs = micros();
+  }
 
-    if (!timeSynced && (millis() - lastNtpRetryMs > 30000UL)) {
-      lastNtpRetryMs = millis();
-      timeSynced = syncTimeWithNTP();
+  uint32_t startAllocations = halAllocationCount();
+  if (pixelStream.active()) {
+    // Frames arrive from the network; only dithering refreshes remain.
+  } else if (animationActive()) {
+    if (serviceAnimation()) {
+      recordRenderStats(currentAnimation, nowUs, startAllocations);
     }
+  } else if (clockFaceAvailable()) {
+    if (displayClock()) {
+      recordRenderStats(ANIM_NONE, nowUs, startAllocations);
+    }
+  }
+  outputFrame();
+  if (secondPhasePending) {
+    secondPhasePending = false;
+    METRICS_RECORD(secondPhaseHistogram, (uint32_t)(systemClock.nowUs() % 1000000));
+  }
+}
 
-    displayClock();
-  } else {
-    wifiSearchingAnimation();
+// The face is shown once Wi-Fi is up (the time follows from NTP), or
+// whenever the clock has a time: restored after a warm reset, or kept
+// running while Wi-Fi reconnects.
+bool clockFaceAvailable() {
+  return wifiLink.connected() || systemClock.isSet();
+}
+
+// Runs on every join, the first one and each reconnect. The animation
+// only plays if the face was not already showing the time.
+void wifiJoined() {
+  [[maybe_unused]] IPAddress ip = WiFi.localIP();
+  LOG_INFO("Wi-Fi connected in %lu ms (%s), IP address %u.%u.%u.%u", (unsigned long)wifiLink.lastJoinMs(),
+           wifiLink.lastJoinDirect() ? "cached access point" : "scan", ip[0], ip[1], ip[2], ip[3]);
+  if (wifiLink.losses() > 0) {
+    METRICS_RECORD(wifiReconnectHistogram, wifiLink.lastJoinMs() < UINT32_MAX / 1000 ? wifiLink.lastJoinMs() * 1000
+                                                                                      : UINT32_MAX);
+  }
+  if (!timeRestored && !faceShown) {
+    queueAnimation(ANIM_WIFI_CONNECTED);
+  }
+  ntp.requestSync();
+  wifiJoining = false;
+  timeRestored = false;
+}
+
+// Opens the setup portal if the saved network has not been joined in time.
+// wifiLink keeps trying meanwhile, so a late join still goes through.
+void serviceWifiJoin() {
+  if (wifiJoining && millis() - wifiJoinStartMs >= WIFI_JOIN_TIMEOUT_MS) {
+    wifiJoining = false;
+    LOG_WARN("Saved Wi-Fi not joined, starting Web Portal (non-blocking)");
+    wm.startConfigPortal("Clock-Setup");
   }
+}
 
-  server.handleClient();
+// Once the time is known the rest of the startup animation is skipped: the
+// animation on the ring finishes, the ones still waiting are dropped.
+void endBootAnimation() {
+  AnimationJob job;
+  while (animationJobs.size() > 0 && animationJobs.peek(0).id <= bootAnimationLastJob && animationJobs.pop(&job)) {
+    publishJobState(job.id, JOB_DONE);
+  }
+  bootAnimationLastJob = 0;
 }
 
-void displayClock() {
-  applyTimezone();
-  ring.clear();
+// Keeps the time in RTC memory for the next warm reset.
+void serviceWarmStart() {
+  if (!systemClock.isSet() || millis() - lastWarmStartSaveMs < WARM_START_SAVE_MS) {
+    return;
+  }
+  lastWarmStartSaveMs = millis();
+  warmStart.save(systemClock.nowUs());
+}
 
-  time_t nowEpoch = time(nullptr);
-  if (nowEpoch < 100000) {
-    ring.show();
-    delay(1000);
+// Fires the schedule entries that are due; one comparison per frame
+// otherwise. A brightness change is sent out with the next frame.
+void serviceSchedule() {
+  if (!systemClock.isSet()) {
     return;
   }
+  schedule.service(systemClock.nowUs() / 1000000, fireScheduledEvent, nullptr);
+  if (schedule.brightness() != outputBrightness) {
+    outputBrightness = schedule.brightness();
+    canvasDirty = true;
+  }
+}
 
-  struct tm now;
-  localtime_r(&nowEpoch, &now);
+void fireScheduledEvent([[maybe_unused]] uint8_t slot, const ScheduleEntry& entry, void*) {
+  LOG_INFO("Schedule %u: %s", slot, SCHEDULE_ACTION_NAMES[entry.action]);
+  // Chimes are skipped while a controller streams to the ring; an alarm
+  // waits for the stream to end.
+  if (entry.action == SCHEDULE_ALARM) {
+    queueAnimation(ANIM_ALARM);
+  } else if (entry.action == SCHEDULE_CHIME && !pixelStream.active()) {
+    queueAnimation(ANIM_CHIME);
+  }
+}
 
-  // Mark the hour positions
-  if (showQuadrants) {
-    int markerCount = (quadrantMode == 4) ? 4 : 12;
-    for (int i = 0; i < markerCount; i++) {
-      int pos = wrapLedIndex((i * NUM_LEDS) / markerCount);
-      ring.setPixelColor(pos, applyGammaCorrection(colorQuadrants));
+// Phase-locks the clock's ticks to the UTC second rather than to boot
+// time. Within SECOND_SPIN_US of a boundary this tick waits for it (and
+// the ticks after it follow from there); otherwise, if the boundary comes
+// before the next tick, that tick is brought forward to just before it.
+void alignFrameToSecond() {
+  if (!systemClock.isSet()) {
+    return;
+  }
+  int64_t utcUs = systemClock.nowUs();
+  unsigned long untilSecondUs = 1000000 - (unsigned long)(utcUs % 1000000);
+  if (untilSecondUs <= SECOND_SPIN_US) {
+    // Bounded in case NTP steps the clock back meanwhile.
+    int64_t second = utcUs / 1000000;
+    unsigned long spinStartUs = micros();
+    while (systemClock.nowUs() / 1000000 == second && micros() - spinStartUs < SECOND_SPIN_US) {
     }
+    nextFrameUs = micros() + FRAME_INTERVAL_US;
+  } else if (untilSecondUs < FRAME_INTERVAL_US + SECOND_LEAD_US) {
+    nextFrameUs = micros() + untilSecondUs - SECOND_LEAD_US;
   }
+}
 
-  // Calculate positions
-  int secondPos = wrapLedIndex((now.tm_sec % 60) * NUM_LEDS / 60);
-  int minutePos = wrapLedIndex((now.tm_min % 60) * NUM_LEDS / 60);
-  int hourPos;
-  if (hourHandMode == 1) {
-    int hourTicks = (now.tm_hour % 12) * 60 + now.tm_min; // 0..719
-    hourPos = wrapLedIndex((hourTicks * NUM_LEDS) / 720);
-  } else {
-    hourPos = wrapLedIndex(((now.tm_hour % 12) * NUM_LEDS) / 12);
+// Reads DDP / E1.31 packets into the canvas and shows a complete frame at
+// once, rather than on the next scheduler tick. The first packet starts
+// streaming mode; PixelStream::TIMEOUT_MS without one returns to the clock.
+void servicePixelStream() {
+  if (!wifiLink.connected()) {
+    return;
+  }
+  bool wasActive = pixelStream.active();
+  if (pixelStream.service(millis())) {
+    pushFrame();
+    outputFrame();
+  }
+  if (pixelStream.active() != wasActive) {
+    LOG_INFO("%s", wasActive ? "Pixel stream ended, showing the clock" : "Pixel stream started");
+    clockNeedsRedraw = true;
   }
+}
+
+// Marks the canvas as holding a finished frame for outputFrame().
+void pushFrame() {
+  framesRendered++;
+  canvasDirty = true;
+}
 
-  // Set hands (draw order matters on overlap)
-  ring.setPixelColor(wrapLedIndex(hourPos - 1), applyGammaCorrection(colorHourHand));
-  ring.setPixelColor(hourPos, applyGammaCorrection(colorHourHand));
-  ring.setPixelColor(wrapLedIndex(hourPos + 1), applyGammaCorrection(colorHourHand));
-  ring.setPixelColor(minutePos, applyGammaCorrection(colorMinuteHand));
-  ring.setPixelColor(secondPos, applyGammaCorrection(colorSecondHand));
+// Converts the canvas into LED values (gamma, colour correction,
+// scheduled brightness, temporal dithering) and sends them to the ring only if they
+// differ from what it already displays. Runs once per tick; while dim
+// channels are being dithered it refreshes even if the canvas is unchanged.
+// Returns true when show() was issued.
+bool outputFrame() {
+  if (!canvasDirty && !ditherPending) {
+    return false;
+  }
+  canvasDirty = false;
+  uint8_t* pixels = ring.getPixels();
+  ditherPending = gammaCorrectFrame(canvas.getPixels(), pixels, ditherResidual, sizeof(shownPixels),
+                                    outputBrightness, TEMPORAL_DITHERING);
+  if (shownPixelsValid && memcmp(pixels, shownPixels, sizeof(shownPixels)) == 0) {
+    framesSkipped++;
+    return false;
+  }
+  {
+    METRICS_TIME_SCOPE(showHistogram);
+    if (!showFrame()) {
+      canvasDirty = true; // DMA still busy with the last frame: retry next tick
+      return false;
+    }
+  }
+  memcpy(shownPixels, pixels, sizeof(shownPixels));
+  shownPixelsValid = true;
+  framesPushed++;
+  return true;
+}
 
+// Sends ring's pixel buffer to the LEDs through the configured output.
+bool showFrame() {
+#if LED_OUTPUT_DMA
+  return halLedDmaShow(ring.getPixels());
+#else
   ring.show();
-  delay(1000); // Update every second
+  return true;
+#endif
 }
 
-void handleRoot() {
-  applyTimezone();
-  time_t nowEpoch = time(nullptr);
-  struct tm now;
-  localtime_r(&nowEpoch, &now);
-
-  String html = "<!doctype html><html><head><meta name='viewport' content='width=device-width,initial-scale=1'>";
-  html += "<style>body{font-family:Arial,sans-serif;background:#0f172a;color:#e2e8f0;margin:0;padding:16px;}";
-  html += ".card{max-width:720px;margin:0 auto;background:#111827;border:1px solid #334155;border-radius:12px;padding:18px;}";
-  html += "h1{margin:0 0 8px 0;font-size:22px;}h2{margin:20px 0 10px 0;font-size:16px;color:#93c5fd;}";
-  html += ".grid{display:grid;grid-template-columns:1fr 1fr;gap:12px;}@media(max-width:680px){.grid{grid-template-columns:1fr;}}";
-  html += "label{font-size:13px;color:#cbd5e1;display:block;margin-bottom:6px;}";
-  html += "input[type='color'],input[type='number'],input[type='text']{width:100%;height:40px;border-radius:8px;border:1px solid #475569;background:#0b1220;color:#e2e8f0;padding:0 10px;box-sizing:border-box;}";
-  html += ".row{margin-bottom:12px;} .check{display:flex;align-items:center;gap:8px;margin:12px 0;}";
-  html += "button{background:#2563eb;color:white;border:none;border-radius:8px;padding:10px 14px;font-weight:600;cursor:pointer;}";
-  html += "small{color:#94a3b8;} .status{margin:8px 0 14px 0;padding:10px;border-radius:8px;background:#0b1220;border:1px solid #334155;}";
-  html += "</style></head><body><div class='card'>";
-  html += "<h1>WS2812 LED Ring Clock</h1>";
-  html += "<div class='status'>";
-  if (nowEpoch < 100000) {
-    html += "Current Time: not synced (NTP)<br>";
-  } else {
-  html += "Current Time: " + String(now.tm_hour) + ":" + String(now.tm_min) + ":" + String(now.tm_sec) + "<br>";
-  }
-  html += "IP: " + WiFi.localIP().toString() + "<br>";
-  html += "NTP: " + String(ntpServer) + "<br>";
-  html += "TZ: " + String(tzInfo);
-  html += "</div>";
-
-  html += "<h2>Animation Test</h2>";
-  html += "<form action='/testAnimation' method='POST'>";
-  html += "<div class='row'><label>Select animation</label>";
-  html += "<select name='animation' style='width:100%;height:40px;border-radius:8px;border:1px solid #475569;background:#0b1220;color:#e2e8f0;padding:0 10px;box-sizing:border-box;'>";
-  html += "<option value='rotating'>Rotating Ring</option>";
-  html += "<option value='pulsating'>Pulsating Glow</option>";
-  html += "<option value='progress'>Progress Bar</option>";
-  html += "<option value='wifiSearching'>WiFi Searching</option>";
-  html += "<option value='wifiConnecting'>WiFi Connecting</option>";
-  html += "<option value='wifiConnected'>WiFi Connected</option>";
-  html += "<option value='wifiFailed'>WiFi Failed</option>";
-  html += "</select></div>";
-  html += "<button type='submit'>Run Animation</button>";
-  html += "</form>";
-
-  html += "<form action='/update' method='POST'>";
-  html += "<h2>LED Colors</h2><div class='grid'>";
-  html += "<div class='row'><label>Quadrants</label><input type='color' name='quadrantsColor' value='" + colorToHex(colorQuadrants) + "'></div>";
-  html += "<div class='row'><label>Hour Hand</label><input type='color' name='hourHandColor' value='" + colorToHex(colorHourHand) + "'></div>";
-  html += "<div class='row'><label>Minute Hand</label><input type='color' name='minuteHandColor' value='" + colorToHex(colorMinuteHand) + "'></div>";
-  html += "<div class='row'><label>Second Hand</label><input type='color' name='secondHandColor' value='" + colorToHex(colorSecondHand) + "'></div>";
-  html += "</div>";
-  html += "<h2>Display</h2>";
-  html += "<div class='row'><label>Quadrant Mode</label>";
-  html += "<select name='quadrantMode' style='width:100%;height:40px;border-radius:8px;border:1px solid #475569;background:#0b1220;color:#e2e8f0;padding:0 10px;box-sizing:border-box;'>";
-  html += "<option value='0'";
-  if (!showQuadrants) {
-    html += " selected";
-  }
-  html += ">Off</option>";
-  html += "<option value='4'";
-  if (showQuadrants && quadrantMode == 4) {
-    html += " selected";
-  }
-  html += ">4 quadrants</option>";
-  html += "<option value='12'";
-  if (showQuadrants && quadrantMode == 12) {
-    html += " selected";
-  }
-  html += ">12 quadrants</option>";
-  html += "</select></div>";
-  html += "<div class='row'><label>Hour Hand Mode</label>";
-  html += "<select name='hourHandMode' style='width:100%;height:40px;border-radius:8px;border:1px solid #475569;background:#0b1220;color:#e2e8f0;padding:0 10px;box-sizing:border-box;'>";
-  html += "<option value='0'";
-  if (hourHandMode == 0) {
-    html += " selected";
-  }
-  html += ">Step (hour only)</option>";
-  html += "<option value='1'";
-  if (hourHandMode == 1) {
-    html += " selected";
-  }
-  html += ">Continuous (hour + minute)</option>";
-  html += "</select></div>";
-  html += "<h2>Time Sync</h2>";
-  html += "<div class='row'><label>NTP Server</label><input type='text' name='ntpServer' maxlength='63' value='" + String(ntpServer) + "'></div>";
-  html += "<div class='row'><label>Timezone</label>";
-  html += "<select name='tzPreset' style='width:100%;height:40px;border-radius:8px;border:1px solid #475569;background:#0b1220;color:#e2e8f0;padding:0 10px;box-sizing:border-box;'>";
-  html += "<option value='rome'";
-  if (strcmp(tzInfo, TZ_ROME) == 0) {
-    html += " selected";
-  }
-  html += ">Europe/Rome</option>";
-  html += "<option value='london'";
-  if (strcmp(tzInfo, TZ_LONDON) == 0) {
-    html += " selected";
-  }
-  html += ">Europe/London</option>";
-  html += "<option value='utc'";
-  if (strcmp(tzInfo, TZ_UTC) == 0) {
-    html += " selected";
-  }
-  html += ">UTC</option>";
-  html += "<option value='newyork'";
-  if (strcmp(tzInfo, TZ_NEWYORK) == 0) {
-    html += " selected";
-  }
-  html += ">America/New_York</option>";
-  html += "<option value='losangeles'";
-  if (strcmp(tzInfo, TZ_LOSANGELES) == 0) {
-    html += " selected";
-  }
-  html += ">America/Los_Angeles</option>";
-  html += "<option value='tokyo'";
-  if (strcmp(tzInfo, TZ_TOKYO) == 0) {
-    html += " selected";
-  }
-  html += ">Asia/Tokyo</option>";
-  html += "<option value='sydney'";
-  if (strcmp(tzInfo, TZ_SYDNEY) == 0) {
-    html += " selected";
-  }
-  html += ">Australia/Sydney</option>";
-  html += "<option value='berlin'";
-  if (strcmp(tzInfo, TZ_BERLIN) == 0) {
-    html += " selected";
-  }
-  html += ">Europe/Berlin</option>";
-  html += "<option value='dubai'";
-  if (strcmp(tzInfo, TZ_DUBAI) == 0) {
-    html += " selected";
-  }
-  html += ">Asia/Dubai</option>";
-  html += "<option value='kolkata'";
-  if (strcmp(tzInfo, TZ_KOLKATA) == 0) {
-    html += " selected";
-  }
-  html += ">Asia/Kolkata</option>";
-  html += "<option value='shanghai'";
-  if (strcmp(tzInfo, TZ_SHANGHAI) == 0) {
-    html += " selected";
-  }
-  html += ">Asia/Shanghai</option>";
-  html += "<option value='moscow'";
-  if (strcmp(tzInfo, TZ_MOSCOW) == 0) {
-    html += " selected";
-  }
-  html += ">Europe/Moscow</option>";
-  html += "</select></div>";
-  html += "<small>Esempio: pool.ntp.org, time.google.com</small><br><br>";
-  html += "<button type='submit'>Save Settings</button>";
-  html += "</form>";
-  html += "</div></body></html>";
-
-  server.send(200, "text/html", html);
+void recordRenderStats(uint8_t renderer, unsigned long startUs, uint32_t startAllocations) {
+  uint32_t elapsedUs = micros() - startUs;
+  RenderStats& stats = renderStats[renderer];
+  stats.frames++;
+  stats.totalUs += elapsedUs;
+  stats.allocations += halAllocationCount() - startAllocations;
+  if (elapsedUs > stats.maxUs) {
+    stats.maxUs = elapsedUs;
+  }
+  if (renderer == ANIM_NONE) {
+    METRICS_RECORD(clockRenderHistogram, elapsedUs);
+  }
 }
 
-void handleUpdate() {
-  bool ntpServerChanged = false;
-  bool timezoneChanged = false;
+// Prints average ns/frame, worst frame (also as a share of the scheduler
+// tick, the budget a smooth-mode frame has) and allocations/frame for every
+// renderer that drew at least one frame, then starts a new window.
+void reportRenderStats() {
+  for (uint8_t i = 0; i < ANIM_COUNT; i++) {
+    RenderStats& stats = renderStats[i];
+    if (stats.frames == 0) {
+      continue;
+    }
+    LOG_INFO("Render %s: %lu frames, %lu ns/frame, max %lu us (%lu%% of frame budget), %lu.%02lu allocs/frame",
+             RENDERER_NAMES[i], (unsigned long)stats.frames,
+             (unsigned long)((uint64_t)stats.totalUs * 1000 / stats.frames), (unsigned long)stats.maxUs,
+             (unsigned long)(stats.maxUs * 100 / FRAME_INTERVAL_US),
+             (unsigned long)(stats.allocations / stats.frames),
+             (unsigned long)((stats.allocations * 100 / stats.frames) % 100));
+    stats = RenderStats();
+  }
+}
 
-  if (server.hasArg("quadrantsColor")) {
-    colorQuadrants = hexToColor(server.arg("quadrantsColor"));
+void trackLoopLatency(unsigned long loopStartUs) {
+  unsigned long loopUs = micros() - loopStartUs;
+  METRICS_RECORD(loopHistogram, loopUs);
+  if (loopUs > loopLatencyMaxUs) {
+    loopLatencyMaxUs = loopUs;
   }
-  if (server.hasArg("hourHandColor")) {
-    colorHourHand = hexToColor(server.arg("hourHandColor"));
+  if (loopUs > loopLatencyWorstUs) {
+    loopLatencyWorstUs = loopUs;
   }
-  if (server.hasArg("minuteHandColor")) {
-    colorMinuteHand = hexToColor(server.arg("minuteHandColor"));
+  if (millis() - lastLatencyReportMs >= LATENCY_REPORT_INTERVAL_MS) {
+    lastLatencyReportMs = millis();
+    LOG_INFO("Loop latency max: %lu us (worst since boot: %lu us)", loopLatencyMaxUs, loopLatencyWorstUs);
+    loopLatencyMaxUs = 0;
+    LOG_INFO("Frames: %lu rendered, %lu pushed (~%lu ms of show() skipped)",
+             (unsigned long)framesRendered, (unsigned long)framesPushed,
+             (unsigned long)((uint64_t)framesSkipped * SHOW_US_PER_FRAME / 1000));
+    reportRenderStats();
   }
-  if (server.hasArg("secondHandColor")) {
-    colorSecondHand = hexToColor(server.arg("secondHandColor"));
+}
+
+// In tick mode the face is redrawn only when the displayed second changes
+// (or a redraw was requested), so it is cheap to call on every scheduler
+// tick. Smooth mode redraws on every tick. Returns true when a frame was
+// drawn.
+bool displayClock() {
+  struct timeval tv;
+  systemClock.now(&tv);
+  time_t nowEpoch = tv.tv_sec;
+  if (handMotionMode == 0 && !clockNeedsRedraw && nowEpoch == lastClockEpoch) {
+    return false;
   }
-  ring.setBrightness(BRIGHTNESS_FIXED);
-  if (server.hasArg("quadrantMode")) {
-    int mode = server.arg("quadrantMode").toInt();
-    if (mode == 0) {
-      showQuadrants = false;
+  clockNeedsRedraw = false;
+  secondPhasePending = systemClock.isSet() && nowEpoch == lastClockEpoch + 1;
+  lastClockEpoch = nowEpoch;
+
+  canvas.clear();
+
+  if (!systemClock.isSet()) {
+    pushFrame();
+    return true;
+  }
+  if (!faceShown) {
+    faceShown = true;
+    firstFaceMs = millis();
+    LOG_INFO("Clock face shown %lu ms after boot", (unsigned long)firstFaceMs);
+  }
+
+  struct tm now;
+  localZone.localTime(nowEpoch, &now);
+  ClockFaceTime time = {
+    (uint8_t)(now.tm_hour >= 12 ? now.tm_hour - 12 : now.tm_hour),
+    (uint8_t)now.tm_min,
+    (uint8_t)now.tm_sec,
+    (uint32_t)tv.tv_usec,
+  };
+  ClockFaceStyle style = {
+    colorQuadrants, colorHourHand, colorMinuteHand, colorSecondHand,
+    (uint8_t)(showQuadrants ? (quadrantMode == 4 ? 4 : 12) : 0),
+    hourHandMode == 1,
+    handMotionMode == 1,
+  };
+  memset(clockLayers, 0, sizeof(clockLayers));
+  ClockFaceLayers layers = {clockLayers[0], clockLayers[1], clockLayers[2], clockLayers[3]};
+  for (const ClockFaceRenderer* face : CLOCK_FACES) {
+    face->draw(layers, time, style);
+  }
+  // Markers are opaque on black; the hands are stacked hour, minute,
+  // second, so with BLEND_OVER the second hand hides the others as before.
+  const Layer stack[CLOCK_LAYER_COUNT] = {
+    {clockLayers[0], BLEND_OVER},
+    {clockLayers[1], handBlend},
+    {clockLayers[2], handBlend},
+    {clockLayers[3], handBlend},
+  };
+  compositeLayers(stack, CLOCK_LAYER_COUNT, NUM_LEDS, composedFrame);
+  for (uint16_t i = 0; i < NUM_LEDS; i++) {
+    canvas.setPixelColor(i, composedFrame[i]);
+  }
+
+  pushFrame();
+  return true;
+}
+
+// Root page markup, kept in flash. {{key}} placeholders are filled in by
+// expandRootPage() while the page is streamed in HTML_CHUNK_SIZE chunks.
+static const char ROOT_PAGE_TEMPLATE[] PROGMEM =
+  "<!doctype html><html><head><meta name='viewport' content='width=device-width,initial-scale=1'>"
+  "<link rel='stylesheet' href='{{asset:style.css}}'>"
+  "<script src='{{asset:app.js}}' defer></script>"
+  "</head><body><div class='card'>"
+  "<h1>WS2812 LED Ring Clock</h1>"
+  "<div class='status'>"
+  "Current Time: <span id='time'>{{time}}</span><br>"
+  "IP: {{ip}}<br>"
+  "NTP: {{ntpServer}}<br>"
+  "Clock: <span id='clock'>{{clockStatus}}</span><br>"
+  "TZ: {{tzInfo}}<br>"
+  "Loop latency (worst): {{loopLatency}} us<br>"
+  "Frames rendered/pushed: {{framesRendered}} / {{framesPushed}}"
+  "</div>"
+  "<h2>Animation Test</h2>"
+  "<form action='/testAnimation' method='POST'>"
+  "<div class='row'><label>Select animation</label>"
+  "<select name='animation'>{{animationOptions}}</select></div>"
+  "<button type='submit'>Run Animation</button>"
+  "</form>"
+  "<form action='/update' method='POST'>"
+  "<h2>LED Colors</h2><div class='grid'>"
+  "<div class='row'><label>Quadrants</label><input type='color' name='quadrantsColor' value='{{colorQuadrants}}'></div>"
+  "<div class='row'><label>Hour Hand</label><input type='color' name='hourHandColor' value='{{colorHourHand}}'></div>"
+  "<div class='row'><label>Minute Hand</label><input type='color' name='minuteHandColor' value='{{colorMinuteHand}}'></div>"
+  "<div class='row'><label>Second Hand</label><input type='color' name='secondHandColor' value='{{colorSecondHand}}'></div>"
+  "</div>"
+  "<h2>Display</h2>"
+  "<div class='row'><label>Quadrant Mode</label>"
+  "<select name='quadrantMode'>{{quadrantModeOptions}}</select></div>"
+  "<div class='row'><label>Hour Hand Mode</label>"
+  "<select name='hourHandMode'>{{hourHandModeOptions}}</select></div>"
+  "<div class='row'><label>Hand Motion</label>"
+  "<select name='handMotionMode'>{{handMotionModeOptions}}</select></div>"
+  "<div class='row'><label>Overlapping Hands</label>"
+  "<select name='handBlend'>{{handBlendOptions}}</select></div>"
+  "<h2>Time Sync</h2>"
+  "<div class='row'><label>NTP Server</label><input type='text' name='ntpServer' maxlength='63' value='{{ntpServer}}'></div>"
+  "<div class='row'><label>Timezone</label>"
+  "<select name='tzPreset' id='tzPreset'>{{tzOptions}}</select></div>"
+  "<div class='row'><label>Sync With Other Clocks</label>"
+  "<select name='syncRole'>{{syncRoleOptions}}</select></div>"
+  "<small>Esempio: pool.ntp.org, time.google.com</small><br><br>"
+  "<button type='submit'>Save Settings</button>"
+  "</form>"
+  "</div></body></html>";
+
+void printOption(HtmlStream& out, const char* value, const char* label, bool selected) {
+  out.printf("<option value='%s'%s>", value, selected ? " selected" : "");
+  out.print(label);
+  out.print("</option>");
+}
+
+// Options for the uploaded effects, "<name>.fx" in /effects.
+void printEffectOption(const char* fileName, size_t, void* context) {
+  const char* dot = strrchr(fileName, '.');
+  char name[EFFECT_NAME_MAX + 1];
+  if (dot == nullptr || strcmp(dot, ".fx") != 0 || (size_t)(dot - fileName) > EFFECT_NAME_MAX) {
+    return;
+  }
+  memcpy(name, fileName, dot - fileName);
+  name[dot - fileName] = '\0';
+  printOption(*(HtmlStream*)context, name, name, false);
+}
+
+void expandRootPage(HtmlStream& out, const char* key) {
+  if (strncmp(key, "asset:", 6) == 0) {
+    const WebAsset* asset = findWebAsset(key + 6);
+    out.print(asset != nullptr ? asset->url : "");
+  } else if (strcmp(key, "time") == 0) {
+    if (!systemClock.isSet()) {
+      out.print("not synced (NTP)");
     } else {
-      showQuadrants = true;
-      quadrantMode = (mode == 4) ? 4 : 12;
+      struct timeval tv;
+      systemClock.now(&tv);
+      time_t nowEpoch = tv.tv_sec;
+      struct tm now;
+      localZone.localTime(nowEpoch, &now);
+      out.printf("%02d:%02d:%02d", now.tm_hour, now.tm_min, now.tm_sec);
+    }
+  } else if (strcmp(key, "ip") == 0) {
+    IPAddress ip = WiFi.localIP();
+    out.printf("%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+  } else if (strcmp(key, "ntpServer") == 0) {
+    out.printEscaped(ntpServer);
+  } else if (strcmp(key, "clockStatus") == 0) {
+    if (!ntp.synced()) {
+      out.print(systemClock.isSet() ? "free running (RTC), " : "not set, ");
+      out.print("waiting for NTP");
+    } else {
+      out.printEscaped(ntp.lastServer());
+      if (ntp.lastStepped()) {
+        out.print(", stepped");
+      } else {
+        out.printf(", offset %.1f ms", ntp.lastOffsetUs() / 1000.0);
+      }
+      out.printf(", delay %.1f ms, drift %.2f ppm", ntp.lastDelayUs() / 1000.0, systemClock.driftPpb() / 1000.0);
+      out.printf(", poll %lu s (next in %lu s)", (unsigned long)ntp.pollIntervalS(),
+                 (unsigned long)ntp.secondsUntilPoll());
+    }
+  } else if (strcmp(key, "tzInfo") == 0) {
+    out.printEscaped(tzInfo);
+  } else if (strcmp(key, "loopLatency") == 0) {
+    out.printf("%lu", loopLatencyWorstUs);
+  } else if (strcmp(key, "framesRendered") == 0) {
+    out.printf("%lu", (unsigned long)framesRendered);
+  } else if (strcmp(key, "framesPushed") == 0) {
+    out.printf("%lu", (unsigned long)framesPushed);
+  } else if (strcmp(key, "colorQuadrants") == 0) {
+    char hex[8];
+    formatHexColor(colorQuadrants, hex);
+    out.print(hex);
+  } else if (strcmp(key, "colorHourHand") == 0) {
+    char hex[8];
+    formatHexColor(colorHourHand, hex);
+    out.print(hex);
+  } else if (strcmp(key, "colorMinuteHand") == 0) {
+    char hex[8];
+    formatHexColor(colorMinuteHand, hex);
+    out.print(hex);
+  } else if (strcmp(key, "colorSecondHand") == 0) {
+    char hex[8];
+    formatHexColor(colorSecondHand, hex);
+    out.print(hex);
+  } else if (strcmp(key, "quadrantModeOptions") == 0) {
+    printOption(out, "0", "Off", !showQuadrants);
+    printOption(out, "4", "4 quadrants", showQuadrants && quadrantMode == 4);
+    printOption(out, "12", "12 quadrants", showQuadrants && quadrantMode == 12);
+  } else if (strcmp(key, "hourHandModeOptions") == 0) {
+    printOption(out, "0", "Step (hour only)", hourHandMode == 0);
+    printOption(out, "1", "Continuous (hour + minute)", hourHandMode == 1);
+  } else if (strcmp(key, "handMotionModeOptions") == 0) {
+    printOption(out, "0", "Tick (whole seconds)", handMotionMode == 0);
+    printOption(out, "1", "Smooth (sub-second)", handMotionMode == 1);
+  } else if (strcmp(key, "handBlendOptions") == 0) {
+    static const char* const LABELS[BLEND_MODE_COUNT] = {
+      "Top hand covers", "Add colours", "Brightest colour", "Screen (mix like light)"
+    };
+    for (uint8_t i = 0; i < BLEND_MODE_COUNT; i++) {
+      printOption(out, BLEND_MODE_NAMES[i], LABELS[i], handBlend == i);
+    }
+  } else if (strcmp(key, "syncRoleOptions") == 0) {
+    static const char* const LABELS[SYNC_ROLE_COUNT] = {
+      "Off (NTP only)", "Leader (sends its time)", "Follower (ticks with the leader)"
+    };
+    for (uint8_t i = 0; i < SYNC_ROLE_COUNT; i++) {
+      printOption(out, SYNC_ROLE_NAMES[i], LABELS[i], phaseSync.role() == i);
+    }
+  } else if (strcmp(key, "animationOptions") == 0) {
+    for (uint8_t i = 0; i < ANIM_COUNT; i++) {
+      if (BUILTIN_EFFECTS[i].program != nullptr) {
+        printOption(out, RENDERER_NAMES[i], BUILTIN_EFFECTS[i].label, false);
+      }
+    }
+    halFsList("/effects", printEffectOption, &out);
+  } else if (strcmp(key, "tzOptions") == 0) {
+    // Only the current zone; app.js adds the others from /api/timezones.
+    char name[TZ_DB_NAME_MAX];
+    if (tzDbName(tzZone, name)) {
+      printOption(out, name, name, true);
     }
   }
-  if (server.hasArg("hourHandMode")) {
-    int mode = server.arg("hourHandMode").toInt();
-    hourHandMode = (mode == 1) ? 1 : 0;
+}
+
+void handleRoot() {
+  HtmlStream out(server);
+  [[maybe_unused]] uint32_t heapBefore = halFreeHeap(); // Only for LOG_DEBUG
+  out.begin(200, "text/html");
+  out.printTemplate_P(ROOT_PAGE_TEMPLATE, expandRootPage);
+  out.end();
+
+  LOG_DEBUG("Served / (%u bytes): free heap %u, low-watermark %u",
+            (unsigned)out.bytesSent(), (unsigned)heapBefore, (unsigned)out.heapLowWatermark());
+}
+
+const WebAsset* findWebAsset(const char* name) {
+  for (size_t i = 0; i < WEB_ASSET_COUNT; i++) {
+    if (strcmp(WEB_ASSETS[i].name, name) == 0) {
+      return &WEB_ASSETS[i];
+    }
+  }
+  return nullptr;
+}
+
+// Assets are gzipped in flash and sent as they are; every browser asks for
+// gzip. Their URL changes with their content, so they are cached as
+// immutable, and a revalidation (a reload in some browsers) gets a 304.
+void sendWebAsset(const WebAsset& asset) {
+  server.sendHeader("Cache-Control", "public, max-age=31536000, immutable");
+  server.sendHeader("ETag", asset.etag);
+  String ifNoneMatch = server.header("If-None-Match");
+  if (strstr(ifNoneMatch.c_str(), asset.etag) != nullptr || ifNoneMatch == "*") {
+    server.send(304, asset.contentType, "");
+    return;
+  }
+  server.sendHeader("Content-Encoding", "gzip");
+  server.send_P(200, asset.contentType, (PGM_P)asset.data, asset.size);
+}
+
+// GET /api/timezones: every zone name, in order, as a JSON array streamed
+// out of flash. It only changes with the firmware, so it is revalidated
+// against the database's ETag rather than sent again.
+void handleApiTimezones() {
+  server.sendHeader("Cache-Control", "no-cache");
+  server.sendHeader("ETag", TZ_DB_VERSION);
+  if (strstr(server.header("If-None-Match").c_str(), TZ_DB_VERSION) != nullptr) {
+    server.send(304, "application/json", "");
+    return;
+  }
+  HtmlStream out(server);
+  out.begin(200, "application/json");
+  out.print("[");
+  tzDbForEach([](uint16_t id, const char* name, void* context) {
+    ((HtmlStream*)context)->printf(id == 0 ? "\"%s\"" : ",\"%s\"", name);
+  }, &out);
+  out.print("]");
+  out.end();
+}
+
+// Schedule entries over HTTP. "time" is "HH:MM" in local time, or "*:MM"
+// for every hour; "days" is "daily" or weekday names, e.g. "mon,tue".
+bool parseScheduleTime(const char* value, ScheduleEntry* entry) {
+  unsigned hour = SCHEDULE_EVERY_HOUR;
+  unsigned minute;
+  char end;
+  if (strncmp(value, "*:", 2) == 0 ? sscanf(value + 2, "%2u%c", &minute, &end) != 1
+                                   : sscanf(value, "%2u:%2u%c", &hour, &minute, &end) != 2) {
+    return false;
+  }
+  if (hour > 23 && hour != SCHEDULE_EVERY_HOUR) {
+    return false;
+  }
+  entry->hour = hour;
+  entry->minute = minute;
+  return minute <= 59;
+}
+
+bool parseScheduleDays(const char* value, uint8_t* days) {
+  if (strcmp(value, "daily") == 0) {
+    *days = SCHEDULE_EVERY_DAY;
+    return true;
+  }
+  *days = 0;
+  while (*value != '\0') {
+    uint8_t day = 0;
+    while (day < 7 && strncmp(value, SCHEDULE_DAY_NAMES[day], 3) != 0) {
+      day++;
+    }
+    if (day == 7 || (value[3] != ',' && value[3] != '\0')) {
+      return false;
+    }
+    *days |= 1 << day;
+    value += value[3] == ',' ? 4 : 3;
   }
-  if (server.hasArg("ntpServer")) {
-    String inputNtp = server.arg("ntpServer");
-    inputNtp.trim();
-    if (inputNtp.length() > 0 && inputNtp.length() < (int)sizeof(ntpServer)) {
-      if (strncmp(ntpServer, inputNtp.c_str(), sizeof(ntpServer) - 1) != 0) {
-        inputNtp.toCharArray(ntpServer, sizeof(ntpServer));
-        ntpServerChanged = true;
+  return *days != 0;
+}
+
+void writeScheduleEntryJson(JsonWriter& json, uint8_t slot, const ScheduleEntry& entry) {
+  char time[8];
+  if (entry.hour == SCHEDULE_EVERY_HOUR) {
+    snprintf(time, sizeof(time), "*:%02u", entry.minute);
+  } else {
+    snprintf(time, sizeof(time), "%02u:%02u", entry.hour, entry.minute);
+  }
+  char days[7 * 4] = "daily";
+  if (entry.days != SCHEDULE_EVERY_DAY) {
+    days[0] = '\0';
+    for (uint8_t day = 0; day < 7; day++) {
+      if (entry.days & (1 << day)) {
+        strcat(days, days[0] == '\0' ? "" : ",");
+        strcat(days, SCHEDULE_DAY_NAMES[day]);
       }
     }
   }
-  if (server.hasArg("tzPreset")) {
-    String tzPreset = server.arg("tzPreset");
-    const char* newTz = TZ_ROME;
-    if (tzPreset == "london") {
-      newTz = TZ_LONDON;
-    } else if (tzPreset == "utc") {
-      newTz = TZ_UTC;
-    } else if (tzPreset == "newyork") {
-      newTz = TZ_NEWYORK;
-    } else if (tzPreset == "losangeles") {
-      newTz = TZ_LOSANGELES;
-    } else if (tzPreset == "tokyo") {
-      newTz = TZ_TOKYO;
-    } else if (tzPreset == "sydney") {
-      newTz = TZ_SYDNEY;
-    } else if (tzPreset == "berlin") {
-      newTz = TZ_BERLIN;
-    } else if (tzPreset == "dubai") {
-      newTz = TZ_DUBAI;
-    } else if (tzPreset == "kolkata") {
-      newTz = TZ_KOLKATA;
-    } else if (tzPreset == "shanghai") {
-      newTz = TZ_SHANGHAI;
-    } else if (tzPreset == "moscow") {
-      newTz = TZ_MOSCOW;
-    }
-
-    if (strncmp(tzInfo, newTz, sizeof(tzInfo) - 1) != 0) {
-      strncpy(tzInfo, newTz, sizeof(tzInfo));
-      tzInfo[sizeof(tzInfo) - 1] = '\0';
-      timezoneChanged = true;
-    }
-  }
-
-  if (timezoneChanged) {
-    applyTimezone();
+  json.add("slot", (uint32_t)slot);
+  json.add("action", SCHEDULE_ACTION_NAMES[entry.action]);
+  json.add("time", time);
+  json.add("days", days);
+  if (entry.action == SCHEDULE_BRIGHTNESS) {
+    json.add("brightness", (uint32_t)entry.value);
+  }
+}
+
+// GET /api/schedule: the brightness now, the next event and the entries
+// in use. The envelope is written up to the open entries array, then the
+// entries are streamed one at a time after it.
+void handleApiSchedule() {
+  server.sendHeader("Cache-Control", "no-cache");
+  HtmlStream out(server);
+  out.begin(200, "application/json");
+  JsonWriter json(jsonBuffer, sizeof(jsonBuffer));
+  json.beginObject();
+  json.add("brightness", (uint32_t)outputBrightness);
+  uint8_t nextSlot;
+  int64_t nextUtc;
+  if (schedule.next(&nextSlot, &nextUtc)) {
+    json.beginObject("next");
+    json.add("slot", (uint32_t)nextSlot);
+    json.add("epoch", nextUtc);
+    json.endObject();
+  } else {
+    json.addNull("next");
+  }
+  json.beginArray("entries");
+  out.print(json.c_str());
+  bool first = true;
+  for (uint8_t slot = 0; slot < Schedule::MAX_ENTRIES; slot++) {
+    const ScheduleEntry& entry = schedule.entry(slot);
+    if (entry.action == SCHEDULE_OFF) {
+      continue;
+    }
+    JsonWriter item(jsonBuffer, sizeof(jsonBuffer));
+    item.beginObject();
+    writeScheduleEntryJson(item, slot, entry);
+    item.endObject();
+    out.print(first ? "" : ",");
+    out.print(item.c_str());
+    first = false;
+  }
+  out.print("]}");
+  out.end();
+}
+
+struct SchedulePatch {
+  ScheduleEntry entry;
+  bool hasTime;
+  bool hasBrightness;
+  char badKey[32];
+};
+
+bool applyJsonScheduleField(const JsonMember& member, void* context) {
+  SchedulePatch* patch = (SchedulePatch*)context;
+  bool ok = false;
+  if (strcmp(member.key, "action") == 0 && member.type == JSON_STRING) {
+    for (uint8_t i = SCHEDULE_ALARM; i < SCHEDULE_ACTION_COUNT; i++) {
+      if (strcmp(member.value, SCHEDULE_ACTION_NAMES[i]) == 0) {
+        patch->entry.action = i;
+        ok = true;
+      }
+    }
+  } else if (strcmp(member.key, "time") == 0 && member.type == JSON_STRING) {
+    ok = patch->hasTime = parseScheduleTime(member.value, &patch->entry);
+  } else if (strcmp(member.key, "days") == 0 && member.type == JSON_STRING) {
+    ok = parseScheduleDays(member.value, &patch->entry.days);
+  } else if (strcmp(member.key, "brightness") == 0 && member.type == JSON_NUMBER) {
+    char* end;
+    long value = strtol(member.value, &end, 10);
+    ok = patch->hasBrightness = *end == '\0' && value >= 0 && value <= 255;
+    patch->entry.value = value;
   }
-  if (ntpServerChanged) {
-    timeSynced = syncTimeWithNTP();
+  if (!ok) {
+    strncpy(patch->badKey, member.key, sizeof(patch->badKey));
+    patch->badKey[sizeof(patch->badKey) - 1] = '\0';
   }
+  return ok;
+}
 
-  saveSettings();
+// Slot number of ?slot=, or -1.
+int scheduleSlotArg() {
+  String arg = server.arg("slot");
+  char* end;
+  long slot = strtol(arg.c_str(), &end, 10);
+  return arg.length() > 0 && *end == '\0' && slot >= 0 && slot < Schedule::MAX_ENTRIES ? (int)slot : -1;
+}
+
+// PUT /api/schedule?slot=<0..7> with the whole entry, e.g.
+// {"action":"brightness","time":"22:30","days":"daily","brightness":40}.
+// "days" defaults to daily; "brightness" is required for brightness entries.
+void handleApiSchedulePut() {
+  int slot = scheduleSlotArg();
+  if (slot < 0) {
+    server.send(404, "text/plain", "No such slot");
+    return;
+  }
+  SchedulePatch patch = {{SCHEDULE_OFF, 0, 0, SCHEDULE_EVERY_DAY, 0}, false, false, ""};
+  JsonParseResult result = jsonParseObject(server.arg("plain").c_str(), applyJsonScheduleField, &patch);
+  if (result == JSON_OK && (patch.entry.action == SCHEDULE_OFF || !patch.hasTime)) {
+    result = JSON_REJECTED;
+    strcpy(patch.badKey, patch.entry.action == SCHEDULE_OFF ? "action" : "time");
+  } else if (result == JSON_OK && patch.entry.action == SCHEDULE_BRIGHTNESS && !patch.hasBrightness) {
+    result = JSON_REJECTED;
+    strcpy(patch.badKey, "brightness");
+  }
+
+  JsonWriter json(jsonBuffer, sizeof(jsonBuffer));
+  json.beginObject();
+  if (result != JSON_OK || !schedule.set(slot, patch.entry)) {
+    json.add("error", result == JSON_SYNTAX_ERROR ? "malformed JSON" : "invalid entry");
+    if (result == JSON_REJECTED) {
+      json.add("field", patch.badKey);
+    }
+    json.endObject();
+    sendJson(400, json);
+    return;
+  }
+  settingsUpdated(0);
+  writeScheduleEntryJson(json, slot, schedule.entry(slot));
+  json.endObject();
+  sendJson(200, json);
+}
+
+// DELETE /api/schedule?slot=<0..7>
+void handleApiScheduleDelete() {
+  int slot = scheduleSlotArg();
+  if (slot < 0) {
+    server.send(404, "text/plain", "No such slot");
+    return;
+  }
+  schedule.set(slot, ScheduleEntry());
+  settingsUpdated(0);
+  server.send(204, "text/plain", "");
+}
+
+// Form fields of the settings page; the JSON API uses the same names.
+const char* const SETTING_KEYS[] = {
+  "quadrantsColor", "hourHandColor", "minuteHandColor", "secondHandColor",
+  "quadrantMode", "hourHandMode", "handMotionMode", "ntpServer", "tzPreset", "handBlend", "syncRole"
+};
+
+void handleUpdate() {
+  uint8_t changes = 0;
+  for (const char* key : SETTING_KEYS) {
+    if (server.hasArg(key)) {
+      applySetting(key, server.arg(key).c_str(), &changes);
+    }
+  }
+  settingsUpdated(changes);
 
   server.sendHeader("Location", "/");
   server.send(303, "text/plain", "Updated");
 }
 
+// The settings page form. Browsers get the page back right away; scripts
+// should use POST /api/animations, which returns the job.
 void handleTestAnimation() {
   if (!server.hasArg("animation")) {
     server.sendHeader("Location", "/");
     server.send(303, "text/plain", "No animation selected");
     return;
   }
+  bool busy;
+  queueNamedAnimation(server.arg("animation").c_str(), &busy);
+  server.sendHeader("Location", "/");
+  server.send(303, "text/plain", "Animation queued");
+}
+
+// Queues a built-in or uploaded animation by name. Returns its job id, or
+// 0 with *busy set when the queue has no room for it, or 0 with *busy clear
+// for an unknown name.
+uint32_t queueNamedAnimation(const char* name, bool* busy) {
+  *busy = false;
+  for (uint8_t i = 0; i < ANIM_COUNT; i++) {
+    if (BUILTIN_EFFECTS[i].program != nullptr && strcmp(name, RENDERER_NAMES[i]) == 0) {
+      uint32_t job = queueAnimation((AnimationId)i);
+      *busy = job == 0;
+      return job;
+    }
+  }
+  return queueUploadedEffect(name, busy);
+}
+
+void writeJobJson(JsonWriter& json, uint32_t job) {
+  json.add("job", job);
+  json.add("state", JOB_STATE_NAMES[animationJobState(job)]);
+}
+
+// POST /api/animations?name=<name>: 202 with the job, which can be polled
+// at /api/jobs?id=<job> or followed as "job" events on /api/events.
+void handleApiAnimations() {
+  String name = server.arg("name");
+  bool busy;
+  uint32_t job = queueNamedAnimation(name.c_str(), &busy);
+  if (job == 0) {
+    if (busy) {
+      server.sendHeader("Retry-After", "1");
+      server.send(503, "text/plain", "Animation queue full");
+    } else {
+      server.send(404, "text/plain", "No such animation");
+    }
+    return;
+  }
+  JsonWriter json(jsonBuffer, sizeof(jsonBuffer));
+  json.beginObject();
+  writeJobJson(json, job);
+  json.endObject();
+  char location[32];
+  snprintf(location, sizeof(location), "/api/jobs?id=%lu", (unsigned long)job);
+  server.sendHeader("Location", location);
+  sendJson(202, json);
+}
 
-  String animation = server.arg("animation");
+// GET /api/jobs?id=<job>
+void handleApiJobs() {
+  uint32_t job = (uint32_t)strtoul(server.arg("id").c_str(), nullptr, 10);
+  if (animationJobState(job) == JOB_UNKNOWN) {
+    server.send(404, "text/plain", "No such job");
+    return;
+  }
+  JsonWriter json(jsonBuffer, sizeof(jsonBuffer));
+  json.beginObject();
+  writeJobJson(json, job);
+  json.endObject();
+  sendJson(200, json);
+}
 
-  if (animation == "rotating") {
-    rotatingRingAnimation();
-  } else if (animation == "pulsating") {
-    pulsatingGlowAnimation();
-  } else if (animation == "progress") {
-    progressBarAnimation();
-  } else if (animation == "wifiSearching") {
-    for (int i = 0; i < NUM_LEDS; i++) {
-      wifiSearchingAnimation();
+// Uploaded effects are stored as /effects/<name>.fx; names are 1..24
+// letters, digits, '-' or '_' and cannot shadow a built-in effect.
+bool effectPath(const char* name, char* path, size_t size) {
+  size_t len = strlen(name);
+  if (len == 0 || len > EFFECT_NAME_MAX ||
+      strspn(name, "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_") != len) {
+    return false;
+  }
+  for (uint8_t i = 0; i < ANIM_COUNT; i++) {
+    if (strcmp(name, RENDERER_NAMES[i]) == 0) {
+      return false;
     }
-  } else if (animation == "wifiConnecting") {
-    for (int i = 0; i < 20; i++) {
-      wifiConnectingAnimation();
+  }
+  snprintf(path, size, "/effects/%s.fx", name);
+  return true;
+}
+
+uint32_t queueUploadedEffect(const char* name, bool* busy) {
+  *busy = false;
+  char path[48];
+  if (!effectPath(name, path, sizeof(path))) {
+    return 0;
+  }
+  // Only one uploaded effect can wait in the queue at a time, since they
+  // share the buffer; asking for the same one again joins its job.
+  *busy = true;
+  if (currentAnimation == ANIM_UPLOADED && animationStep == 0) {
+    return 0;
+  }
+  for (uint8_t i = 0; i < animationJobs.size(); i++) {
+    const AnimationJob& waiting = animationJobs.peek(i);
+    if (waiting.animation == ANIM_UPLOADED) {
+      return strcmp(name, queuedEffectName) == 0 ? waiting.id : 0;
     }
-  } else if (animation == "wifiConnected") {
-    wifiConnectedAnimation();
-  } else if (animation == "wifiFailed") {
-    wifiFailedAnimation();
   }
+  if (animationJobs.size() >= ANIMATION_QUEUE_SIZE) {
+    return 0;
+  }
+  int32_t size = halFsRead(path, queuedEffect, sizeof(queuedEffect));
+  if (size < 0) {
+    *busy = false;
+    return 0;
+  }
+  queuedEffectSize = size;
+  strncpy(queuedEffectName, name, sizeof(queuedEffectName));
+  queuedEffectName[sizeof(queuedEffectName) - 1] = '\0';
+  return queueAnimation(ANIM_UPLOADED);
+}
 
-  server.sendHeader("Location", "/");
-  server.send(303, "text/plain", "Animation executed");
+// Parses "#RRGGBB".
+bool parseHexColor(const char* hex, uint32_t* color) {
+  if (hex[0] != '#' || strlen(hex) != 7 || strspn(hex + 1, "0123456789abcdefABCDEF") != 6) {
+    return false;
+  }
+  long number = strtol(hex + 1, NULL, 16);
+  *color = ring.Color((number >> 16) & 0xFF, (number >> 8) & 0xFF, number & 0xFF);
+  return true;
 }
 
-uint32_t hexToColor(String hex) {
-  long number = strtol(&hex[1], NULL, 16);
-  return ring.Color((number >> 16) & 0xFF, (number >> 8) & 0xFF, number & 0xFF);
+// Writes "#RRGGBB" into hex[8].
+void formatHexColor(uint32_t color, char* hex) {
+  snprintf(hex, 8, "#%02X%02X%02X", (uint8_t)((color >> 16) & 0xFF), (uint8_t)((color >> 8) & 0xFF), (uint8_t)(color & 0xFF));
 }
 
-String colorToHex(uint32_t color) {
-  char hex[8];
-  snprintf(hex, sizeof(hex), "#%02X%02X%02X", (uint8_t)((color >> 16) & 0xFF), (uint8_t)((color >> 8) & 0xFF), (uint8_t)(color & 0xFF));
-  return String(hex);
+// Applies one setting from the form or the JSON API. Returns false (and
+// changes nothing) for an unknown key or an invalid value.
+bool applySetting(const char* key, const char* value, uint8_t* changes) {
+  if (strcmp(key, "quadrantsColor") == 0) {
+    return parseHexColor(value, &colorQuadrants);
+  }
+  if (strcmp(key, "hourHandColor") == 0) {
+    return parseHexColor(value, &colorHourHand);
+  }
+  if (strcmp(key, "minuteHandColor") == 0) {
+    return parseHexColor(value, &colorMinuteHand);
+  }
+  if (strcmp(key, "secondHandColor") == 0) {
+    return parseHexColor(value, &colorSecondHand);
+  }
+  if (strcmp(key, "quadrantMode") == 0) {
+    if (strcmp(value, "0") == 0) {
+      showQuadrants = false;
+    } else if (strcmp(value, "4") == 0 || strcmp(value, "12") == 0) {
+      showQuadrants = true;
+      quadrantMode = atoi(value);
+    } else {
+      return false;
+    }
+    return true;
+  }
+  if (strcmp(key, "hourHandMode") == 0 || strcmp(key, "handMotionMode") == 0) {
+    if (strcmp(value, "0") != 0 && strcmp(value, "1") != 0) {
+      return false;
+    }
+    if (strcmp(key, "hourHandMode") == 0) {
+      hourHandMode = value[0] - '0';
+    } else {
+      handMotionMode = value[0] - '0';
+    }
+    return true;
+  }
+  if (strcmp(key, "handBlend") == 0) {
+    for (uint8_t i = 0; i < BLEND_MODE_COUNT; i++) {
+      if (strcmp(value, BLEND_MODE_NAMES[i]) == 0) {
+        handBlend = (BlendMode)i;
+        return true;
+      }
+    }
+    return false;
+  }
+  if (strcmp(key, "ntpServer") == 0) {
+    while (*value == ' ') {
+      value++;
+    }
+    size_t len = strlen(value);
+    while (len > 0 && value[len - 1] == ' ') {
+      len--;
+    }
+    if (len == 0 || len >= sizeof(ntpServer)) {
+      return false;
+    }
+    if (strncmp(ntpServer, value, len) != 0 || ntpServer[len] != '\0') {
+      memcpy(ntpServer, value, len);
+      ntpServer[len] = '\0';
+      *changes |= SETTING_CHANGED_NTP;
+    }
+    return true;
+  }
+  if (strcmp(key, "syncRole") == 0) {
+    for (uint8_t i = 0; i < SYNC_ROLE_COUNT; i++) {
+      if (strcmp(value, SYNC_ROLE_NAMES[i]) == 0) {
+        phaseSync.setRole((PhaseSyncRole)i);
+        return true;
+      }
+    }
+    return false;
+  }
+  if (strcmp(key, "tzPreset") == 0) {
+    // An IANA zone name, or one of the short ids of older builds.
+    uint16_t zone = tzDbFind(value);
+    for (const LegacyTimezone& legacy : LEGACY_TIMEZONES) {
+      if (zone == TZ_DB_NONE && strcmp(value, legacy.id) == 0) {
+        zone = tzDbFind(legacy.zone);
+      }
+    }
+    if (zone == TZ_DB_NONE) {
+      return false;
+    }
+    if (zone != tzZone) {
+      selectTimezone(zone);
+      *changes |= SETTING_CHANGED_TZ;
+    }
+    return true;
+  }
+  return false;
 }
 
-uint32_t applyGammaCorrection(uint32_t color) {
-  return color;
+// Follow-up work after the settings were changed through any interface.
+void settingsUpdated(uint8_t changes) {
+  pendingSettingChanges |= changes | SETTING_CHANGED_ANY;
 }
 
-int wrapLedIndex(int index) {
-  if (NUM_LEDS <= 0) {
-    return 0;
+void serviceSettingsCommands() {
+  uint8_t changes = pendingSettingChanges;
+  if (changes == 0) {
+    return;
+  }
+  pendingSettingChanges = 0;
+  if (changes & SETTING_CHANGED_TZ) {
+    applyTimezone();
+    schedule.invalidate();
   }
-  index %= NUM_LEDS;
-  if (index < 0) {
-    index += NUM_LEDS;
+  if (changes & SETTING_CHANGED_NTP) {
+    ntp.requestSync();
   }
-  return index;
+  requestSettingsSave();
+  clockNeedsRedraw = true;
+  publishSettings();
 }
 
-bool syncTimeWithNTP() {
-  Serial.println("Syncing time with NTP...");
-  // Use ESP8266 overload with TZ string to ensure timezone is applied reliably.
-  configTime(tzInfo, ntpServer, NTP_SERVER_2, NTP_SERVER_3);
+// Makes `zone` the current timezone; applyTimezone() then parses its rule.
+void selectTimezone(uint16_t zone) {
+  if (tzDbRule(zone, tzInfo)) {
+    tzZone = zone;
+  }
+}
 
-  for (int i = 0; i < 60; i++) {
-    time_t now = time(nullptr);
-    if (now > 100000) {
-      struct tm localNow;
-      localtime_r(&now, &localNow);
-      char timeBuf[32];
-      strftime(timeBuf, sizeof(timeBuf), "%Y-%m-%d %H:%M:%S", &localNow);
-      Serial.println("NTP sync successful");
-      Serial.println(String("Local time after sync: ") + timeBuf + " TZ=" + tzInfo);
-      return true;
+// Writes the settings as members of the open object; with `previous`, only
+// the ones that differ from it.
+void writeSettingsJson(JsonWriter& json, const SavedSettings& s, const SavedSettings* previous) {
+  char hex[8];
+  const uint32_t colors[4] = {s.colorQuadrants, s.colorHourHand, s.colorMinuteHand, s.colorSecondHand};
+  const uint32_t oldColors[4] = {
+    previous ? previous->colorQuadrants : 0, previous ? previous->colorHourHand : 0,
+    previous ? previous->colorMinuteHand : 0, previous ? previous->colorSecondHand : 0
+  };
+  for (int i = 0; i < 4; i++) {
+    if (previous == nullptr || colors[i] != oldColors[i]) {
+      formatHexColor(colors[i], hex);
+      json.add(SETTING_KEYS[i], hex);
+    }
+  }
+  uint32_t quadrants = s.showQuadrants ? s.quadrantMode : 0;
+  if (previous == nullptr || quadrants != (previous->showQuadrants ? previous->quadrantMode : 0u)) {
+    json.add("quadrantMode", quadrants);
+  }
+  if (previous == nullptr || s.hourHandMode != previous->hourHandMode) {
+    json.add("hourHandMode", (uint32_t)s.hourHandMode);
+  }
+  if (previous == nullptr || s.handMotionMode != previous->handMotionMode) {
+    json.add("handMotionMode", (uint32_t)s.handMotionMode);
+  }
+  if (previous == nullptr || s.handBlend != previous->handBlend) {
+    json.add("handBlend", BLEND_MODE_NAMES[s.handBlend < BLEND_MODE_COUNT ? (BlendMode)s.handBlend : BLEND_OVER]);
+  }
+  if (previous == nullptr || strcmp(s.ntpServer, previous->ntpServer) != 0) {
+    json.add("ntpServer", s.ntpServer);
+  }
+  if (previous == nullptr || s.tzZone != previous->tzZone) {
+    char name[TZ_DB_NAME_MAX];
+    char rule[TZ_DB_RULE_MAX];
+    if (tzDbName(s.tzZone, name) && tzDbRule(s.tzZone, rule)) {
+      json.add("tzPreset", name);
+      json.add("tz", rule);
     }
-    delay(250);
   }
+  if (previous == nullptr || s.syncRole != previous->syncRole) {
+    json.add("syncRole", SYNC_ROLE_NAMES[s.syncRole < SYNC_ROLE_COUNT ? (PhaseSyncRole)s.syncRole : SYNC_OFF]);
+  }
+}
+
+void writeTimeJson(JsonWriter& json) {
+  struct timeval tv;
+  systemClock.now(&tv);
+  if (!systemClock.isSet()) {
+    json.addNull("time");
+    json.addNull("epoch");
+    return;
+  }
+  struct tm now;
+  localZone.localTime(tv.tv_sec, &now);
+  char time[12];
+  snprintf(time, sizeof(time), "%02d:%02d:%02d", now.tm_hour, now.tm_min, now.tm_sec);
+  json.add("time", time);
+  json.add("epoch", (uint32_t)tv.tv_sec);
+}
+
+void writeSyncJson(JsonWriter& json) {
+  json.add("clockSet", systemClock.isSet());
+  json.add("synced", ntp.synced());
+  if (ntp.synced()) {
+    json.add("server", ntp.lastServer());
+    json.add("stepped", ntp.lastStepped());
+    json.addFixed("offsetMs", ntp.lastOffsetUs(), 3);
+    json.addFixed("delayMs", ntp.lastDelayUs(), 3);
+  }
+  json.addFixed("driftPpm", systemClock.driftPpb(), 3);
+  json.add("pollS", ntp.pollIntervalS());
+  json.add("nextPollS", ntp.secondsUntilPoll());
+}
+
+void sendJson(int code, const JsonWriter& json) {
+  if (json.overflowed()) {
+    server.send(500, "application/json", "{\"error\":\"response too large\"}");
+    return;
+  }
+  server.sendHeader("Cache-Control", "no-cache");
+  server.setContentLength(json.length());
+  server.send(code, "application/json", "");
+  server.sendContent(json.c_str(), json.length());
+}
+
+void handleApiSettings() {
+  SavedSettings s;
+  packSettings(s);
+  JsonWriter json(jsonBuffer, sizeof(jsonBuffer));
+  json.beginObject();
+  writeSettingsJson(json, s, nullptr);
+  json.endObject();
+  sendJson(200, json);
+}
 
-  Serial.println("NTP sync failed");
+struct SettingsPatch {
+  uint8_t changes;
+  char badKey[32];
+};
+
+bool applyJsonSetting(const JsonMember& member, void* context) {
+  SettingsPatch* patch = (SettingsPatch*)context;
+  if ((member.type == JSON_STRING || member.type == JSON_NUMBER) &&
+      applySetting(member.key, member.value, &patch->changes)) {
+    return true;
+  }
+  strncpy(patch->badKey, member.key, sizeof(patch->badKey));
+  patch->badKey[sizeof(patch->badKey) - 1] = '\0';
   return false;
 }
 
+// PATCH /api/settings with a flat JSON object of the fields to change.
+// Members are applied in order; on the first bad one the request fails
+// with 400, keeping the members before it.
+void handleApiSettingsPatch() {
+  SettingsPatch patch = {0, ""};
+  JsonParseResult result = jsonParseObject(server.arg("plain").c_str(), applyJsonSetting, &patch);
+  settingsUpdated(patch.changes);
+
+  JsonWriter json(jsonBuffer, sizeof(jsonBuffer));
+  json.beginObject();
+  if (result != JSON_OK) {
+    json.add("error", result == JSON_SYNTAX_ERROR ? "malformed JSON" : "invalid setting");
+    if (result == JSON_REJECTED) {
+      json.add("field", patch.badKey);
+    }
+    json.endObject();
+    sendJson(400, json);
+    return;
+  }
+  SavedSettings s;
+  packSettings(s);
+  writeSettingsJson(json, s, nullptr);
+  json.endObject();
+  sendJson(200, json);
+}
+
+void handleApiStatus() {
+  JsonWriter json(jsonBuffer, sizeof(jsonBuffer));
+  json.beginObject();
+  writeTimeJson(json);
+  json.add("tz", tzInfo);
+  json.beginObject("sync");
+  writeSyncJson(json);
+  json.endObject();
+  IPAddress ip = WiFi.localIP();
+  char address[16];
+  snprintf(address, sizeof(address), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+  json.add("ip", address);
+  json.beginObject("wifi");
+  json.add("state", WIFI_LINK_STATE_NAMES[wifiLink.state()]);
+  json.add("lastJoinMs", wifiLink.lastJoinMs());
+  json.add("lastJoinDirect", wifiLink.lastJoinDirect());
+  json.add("losses", wifiLink.losses());
+  json.endObject();
+  json.add("uptimeS", (uint32_t)(millis() / 1000));
+  json.add("freeHeap", halFreeHeap());
+  json.add("loopLatencyUs", (uint32_t)loopLatencyWorstUs);
+  json.add("framesRendered", framesRendered);
+  json.add("framesPushed", framesPushed);
+  json.add("streaming", pixelStream.active());
+  json.add("brightness", (uint32_t)outputBrightness);
+  json.beginObject("phaseSync");
+  json.add("role", SYNC_ROLE_NAMES[phaseSync.role()]);
+  json.add("following", phaseSync.following());
+  if (phaseSync.following()) {
+    json.add("leader", phaseSync.leader().toString().c_str());
+    json.addFixed("offsetMs", phaseSync.lastOffsetUs(), 3);
+    json.addFixed("jitterMs", phaseSync.jitterUs(), 3);
+  }
+  json.endObject();
+  json.add("eventClients", (uint32_t)events.clientCount());
+  json.endObject();
+  sendJson(200, json);
+}
+
+void addEffectJson(const char* fileName, size_t size, void* context) {
+  const char* dot = strrchr(fileName, '.');
+  char name[EFFECT_NAME_MAX + 1];
+  if (dot == nullptr || strcmp(dot, ".fx") != 0 || (size_t)(dot - fileName) > EFFECT_NAME_MAX) {
+    return;
+  }
+  memcpy(name, fileName, dot - fileName);
+  name[dot - fileName] = '\0';
+  JsonWriter& json = *(JsonWriter*)context;
+  json.beginObject();
+  json.add("name", name);
+  json.add("size", (uint32_t)size);
+  json.endObject();
+}
+
+// GET /api/effects: the built-in effect names and the uploaded effects.
+void handleApiEffects() {
+  JsonWriter json(jsonBuffer, sizeof(jsonBuffer));
+  json.beginObject();
+  json.beginArray("builtin");
+  for (uint8_t i = 0; i < ANIM_COUNT; i++) {
+    if (BUILTIN_EFFECTS[i].program != nullptr) {
+      json.add(nullptr, RENDERER_NAMES[i]);
+    }
+  }
+  json.endArray();
+  json.beginArray("uploaded");
+  halFsList("/effects", addEffectJson, &json);
+  json.endArray();
+  json.endObject();
+  sendJson(200, json);
+}
+
+// POST /api/effects, multipart/form-data with one file part; the file name
+// without its extension names the effect. The body is only collected
+// here; handleApiEffectUpload() checks and stores it.
+void handleApiEffectUploadData() {
+  HTTPUpload& upload = server.upload();
+  if (upload.status == UPLOAD_FILE_START) {
+    uploadSize = 0;
+    uploadTooLarge = false;
+    // A name that is too long is left empty, which effectPath() rejects.
+    size_t len = strcspn(upload.filename.c_str(), ".");
+    len = len > EFFECT_NAME_MAX ? 0 : len;
+    memcpy(uploadName, upload.filename.c_str(), len);
+    uploadName[len] = '\0';
+  } else if (upload.status == UPLOAD_FILE_WRITE) {
+    if (uploadSize + upload.currentSize > sizeof(uploadBuffer)) {
+      uploadTooLarge = true;
+    } else {
+      memcpy(uploadBuffer + uploadSize, upload.buf, upload.currentSize);
+      uploadSize += upload.currentSize;
+    }
+  } else if (upload.status == UPLOAD_FILE_ABORTED) {
+    uploadSize = 0;
+  }
+}
+
+void handleApiEffectUpload() {
+  char path[48];
+  const char* error = nullptr;
+  if (!effectPath(uploadName, path, sizeof(path))) {
+    error = "invalid effect name";
+  } else if (uploadTooLarge) {
+    error = "too large";
+  } else {
+    error = EffectPlayer::verify(uploadBuffer, uploadSize);
+  }
+  if (error == nullptr && !halFsWrite(path, uploadBuffer, uploadSize)) {
+    error = "could not write the file";
+  }
+
+  JsonWriter json(jsonBuffer, sizeof(jsonBuffer));
+  json.beginObject();
+  if (error != nullptr) {
+    json.add("error", error);
+  } else {
+    json.add("name", uploadName);
+    json.add("size", (uint32_t)uploadSize);
+  }
+  json.endObject();
+  uploadName[0] = '\0';
+  uploadSize = 0;
+  sendJson(error != nullptr ? 400 : 201, json);
+}
+
+// DELETE /api/effects?name=<name>
+void handleApiEffectDelete() {
+  char path[48];
+  if (!effectPath(server.arg("name").c_str(), path, sizeof(path)) || !halFsRemove(path)) {
+    server.send(404, "text/plain", "No such effect");
+    return;
+  }
+  server.send(204, "text/plain", "");
+}
+
+// GET /log: the lines still in the log buffer, as plain text. With
+// ?since=<position> only what was logged after it; X-Log-Position is the
+// position to ask from next time, so a script can follow the log.
+void handleLog() {
+  String since = server.arg("since");
+  uint32_t position = since.length() > 0 ? strtoul(since.c_str(), nullptr, 10) : 0;
+  // Lines logged while this is sent are left for the next request; a
+  // position from before a reboot starts again from the oldest line.
+  uint32_t end = logPosition();
+  if (position > end) {
+    position = 0;
+  }
+  char next[12];
+  snprintf(next, sizeof(next), "%lu", (unsigned long)end);
+  server.sendHeader("Cache-Control", "no-cache");
+  server.sendHeader("X-Log-Position", next);
+  HtmlStream out(server);
+  out.begin(200, "text/plain");
+  char chunk[128];
+  size_t n;
+  while (position < end && (n = logRead(&position, chunk, end - position < sizeof(chunk) ? end - position : sizeof(chunk))) > 0) {
+    out.write(chunk, n);
+  }
+  out.end();
+}
+
+// GET /api/events: an SSE stream. A new subscriber gets the full state,
+// after that "time" every second and "sync"/"settings" with only the
+// fields that changed.
+void handleApiEvents() {
+  // Bring existing subscribers up to date first, so the snapshot below is
+  // also the baseline for the next change events.
+  serviceEvents();
+  int slot = events.accept(server.client());
+  if (slot < 0) {
+    server.send(503, "text/plain", "Too many event streams");
+    return;
+  }
+
+  SavedSettings s;
+  packSettings(s);
+  JsonWriter settings(jsonBuffer, sizeof(jsonBuffer));
+  settings.beginObject();
+  writeSettingsJson(settings, s, nullptr);
+  settings.endObject();
+  events.send(slot, "settings", jsonBuffer);
+
+  JsonWriter sync(jsonBuffer, sizeof(jsonBuffer));
+  sync.beginObject();
+  writeSyncJson(sync);
+  sync.endObject();
+  events.send(slot, "sync", jsonBuffer);
+
+  JsonWriter time(jsonBuffer, sizeof(jsonBuffer));
+  time.beginObject();
+  writeTimeJson(time);
+  time.endObject();
+  events.send(slot, "time", jsonBuffer);
+
+  struct timeval tv;
+  systemClock.now(&tv);
+  lastEventEpoch = tv.tv_sec;
+  publishedSyncCount = ntp.syncCount();
+  publishedClockSet = systemClock.isSet();
+}
+
+#if CLOCK_METRICS
+// GET /metrics in the Prometheus text format.
+void handleMetrics() {
+  HtmlStream out(server);
+  out.begin(200, "text/plain; version=0.0.4");
+  loopHistogram.print(out, "clock_loop_duration_seconds", "Duration of loop() iterations.");
+  clockRenderHistogram.print(out, "clock_render_duration_seconds", "Time to draw a clock face frame.");
+  showHistogram.print(out, "clock_show_duration_seconds", "Time spent in ring.show().");
+  httpHistogram.print(out, "clock_http_duration_seconds", "Time spent in server.handleClient().");
+  ntpHistogram.print(out, "clock_ntp_service_duration_seconds", "Time spent in one NTP client step.");
+  secondPhaseHistogram.print(out, "clock_second_phase_seconds",
+                             "Time from the UTC second boundary until the new second is shown.");
+  wifiReconnectHistogram.print(out, "clock_wifi_reconnect_seconds", "Time from losing Wi-Fi until it was joined again.");
+  printMetric(out, "clock_frames_rendered_total", "counter", "Frames drawn into the canvas.", framesRendered);
+  printMetric(out, "clock_frames_pushed_total", "counter", "Frames sent to the LEDs.", framesPushed);
+  printMetric(out, "clock_frames_skipped_total", "counter", "Frames identical to what the LEDs show.", framesSkipped);
+  printMetric(out, "clock_stream_packets_total", "counter", "DDP / E1.31 packets accepted.", pixelStream.packets());
+  printMetric(out, "clock_stream_frames_total", "counter", "Streamed frames shown.", pixelStream.frames());
+  printMetric(out, "clock_stream_rejected_total", "counter", "UDP packets on the stream ports that were not used.",
+              pixelStream.rejected());
+  printMetric(out, "clock_phase_sync_beacons_total", "counter", "Phase sync beacons sent (leader) or heard (follower).",
+              phaseSync.beacons());
+  printMetric(out, "clock_phase_sync_corrections_total", "counter", "Clock corrections from the leader's beacons.",
+              phaseSync.corrections());
+  printMetric(out, "clock_ntp_rounds_total", "counter", "NTP sync rounds started.", ntp.roundCount());
+  printMetric(out, "clock_ntp_syncs_total", "counter", "NTP sync rounds that corrected the clock.", ntp.syncCount());
+  printMetric(out, "clock_settings_writes_total", "counter", "Settings records written to flash.",
+              settingsJournal.writes());
+  printMetric(out, "clock_settings_erases_total", "counter", "Settings flash sector erases.", settingsJournal.erases());
+  printMetric(out, "clock_settings_unchanged_total", "counter", "Settings saves skipped as unchanged.",
+              settingsJournal.skipped());
+  printMetric(out, "clock_heap_free_bytes", "gauge", "Free heap.", halFreeHeap());
+  printMetric(out, "clock_heap_max_block_bytes", "gauge", "Largest free heap block.", halMaxFreeBlock());
+  printMetric(out, "clock_heap_fragmentation_percent", "gauge", "Heap fragmentation.", halHeapFragmentation());
+  printMetric(out, "clock_uptime_seconds", "gauge", "Time since boot.", millis() / 1000);
+  printMetric(out, "clock_boot_face_milliseconds", "gauge", "Time from boot until the face showed the time.",
+              firstFaceMs);
+  printMetric(out, "clock_warm_resets", "gauge", "Warm resets in a row with the time kept in RTC memory.",
+              warmStart.resets());
+  printMetric(out, "clock_brightness", "gauge", "Output brightness set by the schedule (0-255).", outputBrightness);
+  printMetric(out, "clock_log_dropped_bytes_total", "counter", "Log output overwritten before the UART sent it.",
+              logDroppedBytes());
+  printMetric(out, "clock_wifi_losses_total", "counter", "Times the Wi-Fi link was lost.", wifiLink.losses());
+  printMetric(out, "clock_wifi_direct_joins_total", "counter", "Joins straight to the cached access point.",
+              wifiLink.directJoins());
+  printMetric(out, "clock_wifi_scan_joins_total", "counter", "Joins after a scan.", wifiLink.scanJoins());
+  printMetric(out, "clock_wifi_failed_attempts_total", "counter", "Join attempts that failed or timed out.",
+              wifiLink.failedAttempts());
+  printMetric(out, "clock_event_clients", "gauge", "Connected /api/events streams.", events.clientCount());
+  out.end();
+}
+#endif
+
+// Pushes settings that differ from what event clients last saw.
+void publishSettings() {
+  SavedSettings current;
+  packSettings(current);
+  if (events.clientCount() > 0) {
+    JsonWriter json(jsonBuffer, sizeof(jsonBuffer));
+    json.beginObject();
+    writeSettingsJson(json, current, &publishedSettings);
+    json.endObject();
+    if (json.length() > 2) {
+      events.broadcast("settings", jsonBuffer);
+    }
+  }
+  publishedSettings = current;
+}
+
+// Called every loop; costs one comparison while nobody is subscribed.
+void serviceEvents() {
+  events.service();
+  if (events.clientCount() == 0) {
+    return;
+  }
+
+  if (ntp.syncCount() != publishedSyncCount || systemClock.isSet() != publishedClockSet) {
+    publishedSyncCount = ntp.syncCount();
+    publishedClockSet = systemClock.isSet();
+    JsonWriter json(jsonBuffer, sizeof(jsonBuffer));
+    json.beginObject();
+    writeSyncJson(json);
+    json.endObject();
+    events.broadcast("sync", jsonBuffer);
+  }
+
+  struct timeval tv;
+  systemClock.now(&tv);
+  if (tv.tv_sec != lastEventEpoch) {
+    lastEventEpoch = tv.tv_sec;
+    JsonWriter json(jsonBuffer, sizeof(jsonBuffer));
+    json.beginObject();
+    writeTimeJson(json);
+    json.endObject();
+    events.broadcast("time", jsonBuffer);
+  }
+}
+
+// Runs the NTP state machine; never blocks, so it is called every loop
+// while Wi-Fi is up.
+void serviceTimeSync() {
+  if (phaseSync.service(millis()) && phaseSync.lastStepped()) {
+    clockNeedsRedraw = true;
+  }
+  // A follower takes its time from the leader, not from the NTP servers.
+  if (phaseSync.following()) {
+    return;
+  }
+  NtpEvent event;
+  {
+    METRICS_TIME_SCOPE(ntpHistogram);
+    event = ntp.service();
+  }
+  if (event != NTP_EVENT_SYNCED) {
+    return;
+  }
+  struct timeval tv;
+  systemClock.now(&tv);
+  struct tm localNow;
+  localZone.localTime(tv.tv_sec, &localNow);
+  char timeBuf[32];
+  strftime(timeBuf, sizeof(timeBuf), "%Y-%m-%d %H:%M:%S", &localNow);
+  LOG_INFO("NTP %s: %s %ld us, delay %ld us, drift %ld ppb, next poll in %lu s",
+           ntp.lastServer(), ntp.lastStepped() ? "stepped" : "offset", (long)ntp.lastOffsetUs(),
+           (long)ntp.lastDelayUs(), (long)systemClock.driftPpb(), (unsigned long)ntp.pollIntervalS());
+  LOG_INFO("Local time after sync: %s TZ=%s", timeBuf, tzInfo);
+  clockNeedsRedraw = true;
+}
+
+// Parses tzInfo into localZone; call whenever tzInfo changes.
 void applyTimezone() {
-  setenv("TZ", tzInfo, 1);
-  tzset();
+  if (!localZone.set(tzInfo)) {
+    LOG_WARN("Invalid TZ, using UTC: %s", tzInfo);
+  }
+}
+
+// Converts a record in the V1 layout, `length` bytes long, on top of the
+// defaults in `s`.
+void upgradeSettingsV1(const SavedSettingsV1& old, size_t length, SavedSettings& s) {
+  s.colorQuadrants = old.colorQuadrants;
+  s.colorHourHand = old.colorHourHand;
+  s.colorMinuteHand = old.colorMinuteHand;
+  s.colorSecondHand = old.colorSecondHand;
+  s.showQuadrants = old.showQuadrants;
+  s.quadrantMode = old.quadrantMode;
+  s.hourHandMode = old.hourHandMode;
+  memcpy(s.ntpServer, old.ntpServer, sizeof(s.ntpServer));
+  // Fields appended to V1 over time.
+  if (length > offsetof(SavedSettingsV1, handMotionMode)) {
+    s.handMotionMode = old.handMotionMode;
+  }
+  if (length > offsetof(SavedSettingsV1, handBlend)) {
+    s.handBlend = old.handBlend;
+  }
+  if (length > offsetof(SavedSettingsV1, syncRole)) {
+    s.syncRole = old.syncRole;
+  }
+  for (const LegacyTimezone& legacy : LEGACY_TIMEZONES) {
+    uint16_t zone = tzDbFind(legacy.zone);
+    if (strncmp(old.tzInfo, legacy.posix, sizeof(old.tzInfo)) == 0 && zone != TZ_DB_NONE) {
+      s.tzZone = zone;
+      s.tzZoneCrc = tzDbNameCrc(zone);
+    }
+  }
 }
 
 void loadSettings() {
+  // Start from the current defaults so a record written by an older build
+  // (shorter struct) only overrides the fields it has.
+  selectTimezone(tzDbFind(DEFAULT_TZ_ZONE));
   SavedSettings s;
-  EEPROM.get(0, s);
+  packSettings(s);
+  union {
+    SavedSettings current;
+    SavedSettingsV1 v1;
+  } record;
+  size_t length = settingsJournal.load(&record, sizeof(record));
+  bool fromEeprom = false;
+
+  if (length == 0) {
+    // Older builds kept a single SavedSettings at offset 0 via EEPROM.put().
+    uint32_t legacy[(sizeof(SavedSettingsV1) + 3) / 4];
+    if (halSettingsRead(0, 0, legacy, sizeof(legacy)) && ((const SavedSettingsV1*)legacy)->magic == SETTINGS_MAGIC_V1) {
+      memcpy(&record.v1, legacy, sizeof(record.v1));
+      length = sizeof(record.v1);
+      fromEeprom = true;
+    }
+  }
 
-  if (s.magic != SETTINGS_MAGIC) {
-    Serial.println("No saved settings found, using defaults");
+  bool upgraded = false;
+  if (length >= sizeof(uint32_t) && record.current.magic == SETTINGS_MAGIC) {
+    memcpy(&s, &record.current, length < sizeof(s) ? length : sizeof(s));
+  } else if (length >= sizeof(uint32_t) && record.v1.magic == SETTINGS_MAGIC_V1) {
+    upgradeSettingsV1(record.v1, length, s);
+    upgraded = true;
+  } else {
+    LOG_INFO("No saved settings found, using defaults");
     return;
   }
 
@@ -542,22 +2128,43 @@ void loadSettings() {
   showQuadrants = (s.showQuadrants != 0);
   quadrantMode = (s.quadrantMode == 4) ? 4 : 12;
   hourHandMode = (s.hourHandMode == 1) ? 1 : 0;
+  handMotionMode = (s.handMotionMode == 1) ? 1 : 0;
+  handBlend = (s.handBlend < BLEND_MODE_COUNT) ? (BlendMode)s.handBlend : BLEND_OVER;
+  phaseSync.setRole(s.syncRole < SYNC_ROLE_COUNT ? (PhaseSyncRole)s.syncRole : SYNC_OFF);
   if (strlen(s.ntpServer) > 0 && strlen(s.ntpServer) < sizeof(ntpServer)) {
     strncpy(ntpServer, s.ntpServer, sizeof(ntpServer));
     ntpServer[sizeof(ntpServer) - 1] = '\0';
   }
-  if (strlen(s.tzInfo) > 0 && strlen(s.tzInfo) < sizeof(tzInfo)) {
-    strncpy(tzInfo, s.tzInfo, sizeof(tzInfo));
-    tzInfo[sizeof(tzInfo) - 1] = '\0';
+  // The zone list may have changed since the record was written.
+  uint16_t zone = s.tzZone;
+  if (tzDbNameCrc(zone) != s.tzZoneCrc) {
+    zone = tzDbFindByCrc(s.tzZoneCrc);
+  }
+  if (zone != TZ_DB_NONE) {
+    selectTimezone(zone);
+  }
+  for (uint8_t i = 0; i < Schedule::MAX_ENTRIES; i++) {
+    if (!schedule.set(i, s.schedule[i])) {
+      schedule.set(i, ScheduleEntry());
+    }
   }
 
-  Serial.println(String("Loaded NTP from EEPROM: ") + ntpServer);
-  Serial.println(String("Loaded TZ from EEPROM: ") + tzInfo);
-  Serial.println("Settings loaded from EEPROM");
+  char zoneName[TZ_DB_NAME_MAX] = "";
+  tzDbName(tzZone, zoneName);
+  LOG_INFO("Loaded NTP from flash: %s", ntpServer);
+  LOG_INFO("Loaded TZ from flash: %s (%s)", zoneName, tzInfo);
+  if (fromEeprom || upgraded) {
+    LOG_INFO("%s", fromEeprom ? "Migrating settings from the old EEPROM layout" : "Upgrading the settings record");
+    saveSettings();
+  } else {
+    LOG_INFO("Settings loaded from journal (record %lu, %lu of %lu bytes used)",
+             (unsigned long)settingsJournal.sequence(), (unsigned long)settingsJournal.usedBytes(),
+             (unsigned long)HAL_SETTINGS_SECTOR_SIZE);
+  }
 }
 
-void saveSettings() {
-  SavedSettings s;
+void packSettings(SavedSettings& s) {
+  memset(&s, 0, sizeof(s));
   s.magic = SETTINGS_MAGIC;
   s.colorQuadrants = colorQuadrants;
   s.colorHourHand = colorHourHand;
@@ -566,100 +2173,156 @@ void saveSettings() {
   s.showQuadrants = showQuadrants ? 1 : 0;
   s.quadrantMode = (quadrantMode == 4) ? 4 : 12;
   s.hourHandMode = (hourHandMode == 1) ? 1 : 0;
+  s.handMotionMode = (handMotionMode == 1) ? 1 : 0;
+  s.handBlend = handBlend;
+  s.syncRole = phaseSync.role();
   strncpy(s.ntpServer, ntpServer, sizeof(s.ntpServer));
   s.ntpServer[sizeof(s.ntpServer) - 1] = '\0';
-  strncpy(s.tzInfo, tzInfo, sizeof(s.tzInfo));
-  s.tzInfo[sizeof(s.tzInfo) - 1] = '\0';
-
-  EEPROM.put(0, s);
-  EEPROM.commit();
-  Serial.println("Settings saved to EEPROM");
+  s.tzZone = tzZone;
+  s.tzZoneCrc = tzDbNameCrc(tzZone);
+  for (uint8_t i = 0; i < Schedule::MAX_ENTRIES; i++) {
+    s.schedule[i] = schedule.entry(i);
+  }
 }
 
+// Writes the settings now. Unchanged settings are not written at all.
+void saveSettings() {
+  settingsSavePending = false;
+  SavedSettings s;
+  packSettings(s);
 
-
-
-
-
-void rotatingRingAnimation() {
-  for (int i = 0; i < NUM_LEDS; i++) {
-    ring.clear();
-    ring.setPixelColor(i, ring.Color(0, 0, 255)); // Blue
-    ring.show();
-    delay(50); // Adjust speed as needed
+  SettingsJournal::SaveResult result = settingsJournal.save(&s, sizeof(s));
+  if (result == SettingsJournal::SAVE_FAILED) {
+    LOG_ERROR("Settings save failed");
+  } else if (result == SettingsJournal::SAVE_UNCHANGED) {
+    LOG_INFO("Settings unchanged, not written");
+  } else {
+    LOG_INFO("Settings saved (record %lu, %lu bytes used, %lu writes / %lu erases since boot)",
+             (unsigned long)settingsJournal.sequence(), (unsigned long)settingsJournal.usedBytes(),
+             (unsigned long)settingsJournal.writes(), (unsigned long)settingsJournal.erases());
   }
 }
 
-void pulsatingGlowAnimation() {
-  for (int brightness = 0; brightness <= 255; brightness += 5) {
-    ring.setBrightness(brightness);
-    ring.fill(ring.Color(0, 0, 255)); // Blue
-    ring.show();
-    delay(20);
-  }
-  for (int brightness = 255; brightness >= 0; brightness -= 5) {
-    ring.setBrightness(brightness);
-    ring.fill(ring.Color(0, 0, 255)); // Blue
-    ring.show();
-    delay(20);
+void requestSettingsSave() {
+  unsigned long now = millis();
+  if (!settingsSavePending) {
+    settingsSavePending = true;
+    settingsFirstChangeMs = now;
   }
-  ring.setBrightness(BRIGHTNESS_FIXED); // Restore fixed brightness
+  settingsLastChangeMs = now;
 }
 
-
-void progressBarAnimation() {
-  for (int i = 0; i < NUM_LEDS; i++) {
-    ring.setPixelColor(i, ring.Color(0, 255, 0)); // Green
-    ring.show();
-    delay(50); // Adjust progress speed
+void serviceSettingsSave() {
+  if (!settingsSavePending) {
+    return;
+  }
+  unsigned long now = millis();
+  if (now - settingsLastChangeMs >= SETTINGS_SAVE_DELAY_MS || now - settingsFirstChangeMs >= SETTINGS_SAVE_MAX_DELAY_MS) {
+    saveSettings();
   }
 }
 
-
-void wifiSearchingAnimation() {
-  static int pos = 0;
-  ring.clear();
-  ring.setPixelColor(pos, ring.Color(0, 0, 255)); // Blue
-  pos = (pos + 1) % NUM_LEDS;
-  ring.show();
-  delay(100); // Adjust speed as needed
+// Returns the job id, or 0 when the queue is full.
+uint32_t queueAnimation(AnimationId id) {
+  if (id == ANIM_NONE) {
+    return 0;
+  }
+  for (uint8_t i = 0; i < animationJobs.size(); i++) {
+    if (animationJobs.peek(i).animation == id) {
+      return animationJobs.peek(i).id;
+    }
+  }
+  AnimationJob job = {lastAnimationJobId + 1, id};
+  if (!animationJobs.push(job)) {
+    return 0;
+  }
+  lastAnimationJobId = job.id;
+  publishJobState(job.id, JOB_QUEUED);
+  return job.id;
 }
 
-
-void wifiConnectingAnimation() {
-  for (int i = 0; i < NUM_LEDS; i++) {
-    int brightness = (sin(i * 0.2) + 1) * 127; // Sine wave effect
-    ring.setPixelColor(i, ring.Color(0, brightness, brightness)); // Cyan
+AnimationJobState animationJobState(uint32_t job) {
+  if (job == 0 || job > lastAnimationJobId) {
+    return JOB_UNKNOWN;
   }
-  ring.show();
-  delay(100); // Adjust wave speed
+  if (job == currentAnimationJobId && currentAnimation != ANIM_NONE) {
+    return JOB_RUNNING;
+  }
+  for (uint8_t i = 0; i < animationJobs.size(); i++) {
+    if (animationJobs.peek(i).id == job) {
+      return JOB_QUEUED;
+    }
+  }
+  return JOB_DONE;
 }
 
-
-
-void wifiConnectedAnimation() {
-  for (int i = 0; i < 3; i++) { // Flash three times
-    ring.fill(ring.Color(0, 255, 0)); // Green
-    ring.show();
-    delay(200);
-    ring.clear();
-    ring.show();
-    delay(200);
+void publishJobState(uint32_t job, AnimationJobState state) {
+  if (events.clientCount() == 0) {
+    return;
   }
+  char data[48];
+  snprintf(data, sizeof(data), "{\"job\":%lu,\"state\":\"%s\"}", (unsigned long)job, JOB_STATE_NAMES[state]);
+  events.broadcast("job", data);
 }
 
+bool animationActive() {
+  return currentAnimation != ANIM_NONE || animationJobs.size() > 0;
+}
 
-void wifiFailedAnimation() {
-  for (int i = 0; i < 3; i++) { // Flash three times
-    ring.fill(ring.Color(255, 0, 0)); // Red
-    ring.show();
-    delay(200);
-    ring.clear();
-    ring.show();
-    delay(200);
+// Draws one frame of an animation and returns the delay in ms before the
+// next one, or 0 once it has finished (or its effect was stopped).
+uint16_t renderAnimationFrame(AnimationId id, uint32_t step) {
+  if (step == 0) {
+    bool started = id == ANIM_UPLOADED
+                       ? effectPlayer.start(queuedEffect, queuedEffectSize, false)
+                       : effectPlayer.start(BUILTIN_EFFECTS[id].program, BUILTIN_EFFECTS[id].size, true);
+    if (!started) {
+      LOG_WARN("Effect %s not played: %s", RENDERER_NAMES[id], effectPlayer.error());
+      return 0;
+    }
+  }
+  uint16_t waitMs = effectPlayer.renderFrame(canvas, step);
+  if (waitMs != 0) {
+    pushFrame();
+  } else if (effectPlayer.error() != nullptr) {
+    LOG_WARN("Effect %s stopped at frame %lu: %s", RENDERER_NAMES[id], (unsigned long)step, effectPlayer.error());
   }
+  return waitMs;
 }
 
+// Advances the current animation by at most one frame; starts the next
+// queued animation once the current one reports it has finished. Returns
+// true when a frame was drawn.
+bool serviceAnimation() {
+  if (currentAnimation == ANIM_NONE) {
+    AnimationJob job;
+    if (!animationJobs.pop(&job)) {
+      return false;
+    }
+    currentAnimation = job.animation;
+    currentAnimationJobId = job.id;
+    animationStep = 0;
+    animationNextFrameMs = millis();
+    publishJobState(job.id, JOB_RUNNING);
+  }
 
+  if ((long)(millis() - animationNextFrameMs) < 0) {
+    return false;
+  }
 
-
+  uint16_t waitMs = renderAnimationFrame(currentAnimation, animationStep);
+  if (waitMs == 0) {
+    currentAnimation = ANIM_NONE;
+    clockNeedsRedraw = true;
+    publishJobState(currentAnimationJobId, JOB_DONE);
+    return false;
+  }
+  animationStep++;
+  // Advance from the due time, not from now, so frame intervals that are not
+  // a multiple of the scheduler tick keep their average rate.
+  animationNextFrameMs += waitMs;
+  if ((long)(millis() - animationNextFrameMs) >= (long)waitMs) {
+    animationNextFrameMs = millis() + waitMs;
+  }
+  return true;
+}
@@ -0,0 +1,43 @@
+#include "metrics.h"
+
+#if CLOCK_METRICS
+
+#include "html_stream.h"
+
+namespace {
+
+void printHeader(HtmlStream& out, const char* name, const char* type, const char* help) {
+  out.print("# HELP ");
+  out.print(name);
+  out.print(" ");
+  out.print(help);
+  out.print("\n# TYPE ");
+  out.print(name);
+  out.print(" ");
+  out.print(type);
+  out.print("\n");
+}
+
+}  // namespace
+
+void printMetric(HtmlStream& out, const char* name, const char* type, const char* help, uint32_t value) {
+  printHeader(out, name, type, help);
+  out.printf("%s %lu\n", name, (unsigned long)value);
+}
+
+void LatencyHistogram::print(HtmlStream& out, const char* name, const char* help) const {
+  printHeader(out, name, "histogram", help);
+  uint32_t cumulative = 0;
+  for (uint8_t i = 0; i < BUCKETS - 1; i++) {
+    cumulative += counts_[i];
+    uint32_t boundUs = (uint32_t)1 << (i + shift_);
+    out.printf("%s_bucket{le=\"%lu.%06lu\"} %lu\n", name, (unsigned long)(boundUs / 1000000),
+               (unsigned long)(boundUs % 1000000), (unsigned long)cumulative);
+  }
+  cumulative += counts_[BUCKETS - 1];
+  out.printf("%s_bucket{le=\"+Inf\"} %lu\n", name, (unsigned long)cumulative);
+  out.printf("%s_sum %lu.%06lu\n", name, (unsigned long)(sumUs_ / 1000000), (unsigned long)(sumUs_ % 1000000));
+  out.printf("%s_count %lu\n", name, (unsigned long)cumulative);
+}
+
+#endif
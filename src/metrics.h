@@ -0,0 +1,66 @@
+#pragma once
+
+#include "hal.h"
+
+// Hot-path instrumentation behind /metrics. Build with -DCLOCK_METRICS=0
+// to remove it completely: the macros below then expand to nothing and
+// the endpoint is not registered.
+#ifndef CLOCK_METRICS
+#define CLOCK_METRICS 1
+#endif
+
+#if CLOCK_METRICS
+
+class HtmlStream;
+
+// Latency histogram with power-of-two buckets: bucket i counts samples of
+// at most 2^(i + shift) us (1 us .. ~1 s by default), the last one
+// everything slower. A shift of 10 covers 1 ms .. ~18 min, for slow
+// operations. A sample costs a count-leading-zeros and two adds into a
+// fixed array; nothing is allocated and nothing is reset, as Prometheus
+// expects.
+class LatencyHistogram {
+ public:
+  static const uint8_t BUCKETS = 22;
+
+  explicit LatencyHistogram(uint8_t shift = 0) : shift_(shift) {}
+
+  void record(uint32_t us) {
+    uint8_t bucket = us > 1 ? 32 - __builtin_clz(us - 1) : 0;
+    bucket = bucket > shift_ ? bucket - shift_ : 0;
+    counts_[bucket < BUCKETS - 1 ? bucket : BUCKETS - 1]++;
+    sumUs_ += us;
+  }
+
+  // Writes name_bucket{le="..."}, name_sum and name_count in seconds.
+  void print(HtmlStream& out, const char* name, const char* help) const;
+
+ private:
+  uint8_t shift_;
+  uint32_t counts_[BUCKETS] = {};
+  uint64_t sumUs_ = 0;
+};
+
+// Records the time from construction to the end of the enclosing scope.
+class ScopedLatency {
+ public:
+  explicit ScopedLatency(LatencyHistogram& histogram) : histogram_(histogram), startUs_(micros()) {}
+  ~ScopedLatency() { histogram_.record(micros() - startUs_); }
+
+ private:
+  LatencyHistogram& histogram_;
+  uint32_t startUs_;
+};
+
+// Writes one counter or gauge sample with its HELP and TYPE lines.
+void printMetric(HtmlStream& out, const char* name, const char* type, const char* help, uint32_t value);
+
+#define METRICS_TIME_SCOPE(histogram) ScopedLatency scopedLatency(histogram)
+#define METRICS_RECORD(histogram, us) (histogram).record(us)
+
+#else
+
+#define METRICS_TIME_SCOPE(histogram) do {} while (0)
+#define METRICS_RECORD(histogram, us) do {} while (0)
+
+#endif
@@ -0,0 +1,264 @@
+#include "ntp_client.h"
+
+#include "logger.h"
+
+namespace {
+
+const uint16_t LOCAL_PORT = 2390;
+const uint8_t PACKET_SIZE = 48;
+const uint32_t RESOLVE_TIMEOUT_MS = 3000;
+const uint32_t RESPONSE_TIMEOUT_MS = 1000;
+const uint32_t RETRY_MIN_S = 15;
+
+// Offsets above this are stepped; smaller ones are slewed at SLEW_PPM
+// (128 ms takes ~4 minutes to slew in).
+const int64_t STEP_THRESHOLD_US = 128000;
+// Poll interval doubles below the first bound and resets above the second.
+const int64_t POLL_GROW_OFFSET_US = 20000;
+const int64_t POLL_RESET_OFFSET_US = 100000;
+// Minimum spacing of two samples used to estimate drift.
+const uint64_t DRIFT_MIN_INTERVAL_US = 32ULL * 1000000ULL;
+
+// Seconds from 1900-01-01 (NTP era 0) to 1970-01-01.
+const int64_t NTP_UNIX_OFFSET_S = 2208988800LL;
+
+uint32_t readBe32(const uint8_t* p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+void writeBe32(uint8_t* p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+void unixUsToNtp(int64_t us, uint8_t* out) {
+  int64_t seconds = us / 1000000;
+  uint32_t micros = (uint32_t)(us - seconds * 1000000);
+  writeBe32(out, (uint32_t)(seconds + NTP_UNIX_OFFSET_S));  // wraps into era 1 after 2036
+  writeBe32(out + 4, (uint32_t)(((uint64_t)micros << 32) / 1000000));
+}
+
+int64_t ntpToUnixUs(const uint8_t* p) {
+  uint32_t seconds = readBe32(p);
+  uint32_t fraction = readBe32(p + 4);
+  int64_t unixSeconds = (int64_t)seconds - NTP_UNIX_OFFSET_S;
+  if (seconds < 0x80000000UL) {
+    unixSeconds += 0x100000000LL;  // Era 1 (from 2036-02-07)
+  }
+  return unixSeconds * 1000000 + (int64_t)(((uint64_t)fraction * 1000000) >> 32);
+}
+
+int64_t absUs(int64_t v) {
+  return v < 0 ? -v : v;
+}
+
+}  // namespace
+
+void NtpClient::setServers(const char* primary, const char* secondary, const char* tertiary) {
+  servers_[0] = primary;
+  servers_[1] = secondary;
+  servers_[2] = tertiary;
+}
+
+void NtpClient::requestSync() {
+  pollDue_ = true;
+}
+
+uint32_t NtpClient::secondsUntilPoll() const {
+  if (state_ != IDLE || pollDue_) {
+    return 0;
+  }
+  int32_t remaining = (int32_t)(nextPollMs_ - millis());
+  return remaining > 0 ? (uint32_t)remaining / 1000 : 0;
+}
+
+NtpEvent NtpClient::service() {
+  uint32_t now = millis();
+
+  if (state_ == IDLE) {
+    if (!pollDue_ && (int32_t)(now - nextPollMs_) < 0) {
+      return NTP_EVENT_NONE;
+    }
+    pollDue_ = false;
+    roundCount_++;
+    if (!udpOpen_) {
+      udpOpen_ = udp_.begin(LOCAL_PORT) != 0;
+      if (!udpOpen_) {
+        return finishRound();
+      }
+    }
+    best_ = {};
+    serverIndex_ = 0;
+    startServer();
+  } else if (state_ == RESOLVING) {
+    HalDnsResult result = halResolveHost(host_, &address_);
+    if (result == HAL_DNS_DONE) {
+      sendRequest();
+    } else if (result == HAL_DNS_FAILED || (int32_t)(now - deadlineMs_) >= 0) {
+      LOG_WARN("NTP: cannot resolve %s", host_);
+      nextServer();
+    }
+  } else {
+    Sample sample;
+    if (readResponse(&sample)) {
+      if (sample.valid && (!best_.valid || sample.delayUs < best_.delayUs)) {
+        best_ = sample;
+      }
+      nextServer();
+    } else if ((int32_t)(now - deadlineMs_) >= 0) {
+      LOG_WARN("NTP: no reply from %s", host_);
+      nextServer();
+    }
+  }
+
+  if (state_ == IDLE) {
+    return finishRound();
+  }
+  return NTP_EVENT_NONE;
+}
+
+// Starts resolving servers_[serverIndex_], skipping empty entries. Leaves
+// the state IDLE once every server has been tried.
+void NtpClient::startServer() {
+  while (serverIndex_ < MAX_SERVERS &&
+         (servers_[serverIndex_] == nullptr || servers_[serverIndex_][0] == '\0')) {
+    serverIndex_++;
+  }
+  if (serverIndex_ >= MAX_SERVERS) {
+    state_ = IDLE;
+    return;
+  }
+
+  strncpy(host_, servers_[serverIndex_], sizeof(host_));
+  host_[sizeof(host_) - 1] = '\0';
+  port_ = DEFAULT_PORT;
+  char* colon = strrchr(host_, ':');
+  if (colon != nullptr && colon[1] != '\0' && strspn(colon + 1, "0123456789") == strlen(colon + 1)) {
+    port_ = (uint16_t)atoi(colon + 1);
+    *colon = '\0';
+  }
+
+  state_ = RESOLVING;
+  deadlineMs_ = millis() + RESOLVE_TIMEOUT_MS;
+}
+
+void NtpClient::nextServer() {
+  serverIndex_++;
+  startServer();
+}
+
+void NtpClient::sendRequest() {
+  // Drop stale replies from an earlier server so they cannot be mistaken
+  // for this one's.
+  while (udp_.parsePacket() > 0) {
+  }
+
+  uint8_t packet[PACKET_SIZE] = {};
+  packet[0] = 0x23;  // LI 0, version 4, mode 3 (client)
+  requestUs_ = clock_.nowUs();
+  unixUsToNtp(requestUs_, requestStamp_);
+  memcpy(packet + 40, requestStamp_, sizeof(requestStamp_));
+
+  if (!udp_.beginPacket(address_, port_) || udp_.write(packet, PACKET_SIZE) != PACKET_SIZE || !udp_.endPacket()) {
+    LOG_WARN("NTP: send to %s failed", host_);
+    nextServer();
+    return;
+  }
+  state_ = WAITING;
+  deadlineMs_ = millis() + RESPONSE_TIMEOUT_MS;
+}
+
+// Returns true when a reply to the outstanding request was consumed;
+// sample->valid tells whether it is usable.
+bool NtpClient::readResponse(Sample* sample) {
+  int size = udp_.parsePacket();
+  if (size <= 0) {
+    return false;
+  }
+  int64_t t4 = clock_.nowUs();
+  uint8_t packet[PACKET_SIZE];
+  if (size < PACKET_SIZE || udp_.read(packet, PACKET_SIZE) != PACKET_SIZE ||
+      memcmp(packet + 24, requestStamp_, sizeof(requestStamp_)) != 0) {
+    return false;  // Not ours; keep waiting
+  }
+
+  sample->valid = false;
+  uint8_t leap = packet[0] >> 6;
+  uint8_t mode = packet[0] & 0x07;
+  uint8_t stratum = packet[1];
+  if (mode != 4 || leap == 3 || stratum == 0 || stratum > 15 || readBe32(packet + 40) == 0) {
+    LOG_WARN("NTP: %s unsynchronised or refused (stratum %u)", host_, stratum);
+    return true;
+  }
+
+  int64_t t1 = requestUs_;
+  int64_t t2 = ntpToUnixUs(packet + 32);
+  int64_t t3 = ntpToUnixUs(packet + 40);
+  int64_t delay = (t4 - t1) - (t3 - t2);
+  sample->valid = true;
+  sample->offsetUs = ((t2 - t1) + (t3 - t4)) / 2;
+  sample->delayUs = delay < 0 ? 0 : delay;
+  sample->server = serverIndex_;
+  return true;
+}
+
+NtpEvent NtpClient::finishRound() {
+  if (!best_.valid) {
+    uint32_t retryS = RETRY_MIN_S << (failures_ < 5 ? failures_ : 5);
+    if (retryS > pollIntervalS_) {
+      retryS = pollIntervalS_;
+    }
+    if (failures_ < 255) {
+      failures_++;
+    }
+    nextPollMs_ = millis() + retryS * 1000;
+    LOG_WARN("NTP sync failed, retry in %u s", (unsigned)retryS);
+    return NTP_EVENT_FAILED;
+  }
+
+  applySample(best_);
+  best_.valid = false;
+  failures_ = 0;
+  nextPollMs_ = millis() + pollIntervalS_ * 1000;
+  return NTP_EVENT_SYNCED;
+}
+
+void NtpClient::applySample(const Sample& sample) {
+  uint64_t mono = halMicros64();
+  int64_t offset = sample.offsetUs;
+
+  lastStepped_ = !clock_.isSet() || absUs(offset) > STEP_THRESHOLD_US;
+  if (lastStepped_) {
+    clock_.step(clock_.nowUs() + offset);
+    pollIntervalS_ = MIN_POLL_S;
+    driftBaseValid_ = true;
+    driftBaseMono_ = mono;
+  } else {
+    // What is left of the previous correction is part of this offset;
+    // the rest accumulated through frequency error since the last sample.
+    if (driftBaseValid_ && mono - driftBaseMono_ >= DRIFT_MIN_INTERVAL_US) {
+      int64_t drifted = offset - clock_.pendingSlewUs();
+      int64_t ppb = drifted * 1000000000LL / (int64_t)(mono - driftBaseMono_);
+      clock_.setDriftPpb(clock_.driftPpb() + (int32_t)(ppb / 2));  // FLL gain 1/2
+      driftBaseMono_ = mono;
+    } else if (!driftBaseValid_) {
+      driftBaseValid_ = true;
+      driftBaseMono_ = mono;
+    }
+    clock_.slew(offset);
+
+    if (absUs(offset) < POLL_GROW_OFFSET_US) {
+      pollIntervalS_ = pollIntervalS_ * 2 > MAX_POLL_S ? MAX_POLL_S : pollIntervalS_ * 2;
+    } else if (absUs(offset) > POLL_RESET_OFFSET_US) {
+      pollIntervalS_ = MIN_POLL_S;
+    }
+  }
+
+  syncCount_++;
+  lastOffsetUs_ = (int32_t)(offset > INT32_MAX ? INT32_MAX : (offset < INT32_MIN ? INT32_MIN : offset));
+  lastDelayUs_ = (int32_t)(sample.delayUs > INT32_MAX ? INT32_MAX : sample.delayUs);
+  strncpy(lastServer_, servers_[sample.server], sizeof(lastServer_));
+  lastServer_[sizeof(lastServer_) - 1] = '\0';
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "hal.h"
+#include "system_clock.h"
+
+enum NtpEvent : uint8_t {
+  NTP_EVENT_NONE = 0,
+  NTP_EVENT_SYNCED,  // A round finished and the clock was corrected
+  NTP_EVENT_FAILED,  // No server answered; a retry is scheduled
+};
+
+// Non-blocking SNTP client (RFC 4330). A sync round queries each server
+// once, keeps the sample with the smallest round-trip delay and feeds it
+// to the SystemClock: large errors are stepped, the rest slewed. The
+// residual offset between rounds trains the clock's drift estimate, and
+// the poll interval doubles while the clock stays within a few ms.
+//
+// service() must be called from loop(); each call does at most one DNS
+// poll, one send or one receive and returns immediately.
+class NtpClient {
+ public:
+  static const uint8_t MAX_SERVERS = 3;
+  static const uint16_t DEFAULT_PORT = 123;
+  static const uint32_t MIN_POLL_S = 64;
+  static const uint32_t MAX_POLL_S = 2048;
+
+  explicit NtpClient(SystemClock& clock) : clock_(clock) {}
+
+  // Server names are "host" or "host:port" and are read on every round,
+  // so the strings must outlive the client. Null entries are skipped.
+  void setServers(const char* primary, const char* secondary, const char* tertiary);
+  // Starts a round on the next service() call.
+  void requestSync();
+  NtpEvent service();
+
+  bool synced() const { return syncCount_ > 0; }
+  uint32_t syncCount() const { return syncCount_; }
+  // Rounds started, successful or not.
+  uint32_t roundCount() const { return roundCount_; }
+  // Offset of the last sample; only meaningful when it was slewed, a step
+  // from an unset clock measures the time since boot.
+  int32_t lastOffsetUs() const { return lastOffsetUs_; }
+  bool lastStepped() const { return lastStepped_; }
+  int32_t lastDelayUs() const { return lastDelayUs_; }
+  const char* lastServer() const { return lastServer_; }
+  uint32_t pollIntervalS() const { return pollIntervalS_; }
+  // Seconds until the next round, 0 while one is running.
+  uint32_t secondsUntilPoll() const;
+
+ private:
+  enum State : uint8_t { IDLE, RESOLVING, WAITING };
+
+  struct Sample {
+    bool valid;
+    int64_t offsetUs;
+    int64_t delayUs;
+    uint8_t server;
+  };
+
+  void startServer();
+  void nextServer();
+  void sendRequest();
+  bool readResponse(Sample* sample);
+  NtpEvent finishRound();
+  void applySample(const Sample& sample);
+
+  SystemClock& clock_;
+  const char* servers_[MAX_SERVERS] = {nullptr, nullptr, nullptr};
+  WiFiUDP udp_;
+  bool udpOpen_ = false;
+
+  State state_ = IDLE;
+  uint8_t serverIndex_ = 0;
+  char host_[64];
+  uint16_t port_ = DEFAULT_PORT;
+  IPAddress address_;
+  uint32_t deadlineMs_ = 0;
+  uint8_t requestStamp_[8];  // Our transmit timestamp, echoed as originate
+  int64_t requestUs_ = 0;
+  Sample best_ = {};
+
+  bool pollDue_ = true;
+  uint32_t nextPollMs_ = 0;
+  uint32_t pollIntervalS_ = MIN_POLL_S;
+  uint8_t failures_ = 0;
+
+  uint32_t syncCount_ = 0;
+  uint32_t roundCount_ = 0;
+  int32_t lastOffsetUs_ = 0;
+  bool lastStepped_ = false;
+  int32_t lastDelayUs_ = 0;
+  char lastServer_[64] = "";
+  // Drift training: monotonic time of the last slewed sample.
+  bool driftBaseValid_ = false;
+  uint64_t driftBaseMono_ = 0;
+};
@@ -0,0 +1,143 @@
+#include "phase_sync.h"
+
+#include "logger.h"
+
+const char* const SYNC_ROLE_NAMES[SYNC_ROLE_COUNT] = {"off", "leader", "follower"};
+
+namespace {
+
+const uint8_t BEACON_SIZE = 16;
+const uint8_t BEACON_VERSION = 1;
+const IPAddress BEACON_GROUP(239, 255, 12, 31);
+// Followers step rather than slew beyond this, so clocks side by side
+// agree within a few ms after one window instead of after a slew of up to
+// 40 s (20 ms at 500 ppm). A step this small is invisible on the dial.
+const int64_t STEP_THRESHOLD_US = 4000;
+
+int64_t absUs(int64_t v) {
+  return v < 0 ? -v : v;
+}
+
+int32_t clampUs(int64_t v) {
+  return (int32_t)(v > INT32_MAX ? INT32_MAX : (v < INT32_MIN ? INT32_MIN : v));
+}
+
+}  // namespace
+
+void PhaseSync::setRole(PhaseSyncRole role) {
+  if (role == role_) {
+    return;
+  }
+  udp_.stop();
+  open_ = false;
+  role_ = role;
+  following_ = false;
+  windowCount_ = 0;
+}
+
+bool PhaseSync::service(uint32_t nowMs) {
+  if (role_ == SYNC_LEADER) {
+    if (clock_.isSet() && (int32_t)(nowMs - nextBeaconMs_) >= 0) {
+      nextBeaconMs_ = nowMs + BEACON_INTERVAL_MS;
+      sendBeacon();
+    }
+    return false;
+  }
+  if (role_ != SYNC_FOLLOWER) {
+    return false;
+  }
+  if (!open_) {
+    open_ = udp_.beginMulticast(WiFi.localIP(), BEACON_GROUP, PORT) != 0;
+    if (!open_) {
+      return false;
+    }
+  }
+  bool corrected = false;
+  while (udp_.parsePacket() > 0) {
+    corrected |= readBeacon(nowMs);
+  }
+  if (following_ && nowMs - lastBeaconMs_ >= LEADER_TIMEOUT_MS) {
+    LOG_WARN("Phase sync: leader lost, back to NTP");
+    following_ = false;
+    windowCount_ = 0;
+  }
+  return corrected;
+}
+
+void PhaseSync::sendBeacon() {
+  uint8_t beacon[BEACON_SIZE] = {'C', 'S', BEACON_VERSION, 0};
+  uint32_t sequence = sequence_++;
+  for (int i = 0; i < 4; i++) {
+    beacon[4 + i] = (uint8_t)(sequence >> (24 - 8 * i));
+  }
+  if (!udp_.beginPacketMulticast(BEACON_GROUP, PORT, WiFi.localIP(), 1)) {
+    return;
+  }
+  uint64_t utcUs = (uint64_t)clock_.nowUs();
+  for (int i = 0; i < 8; i++) {
+    beacon[8 + i] = (uint8_t)(utcUs >> (56 - 8 * i));
+  }
+  udp_.write(beacon, BEACON_SIZE);
+  udp_.endPacket();
+  beacons_++;
+}
+
+bool PhaseSync::readBeacon(uint32_t nowMs) {
+  int64_t localUs = clock_.nowUs();
+  uint8_t beacon[BEACON_SIZE];
+  if (udp_.read(beacon, BEACON_SIZE) != BEACON_SIZE || beacon[0] != 'C' || beacon[1] != 'S' ||
+      beacon[2] != BEACON_VERSION) {
+    return false;
+  }
+  IPAddress from = udp_.remoteIP();
+  if (following_ && from != leader_) {
+    return false;
+  }
+  uint64_t leaderUs = 0;
+  for (int i = 0; i < 8; i++) {
+    leaderUs = (leaderUs << 8) | beacon[8 + i];
+  }
+  beacons_++;
+  lastBeaconMs_ = nowMs;
+  int64_t residual = (int64_t)leaderUs - localUs - clock_.pendingSlewUs();
+
+  if (!following_) {
+    following_ = true;
+    leader_ = from;
+    windowCount_ = 0;
+    LOG_INFO("Phase sync: following %u.%u.%u.%u", from[0], from[1], from[2], from[3]);
+    // Lock on at once rather than a window later, if it is far off.
+    if (!clock_.isSet() || absUs(residual) > STEP_THRESHOLD_US) {
+      correct(residual);
+      return true;
+    }
+  }
+
+  if (windowCount_ == 0 || residual > windowMaxUs_) {
+    windowMaxUs_ = residual;
+  }
+  if (windowCount_ == 0 || residual < windowMinUs_) {
+    windowMinUs_ = residual;
+  }
+  if (++windowCount_ < WINDOW) {
+    return false;
+  }
+  windowCount_ = 0;
+  jitterUs_ = clampUs(windowMaxUs_ - windowMinUs_);
+  correct(windowMaxUs_);
+  return true;
+}
+
+// Applies a residual offset: on top of what is still being slewed, or as
+// a step when the total is large.
+void PhaseSync::correct(int64_t residualUs) {
+  int64_t offset = residualUs + clock_.pendingSlewUs();
+  lastStepped_ = !clock_.isSet() || absUs(offset) > STEP_THRESHOLD_US;
+  if (lastStepped_) {
+    clock_.step(clock_.nowUs() + offset);
+  } else {
+    clock_.slew(offset);
+  }
+  lastOffsetUs_ = clampUs(offset);
+  corrections_++;
+}
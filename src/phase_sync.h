@@ -0,0 +1,83 @@
+#pragma once
+
+#include "hal.h"
+#include "system_clock.h"
+
+enum PhaseSyncRole : uint8_t {
+  SYNC_OFF,
+  SYNC_LEADER,    // Multicasts beacons from its (NTP-disciplined) clock
+  SYNC_FOLLOWER,  // Follows the leader's clock instead of polling NTP
+  SYNC_ROLE_COUNT
+};
+
+extern const char* const SYNC_ROLE_NAMES[SYNC_ROLE_COUNT];
+
+// Keeps the clocks on one LAN ticking together. The leader multicasts a
+// 16-byte beacon with its UTC time once a second:
+//
+//   0  'C' 'S'
+//   2  version (1)
+//   3  reserved (0)
+//   4  uint32 sequence
+//   8  int64 leader UTC in microseconds, taken just before sending
+//
+// (big-endian). A follower compares each beacon with its own clock. The
+// one-way delay only ever makes the leader look behind, so over a window
+// of WINDOW beacons the largest difference is the best offset estimate;
+// the spread is reported as jitter. The offset is slewed into the
+// SystemClock like an NTP correction (stepped when large or when the clock
+// is unset), and the frame scheduler's second alignment does the rest.
+class PhaseSync {
+ public:
+  static const uint16_t PORT = 4061;
+  static const uint32_t BEACON_INTERVAL_MS = 1000;
+  static const uint8_t WINDOW = 8;
+  static const uint32_t LEADER_TIMEOUT_MS = 10000;
+
+  explicit PhaseSync(SystemClock& clock) : clock_(clock) {}
+
+  void setRole(PhaseSyncRole role);
+  PhaseSyncRole role() const { return role_; }
+
+  // Call from loop(): sends a due beacon or reads waiting ones. Returns
+  // true when a follower corrected its clock.
+  bool service(uint32_t nowMs);
+
+  // A follower that has heard its leader within LEADER_TIMEOUT_MS. It
+  // does not need NTP meanwhile.
+  bool following() const { return following_; }
+  IPAddress leader() const { return leader_; }
+  // Follower: last correction and the beacon spread in its window.
+  int32_t lastOffsetUs() const { return lastOffsetUs_; }
+  int32_t jitterUs() const { return jitterUs_; }
+  bool lastStepped() const { return lastStepped_; }
+  uint32_t beacons() const { return beacons_; }
+  uint32_t corrections() const { return corrections_; }
+
+ private:
+  void sendBeacon();
+  bool readBeacon(uint32_t nowMs);
+  void correct(int64_t offsetUs);
+
+  SystemClock& clock_;
+  WiFiUDP udp_;
+  PhaseSyncRole role_ = SYNC_OFF;
+  bool open_ = false;
+  uint32_t sequence_ = 0;
+  uint32_t nextBeaconMs_ = 0;
+
+  bool following_ = false;
+  IPAddress leader_;
+  uint32_t lastBeaconMs_ = 0;
+  // Current window: residual offsets (leader - local, less any slew still
+  // pending) of the beacons so far.
+  uint8_t windowCount_ = 0;
+  int64_t windowMaxUs_ = 0;
+  int64_t windowMinUs_ = 0;
+
+  int32_t lastOffsetUs_ = 0;
+  int32_t jitterUs_ = 0;
+  bool lastStepped_ = false;
+  uint32_t beacons_ = 0;
+  uint32_t corrections_ = 0;
+};
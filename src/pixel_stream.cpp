@@ -0,0 +1,155 @@
+#include "pixel_stream.h"
+
+namespace {
+
+// DDP, http://www.3waylabs.com/ddp/
+const size_t DDP_HEADER_SIZE = 10;
+const size_t DDP_TIMECODE_SIZE = 4;
+const uint8_t DDP_VERSION_MASK = 0xC0;
+const uint8_t DDP_VERSION_1 = 0x40;
+const uint8_t DDP_FLAG_TIMECODE = 0x10;
+const uint8_t DDP_FLAG_REPLY = 0x04;
+const uint8_t DDP_FLAG_QUERY = 0x02;
+const uint8_t DDP_FLAG_PUSH = 0x01;
+const uint8_t DDP_TYPE_UNDEFINED = 0x00;
+const uint8_t DDP_TYPE_RGB8 = 0x0B;
+const uint8_t DDP_ID_DISPLAY = 1;
+const uint8_t DDP_ID_ALL = 255;
+
+// E1.31 data packet: root, framing and DMP layers up to the start code.
+const size_t E131_HEADER_SIZE = 126;
+const uint8_t E131_ACN_ID[12] = {'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0};
+const uint32_t E131_VECTOR_ROOT_DATA = 0x00000004;
+const uint32_t E131_VECTOR_FRAMING_DATA = 0x00000002;
+const uint8_t E131_VECTOR_DMP_SET_PROPERTY = 0x02;
+const uint8_t E131_OPTION_TERMINATED = 0x40;
+const uint8_t E131_OPTION_PREVIEW = 0x80;
+
+uint16_t be16(const uint8_t* p) {
+  return ((uint16_t)p[0] << 8) | p[1];
+}
+
+uint32_t be32(const uint8_t* p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+}  // namespace
+
+bool PixelStream::begin() {
+  if (!open_) {
+    open_ = ddp_.begin(DDP_PORT) != 0 && e131_.begin(E131_PORT) != 0;
+  }
+  return open_;
+}
+
+bool PixelStream::service(uint32_t nowMs) {
+  if (!begin()) {
+    return false;
+  }
+  bool push = false;
+  bool terminated = false;
+  while (ddp_.parsePacket() > 0) {
+    if (readDdp(&push)) {
+      accept(nowMs);
+    } else {
+      rejected_++;
+    }
+  }
+  while (e131_.parsePacket() > 0) {
+    if (readE131(&push, &terminated)) {
+      accept(nowMs);
+    } else if (!terminated) {
+      rejected_++;
+    }
+  }
+  if (terminated || (active_ && nowMs - lastPacketMs_ >= TIMEOUT_MS)) {
+    active_ = false;
+  }
+  if (!push || !active_) {
+    return false;
+  }
+  frames_++;
+  return true;
+}
+
+void PixelStream::accept(uint32_t nowMs) {
+  packets_++;
+  lastPacketMs_ = nowMs;
+  active_ = true;
+}
+
+bool PixelStream::readDdp(bool* push) {
+  uint8_t header[DDP_HEADER_SIZE + DDP_TIMECODE_SIZE];
+  if (ddp_.read(header, DDP_HEADER_SIZE) != (int)DDP_HEADER_SIZE) {
+    return false;
+  }
+  uint8_t flags = header[0];
+  if ((flags & DDP_VERSION_MASK) != DDP_VERSION_1 || (flags & (DDP_FLAG_REPLY | DDP_FLAG_QUERY)) != 0) {
+    return false;
+  }
+  if ((flags & DDP_FLAG_TIMECODE) != 0 &&
+      ddp_.read(header + DDP_HEADER_SIZE, DDP_TIMECODE_SIZE) != (int)DDP_TIMECODE_SIZE) {
+    return false;
+  }
+  uint8_t type = header[2];
+  uint8_t id = header[3];
+  uint32_t offset = be32(header + 4);
+  uint16_t length = be16(header + 8);
+  if ((type != DDP_TYPE_UNDEFINED && type != DDP_TYPE_RGB8) || (id != DDP_ID_DISPLAY && id != DDP_ID_ALL) ||
+      offset % 3 != 0 || length % 3 != 0 || length > (size_t)ddp_.available()) {
+    return false;
+  }
+  readPixels(ddp_, offset, length);
+  if ((flags & DDP_FLAG_PUSH) != 0) {
+    *push = true;
+  }
+  return true;
+}
+
+bool PixelStream::readE131(bool* push, bool* terminated) {
+  uint8_t header[E131_HEADER_SIZE];
+  if (e131_.read(header, E131_HEADER_SIZE) != (int)E131_HEADER_SIZE) {
+    return false;
+  }
+  if (be16(header) != 0x0010 || memcmp(header + 4, E131_ACN_ID, sizeof(E131_ACN_ID)) != 0 ||
+      be32(header + 18) != E131_VECTOR_ROOT_DATA || be32(header + 40) != E131_VECTOR_FRAMING_DATA ||
+      header[117] != E131_VECTOR_DMP_SET_PROPERTY || header[118] != 0xA1 || header[125] != 0x00) {
+    return false;
+  }
+  uint8_t options = header[112];
+  if ((options & E131_OPTION_PREVIEW) != 0) {
+    return false;
+  }
+  if ((options & E131_OPTION_TERMINATED) != 0) {
+    *terminated = true;
+    return false;
+  }
+  uint16_t universe = be16(header + 113);
+  uint16_t channels = be16(header + 123);
+  if (universe < FIRST_UNIVERSE || channels == 0 || (size_t)(channels - 1) > (size_t)e131_.available()) {
+    return false;
+  }
+  size_t length = (channels - 1) / 3 * 3;
+  size_t offset = (size_t)(universe - FIRST_UNIVERSE) * LEDS_PER_UNIVERSE * 3;
+  readPixels(e131_, offset, length);
+  if (offset < frameBytes_ && offset + LEDS_PER_UNIVERSE * 3 >= frameBytes_) {
+    *push = true;
+  }
+  return true;
+}
+
+void PixelStream::readPixels(WiFiUDP& udp, size_t offset, size_t length) {
+  if (offset >= frameBytes_) {
+    return;
+  }
+  if (length > frameBytes_ - offset) {
+    length = frameBytes_ - offset;
+  }
+  uint8_t* pixels = frame_ + offset;
+  udp.read(pixels, length);
+  for (size_t i = 0; i < length; i += 3) {
+    uint8_t red = pixels[i];
+    pixels[i] = pixels[i + 1];
+    pixels[i + 1] = red;
+  }
+}
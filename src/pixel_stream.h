@@ -0,0 +1,58 @@
+#pragma once
+
+#include "hal.h"
+
+// Realtime pixel data from a lighting controller, over DDP (UDP 4048) or
+// E1.31 / sACN (UDP 5568, unicast). Headers are read into a small stack
+// buffer and checked; pixel payloads are read from the UDP packet straight
+// into the frame buffer and swapped from RGB to GRB in place, so nothing
+// is allocated or copied twice.
+//
+// E1.31 universes hold 170 LEDs each, starting at universe
+// FIRST_UNIVERSE. DDP offsets are bytes of RGB data and must be whole LEDs.
+class PixelStream {
+ public:
+  static const uint16_t DDP_PORT = 4048;
+  static const uint16_t E131_PORT = 5568;
+  static const uint16_t FIRST_UNIVERSE = 1;
+  static const uint16_t LEDS_PER_UNIVERSE = 170;
+  // Streaming ends this long after the last packet.
+  static const uint32_t TIMEOUT_MS = 2500;
+
+  // `frame` is a GRB buffer of `frameBytes` bytes (3 per LED).
+  PixelStream(uint8_t* frame, size_t frameBytes) : frame_(frame), frameBytes_(frameBytes) {}
+
+  // Opens the sockets; service() calls it until it succeeds.
+  bool begin();
+  // Reads every waiting packet. Returns true when a frame is complete: a
+  // DDP packet with the push flag, or the E1.31 universe holding the last
+  // LED.
+  bool service(uint32_t nowMs);
+  // A packet arrived within TIMEOUT_MS and the sender did not end the
+  // stream. Updated by service().
+  bool active() const { return active_; }
+
+  uint32_t packets() const { return packets_; }
+  uint32_t frames() const { return frames_; }
+  // Packets that were not valid DDP / E1.31 data for this strip.
+  uint32_t rejected() const { return rejected_; }
+
+ private:
+  void accept(uint32_t nowMs);
+  bool readDdp(bool* push);
+  // A packet with the stream-terminated option sets *terminated instead.
+  bool readE131(bool* push, bool* terminated);
+  // Reads `length` RGB bytes to `offset` of the frame, clipped to its end.
+  void readPixels(WiFiUDP& udp, size_t offset, size_t length);
+
+  uint8_t* frame_;
+  size_t frameBytes_;
+  WiFiUDP ddp_;
+  WiFiUDP e131_;
+  bool open_ = false;
+  bool active_ = false;
+  uint32_t lastPacketMs_ = 0;
+  uint32_t packets_ = 0;
+  uint32_t frames_ = 0;
+  uint32_t rejected_ = 0;
+};
@@ -0,0 +1,199 @@
+#include "schedule.h"
+
+const char* const SCHEDULE_ACTION_NAMES[SCHEDULE_ACTION_COUNT] = {"off", "alarm", "chime", "brightness"};
+const char* const SCHEDULE_DAY_NAMES[7] = {"sun", "mon", "tue", "wed", "thu", "fri", "sat"};
+
+namespace {
+
+const int32_t SECONDS_PER_DAY = 86400;
+// Days searched for the next (or last) firing; an entry fires at least
+// once a week.
+const int64_t SEARCH_DAYS = 8;
+
+int64_t floorDiv(int64_t a, int64_t b) {
+  int64_t q = a / b;
+  return (a % b != 0 && ((a < 0) != (b < 0))) ? q - 1 : q;
+}
+
+// tm_wday of a day counted from 1970-01-01, a Thursday.
+uint8_t weekdayOfDays(int64_t days) {
+  return (uint8_t)(((days % 7) + 11) % 7);
+}
+
+}  // namespace
+
+bool Schedule::set(uint8_t slot, const ScheduleEntry& entry) {
+  if (slot >= MAX_ENTRIES || entry.action >= SCHEDULE_ACTION_COUNT) {
+    return false;
+  }
+  if (entry.action == SCHEDULE_OFF) {
+    entries_[slot] = ScheduleEntry();
+  } else if (entry.hour > SCHEDULE_EVERY_HOUR || entry.minute > 59 || entry.days == 0 ||
+             (entry.days & ~SCHEDULE_EVERY_DAY) != 0) {
+    return false;
+  } else {
+    entries_[slot] = entry;
+  }
+  dirty_ = true;
+  return true;
+}
+
+bool Schedule::next(uint8_t* slot, int64_t* utc) const {
+  if (heapSize_ == 0 || nextUtc_ == INT64_MAX) {
+    return false;
+  }
+  *slot = heap_[0];
+  *utc = nextUtc_;
+  return true;
+}
+
+void Schedule::service(int64_t utc, FireFn fn, void* context) {
+  if (dirty_ || utc < lastUtc_ || utc - lastUtc_ > MAX_CATCH_UP_S) {
+    rebuild(utc);
+  }
+  lastUtc_ = utc;
+  while (utc >= nextUtc_) {
+    uint8_t slot = heap_[0];
+    const ScheduleEntry& entry = entries_[slot];
+    if (entry.action == SCHEDULE_BRIGHTNESS) {
+      brightness_ = entry.value;
+    }
+    fireUtc_[slot] = fireAfter(entry, utc);
+    siftDown(0);
+    nextUtc_ = fireUtc_[heap_[0]];
+    fn(slot, entry, context);
+  }
+}
+
+// Refills the heap from `utc`, and takes the brightness from the last
+// brightness entry that fired before it (the highest slot on a tie, the
+// one service() would have fired last).
+void Schedule::rebuild(int64_t utc) {
+  heapSize_ = 0;
+  brightness_ = DEFAULT_BRIGHTNESS;
+  int64_t lastBrightnessUtc = INT64_MIN;
+  for (uint8_t slot = 0; slot < MAX_ENTRIES; slot++) {
+    const ScheduleEntry& entry = entries_[slot];
+    if (entry.action == SCHEDULE_OFF) {
+      continue;
+    }
+    fireUtc_[slot] = fireAfter(entry, utc);
+    heap_[heapSize_] = slot;
+    siftUp(heapSize_++);
+    if (entry.action == SCHEDULE_BRIGHTNESS) {
+      int64_t last = fireAtOrBefore(entry, utc);
+      if (last != INT64_MIN && last >= lastBrightnessUtc) {
+        lastBrightnessUtc = last;
+        brightness_ = entry.value;
+      }
+    }
+  }
+  nextUtc_ = heapSize_ > 0 ? fireUtc_[heap_[0]] : INT64_MAX;
+  dirty_ = false;
+}
+
+int64_t Schedule::fireAfter(const ScheduleEntry& entry, int64_t utc) {
+  if (entry.action == SCHEDULE_OFF || entry.days == 0) {
+    return INT64_MAX;
+  }
+  uint8_t firstHour = entry.hour == SCHEDULE_EVERY_HOUR ? 0 : entry.hour;
+  uint8_t lastHour = entry.hour == SCHEDULE_EVERY_HOUR ? 23 : entry.hour;
+  int64_t today = floorDiv(utc + zone_.utcOffset(utc), SECONDS_PER_DAY);
+  for (int64_t day = today - 1; day <= today + SEARCH_DAYS; day++) {
+    if ((entry.days & (1 << weekdayOfDays(day))) == 0) {
+      continue;
+    }
+    for (uint8_t hour = firstHour; hour <= lastHour; hour++) {
+      int64_t fire = localToUtc(day * SECONDS_PER_DAY + hour * 3600 + entry.minute * 60);
+      if (fire > utc) {
+        return fire;
+      }
+    }
+  }
+  return INT64_MAX;
+}
+
+int64_t Schedule::fireAtOrBefore(const ScheduleEntry& entry, int64_t utc) {
+  if (entry.action == SCHEDULE_OFF || entry.days == 0) {
+    return INT64_MIN;
+  }
+  int firstHour = entry.hour == SCHEDULE_EVERY_HOUR ? 23 : entry.hour;
+  int lastHour = entry.hour == SCHEDULE_EVERY_HOUR ? 0 : entry.hour;
+  int64_t today = floorDiv(utc + zone_.utcOffset(utc), SECONDS_PER_DAY);
+  for (int64_t day = today + 1; day >= today - SEARCH_DAYS; day--) {
+    if ((entry.days & (1 << weekdayOfDays(day))) == 0) {
+      continue;
+    }
+    for (int hour = firstHour; hour >= lastHour; hour--) {
+      int64_t fire = localToUtc(day * SECONDS_PER_DAY + hour * 3600 + entry.minute * 60);
+      if (fire <= utc) {
+        return fire;
+      }
+    }
+  }
+  return INT64_MIN;
+}
+
+// UTC time of the local time `local` (seconds since the epoch, as if the
+// local time were UTC). Assumes transitions are more than a day apart, so
+// the offsets a day either side are the ones around any change near it.
+int64_t Schedule::localToUtc(int64_t local) {
+  int32_t before = zone_.utcOffset(local - SECONDS_PER_DAY);
+  int32_t after = zone_.utcOffset(local + SECONDS_PER_DAY);
+  // With the larger offset the instant is earlier: the first of two.
+  int32_t larger = before > after ? before : after;
+  int32_t smaller = before > after ? after : before;
+  if (zone_.utcOffset(local - larger) == larger) {
+    return local - larger;
+  }
+  if (zone_.utcOffset(local - smaller) == smaller) {
+    return local - smaller;
+  }
+  // Skipped by a change to a larger offset: find the moment of the change,
+  // which lies between the two readings.
+  int64_t low = local - after;   // Still `before`
+  int64_t high = local - before; // Already `after`
+  while (high - low > 1) {
+    int64_t middle = low + (high - low) / 2;
+    if (zone_.utcOffset(middle) == before) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+  }
+  return high;
+}
+
+void Schedule::siftUp(uint8_t i) {
+  while (i > 0) {
+    uint8_t parent = (i - 1) / 2;
+    uint8_t a = heap_[i];
+    uint8_t b = heap_[parent];
+    if (fireUtc_[b] < fireUtc_[a] || (fireUtc_[b] == fireUtc_[a] && b < a)) {
+      break;
+    }
+    heap_[i] = b;
+    heap_[parent] = a;
+    i = parent;
+  }
+}
+
+void Schedule::siftDown(uint8_t i) {
+  while (true) {
+    uint8_t smallest = i;
+    for (uint8_t child = 2 * i + 1; child <= 2 * i + 2 && child < heapSize_; child++) {
+      uint8_t a = heap_[child];
+      uint8_t b = heap_[smallest];
+      if (fireUtc_[a] < fireUtc_[b] || (fireUtc_[a] == fireUtc_[b] && a < b)) {
+        smallest = child;
+      }
+    }
+    if (smallest == i) {
+      return;
+    }
+    uint8_t slot = heap_[i];
+    heap_[i] = heap_[smallest];
+    heap_[smallest] = slot;
+    i = smallest;
+  }
+}
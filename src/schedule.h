@@ -0,0 +1,86 @@
+#pragma once
+
+#include "hal.h"
+#include "timezone.h"
+
+enum ScheduleAction : uint8_t {
+  SCHEDULE_OFF,         // Empty slot
+  SCHEDULE_ALARM,       // Plays the alarm effect
+  SCHEDULE_CHIME,       // Plays the chime effect
+  SCHEDULE_BRIGHTNESS,  // Sets the brightness to `value` until the next one
+  SCHEDULE_ACTION_COUNT
+};
+
+extern const char* const SCHEDULE_ACTION_NAMES[SCHEDULE_ACTION_COUNT];
+extern const char* const SCHEDULE_DAY_NAMES[7];
+
+const uint8_t SCHEDULE_EVERY_HOUR = 24;
+const uint8_t SCHEDULE_EVERY_DAY = 0x7F;
+
+// One recurring event, in local time. Saved in the settings as it is.
+struct ScheduleEntry {
+  uint8_t action;  // ScheduleAction
+  uint8_t hour;    // 0..23, or SCHEDULE_EVERY_HOUR
+  uint8_t minute;
+  uint8_t days;    // Bit n = weekday n (tm_wday, 0 = Sunday)
+  uint8_t value;   // Brightness, for SCHEDULE_BRIGHTNESS
+};
+
+// Recurring events at a local time of day on some weekdays: alarms,
+// chimes, and brightness changes (night mode). Each entry's next firing,
+// in UTC seconds, is kept in a min-heap, so service() costs one
+// comparison per call until the earliest one is due.
+//
+// Firing times follow the timezone's DST rules: a local time that is
+// skipped when the clocks go forward fires at the moment of the change,
+// one that occurs twice when they go back fires the first time only.
+// They are recomputed when the entries or the timezone change (see
+// invalidate()) and when the clock jumps; after a jump the events passed
+// over are not fired, but the brightness follows the last one.
+class Schedule {
+ public:
+  static const uint8_t MAX_ENTRIES = 8;
+  static const uint8_t DEFAULT_BRIGHTNESS = 255;
+  // A forward jump up to this long still fires the events passed over.
+  static const int64_t MAX_CATCH_UP_S = 60;
+
+  typedef void (*FireFn)(uint8_t slot, const ScheduleEntry& entry, void* context);
+
+  explicit Schedule(Timezone& zone) : zone_(zone) {}
+
+  // Returns false, changing nothing, for an out-of-range entry.
+  bool set(uint8_t slot, const ScheduleEntry& entry);
+  const ScheduleEntry& entry(uint8_t slot) const { return entries_[slot]; }
+  // Recompute the firing times on the next service(), e.g. after a
+  // timezone change.
+  void invalidate() { dirty_ = true; }
+
+  // Calls `fn` for each entry due at `utc` (seconds).
+  void service(int64_t utc, FireFn fn, void* context);
+
+  // Set by the latest brightness entry, DEFAULT_BRIGHTNESS without one.
+  uint8_t brightness() const { return brightness_; }
+  // Next entry to fire and when, or false when there is none.
+  bool next(uint8_t* slot, int64_t* utc) const;
+
+  // UTC time of the first firing of `entry` after `utc`, and of the last
+  // one at or before it; INT64_MAX / INT64_MIN if it never fires.
+  int64_t fireAfter(const ScheduleEntry& entry, int64_t utc);
+  int64_t fireAtOrBefore(const ScheduleEntry& entry, int64_t utc);
+
+ private:
+  void rebuild(int64_t utc);
+  int64_t localToUtc(int64_t local);
+  void siftDown(uint8_t i);
+  void siftUp(uint8_t i);
+
+  Timezone& zone_;
+  ScheduleEntry entries_[MAX_ENTRIES] = {};
+  int64_t fireUtc_[MAX_ENTRIES] = {};
+  uint8_t heap_[MAX_ENTRIES];  // Slots, earliest fireUtc_ first
+  uint8_t heapSize_ = 0;
+  int64_t nextUtc_ = INT64_MAX;  // fireUtc_ of heap_[0]
+  int64_t lastUtc_ = 0;
+  bool dirty_ = true;
+  uint8_t brightness_ = DEFAULT_BRIGHTNESS;
+};
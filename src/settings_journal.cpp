@@ -0,0 +1,139 @@
+#include "settings_journal.h"
+
+#include "crc32.h"
+
+namespace {
+
+const uint16_t RECORD_MAGIC = 0x5E77;
+const uint16_t ERASED_MAGIC = 0xFFFF;
+const size_t HEADER_SIZE = 12;
+const size_t RECORD_WORDS = (HEADER_SIZE + SettingsJournal::MAX_PAYLOAD + 3) / 4;
+
+struct RecordHeader {
+  uint16_t magic;
+  uint16_t length;
+  uint32_t sequence;
+  uint32_t crc;
+};
+static_assert(sizeof(RecordHeader) == HEADER_SIZE, "record header must stay packed");
+
+// CRC of everything but the crc field itself.
+uint32_t recordCrc(const RecordHeader& header, const uint8_t* payload) {
+  uint32_t crc = crc32Update(0, (const uint8_t*)&header, 8);
+  return crc32Update(crc, payload, header.length);
+}
+
+size_t recordSize(size_t payloadLen) {
+  return (HEADER_SIZE + payloadLen + 3) & ~(size_t)3;
+}
+
+}  // namespace
+
+size_t SettingsJournal::load(void* payload, size_t maxLen) {
+  scanned_ = true;
+  hasLatest_ = false;
+  sequence_ = 0;
+  sector_ = 0;
+  nextOffset_ = 0;
+
+  size_t found = 0;
+  for (uint8_t sector = 0; sector < HAL_SETTINGS_SECTOR_COUNT; sector++) {
+    uint32_t previous = sequence_;
+    uint32_t end = scanSector(sector, payload, maxLen, &found);
+    if (sector == 0 || (hasLatest_ && sequence_ != previous)) {
+      sector_ = sector;
+      nextOffset_ = end;
+    }
+  }
+  return found;
+}
+
+uint32_t SettingsJournal::scanSector(uint8_t sector, void* payload, size_t maxLen, size_t* found) {
+  uint32_t record[RECORD_WORDS];
+  RecordHeader* header = (RecordHeader*)record;
+  const uint8_t* body = (const uint8_t*)record + HEADER_SIZE;
+
+  uint32_t offset = 0;
+  while (offset + HEADER_SIZE <= HAL_SETTINGS_SECTOR_SIZE) {
+    if (!halSettingsRead(sector, offset, record, HEADER_SIZE)) {
+      break;
+    }
+    if (header->magic == ERASED_MAGIC) {
+      return offset;
+    }
+    if (header->magic != RECORD_MAGIC || header->length > MAX_PAYLOAD ||
+        offset + recordSize(header->length) > HAL_SETTINGS_SECTOR_SIZE) {
+      break;  // Not a journal (e.g. the old EEPROM layout) or a torn header
+    }
+    size_t size = recordSize(header->length);
+    if (!halSettingsRead(sector, offset + HEADER_SIZE, record + HEADER_SIZE / 4, size - HEADER_SIZE)) {
+      break;
+    }
+    if (recordCrc(*header, body) == header->crc && (!hasLatest_ || header->sequence > sequence_)) {
+      sequence_ = header->sequence;
+      hasLatest_ = true;
+      latestLength_ = header->length;
+      latestPayloadCrc_ = crc32Update(0, body, header->length);
+      *found = header->length;
+      memcpy(payload, body, *found < maxLen ? *found : maxLen);
+    }
+    offset += size;
+  }
+  return HAL_SETTINGS_SECTOR_SIZE;
+}
+
+SettingsJournal::SaveResult SettingsJournal::save(const void* payload, size_t len) {
+  if (len > MAX_PAYLOAD) {
+    return SAVE_FAILED;
+  }
+  if (!scanned_) {
+    uint8_t scratch[MAX_PAYLOAD];
+    load(scratch, sizeof(scratch));
+  }
+  if (hasLatest_ && latestLength_ == len && latestPayloadCrc_ == crc32Update(0, (const uint8_t*)payload, len)) {
+    skipped_++;
+    return SAVE_UNCHANGED;
+  }
+
+  if (nextOffset_ + recordSize(len) <= HAL_SETTINGS_SECTOR_SIZE && append(payload, len, sector_, nextOffset_)) {
+    return SAVE_WRITTEN;
+  }
+
+  // Compact into the other sector: only the newest record survives, and
+  // that is this one. The current sector is left alone until the next
+  // compaction, so a power cut here still finds the previous record.
+  uint8_t target = (sector_ + 1) % HAL_SETTINGS_SECTOR_COUNT;
+  if (!halSettingsErase(target)) {
+    return SAVE_FAILED;
+  }
+  erases_++;
+  return append(payload, len, target, 0) ? SAVE_WRITTEN : SAVE_FAILED;
+}
+
+bool SettingsJournal::append(const void* payload, size_t len, uint8_t sector, uint32_t offset) {
+  uint32_t record[RECORD_WORDS];
+  size_t size = recordSize(len);
+  memset(record, 0xFF, size);
+  RecordHeader* header = (RecordHeader*)record;
+  uint8_t* body = (uint8_t*)record + HEADER_SIZE;
+  header->magic = RECORD_MAGIC;
+  header->length = (uint16_t)len;
+  header->sequence = sequence_ + 1;
+  memcpy(body, payload, len);
+  header->crc = recordCrc(*header, body);
+
+  // Header and payload go out in one write, header first, so an erased
+  // header always marks the end of the log.
+  sector_ = sector;
+  if (!halSettingsWrite(sector, offset, record, size)) {
+    nextOffset_ = HAL_SETTINGS_SECTOR_SIZE;
+    return false;
+  }
+  writes_++;
+  sequence_ = header->sequence;
+  hasLatest_ = true;
+  latestLength_ = header->length;
+  latestPayloadCrc_ = crc32Update(0, body, len);
+  nextOffset_ = offset + size;
+  return true;
+}
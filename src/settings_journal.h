@@ -0,0 +1,53 @@
+#pragma once
+
+#include "hal.h"
+
+// Append-only settings log in the two settings flash sectors (see
+// halSettingsRead()). Each save appends a record
+//
+//   magic:16 | length:16 | sequence:32 | crc32:32 | payload, padded to 4
+//
+// after the previous one in the active sector. Only when it is full is the
+// other sector erased and the new record written at its start, so a
+// ~150-byte payload costs one erase per ~25 saves instead of one per save.
+// The CRC covers header and payload: a record torn by a power cut is
+// skipped and the newest intact one (in either sector) wins, and the old
+// sector stays intact until the compacted record has been written.
+class SettingsJournal {
+ public:
+  static const size_t MAX_PAYLOAD = 240;
+
+  enum SaveResult : uint8_t { SAVE_WRITTEN, SAVE_UNCHANGED, SAVE_FAILED };
+
+  // Scans the sector once and copies the newest valid record into
+  // `payload`. Returns its length (which may differ from maxLen if the
+  // layout changed), or 0 if there is none.
+  size_t load(void* payload, size_t maxLen);
+  // Appends `payload` unless it equals the newest record.
+  SaveResult save(const void* payload, size_t len);
+
+  uint32_t sequence() const { return sequence_; }
+  uint8_t activeSector() const { return sector_; }
+  uint32_t usedBytes() const { return nextOffset_; }
+  uint32_t erases() const { return erases_; }
+  uint32_t writes() const { return writes_; }
+  uint32_t skipped() const { return skipped_; }
+
+ private:
+  // Returns the end of the log in `sector`, or HAL_SETTINGS_SECTOR_SIZE
+  // when no erased space is left to append to.
+  uint32_t scanSector(uint8_t sector, void* payload, size_t maxLen, size_t* found);
+  bool append(const void* payload, size_t len, uint8_t sector, uint32_t offset);
+
+  bool scanned_ = false;
+  uint8_t sector_ = 0;
+  uint32_t nextOffset_ = 0;
+  uint32_t sequence_ = 0;
+  bool hasLatest_ = false;
+  uint16_t latestLength_ = 0;
+  uint32_t latestPayloadCrc_ = 0;
+
+  uint32_t erases_ = 0;
+  uint32_t writes_ = 0;
+  uint32_t skipped_ = 0;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "hal.h"
+
+// Bounded single-producer / single-consumer ring. The producer only writes
+// tail_ and the consumer only writes head_, each published with a release
+// store, so neither side locks or waits: push() fails when the ring is
+// full and pop() when it is empty. Capacity must be a power of two; the
+// free-running 8-bit indices wrap cleanly.
+template <typename T, uint8_t Capacity>
+class SpscQueue {
+  static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+ public:
+  // Producer side.
+  bool push(const T& item) {
+    uint8_t tail = tail_;
+    if ((uint8_t)(tail - __atomic_load_n(&head_, __ATOMIC_ACQUIRE)) == Capacity) {
+      return false;
+    }
+    items_[tail & (Capacity - 1)] = item;
+    __atomic_store_n(&tail_, (uint8_t)(tail + 1), __ATOMIC_RELEASE);
+    return true;
+  }
+
+  // Consumer side.
+  bool pop(T* item) {
+    uint8_t head = head_;
+    if (head == __atomic_load_n(&tail_, __ATOMIC_ACQUIRE)) {
+      return false;
+    }
+    *item = items_[head & (Capacity - 1)];
+    __atomic_store_n(&head_, (uint8_t)(head + 1), __ATOMIC_RELEASE);
+    return true;
+  }
+
+  uint8_t size() const {
+    return (uint8_t)(__atomic_load_n(&tail_, __ATOMIC_ACQUIRE) - __atomic_load_n(&head_, __ATOMIC_ACQUIRE));
+  }
+
+  // Producer side: the item `index` places from the front, for looking
+  // through what is still waiting (e.g. to coalesce duplicates). Only
+  // valid for index < size(), and only while the consumer cannot run,
+  // which holds when both sides are called from loop().
+  const T& peek(uint8_t index) const {
+    return items_[(uint8_t)(head_ + index) & (Capacity - 1)];
+  }
+
+ private:
+  T items_[Capacity];
+  uint8_t head_ = 0;
+  uint8_t tail_ = 0;
+};
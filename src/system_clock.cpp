@@ -0,0 +1,88 @@
+#include "system_clock.h"
+
+namespace {
+
+// Re-anchor at least this often so the drift product cannot overflow and
+// the slew budget is spent continuously rather than in one burst.
+const uint64_t MAX_ANCHOR_AGE_US = 60ULL * 1000000ULL;
+
+}  // namespace
+
+// Folds the time elapsed since the anchor (with drift and slew) into a new
+// anchor at `monoUs`. The drift and slew products keep their fractions of
+// a microsecond for the next call: nowUs() re-anchors on every read while
+// a slew is pending, and reads a few hundred us apart would otherwise
+// round both to zero and never correct the clock.
+void SystemClock::advance(uint64_t monoUs) {
+  int64_t elapsed = (int64_t)(monoUs - anchorMono_);
+  int64_t utc = anchorUtc_ + elapsed + driftUs(elapsed, &driftRemainder_);
+
+  int64_t budgetParts = elapsed * SLEW_PPM + slewBudgetRemainder_;
+  int64_t budget = budgetParts / 1000000;
+  slewBudgetRemainder_ = budgetParts % 1000000;
+  int64_t applied = slewRemaining_;
+  if (applied > budget) {
+    applied = budget;
+  } else if (applied < -budget) {
+    applied = -budget;
+  }
+  slewRemaining_ -= applied;
+
+  anchorMono_ = monoUs;
+  anchorUtc_ = utc + applied;
+}
+
+// Drift over `elapsed` us, with the fraction carried in from the last
+// anchor; the new fraction is stored in *remainder.
+int64_t SystemClock::driftUs(int64_t elapsed, int64_t* remainder) const {
+  int64_t parts = elapsed * driftPpb_ + *remainder;
+  int64_t us = parts / 1000000000LL;
+  *remainder = parts - us * 1000000000LL;
+  return us;
+}
+
+int64_t SystemClock::nowUs() {
+  uint64_t mono = halMicros64();
+  if (mono - anchorMono_ >= MAX_ANCHOR_AGE_US || slewRemaining_ != 0) {
+    advance(mono);
+    return anchorUtc_;
+  }
+  int64_t elapsed = (int64_t)(mono - anchorMono_);
+  int64_t remainder = driftRemainder_;
+  return anchorUtc_ + elapsed + driftUs(elapsed, &remainder);
+}
+
+void SystemClock::now(struct timeval* tv) {
+  int64_t us = nowUs();
+  tv->tv_sec = (time_t)(us / 1000000);
+  tv->tv_usec = (suseconds_t)(us % 1000000);
+}
+
+void SystemClock::step(int64_t utcUs) {
+  anchorMono_ = halMicros64();
+  anchorUtc_ = utcUs;
+  slewRemaining_ = 0;
+  driftRemainder_ = 0;
+  slewBudgetRemainder_ = 0;
+  set_ = true;
+}
+
+void SystemClock::slew(int64_t offsetUs) {
+  advance(halMicros64());
+  slewRemaining_ = offsetUs;
+}
+
+int64_t SystemClock::pendingSlewUs() {
+  advance(halMicros64());
+  return slewRemaining_;
+}
+
+void SystemClock::setDriftPpb(int32_t ppb) {
+  advance(halMicros64());
+  if (ppb > MAX_DRIFT_PPB) {
+    ppb = MAX_DRIFT_PPB;
+  } else if (ppb < -MAX_DRIFT_PPB) {
+    ppb = -MAX_DRIFT_PPB;
+  }
+  driftPpb_ = ppb;
+}
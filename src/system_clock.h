@@ -0,0 +1,49 @@
+#pragma once
+
+#include "hal.h"
+
+// Software UTC clock on top of the monotonic microsecond counter.
+//
+//   utc = anchorUtc + elapsed + elapsed * drift + applied slew
+//
+// where elapsed is the monotonic time since the last re-anchor. Offsets
+// reported by NTP are normally slewed in at no more than SLEW_PPM, so the
+// displayed time never jumps or runs backwards; step() is only for the
+// first fix and for large errors. The drift term compensates the crystal's
+// frequency error between syncs.
+class SystemClock {
+ public:
+  static const int32_t SLEW_PPM = 500;
+  static const int32_t MAX_DRIFT_PPB = 500000;
+
+  bool isSet() const { return set_; }
+
+  // UTC in microseconds since the epoch (monotonic time since boot while
+  // the clock is unset).
+  int64_t nowUs();
+  void now(struct timeval* tv);
+
+  // Jumps to `utcUs` and drops any slew still outstanding.
+  void step(int64_t utcUs);
+  // Replaces the outstanding correction with `offsetUs`, applied gradually.
+  void slew(int64_t offsetUs);
+  int64_t pendingSlewUs();
+
+  // Frequency correction in parts per billion (positive = local crystal
+  // is slow and the clock is sped up).
+  void setDriftPpb(int32_t ppb);
+  int32_t driftPpb() const { return driftPpb_; }
+
+ private:
+  void advance(uint64_t monoUs);
+  int64_t driftUs(int64_t elapsed, int64_t* remainder) const;
+
+  bool set_ = false;
+  uint64_t anchorMono_ = 0;
+  int64_t anchorUtc_ = 0;
+  int32_t driftPpb_ = 0;
+  int64_t slewRemaining_ = 0;
+  // Fractions of a microsecond not yet applied, in us * 1e-9 and us * 1e-6.
+  int64_t driftRemainder_ = 0;
+  int64_t slewBudgetRemainder_ = 0;
+};
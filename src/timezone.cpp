@@ -0,0 +1,280 @@
+#include "timezone.h"
+
+#include <ctype.h>
+
+namespace {
+
+const int32_t SECONDS_PER_DAY = 86400;
+
+int64_t floorDiv(int64_t a, int64_t b) {
+  int64_t q = a / b;
+  return (a % b != 0 && ((a < 0) != (b < 0))) ? q - 1 : q;
+}
+
+// Days since 1970-01-01 of a proleptic Gregorian date (H. Hinnant).
+int64_t daysFromCivil(int y, unsigned m, unsigned d) {
+  y -= m <= 2;
+  const int era = (y >= 0 ? y : y - 399) / 400;
+  const unsigned yoe = (unsigned)(y - era * 400);
+  const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return (int64_t)era * 146097 + (int64_t)doe - 719468;
+}
+
+void civilFromDays(int64_t z, int* year, unsigned* month, unsigned* day) {
+  z += 719468;
+  const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+  const unsigned doe = (unsigned)(z - era * 146097);
+  const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  const unsigned mp = (5 * doy + 2) / 153;
+  *day = doy - (153 * mp + 2) / 5 + 1;
+  *month = mp < 10 ? mp + 3 : mp - 9;
+  *year = (int)(yoe + era * 400) + (*month <= 2);
+}
+
+bool isLeapYear(int y) {
+  return (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+}
+
+int weekdayOfDays(int64_t days) {
+  return (int)(((days % 7) + 11) % 7);  // 1970-01-01 was a Thursday (4)
+}
+
+// Zone abbreviation: 3+ letters, or anything between '<' and '>'.
+const char* skipName(const char* p) {
+  if (*p == '<') {
+    while (*p && *p != '>') {
+      p++;
+    }
+    return *p ? p + 1 : nullptr;
+  }
+  const char* start = p;
+  while (isalpha((unsigned char)*p)) {
+    p++;
+  }
+  return (p - start >= 3) ? p : nullptr;
+}
+
+// [+|-]hh[:mm[:ss]] in seconds.
+const char* parseHms(const char* p, int32_t* seconds) {
+  int sign = 1;
+  if (*p == '+' || *p == '-') {
+    sign = (*p == '-') ? -1 : 1;
+    p++;
+  }
+  if (!isdigit((unsigned char)*p)) {
+    return nullptr;
+  }
+  int32_t parts[3] = {0, 0, 0};
+  for (int i = 0; i < 3; i++) {
+    int32_t v = 0;
+    while (isdigit((unsigned char)*p)) {
+      v = v * 10 + (*p++ - '0');
+    }
+    parts[i] = v;
+    if (i < 2 && *p == ':' && isdigit((unsigned char)p[1])) {
+      p++;
+    } else {
+      break;
+    }
+  }
+  *seconds = sign * (parts[0] * 3600 + parts[1] * 60 + parts[2]);
+  return p;
+}
+
+const char* parseNumber(const char* p, uint16_t* value) {
+  if (!isdigit((unsigned char)*p)) {
+    return nullptr;
+  }
+  uint16_t v = 0;
+  while (isdigit((unsigned char)*p)) {
+    v = v * 10 + (*p++ - '0');
+  }
+  *value = v;
+  return p;
+}
+
+}  // namespace
+
+Timezone::Timezone() {
+  set("UTC0");
+}
+
+bool Timezone::set(const char* posix) {
+  validFrom_ = 0;
+  validUntil_ = 0;
+  cachedDay_ = INT64_MIN;
+  if (parse(posix)) {
+    return true;
+  }
+  stdOffset_ = 0;
+  dstOffset_ = 0;
+  hasDst_ = false;
+  start_ = {};
+  end_ = {};
+  return false;
+}
+
+bool Timezone::parse(const char* posix) {
+  hasDst_ = false;
+  const char* p = skipName(posix);
+  int32_t offset = 0;
+  if (p == nullptr || (p = parseHms(p, &offset)) == nullptr) {
+    return false;
+  }
+  stdOffset_ = -offset;  // POSIX offsets are west-positive
+  dstOffset_ = stdOffset_;
+  if (*p == '\0') {
+    return true;
+  }
+
+  p = skipName(p);
+  if (p == nullptr) {
+    return false;
+  }
+  dstOffset_ = stdOffset_ + 3600;
+  if (*p != ',' && *p != '\0') {
+    if ((p = parseHms(p, &offset)) == nullptr) {
+      return false;
+    }
+    dstOffset_ = -offset;
+  }
+
+  // Rules default to the US ones when omitted, as in newlib.
+  TransitionRule* rules[2] = {&start_, &end_};
+  start_ = {'M', 3, 2, 0, 0, 7200};
+  end_ = {'M', 11, 1, 0, 0, 7200};
+  for (TransitionRule* rule : rules) {
+    if (*p != ',') {
+      break;
+    }
+    p++;
+    uint16_t a = 0;
+    if (*p == 'M') {
+      uint16_t b = 0;
+      uint16_t c = 0;
+      if ((p = parseNumber(p + 1, &a)) == nullptr || *p++ != '.' || (p = parseNumber(p, &b)) == nullptr ||
+          *p++ != '.' || (p = parseNumber(p, &c)) == nullptr || a < 1 || a > 12 || b < 1 || b > 5 || c > 6) {
+        return false;
+      }
+      *rule = {'M', (uint8_t)a, (uint8_t)b, (uint8_t)c, 0, 7200};
+    } else {
+      char kind = 'D';
+      if (*p == 'J') {
+        kind = 'J';
+        p++;
+      }
+      if ((p = parseNumber(p, &a)) == nullptr || a > 365 || (kind == 'J' && a == 0)) {
+        return false;
+      }
+      *rule = {kind, 0, 0, 0, a, 7200};
+    }
+    if (*p == '/') {
+      if ((p = parseHms(p + 1, &rule->time)) == nullptr) {
+        return false;
+      }
+    }
+  }
+  hasDst_ = true;
+  return true;
+}
+
+// UTC instant of a transition in `year`; the rule's time of day is in the
+// local time in force just before the transition.
+int64_t Timezone::transitionUtc(const TransitionRule& rule, int year, int32_t offsetBefore) const {
+  int64_t day;
+  if (rule.kind == 'M') {
+    int64_t first = daysFromCivil(year, rule.month, 1);
+    day = first + (rule.weekday - weekdayOfDays(first) + 7) % 7 + (rule.week - 1) * 7;
+    static const uint8_t MONTH_DAYS[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    int monthDays = MONTH_DAYS[rule.month - 1] + ((rule.month == 2 && isLeapYear(year)) ? 1 : 0);
+    while (day >= first + monthDays) {
+      day -= 7;  // Week 5 means the last such weekday of the month
+    }
+  } else if (rule.kind == 'J') {
+    day = daysFromCivil(year, 1, 1) + rule.day - 1 + ((isLeapYear(year) && rule.day >= 60) ? 1 : 0);
+  } else {
+    day = daysFromCivil(year, 1, 1) + rule.day;
+  }
+  return day * SECONDS_PER_DAY + rule.time - offsetBefore;
+}
+
+// Recomputes the offset in force at `utc` and the interval it stays valid
+// for, from the transitions of the surrounding years.
+void Timezone::refreshOffset(int64_t utc) {
+  if (!hasDst_) {
+    offset_ = stdOffset_;
+    dst_ = false;
+    validFrom_ = INT64_MIN;
+    validUntil_ = INT64_MAX;
+    return;
+  }
+
+  int year;
+  unsigned month;
+  unsigned day;
+  civilFromDays(floorDiv(utc, SECONDS_PER_DAY), &year, &month, &day);
+
+  // Transitions of the previous, current and next year in time order.
+  int64_t events[6];
+  bool eventIsStart[6];
+  int count = 0;
+  for (int y = year - 1; y <= year + 1; y++) {
+    int64_t s = transitionUtc(start_, y, stdOffset_);
+    int64_t e = transitionUtc(end_, y, dstOffset_);
+    bool startFirst = s < e;
+    events[count] = startFirst ? s : e;
+    eventIsStart[count++] = startFirst;
+    events[count] = startFirst ? e : s;
+    eventIsStart[count++] = !startFirst;
+  }
+
+  int last = -1;
+  for (int i = 0; i < count && events[i] <= utc; i++) {
+    last = i;
+  }
+  // Before the first event the state is the opposite of what it switches to.
+  dst_ = (last >= 0) ? eventIsStart[last] : !eventIsStart[0];
+  offset_ = dst_ ? dstOffset_ : stdOffset_;
+  validFrom_ = (last >= 0) ? events[last] : INT64_MIN;
+  validUntil_ = (last + 1 < count) ? events[last + 1] : INT64_MAX;
+}
+
+int32_t Timezone::utcOffset(time_t utc) {
+  if ((int64_t)utc < validFrom_ || (int64_t)utc >= validUntil_) {
+    refreshOffset(utc);
+  }
+  return offset_;
+}
+
+bool Timezone::isDst(time_t utc) {
+  utcOffset(utc);
+  return dst_;
+}
+
+void Timezone::localTime(time_t utc, struct tm* out) {
+  int64_t local = (int64_t)utc + utcOffset(utc);
+  int64_t day = floorDiv(local, SECONDS_PER_DAY);
+  int32_t secondOfDay = (int32_t)(local - day * SECONDS_PER_DAY);
+
+  if (day != cachedDay_) {
+    int year;
+    unsigned month;
+    unsigned mday;
+    civilFromDays(day, &year, &month, &mday);
+    cachedDate_ = {};
+    cachedDate_.tm_year = year - 1900;
+    cachedDate_.tm_mon = month - 1;
+    cachedDate_.tm_mday = mday;
+    cachedDate_.tm_wday = weekdayOfDays(day);
+    cachedDate_.tm_yday = (int)(day - daysFromCivil(year, 1, 1));
+    cachedDay_ = day;
+  }
+
+  *out = cachedDate_;
+  out->tm_hour = secondOfDay / 3600;
+  out->tm_min = (secondOfDay / 60) % 60;
+  out->tm_sec = secondOfDay % 60;
+  out->tm_isdst = dst_ ? 1 : 0;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "hal.h"
+
+// POSIX TZ rule ("CET-1CEST,M3.5.0/2,M10.5.0/3") parsed once, with the UTC
+// offset cached until the next DST transition. localTime() then costs a
+// few integer operations per call instead of setenv()/tzset() plus a full
+// localtime_r(); the calendar date is only recomputed when the local day
+// or the offset changes.
+class Timezone {
+ public:
+  Timezone();
+
+  // Parses a POSIX TZ string. On error the zone falls back to UTC and
+  // false is returned.
+  bool set(const char* posix);
+
+  void localTime(time_t utc, struct tm* out);
+  // Seconds to add to UTC to get local time at `utc`.
+  int32_t utcOffset(time_t utc);
+  bool isDst(time_t utc);
+
+ private:
+  // One end of the DST period: Mm.w.d, Jn or n, plus local time of day.
+  struct TransitionRule {
+    char kind;  // 'M', 'J' or 'D' (zero-based day of year)
+    uint8_t month;
+    uint8_t week;
+    uint8_t weekday;
+    uint16_t day;
+    int32_t time;
+  };
+
+  bool parse(const char* posix);
+  void refreshOffset(int64_t utc);
+  int64_t transitionUtc(const TransitionRule& rule, int year, int32_t offsetBefore) const;
+
+  int32_t stdOffset_ = 0;
+  int32_t dstOffset_ = 0;
+  bool hasDst_ = false;
+  TransitionRule start_ = {};
+  TransitionRule end_ = {};
+
+  // Offset cache: valid for validFrom_ <= utc < validUntil_.
+  int32_t offset_ = 0;
+  bool dst_ = false;
+  int64_t validFrom_ = 0;
+  int64_t validUntil_ = 0;
+
+  // Date cache for the local day last converted.
+  int64_t cachedDay_ = INT64_MIN;
+  struct tm cachedDate_ = {};
+};
@@ -0,0 +1,131 @@
+#include "tz_db.h"
+
+#include "crc32.h"
+
+// Tables generated by tools/tz_db.py; the layout is described there.
+extern const char TZ_DB_RULES[];
+extern const uint16_t TZ_DB_RULE_OFFSETS[];
+extern const uint8_t TZ_DB_NAMES[];
+extern const uint16_t TZ_DB_BLOCK_OFFSETS[];
+
+namespace {
+
+uint16_t blockCount() {
+  return (TZ_DB_ZONE_COUNT + TZ_DB_BLOCK_SIZE - 1) / TZ_DB_BLOCK_SIZE;
+}
+
+// Decodes the entry at `offset` on top of the previous name in `name`.
+// Returns the offset of the next entry; *rule is the entry's rule index.
+uint16_t decodeEntry(uint16_t offset, char name[TZ_DB_NAME_MAX], uint8_t* rule) {
+  uint8_t shared = pgm_read_byte(&TZ_DB_NAMES[offset]);
+  uint8_t length = pgm_read_byte(&TZ_DB_NAMES[offset + 1]);
+  memcpy_P(name + shared, &TZ_DB_NAMES[offset + 2], length);
+  name[shared + length] = '\0';
+  *rule = pgm_read_byte(&TZ_DB_NAMES[offset + 2 + length]);
+  return offset + 3 + length;
+}
+
+// Compares `name` with the first (uncompressed) name of a block.
+int compareBlockHead(const char* name, uint16_t block) {
+  uint16_t offset = pgm_read_word(&TZ_DB_BLOCK_OFFSETS[block]);
+  uint8_t length = pgm_read_byte(&TZ_DB_NAMES[offset + 1]);
+  const uint8_t* head = &TZ_DB_NAMES[offset + 2];
+  for (uint8_t i = 0; i < length; i++) {
+    uint8_t c = pgm_read_byte(head + i);
+    if ((uint8_t)name[i] != c) {
+      return (uint8_t)name[i] < c ? -1 : 1;
+    }
+  }
+  return name[length] == '\0' ? 0 : 1;
+}
+
+// Decodes zone `id` into `name`; returns its rule index.
+uint8_t decodeZone(uint16_t id, char name[TZ_DB_NAME_MAX]) {
+  uint16_t offset = pgm_read_word(&TZ_DB_BLOCK_OFFSETS[id / TZ_DB_BLOCK_SIZE]);
+  uint8_t rule = 0;
+  for (uint16_t i = 0; i <= id % TZ_DB_BLOCK_SIZE; i++) {
+    offset = decodeEntry(offset, name, &rule);
+  }
+  return rule;
+}
+
+}  // namespace
+
+uint16_t tzDbFind(const char* name) {
+  if (strlen(name) >= TZ_DB_NAME_MAX) {
+    return TZ_DB_NONE;
+  }
+  // Last block whose first name is <= name.
+  uint16_t low = 0;
+  uint16_t high = blockCount();
+  while (high - low > 1) {
+    uint16_t mid = (low + high) / 2;
+    if (compareBlockHead(name, mid) < 0) {
+      high = mid;
+    } else {
+      low = mid;
+    }
+  }
+  char candidate[TZ_DB_NAME_MAX];
+  uint16_t offset = pgm_read_word(&TZ_DB_BLOCK_OFFSETS[low]);
+  uint16_t id = low * TZ_DB_BLOCK_SIZE;
+  for (uint8_t i = 0; i < TZ_DB_BLOCK_SIZE && id < TZ_DB_ZONE_COUNT; i++, id++) {
+    uint8_t rule;
+    offset = decodeEntry(offset, candidate, &rule);
+    int order = strcmp(candidate, name);
+    if (order == 0) {
+      return id;
+    }
+    if (order > 0) {
+      break;
+    }
+  }
+  return TZ_DB_NONE;
+}
+
+bool tzDbName(uint16_t id, char name[TZ_DB_NAME_MAX]) {
+  if (id >= TZ_DB_ZONE_COUNT) {
+    return false;
+  }
+  decodeZone(id, name);
+  return true;
+}
+
+bool tzDbRule(uint16_t id, char rule[TZ_DB_RULE_MAX]) {
+  if (id >= TZ_DB_ZONE_COUNT) {
+    return false;
+  }
+  char name[TZ_DB_NAME_MAX];
+  strncpy_P(rule, TZ_DB_RULES + pgm_read_word(&TZ_DB_RULE_OFFSETS[decodeZone(id, name)]), TZ_DB_RULE_MAX);
+  rule[TZ_DB_RULE_MAX - 1] = '\0';
+  return true;
+}
+
+void tzDbForEach(TzDbFn fn, void* context) {
+  char name[TZ_DB_NAME_MAX];
+  uint16_t offset = 0;
+  for (uint16_t id = 0; id < TZ_DB_ZONE_COUNT; id++) {
+    uint8_t rule;
+    offset = decodeEntry(offset, name, &rule);
+    fn(id, name, context);
+  }
+}
+
+uint32_t tzDbNameCrc(uint16_t id) {
+  char name[TZ_DB_NAME_MAX];
+  return tzDbName(id, name) ? crc32Update(0, (const uint8_t*)name, strlen(name)) : 0;
+}
+
+uint16_t tzDbFindByCrc(uint32_t crc) {
+  struct Search {
+    uint32_t crc;
+    uint16_t found;
+  } search = {crc, TZ_DB_NONE};
+  tzDbForEach([](uint16_t id, const char* name, void* context) {
+    Search* s = (Search*)context;
+    if (s->found == TZ_DB_NONE && crc32Update(0, (const uint8_t*)name, strlen(name)) == s->crc) {
+      s->found = id;
+    }
+  }, &search);
+  return search.found;
+}
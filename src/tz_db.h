@@ -0,0 +1,30 @@
+#pragma once
+
+#include "hal.h"
+
+// The IANA time zones with their current POSIX rules, packed into flash at
+// build time by tools/tz_db.py (tz_data.cpp, from tools/tz_zones.csv):
+// names front-coded in blocks, rules stored once each. A zone's id is its
+// position in name order, so ids change when the list is updated; keep
+// tzDbNameCrc() next to a stored id and re-find the zone with
+// tzDbFindByCrc() when it no longer matches.
+const uint16_t TZ_DB_NONE = 0xFFFF;
+const size_t TZ_DB_NAME_MAX = 40;  // Including the NUL
+const size_t TZ_DB_RULE_MAX = 48;
+const uint8_t TZ_DB_BLOCK_SIZE = 16;  // Names per front-coded block
+
+extern const uint16_t TZ_DB_ZONE_COUNT;
+// Quoted hash of the list, for ETags.
+extern const char TZ_DB_VERSION[];
+
+// Binary search by exact name, e.g. "Europe/Rome". TZ_DB_NONE if unknown.
+uint16_t tzDbFind(const char* name);
+// Copy a zone's name / POSIX rule out of flash; false for a bad id.
+bool tzDbName(uint16_t id, char name[TZ_DB_NAME_MAX]);
+bool tzDbRule(uint16_t id, char rule[TZ_DB_RULE_MAX]);
+// Calls fn for every zone in name order.
+typedef void (*TzDbFn)(uint16_t id, const char* name, void* context);
+void tzDbForEach(TzDbFn fn, void* context);
+// CRC-32 of a zone's name (0 for a bad id), and the zone with a given one.
+uint32_t tzDbNameCrc(uint16_t id);
+uint16_t tzDbFindByCrc(uint32_t crc);
@@ -0,0 +1,49 @@
+#include "warm_start.h"
+
+#include "crc32.h"
+
+namespace {
+
+const uint32_t RECORD_MAGIC = 0x57A2C10C;
+
+struct Record {
+  uint32_t magic;
+  uint32_t rtcTicks;
+  int64_t utcUs;
+  uint32_t resets;
+  uint32_t crc;
+};
+static_assert(sizeof(Record) % 4 == 0 && RTC_MEM_WARM_START + sizeof(Record) <= RTC_MEM_WIFI_LINK, "record must fit RTC memory");
+
+uint32_t recordCrc(const Record& record) {
+  return crc32Update(0, (const uint8_t*)&record, offsetof(Record, crc));
+}
+
+}  // namespace
+
+bool WarmStart::restore(int64_t* utcUs) {
+  Record record;
+  uint32_t nowTicks = halRtcTicks();
+  if (!halRtcMemRead(RTC_MEM_WARM_START, (uint32_t*)&record, sizeof(record)) || record.magic != RECORD_MAGIC ||
+      record.crc != recordCrc(record)) {
+    return false;
+  }
+  uint64_t elapsedUs = halRtcTicksToUs(nowTicks - record.rtcTicks);
+  if (elapsedUs > (uint64_t)MAX_AGE_S * 1000000) {
+    return false;
+  }
+  resets_ = record.resets + 1;
+  downtimeMs_ = (uint32_t)(elapsedUs / 1000);
+  *utcUs = record.utcUs + (int64_t)elapsedUs;
+  return true;
+}
+
+void WarmStart::save(int64_t utcUs) {
+  Record record;
+  record.magic = RECORD_MAGIC;
+  record.rtcTicks = halRtcTicks();
+  record.utcUs = utcUs;
+  record.resets = resets_;
+  record.crc = recordCrc(record);
+  halRtcMemWrite(RTC_MEM_WARM_START, (const uint32_t*)&record, sizeof(record));
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "hal.h"
+
+// Carries the time across warm resets (watchdog, exception, restart) in
+// RTC memory, so the face is back within a few hundred ms instead of
+// after the Wi-Fi join and an NTP round. About once a second the clock
+// saves the UTC time with a reading of the RTC timer, which keeps running
+// through the reset; restore() adds the ticks since. The record is CRC
+// guarded, so the garbage left by a power cycle is ignored.
+class WarmStart {
+ public:
+  // Older records are not trusted: the RTC oscillator's calibration
+  // follows the temperature, and its counter wraps after ~8 h.
+  static const uint32_t MAX_AGE_S = 3600;
+
+  // Reads the record of the previous boot. Returns true with *utcUs set to
+  // the current time if it is valid and recent.
+  bool restore(int64_t* utcUs);
+  void save(int64_t utcUs);
+
+  // Warm resets in a row since the last cold boot.
+  uint32_t resets() const { return resets_; }
+  // Age of the restored record: how long the clock was down.
+  uint32_t downtimeMs() const { return downtimeMs_; }
+
+ private:
+  uint32_t resets_ = 0;
+  uint32_t downtimeMs_ = 0;
+};
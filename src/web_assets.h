@@ -0,0 +1,20 @@
+#pragma once
+
+#include "hal.h"
+
+// Static files of the web UI (web/), gzipped at build time by
+// tools/embed_assets.py into the generated web_assets.cpp. The URL carries
+// a hash of the content, so a changed file gets a new URL and browsers can
+// cache every URL forever.
+struct WebAsset {
+  const char* name;         // File name in web/, e.g. "style.css"
+  const char* url;          // e.g. "/assets/style.1a2b3c4d.css"
+  const char* contentType;
+  const char* etag;         // The content hash, quoted
+  const uint8_t* data;      // Gzipped, in PROGMEM
+  size_t size;
+  size_t originalSize;
+};
+
+extern const WebAsset WEB_ASSETS[];
+extern const size_t WEB_ASSET_COUNT;
@@ -0,0 +1,151 @@
+#include "wifi_link.h"
+
+#include "crc32.h"
+#include "logger.h"
+
+const char* const WIFI_LINK_STATE_NAMES[WIFI_LINK_STATE_COUNT] = {"idle", "direct", "scan", "backoff", "up"};
+
+namespace {
+
+const uint32_t CACHE_MAGIC = 0x3F1C10C1;
+
+// Joins the network whose credentials are saved; aimed at one access
+// point when `bssid` is set. The targeted settings are not written to
+// flash, so the saved configuration stays a plain SSID and passphrase.
+void joinSavedNetwork(int32_t channel, const uint8_t* bssid) {
+  String ssid = WiFi.SSID();
+  String psk = WiFi.psk();
+  WiFi.persistent(false);
+  WiFi.begin(ssid.c_str(), psk.c_str(), channel, bssid);
+  WiFi.persistent(true);
+}
+
+}  // namespace
+
+void WifiLink::begin(uint32_t nowMs) {
+  Cache cache;
+  if (halRtcMemRead(RTC_MEM_WIFI_LINK, (uint32_t*)&cache, sizeof(cache)) && cache.magic == CACHE_MAGIC &&
+      cache.crc == cacheCrc(cache)) {
+    cache_ = cache;
+    cacheValid_ = true;
+  }
+  WiFi.mode(WIFI_STA);
+  WiFi.setAutoReconnect(false);
+  outageStartMs_ = nowMs;
+  backoffMs_ = BACKOFF_MIN_MS;
+  startAttempt(nowMs);
+}
+
+WifiLinkEvent WifiLink::service(uint32_t nowMs) {
+  wl_status_t status = WiFi.status();
+  if (status == WL_CONNECTED) {
+    return state_ == WIFI_LINK_UP ? WIFI_LINK_NO_EVENT : joined(nowMs);
+  }
+  // With auto-reconnect off the station gives up on a failed join instead
+  // of retrying.
+  bool failed = status == WL_NO_SSID_AVAIL || status == WL_CONNECT_FAILED || status == WL_WRONG_PASSWORD;
+  uint32_t elapsedMs = nowMs - stateStartMs_;
+  switch (state_) {
+    case WIFI_LINK_UP:
+      losses_++;
+      outageStartMs_ = nowMs;
+      backoffMs_ = BACKOFF_MIN_MS;
+      startAttempt(nowMs);
+      return WIFI_LINK_LOST;
+    case WIFI_LINK_DIRECT:
+      if (failed || elapsedMs >= DIRECT_TIMEOUT_MS) {
+        failedAttempts_++;
+        LOG_INFO("Wi-Fi: cached access point not joined, scanning");
+        startScan(nowMs);
+      }
+      break;
+    case WIFI_LINK_SCAN:
+      if (failed || elapsedMs >= SCAN_TIMEOUT_MS) {
+        failedAttempts_++;
+        LOG_INFO("Wi-Fi: join failed (status %d), retrying in %lu ms", (int)status, (unsigned long)backoffMs_);
+        state_ = WIFI_LINK_BACKOFF;
+        stateStartMs_ = nowMs;
+      }
+      break;
+    case WIFI_LINK_BACKOFF:
+      if (elapsedMs >= backoffMs_) {
+        backoffMs_ = backoffMs_ < BACKOFF_MAX_MS / 2 ? backoffMs_ * 2 : BACKOFF_MAX_MS;
+        startAttempt(nowMs);
+      }
+      break;
+    default:
+      break;
+  }
+  return WIFI_LINK_NO_EVENT;
+}
+
+void WifiLink::startAttempt(uint32_t nowMs) {
+  if (cacheValid_) {
+    startDirect(nowMs);
+  } else {
+    startScan(nowMs);
+  }
+}
+
+void WifiLink::startDirect(uint32_t nowMs) {
+#if WIFI_REUSE_LEASE
+  if (cache_.hasLease) {
+    WiFi.config(IPAddress(cache_.ip), IPAddress(cache_.gateway), IPAddress(cache_.subnet), IPAddress(cache_.dns));
+  }
+#endif
+  joinSavedNetwork(cache_.channel, cache_.bssid);
+  state_ = WIFI_LINK_DIRECT;
+  stateStartMs_ = nowMs;
+}
+
+void WifiLink::startScan(uint32_t nowMs) {
+#if WIFI_REUSE_LEASE
+  // Another access point may be on another network: back to DHCP.
+  WiFi.config(IPAddress(0, 0, 0, 0), IPAddress(0, 0, 0, 0), IPAddress(0, 0, 0, 0));
+#endif
+  joinSavedNetwork(0, nullptr);
+  state_ = WIFI_LINK_SCAN;
+  stateStartMs_ = nowMs;
+}
+
+WifiLinkEvent WifiLink::joined(uint32_t nowMs) {
+  lastJoinDirect_ = state_ == WIFI_LINK_DIRECT;
+  if (lastJoinDirect_) {
+    directJoins_++;
+  } else {
+    scanJoins_++;
+  }
+  lastJoinMs_ = nowMs - outageStartMs_;
+  state_ = WIFI_LINK_UP;
+  stateStartMs_ = nowMs;
+  updateCache();
+  return WIFI_LINK_CONNECTED;
+}
+
+// Saved to RTC memory only when the access point (or lease) changed.
+void WifiLink::updateCache() {
+  Cache cache = {};
+  cache.magic = CACHE_MAGIC;
+  memcpy(cache.bssid, WiFi.BSSID(), sizeof(cache.bssid));
+  cache.channel = (uint8_t)WiFi.channel();
+#if WIFI_REUSE_LEASE
+  cache.hasLease = 1;
+  cache.ip = WiFi.localIP();
+  cache.gateway = WiFi.gatewayIP();
+  cache.subnet = WiFi.subnetMask();
+  cache.dns = WiFi.dnsIP();
+#endif
+  cache.crc = cacheCrc(cache);
+  if (cacheValid_ && memcmp(&cache, &cache_, sizeof(cache)) == 0) {
+    return;
+  }
+  cache_ = cache;
+  cacheValid_ = cache.channel != 0;
+  if (cacheValid_) {
+    halRtcMemWrite(RTC_MEM_WIFI_LINK, (const uint32_t*)&cache, sizeof(cache));
+  }
+}
+
+uint32_t WifiLink::cacheCrc(const Cache& cache) {
+  return crc32Update(0, (const uint8_t*)&cache, offsetof(Cache, crc));
+}
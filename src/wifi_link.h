@@ -0,0 +1,99 @@
+#pragma once
+
+#include "hal.h"
+
+// WIFI_REUSE_LEASE=1 also keeps the DHCP lease (address, gateway, mask,
+// DNS) and configures it statically for a direct join, which skips the
+// DHCP exchange. Only safe where the router reserves the address for the
+// clock, so it is off by default.
+#ifndef WIFI_REUSE_LEASE
+#define WIFI_REUSE_LEASE 0
+#endif
+
+enum WifiLinkState : uint8_t {
+  WIFI_LINK_IDLE,     // Nothing to join yet: waits for the setup portal's join
+  WIFI_LINK_DIRECT,   // Joining the cached access point on its channel
+  WIFI_LINK_SCAN,     // Joining after a scan of all channels
+  WIFI_LINK_BACKOFF,  // Waiting before the next attempt
+  WIFI_LINK_UP,
+  WIFI_LINK_STATE_COUNT
+};
+
+extern const char* const WIFI_LINK_STATE_NAMES[WIFI_LINK_STATE_COUNT];
+
+enum WifiLinkEvent : uint8_t {
+  WIFI_LINK_NO_EVENT,
+  WIFI_LINK_CONNECTED,  // Joined (first join or reconnect)
+  WIFI_LINK_LOST
+};
+
+// Keeps the station on the saved network, in place of the SDK's own
+// reconnect, which scans every channel first (several seconds on a crowded
+// band). The BSSID and channel of the last access point are cached, in RAM
+// and in RTC memory for warm resets, so a join first goes straight to it;
+// if that fails it falls back to a scan, and after a failed scan waits
+// BACKOFF_MIN_MS, doubling up to BACKOFF_MAX_MS, before trying again.
+//
+// WiFi.disconnect() is never called: on the ESP8266 it also erases the
+// saved credentials.
+class WifiLink {
+ public:
+  static const uint32_t DIRECT_TIMEOUT_MS = 3000;
+  static const uint32_t SCAN_TIMEOUT_MS = 15000;
+  static const uint32_t BACKOFF_MIN_MS = 2000;
+  static const uint32_t BACKOFF_MAX_MS = 64000;
+
+  // Starts joining the saved network. Without it the link waits for the
+  // station to be joined by other means (the setup portal), and manages it
+  // from then on.
+  void begin(uint32_t nowMs);
+  // Call every loop.
+  WifiLinkEvent service(uint32_t nowMs);
+
+  WifiLinkState state() const { return state_; }
+  bool connected() const { return state_ == WIFI_LINK_UP; }
+  // The last join: whether it went straight to the cached access point,
+  // and how long it took from begin() or the loss of the link.
+  bool lastJoinDirect() const { return lastJoinDirect_; }
+  uint32_t lastJoinMs() const { return lastJoinMs_; }
+
+  uint32_t losses() const { return losses_; }
+  uint32_t directJoins() const { return directJoins_; }
+  uint32_t scanJoins() const { return scanJoins_; }
+  uint32_t failedAttempts() const { return failedAttempts_; }
+
+ private:
+  struct Cache {
+    uint32_t magic;
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t hasLease;
+    uint32_t ip;
+    uint32_t gateway;
+    uint32_t subnet;
+    uint32_t dns;
+    uint32_t crc;
+  };
+  static_assert(sizeof(Cache) % 4 == 0 && RTC_MEM_WIFI_LINK + sizeof(Cache) <= HAL_RTC_MEM_SIZE,
+                "cache must fit RTC memory");
+
+  void startAttempt(uint32_t nowMs);
+  void startDirect(uint32_t nowMs);
+  void startScan(uint32_t nowMs);
+  WifiLinkEvent joined(uint32_t nowMs);
+  void updateCache();
+  static uint32_t cacheCrc(const Cache& cache);
+
+  WifiLinkState state_ = WIFI_LINK_IDLE;
+  Cache cache_ = {};
+  bool cacheValid_ = false;
+  uint32_t stateStartMs_ = 0;
+  uint32_t outageStartMs_ = 0;
+  uint32_t backoffMs_ = BACKOFF_MIN_MS;
+  bool lastJoinDirect_ = false;
+  uint32_t lastJoinMs_ = 0;
+  uint32_t losses_ = 0;
+  uint32_t directJoins_ = 0;
+  uint32_t scanJoins_ = 0;
+  uint32_t failedAttempts_ = 0;
+};
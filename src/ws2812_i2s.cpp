@@ -0,0 +1,32 @@
+#include "ws2812_i2s.h"
+
+namespace {
+
+// Line bits for one nibble, first bit in the most significant position.
+constexpr uint16_t nibblePattern(uint8_t nibble) {
+  uint16_t pattern = 0;
+  for (int bit = 3; bit >= 0; bit--) {
+    pattern = (pattern << 4) | ((nibble >> bit) & 1 ? 0xE : 0x8);
+  }
+  return pattern;
+}
+
+// 32 bytes, so it stays in RAM rather than PROGMEM: the encoder runs for
+// every LED byte of every frame.
+const uint16_t NIBBLE_PATTERNS[16] = {
+  nibblePattern(0), nibblePattern(1), nibblePattern(2), nibblePattern(3),
+  nibblePattern(4), nibblePattern(5), nibblePattern(6), nibblePattern(7),
+  nibblePattern(8), nibblePattern(9), nibblePattern(10), nibblePattern(11),
+  nibblePattern(12), nibblePattern(13), nibblePattern(14), nibblePattern(15),
+};
+
+}  // namespace
+
+void ws2812EncodeI2s(const uint8_t* pixels, size_t bytes, uint16_t* out) {
+  for (size_t i = 0; i < bytes; i++) {
+    uint8_t value = pixels[i];
+    out[0] = NIBBLE_PATTERNS[value >> 4];
+    out[1] = NIBBLE_PATTERNS[value & 0x0F];
+    out += 2;
+  }
+}
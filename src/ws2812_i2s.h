@@ -0,0 +1,22 @@
+#pragma once
+
+#include "hal.h"
+
+// WS2812 bit-stream for a serial peripheral clocked at 4x the LED data
+// rate (3.2 MHz for 800 kHz LEDs, e.g. the ESP8266 I2S by DMA). Each data
+// bit becomes four line bits, 1110 for a one and 1000 for a zero, so an
+// LED byte is two 16-bit words, high nibble first.
+const size_t WS2812_I2S_WORDS_PER_BYTE = 2;
+
+// Zero bytes sent after a frame: 320 us low, enough to latch WS2812B
+// parts, which need 280 us rather than the 50 us of the original WS2812.
+const size_t WS2812_I2S_RESET_BYTES = 128;
+
+inline size_t ws2812I2sEncodedSize(size_t pixelBytes) {
+  return pixelBytes * WS2812_I2S_WORDS_PER_BYTE * sizeof(uint16_t);
+}
+
+// Encodes `bytes` LED bytes (GRB order, as Adafruit_NeoPixel::getPixels())
+// into ws2812I2sEncodedSize(bytes) bytes at `out`. Pure: no state, no
+// hardware access. One table lookup per nibble.
+void ws2812EncodeI2s(const uint8_t* pixels, size_t bytes, uint16_t* out);
@@ -0,0 +1,107 @@
+// ClockFace<> geometry checks and ns/frame for each supported ring size,
+// in tick and smooth mode, over every time on the dial.
+#include <unity.h>
+
+#include "hal.h"
+#include "clock_face.h"
+
+namespace {
+
+const uint16_t MAX_LEDS = 2 * 255;
+uint32_t layerPixels[4][MAX_LEDS];
+
+const ClockFaceStyle TICK_STYLE = {0xFFFFFF, 0xFF0000, 0x00FF00, 0x0000FF, 12, false, false};
+const ClockFaceStyle SMOOTH_STYLE = {0xFFFFFF, 0xFF0000, 0x00FF00, 0x0000FF, 12, true, true};
+
+ClockFaceLayers clearedLayers() {
+  memset(layerPixels, 0, sizeof(layerPixels));
+  ClockFaceLayers layers = {layerPixels[0], layerPixels[1], layerPixels[2], layerPixels[3]};
+  return layers;
+}
+
+// Every dial time (12 h of seconds), with a microsecond that moves too.
+uint32_t benchmark(const ClockFaceRenderer& face, const ClockFaceStyle& style) {
+  const uint32_t FRAMES = 12 * 3600;
+  uint32_t checksum = 0;
+  uint64_t startUs = halMicros64();
+  for (uint32_t i = 0; i < FRAMES; i++) {
+    ClockFaceLayers layers = clearedLayers();
+    ClockFaceTime time = {(uint8_t)(i / 3600), (uint8_t)(i / 60 % 60), (uint8_t)(i % 60), i * 7919 % 1000000};
+    face.draw(layers, time, style);
+    checksum += layerPixels[3][i % face.ledCount()];
+  }
+  uint64_t elapsedUs = halMicros64() - startUs;
+  (void)checksum;
+  return (uint32_t)(elapsedUs * 1000 / FRAMES);
+}
+
+template <uint16_t Leds>
+void reportRing() {
+  ClockFace<Leds> face;
+  uint32_t tickNs = benchmark(face, TICK_STYLE);
+  uint32_t smoothNs = benchmark(face, SMOOTH_STYLE);
+  char line[80];
+  snprintf(line, sizeof(line), "%u LEDs: tick %lu ns/frame, smooth %lu ns/frame", Leds, (unsigned long)tickNs,
+           (unsigned long)smoothNs);
+  TEST_MESSAGE(line);
+}
+
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_tick_hands_land_on_their_leds() {
+  ClockFace<60> face;
+  ClockFaceLayers layers = clearedLayers();
+  ClockFaceTime time = {3, 15, 42, 0};
+  face.draw(layers, time, TICK_STYLE);
+  TEST_ASSERT_EQUAL_HEX32(0xFF00FF00, layerPixels[2][15]);
+  TEST_ASSERT_EQUAL_HEX32(0xFF0000FF, layerPixels[3][42]);
+  // The hour hand is three LEDs wide around 3 o'clock.
+  TEST_ASSERT_EQUAL_HEX32(0xFFFF0000, layerPixels[1][14]);
+  TEST_ASSERT_EQUAL_HEX32(0xFFFF0000, layerPixels[1][15]);
+  TEST_ASSERT_EQUAL_HEX32(0xFFFF0000, layerPixels[1][16]);
+  TEST_ASSERT_EQUAL_HEX32(0, layerPixels[1][17]);
+  // Twelve markers, one every five LEDs.
+  for (uint16_t i = 0; i < 60; i++) {
+    TEST_ASSERT_EQUAL_HEX32(i % 5 == 0 ? 0xFFFFFFFF : 0, layerPixels[0][i]);
+  }
+}
+
+void test_rotated_ring_is_a_shifted_plain_ring() {
+  ClockFace<24> plain;
+  ClockFace<24, 60, 6> rotated;
+  for (uint32_t i = 0; i < 12 * 3600; i += 37) {
+    ClockFaceTime time = {(uint8_t)(i / 3600), (uint8_t)(i / 60 % 60), (uint8_t)(i % 60), i * 7919 % 1000000};
+    uint32_t expected[4][24];
+    ClockFaceLayers layers = clearedLayers();
+    plain.draw(layers, time, SMOOTH_STYLE);
+    for (uint8_t l = 0; l < 4; l++) {
+      memcpy(expected[l], layerPixels[l], sizeof(expected[l]));
+    }
+    layers = clearedLayers();
+    rotated.draw(layers, time, SMOOTH_STYLE);
+    for (uint8_t l = 0; l < 4; l++) {
+      for (uint16_t led = 0; led < 24; led++) {
+        TEST_ASSERT_EQUAL_HEX32(expected[l][led], layerPixels[l][60 + (led + 6) % 24]);
+      }
+    }
+  }
+}
+
+void test_frame_benchmark() {
+  reportRing<12>();
+  reportRing<24>();
+  reportRing<60>();
+  reportRing<241>();
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_tick_hands_land_on_their_leds);
+  RUN_TEST(test_rotated_ring_is_a_shifted_plain_ring);
+  RUN_TEST(test_frame_benchmark);
+  return UNITY_END();
+}
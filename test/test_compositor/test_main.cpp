@@ -0,0 +1,150 @@
+// The two-lanes-per-word blend maths against a plain per-channel version,
+// on random pixels in every mode, plus ns per composite of both.
+#include <unity.h>
+
+#include "hal.h"
+#include "compositor.h"
+
+namespace {
+
+const uint16_t LEDS = 60;
+const uint8_t LAYERS = 5;
+
+uint32_t random32() {
+  static uint32_t state = 2463534242u;
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+uint32_t naiveChannel(uint32_t below, uint32_t layer, uint32_t weight, BlendMode mode) {
+  uint32_t scaled = layer * weight / 256;
+  switch (mode) {
+    case BLEND_ADD: return below + scaled > 255 ? 255 : below + scaled;
+    case BLEND_MAX: return below > scaled ? below : scaled;
+    case BLEND_SCREEN: return below + scaled - (below * scaled * 2 + 255) / 510;
+    default:
+      // below + (layer - below) * weight / 256, rounded down.
+      return (below * 256 + layer * weight - below * weight) / 256;
+  }
+}
+
+uint32_t naiveBlend(uint32_t below, uint32_t layer, BlendMode mode) {
+  uint32_t alpha = layer >> 24;
+  uint32_t weight = alpha + (alpha >> 7);
+  uint32_t result = 0;
+  for (uint8_t shift = 0; shift < 24; shift += 8) {
+    result |= naiveChannel((below >> shift) & 0xFF, (layer >> shift) & 0xFF, weight, mode) << shift;
+  }
+  return result;
+}
+
+void naiveComposite(const Layer* layers, uint8_t layerCount, uint16_t pixelCount, uint32_t* out) {
+  memset(out, 0, pixelCount * sizeof(uint32_t));
+  for (uint8_t l = 0; l < layerCount; l++) {
+    for (uint16_t i = 0; i < pixelCount; i++) {
+      if (layers[l].pixels[i] >> 24 != 0) {
+        out[i] = naiveBlend(out[i], layers[l].pixels[i], layers[l].mode);
+      }
+    }
+  }
+}
+
+uint32_t layerPixels[LAYERS][LEDS];
+
+// Every pixel of every layer opaque enough to be blended: the worst case.
+void fillLayers(Layer* layers) {
+  for (uint8_t l = 0; l < LAYERS; l++) {
+    for (uint16_t i = 0; i < LEDS; i++) {
+      layerPixels[l][i] = random32() | 0x01000000;
+    }
+    layers[l].pixels = layerPixels[l];
+    layers[l].mode = (BlendMode)(l % BLEND_MODE_COUNT);
+  }
+}
+
+typedef void (*CompositeFunction)(const Layer*, uint8_t, uint16_t, uint32_t*);
+
+uint32_t nsPerComposite(CompositeFunction composite, const Layer* layers) {
+  const uint32_t ROUNDS = 20000;
+  uint32_t out[LEDS];
+  uint32_t checksum = 0;
+  uint64_t startUs = halMicros64();
+  for (uint32_t r = 0; r < ROUNDS; r++) {
+    composite(layers, LAYERS, LEDS, out);
+    checksum += out[r % LEDS];
+  }
+  uint64_t elapsedUs = halMicros64() - startUs;
+  (void)checksum;
+  return (uint32_t)(elapsedUs * 1000 / ROUNDS);
+}
+
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_blend_matches_per_channel_maths() {
+  for (uint8_t mode = 0; mode < BLEND_MODE_COUNT; mode++) {
+    for (uint32_t i = 0; i < 200000; i++) {
+      uint32_t below = random32() & 0xFFFFFF;
+      uint32_t layer = random32();
+      if (i < 256) {
+        layer = withAlpha(layer, (uint8_t)i);  // Every alpha
+      }
+      uint32_t expected = naiveBlend(below, layer, (BlendMode)mode);
+      uint32_t actual = blendPixel(below, layer, (BlendMode)mode);
+      if (actual != expected) {
+        char message[96];
+        snprintf(message, sizeof(message), "%s: %06lX under %08lX gave %06lX, expected %06lX", BLEND_MODE_NAMES[mode],
+                 (unsigned long)below, (unsigned long)layer, (unsigned long)actual, (unsigned long)expected);
+        TEST_FAIL_MESSAGE(message);
+      }
+    }
+  }
+}
+
+void test_extremes() {
+  for (uint8_t mode = 0; mode < BLEND_MODE_COUNT; mode++) {
+    TEST_ASSERT_EQUAL_HEX32(0xFFFFFF, blendPixel(0xFFFFFF, 0xFFFFFFFF, (BlendMode)mode));
+    TEST_ASSERT_EQUAL_HEX32(0x000000, blendPixel(0x000000, 0xFF000000, (BlendMode)mode));
+  }
+  TEST_ASSERT_EQUAL_HEX32(0x123456, blendPixel(0xFFFFFF, 0xFF123456, BLEND_OVER));
+  TEST_ASSERT_EQUAL_HEX32(0xFFFFFF, blendPixel(0x808080, 0xFF808080, BLEND_ADD));
+}
+
+void test_composite_matches_per_channel_maths() {
+  Layer layers[LAYERS];
+  uint32_t actual[LEDS];
+  uint32_t expected[LEDS];
+  for (uint16_t round = 0; round < 200; round++) {
+    fillLayers(layers);
+    // Some transparent pixels, which are skipped.
+    layerPixels[round % LAYERS][round % LEDS] &= 0xFFFFFF;
+    compositeLayers(layers, LAYERS, LEDS, actual);
+    naiveComposite(layers, LAYERS, LEDS, expected);
+    TEST_ASSERT_EQUAL_MEMORY(expected, actual, sizeof(actual));
+  }
+}
+
+void test_composite_benchmark() {
+  Layer layers[LAYERS];
+  fillLayers(layers);
+  uint32_t swarNs = nsPerComposite(compositeLayers, layers);
+  uint32_t naiveNs = nsPerComposite(naiveComposite, layers);
+  char line[96];
+  snprintf(line, sizeof(line), "%u layers x %u LEDs: %lu ns/composite, per channel %lu ns/composite", LAYERS, LEDS,
+           (unsigned long)swarNs, (unsigned long)naiveNs);
+  TEST_MESSAGE(line);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_blend_matches_per_channel_maths);
+  RUN_TEST(test_extremes);
+  RUN_TEST(test_composite_matches_per_channel_maths);
+  RUN_TEST(test_composite_benchmark);
+  return UNITY_END();
+}
@@ -0,0 +1,300 @@
+// EffectPlayer: frame counts past 16 bits, fixed point division of negative
+// values, the checks that refuse or stop a bad effect, and ns/frame of the
+// built-in effects against the C++ renderers they replaced.
+#include <unity.h>
+
+#include "hal.h"
+#include "effect_vm.h"
+
+namespace {
+
+const uint8_t FRAMES_PER_LED_EFFECT[] = {FX_HEADER(EFFECT_FLAG_FRAMES_PER_LED, 10, 300), OP_END};
+
+// (-7 / 2) * -2 = 7, as the red channel.
+const uint8_t NEGATIVE_DIV_EFFECT[] = {
+  FX_HEADER(0, 10, 1),
+  FX_PUSH(-7), FX_PUSH(2), OP_DIV, FX_PUSH(-2), OP_MUL,
+  FX_PUSH(0), FX_PUSH(0), OP_RGB,
+};
+
+// Refused by verify().
+const uint8_t TRUNCATED_OPERAND_EFFECT[] = {FX_HEADER(0, 10, 1), OP_END, OP_PUSH, 7};
+const uint8_t JUMP_INTO_OPERAND_EFFECT[] = {FX_HEADER(0, 10, 1), OP_JMP, 1, FX_PUSH(0), OP_END};
+const uint8_t JUMP_PAST_END_EFFECT[] = {FX_HEADER(0, 10, 1), OP_JMP, 1, OP_END};
+const uint8_t JUMP_BEFORE_START_EFFECT[] = {FX_HEADER(0, 10, 1), OP_JMP, (uint8_t)-3};
+const uint8_t RUNS_OFF_END_EFFECT[] = {FX_HEADER(0, 10, 1), FX_PUSH(1), OP_DROP};
+
+// Stopped while rendering.
+const uint8_t ENDLESS_LOOP_EFFECT[] = {FX_HEADER(0, 10, 1), OP_JMP, (uint8_t)-2};
+// 41 instructions per LED: fits the frame budget on 60 LEDs, not on 241.
+const uint8_t SLOW_EFFECT[] = {
+  FX_HEADER(0, 10, 1),
+  FX_PUSH(0), OP_DROP, FX_PUSH(0), OP_DROP, FX_PUSH(0), OP_DROP, FX_PUSH(0), OP_DROP, FX_PUSH(0), OP_DROP,
+  FX_PUSH(0), OP_DROP, FX_PUSH(0), OP_DROP, FX_PUSH(0), OP_DROP, FX_PUSH(0), OP_DROP, FX_PUSH(0), OP_DROP,
+  FX_PUSH(0), OP_DROP, FX_PUSH(0), OP_DROP, FX_PUSH(0), OP_DROP, FX_PUSH(0), OP_DROP, FX_PUSH(0), OP_DROP,
+  FX_PUSH(0), OP_DROP, FX_PUSH(0), OP_DROP, FX_PUSH(0), OP_DROP, FX_PUSH(0), OP_DROP, FX_PUSH(0), OP_DROP,
+  OP_END,
+};
+const uint8_t STACK_OVERFLOW_EFFECT[] = {
+  FX_HEADER(0, 10, 1),
+  FX_PUSH(0), FX_PUSH(0), FX_PUSH(0), FX_PUSH(0), FX_PUSH(0), FX_PUSH(0), FX_PUSH(0), FX_PUSH(0),
+  FX_PUSH(0), FX_PUSH(0), FX_PUSH(0), FX_PUSH(0), FX_PUSH(0), FX_PUSH(0), FX_PUSH(0), FX_PUSH(0),
+  FX_PUSH(0), OP_END,
+};
+const uint8_t STACK_UNDERFLOW_EFFECT[] = {FX_HEADER(0, 10, 1), FX_PUSH(1), OP_ADD, OP_END};
+
+// Copies of the built-in effects in main.cpp, each with a C++ renderer
+// written the way the animations were before the VM.
+const uint8_t FX_ROTATING[] = {
+  FX_HEADER(EFFECT_FLAG_FRAMES_PER_LED, 50, 1),
+  FX_PUSH(0), FX_PUSH(0), OP_INDEX, OP_STEP, OP_EQ, FX_PUSH(255), OP_MUL, OP_RGB
+};
+const uint8_t FX_PULSATING[] = {
+  FX_HEADER(0, 20, 104),
+  FX_PUSH(0), FX_PUSH(0), OP_STEP, FX_PUSH(5), OP_MUL, OP_DUP, FX_PUSH(515), OP_SWAP, OP_SUB, OP_MIN, OP_RGB
+};
+const uint8_t FX_PROGRESS[] = {
+  FX_HEADER(EFFECT_FLAG_FRAMES_PER_LED, 50, 1),
+  OP_INDEX, OP_STEP, OP_EQ, OP_JZ, 10, FX_PUSH(0), FX_PUSH(255), FX_PUSH(0), OP_RGB, OP_END
+};
+const uint8_t FX_WIFI_CONNECTING[] = {
+  FX_HEADER(0, 100, 20),
+  FX_PUSH(0), OP_INDEX, FX_PUSHF(2086), OP_MUL, OP_SIN, FX_PUSH(1), OP_ADD, FX_PUSH(127), OP_MUL, OP_DUP, OP_RGB
+};
+const uint8_t FX_WIFI_CONNECTED[] = {
+  FX_HEADER(0, 200, 6),
+  FX_PUSH(0), OP_STEP, FX_PUSH(2), OP_MOD, FX_PUSH(0), OP_EQ, FX_PUSH(255), OP_MUL, FX_PUSH(0), OP_RGB
+};
+const uint8_t FX_CHIME[] = {
+  FX_HEADER(0, 40, 13),
+  OP_STEP, FX_PUSH(20), OP_MUL, FX_PUSH(255), OP_SWAP, OP_SUB, OP_DUP, OP_DUP, OP_RGB
+};
+const uint8_t FX_ALARM[] = {
+  FX_HEADER(0, 250, 120),
+  OP_STEP, FX_PUSH(2), OP_MOD, FX_PUSH(0), OP_EQ, FX_PUSH(255), OP_MUL, OP_DUP, FX_PUSH(3), OP_DIV, FX_PUSH(0), OP_RGB
+};
+
+void rotatingNative(Adafruit_NeoPixel& canvas, uint32_t step) {
+  canvas.clear();
+  canvas.setPixelColor(step, canvas.Color(0, 0, 255));
+}
+
+void pulsatingNative(Adafruit_NeoPixel& canvas, uint32_t step) {
+  int level = step < 52 ? step * 5 : 515 - step * 5;
+  canvas.fill(canvas.Color(0, 0, level > 255 ? 255 : level));
+}
+
+void progressNative(Adafruit_NeoPixel& canvas, uint32_t step) {
+  canvas.setPixelColor(step, canvas.Color(0, 255, 0));
+}
+
+void wifiConnectingNative(Adafruit_NeoPixel& canvas, uint32_t) {
+  for (uint16_t i = 0; i < canvas.numPixels(); i++) {
+    int level = (sin(i * 0.2) + 1) * 127;
+    canvas.setPixelColor(i, canvas.Color(0, level, level));
+  }
+}
+
+void wifiConnectedNative(Adafruit_NeoPixel& canvas, uint32_t step) {
+  canvas.fill(step % 2 == 0 ? canvas.Color(0, 255, 0) : 0);
+}
+
+void chimeNative(Adafruit_NeoPixel& canvas, uint32_t step) {
+  uint8_t level = 255 - step * 20;
+  canvas.fill(canvas.Color(level, level, level));
+}
+
+void alarmNative(Adafruit_NeoPixel& canvas, uint32_t step) {
+  canvas.fill(step % 2 == 0 ? canvas.Color(255, 85, 0) : 0);
+}
+
+struct BuiltinCase {
+  const char* label;
+  const uint8_t* program;
+  size_t size;
+  void (*native)(Adafruit_NeoPixel& canvas, uint32_t step);
+  uint8_t tolerance;  // Per channel; the VM's sine is a 256 entry table
+};
+
+const BuiltinCase BUILTINS[] = {
+  {"rotating", FX_ROTATING, sizeof(FX_ROTATING), rotatingNative, 0},
+  {"pulsating", FX_PULSATING, sizeof(FX_PULSATING), pulsatingNative, 0},
+  {"progress", FX_PROGRESS, sizeof(FX_PROGRESS), progressNative, 0},
+  {"wifiConnecting", FX_WIFI_CONNECTING, sizeof(FX_WIFI_CONNECTING), wifiConnectingNative, 4},
+  {"wifiConnected", FX_WIFI_CONNECTED, sizeof(FX_WIFI_CONNECTED), wifiConnectedNative, 0},
+  {"chime", FX_CHIME, sizeof(FX_CHIME), chimeNative, 0},
+  {"alarm", FX_ALARM, sizeof(FX_ALARM), alarmNative, 0},
+};
+
+const uint16_t BENCH_LEDS = 60;
+const uint32_t BENCH_FRAMES = 20000;
+
+EffectPlayer player;
+
+uint8_t channelDifference(uint32_t a, uint32_t b) {
+  uint8_t most = 0;
+  for (uint8_t shift = 0; shift < 24; shift += 8) {
+    int d = (int)((a >> shift) & 0xFF) - (int)((b >> shift) & 0xFF);
+    d = d < 0 ? -d : d;
+    most = d > most ? d : most;
+  }
+  return most;
+}
+
+// Repeats the effect from frame 0 until BENCH_FRAMES have been rendered.
+uint32_t vmNsPerFrame(const BuiltinCase& builtin, Adafruit_NeoPixel& canvas) {
+  uint32_t checksum = 0;
+  uint64_t startUs = halMicros64();
+  for (uint32_t rendered = 0; rendered < BENCH_FRAMES;) {
+    player.start(builtin.program, builtin.size, false);
+    for (uint32_t step = 0; rendered < BENCH_FRAMES && player.renderFrame(canvas, step) != 0; step++) {
+      checksum += canvas.getPixelColor(step % BENCH_LEDS);
+      rendered++;
+    }
+  }
+  uint64_t elapsedUs = halMicros64() - startUs;
+  (void)checksum;
+  return (uint32_t)(elapsedUs * 1000 / BENCH_FRAMES);
+}
+
+uint32_t nativeNsPerFrame(const BuiltinCase& builtin, Adafruit_NeoPixel& canvas, uint32_t frames) {
+  uint32_t checksum = 0;
+  uint64_t startUs = halMicros64();
+  for (uint32_t rendered = 0; rendered < BENCH_FRAMES; rendered++) {
+    uint32_t step = rendered % frames;
+    builtin.native(canvas, step);
+    checksum += canvas.getPixelColor(step % BENCH_LEDS);
+  }
+  uint64_t elapsedUs = halMicros64() - startUs;
+  (void)checksum;
+  return (uint32_t)(elapsedUs * 1000 / BENCH_FRAMES);
+}
+
+uint32_t frameCount(const BuiltinCase& builtin, uint16_t leds) {
+  uint32_t frames = builtin.program[6] | (builtin.program[7] << 8);
+  return (builtin.program[3] & EFFECT_FLAG_FRAMES_PER_LED) ? frames * leds : frames;
+}
+
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_frames_per_led_past_16_bits() {
+  Adafruit_NeoPixel canvas(241, 0, NEO_GRB + NEO_KHZ800);
+  TEST_ASSERT_TRUE(player.start(FRAMES_PER_LED_EFFECT, sizeof(FRAMES_PER_LED_EFFECT), false));
+  // 300 * 241 = 72300 frames.
+  TEST_ASSERT_EQUAL_UINT16(10, player.renderFrame(canvas, 0));
+  TEST_ASSERT_EQUAL_UINT16(10, player.renderFrame(canvas, 65536));
+  TEST_ASSERT_EQUAL_UINT16(10, player.renderFrame(canvas, 72299));
+  TEST_ASSERT_EQUAL_UINT16(0, player.renderFrame(canvas, 72300));
+}
+
+void test_negative_division() {
+  Adafruit_NeoPixel canvas(4, 0, NEO_GRB + NEO_KHZ800);
+  TEST_ASSERT_TRUE(player.start(NEGATIVE_DIV_EFFECT, sizeof(NEGATIVE_DIV_EFFECT), false));
+  TEST_ASSERT_EQUAL_UINT16(10, player.renderFrame(canvas, 0));
+  TEST_ASSERT_EQUAL_HEX32(0x070000, canvas.getPixelColor(3));
+}
+
+void test_malformed_code_is_refused() {
+  Adafruit_NeoPixel canvas(4, 0, NEO_GRB + NEO_KHZ800);
+  TEST_ASSERT_EQUAL_STRING("truncated operand",
+                           EffectPlayer::verify(TRUNCATED_OPERAND_EFFECT, sizeof(TRUNCATED_OPERAND_EFFECT)));
+  TEST_ASSERT_EQUAL_STRING("jump outside the code",
+                           EffectPlayer::verify(JUMP_INTO_OPERAND_EFFECT, sizeof(JUMP_INTO_OPERAND_EFFECT)));
+  TEST_ASSERT_EQUAL_STRING("jump outside the code",
+                           EffectPlayer::verify(JUMP_PAST_END_EFFECT, sizeof(JUMP_PAST_END_EFFECT)));
+  TEST_ASSERT_EQUAL_STRING("jump outside the code",
+                           EffectPlayer::verify(JUMP_BEFORE_START_EFFECT, sizeof(JUMP_BEFORE_START_EFFECT)));
+  TEST_ASSERT_EQUAL_STRING("code must end with END, RGB, HSV or JMP",
+                           EffectPlayer::verify(RUNS_OFF_END_EFFECT, sizeof(RUNS_OFF_END_EFFECT)));
+
+  // A refused upload leaves nothing running, even after a good effect.
+  TEST_ASSERT_TRUE(player.start(NEGATIVE_DIV_EFFECT, sizeof(NEGATIVE_DIV_EFFECT), false));
+  TEST_ASSERT_FALSE(player.start(JUMP_INTO_OPERAND_EFFECT, sizeof(JUMP_INTO_OPERAND_EFFECT), false));
+  TEST_ASSERT_EQUAL_STRING("jump outside the code", player.error());
+  TEST_ASSERT_EQUAL_UINT16(0, player.renderFrame(canvas, 0));
+}
+
+void test_endless_loop_is_stopped() {
+  Adafruit_NeoPixel canvas(4, 0, NEO_GRB + NEO_KHZ800);
+  TEST_ASSERT_NULL(EffectPlayer::verify(ENDLESS_LOOP_EFFECT, sizeof(ENDLESS_LOOP_EFFECT)));
+  TEST_ASSERT_TRUE(player.start(ENDLESS_LOOP_EFFECT, sizeof(ENDLESS_LOOP_EFFECT), false));
+  TEST_ASSERT_EQUAL_UINT16(0, player.renderFrame(canvas, 0));
+  TEST_ASSERT_EQUAL_STRING("instruction budget exceeded", player.error());
+  // Stays stopped.
+  TEST_ASSERT_EQUAL_UINT16(0, player.renderFrame(canvas, 0));
+}
+
+void test_budget_covers_the_whole_frame() {
+  Adafruit_NeoPixel small(60, 0, NEO_GRB + NEO_KHZ800);
+  TEST_ASSERT_TRUE(player.start(SLOW_EFFECT, sizeof(SLOW_EFFECT), false));
+  TEST_ASSERT_EQUAL_UINT16(10, player.renderFrame(small, 0));
+  TEST_ASSERT_EQUAL_UINT32(60 * 41, player.lastFrameInstructions());
+
+  Adafruit_NeoPixel large(241, 0, NEO_GRB + NEO_KHZ800);
+  TEST_ASSERT_TRUE(player.start(SLOW_EFFECT, sizeof(SLOW_EFFECT), false));
+  TEST_ASSERT_EQUAL_UINT16(0, player.renderFrame(large, 0));
+  TEST_ASSERT_EQUAL_STRING("instruction budget exceeded", player.error());
+}
+
+void test_stack_overflow_is_stopped() {
+  Adafruit_NeoPixel canvas(4, 0, NEO_GRB + NEO_KHZ800);
+  TEST_ASSERT_TRUE(player.start(STACK_OVERFLOW_EFFECT, sizeof(STACK_OVERFLOW_EFFECT), false));
+  TEST_ASSERT_EQUAL_UINT16(0, player.renderFrame(canvas, 0));
+  TEST_ASSERT_EQUAL_STRING("stack overflow", player.error());
+}
+
+void test_stack_underflow_is_stopped() {
+  Adafruit_NeoPixel canvas(4, 0, NEO_GRB + NEO_KHZ800);
+  TEST_ASSERT_TRUE(player.start(STACK_UNDERFLOW_EFFECT, sizeof(STACK_UNDERFLOW_EFFECT), false));
+  TEST_ASSERT_EQUAL_UINT16(0, player.renderFrame(canvas, 0));
+  TEST_ASSERT_EQUAL_STRING("stack underflow", player.error());
+}
+
+void test_builtins_match_native_renderers() {
+  for (const BuiltinCase& builtin : BUILTINS) {
+    Adafruit_NeoPixel vm(BENCH_LEDS, 0, NEO_GRB + NEO_KHZ800);
+    Adafruit_NeoPixel native(BENCH_LEDS, 0, NEO_GRB + NEO_KHZ800);
+    TEST_ASSERT_TRUE_MESSAGE(player.start(builtin.program, builtin.size, false), builtin.label);
+    uint32_t frames = frameCount(builtin, BENCH_LEDS);
+    for (uint32_t step = 0; step < frames; step++) {
+      TEST_ASSERT_TRUE_MESSAGE(player.renderFrame(vm, step) != 0, builtin.label);
+      builtin.native(native, step);
+      for (uint16_t i = 0; i < BENCH_LEDS; i++) {
+        TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(builtin.tolerance,
+                                          channelDifference(vm.getPixelColor(i), native.getPixelColor(i)),
+                                          builtin.label);
+      }
+    }
+    TEST_ASSERT_EQUAL_UINT16(0, player.renderFrame(vm, frames));
+  }
+}
+
+void test_frame_benchmark() {
+  for (const BuiltinCase& builtin : BUILTINS) {
+    Adafruit_NeoPixel canvas(BENCH_LEDS, 0, NEO_GRB + NEO_KHZ800);
+    uint32_t vmNs = vmNsPerFrame(builtin, canvas);
+    uint32_t nativeNs = nativeNsPerFrame(builtin, canvas, frameCount(builtin, BENCH_LEDS));
+    char line[96];
+    snprintf(line, sizeof(line), "%s, %u LEDs: VM %lu ns/frame, native %lu ns/frame", builtin.label, BENCH_LEDS,
+             (unsigned long)vmNs, (unsigned long)nativeNs);
+    TEST_MESSAGE(line);
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_frames_per_led_past_16_bits);
+  RUN_TEST(test_negative_division);
+  RUN_TEST(test_malformed_code_is_refused);
+  RUN_TEST(test_endless_loop_is_stopped);
+  RUN_TEST(test_budget_covers_the_whole_frame);
+  RUN_TEST(test_stack_overflow_is_stopped);
+  RUN_TEST(test_stack_underflow_is_stopped);
+  RUN_TEST(test_builtins_match_native_renderers);
+  RUN_TEST(test_frame_benchmark);
+  return UNITY_END();
+}
@@ -0,0 +1,72 @@
+// Frame path benchmark: draws the clock face and converts it for the LEDs
+// (displayClock() + outputFrame() from main.cpp) many times, and reports
+// ns/frame and heap allocations/frame. A frame must not allocate.
+#include <unity.h>
+
+#include "hal.h"
+#include "system_clock.h"
+
+extern SystemClock systemClock;
+extern uint8_t handMotionMode;
+extern bool clockNeedsRedraw;
+bool displayClock();
+bool outputFrame();
+
+namespace {
+
+const uint32_t FRAMES = 20000;
+
+struct FrameCost {
+  uint32_t nsPerFrame;
+  uint32_t allocationsPerFrame;
+};
+
+FrameCost runFrames(uint8_t motionMode) {
+  handMotionMode = motionMode;
+  uint32_t startAllocations = halAllocationCount();
+  uint64_t startUs = halMicros64();
+  for (uint32_t i = 0; i < FRAMES; i++) {
+    clockNeedsRedraw = true;
+    displayClock();
+    outputFrame();
+  }
+  FrameCost cost;
+  cost.nsPerFrame = (uint32_t)((halMicros64() - startUs) * 1000 / FRAMES);
+  cost.allocationsPerFrame = (halAllocationCount() - startAllocations) / FRAMES;
+  return cost;
+}
+
+void report(const char* name, const FrameCost& cost) {
+  char line[96];
+  snprintf(line, sizeof(line), "%s: %lu ns/frame, %lu allocs/frame", name, (unsigned long)cost.nsPerFrame,
+           (unsigned long)cost.allocationsPerFrame);
+  TEST_MESSAGE(line);
+}
+
+}  // namespace
+
+void setUp() {
+  // 2024-03-10 10:08:42.5 UTC: all three hands apart.
+  systemClock.step(1710065322500000LL);
+}
+
+void tearDown() {}
+
+void test_tick_frame() {
+  FrameCost cost = runFrames(0);
+  report("tick", cost);
+  TEST_ASSERT_EQUAL_UINT32(0, cost.allocationsPerFrame);
+}
+
+void test_smooth_frame() {
+  FrameCost cost = runFrames(1);
+  report("smooth", cost);
+  TEST_ASSERT_EQUAL_UINT32(0, cost.allocationsPerFrame);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_tick_frame);
+  RUN_TEST(test_smooth_frame);
+  return UNITY_END();
+}
@@ -0,0 +1,91 @@
+// gammaCorrectFrame(): brightness 0 is off and 255 is full scale, with and
+// without dithering, and dithered dim levels average to the rounded one.
+#include <unity.h>
+
+#include "hal.h"
+#include "gamma.h"
+
+namespace {
+
+const size_t BYTES = 256 * 3;
+
+uint8_t input[BYTES];
+uint8_t output[BYTES];
+uint8_t residual[BYTES];
+
+// Every input value on every channel.
+void fillAllValues() {
+  for (size_t i = 0; i < BYTES; i++) {
+    input[i] = (uint8_t)(i / 3);
+  }
+}
+
+}  // namespace
+
+void setUp() {
+  fillAllValues();
+  memset(residual, 0, sizeof(residual));
+}
+
+void tearDown() {}
+
+void test_brightness_zero_is_off() {
+  for (uint8_t dither = 0; dither < 2; dither++) {
+    for (uint16_t frame = 0; frame < 512; frame++) {
+      TEST_ASSERT_FALSE(gammaCorrectFrame(input, output, residual, BYTES, 0, dither));
+      for (size_t i = 0; i < BYTES; i++) {
+        TEST_ASSERT_EQUAL_UINT8(0, output[i]);
+      }
+    }
+  }
+}
+
+void test_brightness_full_reaches_full_scale() {
+  for (uint8_t dither = 0; dither < 2; dither++) {
+    gammaCorrectFrame(input, output, residual, BYTES, 255, dither);
+    TEST_ASSERT_EQUAL_UINT8(0, output[0]);
+    TEST_ASSERT_EQUAL_UINT8(COLOR_CORRECTION_G, output[BYTES - 3]);
+    TEST_ASSERT_EQUAL_UINT8(COLOR_CORRECTION_R, output[BYTES - 2]);
+    TEST_ASSERT_EQUAL_UINT8(COLOR_CORRECTION_B, output[BYTES - 1]);
+  }
+}
+
+void test_output_grows_with_brightness() {
+  uint8_t previous[BYTES] = {};
+  for (uint16_t brightness = 0; brightness < 256; brightness++) {
+    gammaCorrectFrame(input, output, residual, BYTES, (uint8_t)brightness, false);
+    for (size_t i = 0; i < BYTES; i++) {
+      TEST_ASSERT_GREATER_OR_EQUAL(previous[i], output[i]);
+    }
+    memcpy(previous, output, sizeof(previous));
+  }
+}
+
+void test_dither_averages_to_the_rounded_level() {
+  // A dim input at half brightness: levels with a fractional part.
+  const uint32_t FRAMES = 256;
+  memset(input, 80, 3);
+  uint8_t rounded[3];
+  gammaCorrectFrame(input, rounded, residual, 3, 128, false);
+  uint32_t sums[3] = {};
+  bool fractional = false;
+  for (uint32_t f = 0; f < FRAMES; f++) {
+    fractional |= gammaCorrectFrame(input, output, residual, 3, 128, true);
+    for (uint8_t c = 0; c < 3; c++) {
+      sums[c] += output[c];
+    }
+  }
+  TEST_ASSERT_TRUE(fractional);
+  for (uint8_t c = 0; c < 3; c++) {
+    TEST_ASSERT_INT_WITHIN(FRAMES / 2, rounded[c] * FRAMES, sums[c]);
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_brightness_zero_is_off);
+  RUN_TEST(test_brightness_full_reaches_full_scale);
+  RUN_TEST(test_output_grows_with_brightness);
+  RUN_TEST(test_dither_averages_to_the_rounded_level);
+  return UNITY_END();
+}
@@ -0,0 +1,270 @@
+// NtpClient against stand-in SNTP servers on loopback UDP, in the same
+// process: offset and delay maths, choosing the lowest-delay server,
+// refusing bad replies, step versus slew, retry backoff and poll growth.
+#include <unity.h>
+
+#include "hal.h"
+#include "ntp_client.h"
+
+namespace {
+
+const int64_t START_UTC_US = 1710065322000000LL;
+const int64_t NTP_UNIX_OFFSET_S = 2208988800LL;
+const uint16_t FIRST_PORT = 12301;
+const char* const SERVER_NAMES[3] = {"127.0.0.1:12301", "127.0.0.1:12302", "127.0.0.1:12303"};
+
+void writeTimestamp(uint8_t* p, int64_t unixUs) {
+  uint32_t seconds = (uint32_t)(unixUs / 1000000 + NTP_UNIX_OFFSET_S);
+  uint32_t fraction = (uint32_t)(((uint64_t)(unixUs % 1000000) << 32) / 1000000);
+  for (int i = 0; i < 4; i++) {
+    p[i] = (uint8_t)(seconds >> (24 - 8 * i));
+    p[4 + i] = (uint8_t)(fraction >> (24 - 8 * i));
+  }
+}
+
+// One stand-in server. Its time is the reference clock plus offsetUs. A
+// reply is held for holdMs before it is sent, with both server timestamps
+// taken at sending: the hold looks like network delay on the way out.
+struct Responder {
+  WiFiUDP udp;
+  int64_t offsetUs = 0;
+  uint32_t holdMs = 0;
+  uint8_t firstByte = 0x24;  // LI 0, version 4, mode 4 (server)
+  uint8_t stratum = 2;
+  bool echoOriginate = true;
+
+  bool pending = false;
+  uint32_t dueMs = 0;
+  uint8_t reply[48];
+  IPAddress to;
+  uint16_t toPort = 0;
+};
+
+SystemClock reference;
+Responder responders[3];
+
+void resetResponders() {
+  for (uint8_t i = 0; i < 3; i++) {
+    Responder& r = responders[i];
+    r.offsetUs = 0;
+    r.holdMs = 0;
+    r.firstByte = 0x24;
+    r.stratum = 2;
+    r.echoOriginate = true;
+    r.pending = false;
+    if (!r.udp.begin(FIRST_PORT + i)) {
+      TEST_FAIL_MESSAGE("cannot bind the stand-in server port");
+    }
+    while (r.udp.parsePacket() > 0) {
+    }
+  }
+}
+
+void pumpResponders() {
+  for (Responder& r : responders) {
+    if (!r.pending && r.udp.parsePacket() >= 48) {
+      uint8_t request[48];
+      r.udp.read(request, sizeof(request));
+      memset(r.reply, 0, sizeof(r.reply));
+      r.reply[0] = r.firstByte;
+      r.reply[1] = r.stratum;
+      if (r.echoOriginate) {
+        memcpy(r.reply + 24, request + 40, 8);
+      } else {
+        writeTimestamp(r.reply + 24, START_UTC_US);
+      }
+      r.to = r.udp.remoteIP();
+      r.toPort = r.udp.remotePort();
+      r.dueMs = millis() + r.holdMs;
+      r.pending = true;
+    }
+    if (r.pending && (int32_t)(millis() - r.dueMs) >= 0) {
+      int64_t serverUs = reference.nowUs() + r.offsetUs;
+      writeTimestamp(r.reply + 32, serverUs);
+      writeTimestamp(r.reply + 40, serverUs);
+      r.udp.beginPacket(r.to, r.toPort);
+      r.udp.write(r.reply, sizeof(r.reply));
+      r.udp.endPacket();
+      r.pending = false;
+    }
+  }
+}
+
+// Runs one round, started now, to its end.
+NtpEvent syncRound(NtpClient& client) {
+  client.requestSync();
+  uint32_t startMs = millis();
+  while (millis() - startMs < 10000) {
+    pumpResponders();
+    NtpEvent event = client.service();
+    if (event != NTP_EVENT_NONE) {
+      return event;
+    }
+  }
+  TEST_FAIL_MESSAGE("round did not finish");
+  return NTP_EVENT_NONE;
+}
+
+}  // namespace
+
+void setUp() {
+  reference.step(START_UTC_US);
+  resetResponders();
+}
+
+void tearDown() {}
+
+void test_offset_and_delay() {
+  SystemClock clock;
+  clock.step(START_UTC_US);
+  NtpClient client(clock);
+  client.setServers(SERVER_NAMES[0], nullptr, nullptr);
+  responders[0].offsetUs = 50000;
+  TEST_ASSERT_EQUAL_INT(NTP_EVENT_SYNCED, syncRound(client));
+  TEST_ASSERT_FALSE(client.lastStepped());
+  TEST_ASSERT_INT_WITHIN(2000, 50000, client.lastOffsetUs());
+  TEST_ASSERT_INT_WITHIN(2000, 0, client.lastDelayUs());
+  TEST_ASSERT_INT64_WITHIN(2000, 50000, clock.pendingSlewUs());
+
+  // 40 ms on the way back: the offset is off by half of it.
+  responders[0].offsetUs = 0;
+  responders[0].holdMs = 40;
+  TEST_ASSERT_EQUAL_INT(NTP_EVENT_SYNCED, syncRound(client));
+  TEST_ASSERT_INT_WITHIN(5000, 40000, client.lastDelayUs());
+  TEST_ASSERT_INT_WITHIN(5000, 20000, client.lastOffsetUs());
+}
+
+void test_lowest_delay_sample_wins() {
+  SystemClock clock;
+  clock.step(START_UTC_US);
+  NtpClient client(clock);
+  client.setServers(SERVER_NAMES[0], SERVER_NAMES[1], SERVER_NAMES[2]);
+  responders[0].offsetUs = 30000;
+  responders[0].holdMs = 60;
+  responders[1].offsetUs = 10000;
+  responders[2].offsetUs = 60000;
+  responders[2].holdMs = 30;
+  TEST_ASSERT_EQUAL_INT(NTP_EVENT_SYNCED, syncRound(client));
+  TEST_ASSERT_EQUAL_STRING(SERVER_NAMES[1], client.lastServer());
+  TEST_ASSERT_INT_WITHIN(2000, 10000, client.lastOffsetUs());
+}
+
+void test_reply_to_another_request_is_ignored() {
+  SystemClock clock;
+  clock.step(START_UTC_US);
+  NtpClient client(clock);
+  client.setServers(SERVER_NAMES[0], SERVER_NAMES[1], nullptr);
+  responders[0].echoOriginate = false;
+  responders[0].offsetUs = 90000;
+  responders[1].offsetUs = 5000;
+  TEST_ASSERT_EQUAL_INT(NTP_EVENT_SYNCED, syncRound(client));
+  TEST_ASSERT_EQUAL_STRING(SERVER_NAMES[1], client.lastServer());
+  TEST_ASSERT_INT_WITHIN(2000, 5000, client.lastOffsetUs());
+}
+
+void test_unsynchronised_servers_are_refused() {
+  SystemClock clock;
+  clock.step(START_UTC_US);
+  NtpClient client(clock);
+  client.setServers(SERVER_NAMES[0], SERVER_NAMES[1], SERVER_NAMES[2]);
+  responders[0].stratum = 0;       // Kiss-o'-death
+  responders[1].firstByte = 0xE4;  // Leap 3: not synchronised
+  responders[2].firstByte = 0x23;  // Mode 3: a client, not a server
+  for (Responder& r : responders) {
+    r.offsetUs = 300000;
+  }
+  TEST_ASSERT_EQUAL_INT(NTP_EVENT_FAILED, syncRound(client));
+  TEST_ASSERT_FALSE(client.synced());
+  TEST_ASSERT_INT64_WITHIN(2000, 0, clock.nowUs() - reference.nowUs());
+}
+
+void test_step_threshold() {
+  SystemClock clock;
+  clock.step(START_UTC_US);
+  NtpClient client(clock);
+  client.setServers(SERVER_NAMES[0], nullptr, nullptr);
+  // STEP_THRESHOLD_US is 128 ms.
+  responders[0].offsetUs = 120000;
+  TEST_ASSERT_EQUAL_INT(NTP_EVENT_SYNCED, syncRound(client));
+  TEST_ASSERT_FALSE(client.lastStepped());
+  TEST_ASSERT_INT64_WITHIN(2000, 120000, clock.pendingSlewUs());
+
+  clock.step(reference.nowUs());
+  responders[0].offsetUs = 140000;
+  TEST_ASSERT_EQUAL_INT(NTP_EVENT_SYNCED, syncRound(client));
+  TEST_ASSERT_TRUE(client.lastStepped());
+  TEST_ASSERT_EQUAL_INT64(0, clock.pendingSlewUs());
+  TEST_ASSERT_INT64_WITHIN(2000, 140000, clock.nowUs() - reference.nowUs());
+}
+
+void test_unset_clock_is_stepped() {
+  SystemClock clock;
+  NtpClient client(clock);
+  client.setServers(SERVER_NAMES[0], nullptr, nullptr);
+  TEST_ASSERT_EQUAL_INT(NTP_EVENT_SYNCED, syncRound(client));
+  TEST_ASSERT_TRUE(client.lastStepped());
+  TEST_ASSERT_TRUE(clock.isSet());
+  TEST_ASSERT_INT64_WITHIN(2000, 0, clock.nowUs() - reference.nowUs());
+}
+
+void test_failure_backoff() {
+  SystemClock clock;
+  clock.step(START_UTC_US);
+  NtpClient client(clock);
+  client.setServers(SERVER_NAMES[0], nullptr, nullptr);
+  responders[0].stratum = 0;
+  // 15 s doubling, capped at the poll interval (64 s).
+  const uint32_t RETRY_S[] = {15, 30, 60, 64, 64};
+  for (uint32_t retryS : RETRY_S) {
+    TEST_ASSERT_EQUAL_INT(NTP_EVENT_FAILED, syncRound(client));
+    TEST_ASSERT_INT_WITHIN(1, retryS, client.secondsUntilPoll());
+  }
+  // A success starts the backoff over.
+  responders[0].stratum = 2;
+  TEST_ASSERT_EQUAL_INT(NTP_EVENT_SYNCED, syncRound(client));
+  responders[0].stratum = 0;
+  TEST_ASSERT_EQUAL_INT(NTP_EVENT_FAILED, syncRound(client));
+  TEST_ASSERT_INT_WITHIN(1, 15, client.secondsUntilPoll());
+}
+
+void test_poll_interval_grows_and_resets() {
+  SystemClock clock;
+  clock.step(START_UTC_US);
+  NtpClient client(clock);
+  client.setServers(SERVER_NAMES[0], nullptr, nullptr);
+  TEST_ASSERT_EQUAL_UINT32(NtpClient::MIN_POLL_S, client.pollIntervalS());
+  // Within 20 ms the interval doubles, up to MAX_POLL_S.
+  uint32_t expected = NtpClient::MIN_POLL_S;
+  for (uint8_t i = 0; i < 7; i++) {
+    TEST_ASSERT_EQUAL_INT(NTP_EVENT_SYNCED, syncRound(client));
+    expected = expected * 2 > NtpClient::MAX_POLL_S ? NtpClient::MAX_POLL_S : expected * 2;
+    TEST_ASSERT_EQUAL_UINT32(expected, client.pollIntervalS());
+    TEST_ASSERT_INT_WITHIN(1, expected, client.secondsUntilPoll());
+  }
+  TEST_ASSERT_EQUAL_UINT32(NtpClient::MAX_POLL_S, client.pollIntervalS());
+
+  // Between 20 and 100 ms it stays.
+  responders[0].offsetUs = 50000;
+  TEST_ASSERT_EQUAL_INT(NTP_EVENT_SYNCED, syncRound(client));
+  TEST_ASSERT_EQUAL_UINT32(NtpClient::MAX_POLL_S, client.pollIntervalS());
+
+  // Beyond 100 ms it starts over, slewed or stepped.
+  clock.step(reference.nowUs());
+  responders[0].offsetUs = 110000;
+  TEST_ASSERT_EQUAL_INT(NTP_EVENT_SYNCED, syncRound(client));
+  TEST_ASSERT_FALSE(client.lastStepped());
+  TEST_ASSERT_EQUAL_UINT32(NtpClient::MIN_POLL_S, client.pollIntervalS());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_offset_and_delay);
+  RUN_TEST(test_lowest_delay_sample_wins);
+  RUN_TEST(test_reply_to_another_request_is_ignored);
+  RUN_TEST(test_unsynchronised_servers_are_refused);
+  RUN_TEST(test_step_threshold);
+  RUN_TEST(test_unset_clock_is_stepped);
+  RUN_TEST(test_failure_backoff);
+  RUN_TEST(test_poll_interval_grows_and_resets);
+  return UNITY_END();
+}
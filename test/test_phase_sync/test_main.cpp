@@ -0,0 +1,101 @@
+// A leader and a follower PhaseSync in one process, over loopback
+// multicast, each with its own SystemClock set a few ms apart: the
+// follower must end up within 5 ms of the leader.
+#include <unity.h>
+
+#include "hal.h"
+#include "phase_sync.h"
+
+namespace {
+
+const int64_t START_UTC_US = 1710065322000000LL;
+const int64_t AGREE_US = 5000;
+
+// Leader minus follower, read back to back.
+int64_t disagreementUs(SystemClock& leader, SystemClock& follower) {
+  int64_t leaderUs = leader.nowUs();
+  int64_t followerUs = follower.nowUs();
+  return leaderUs - followerUs;
+}
+
+int64_t absUs(int64_t v) {
+  return v < 0 ? -v : v;
+}
+
+// Sends beacons as fast as the follower takes them, rather than one a
+// second, until the follower has corrected its clock `corrections` times.
+void exchangeBeacons(PhaseSync& leader, PhaseSync& follower, uint32_t corrections) {
+  uint32_t nowMs = 0;
+  for (uint32_t i = 0; i < 100 && follower.corrections() < corrections; i++) {
+    nowMs += PhaseSync::BEACON_INTERVAL_MS;
+    leader.service(nowMs);
+    uint32_t startMs = millis();
+    uint32_t beacons = follower.beacons();
+    while (follower.beacons() == beacons && millis() - startMs < 200) {
+      follower.service(nowMs);
+    }
+  }
+  TEST_ASSERT_GREATER_OR_EQUAL(corrections, follower.corrections());
+}
+
+void checkConverges(int64_t offsetUs) {
+  SystemClock leaderClock;
+  SystemClock followerClock;
+  followerClock.step(START_UTC_US);
+  leaderClock.step(followerClock.nowUs() + offsetUs);
+  PhaseSync leader(leaderClock);
+  PhaseSync follower(followerClock);
+  leader.setRole(SYNC_LEADER);
+  follower.setRole(SYNC_FOLLOWER);
+  follower.service(0);  // Joins the group before the first beacon
+
+  exchangeBeacons(leader, follower, 1);
+  TEST_ASSERT_TRUE(follower.following());
+  char message[64];
+  snprintf(message, sizeof(message), "offset %lld us", (long long)offsetUs);
+  // Whatever is left is being slewed at SLEW_PPM.
+  TEST_ASSERT_INT64_WITHIN_MESSAGE(AGREE_US, 0, disagreementUs(leaderClock, followerClock), message);
+  TEST_ASSERT_INT64_WITHIN_MESSAGE(500, 0, disagreementUs(leaderClock, followerClock) - followerClock.pendingSlewUs(),
+                                   message);
+}
+
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_follower_converges_from_either_side() {
+  const int64_t OFFSETS[] = {-19000, -12000, -6000, 6000, 12000, 19000, 250000};
+  for (int64_t offset : OFFSETS) {
+    checkConverges(offset);
+  }
+}
+
+void test_small_offset_is_slewed() {
+  SystemClock leaderClock;
+  SystemClock followerClock;
+  followerClock.step(START_UTC_US);
+  leaderClock.step(followerClock.nowUs() + 2000);
+  PhaseSync leader(leaderClock);
+  PhaseSync follower(followerClock);
+  leader.setRole(SYNC_LEADER);
+  follower.setRole(SYNC_FOLLOWER);
+  follower.service(0);
+
+  exchangeBeacons(leader, follower, 1);
+  TEST_ASSERT_FALSE(follower.lastStepped());
+  TEST_ASSERT_INT64_WITHIN(500, 2000, followerClock.pendingSlewUs());
+  // A second window corrects on top of the slew still pending.
+  exchangeBeacons(leader, follower, 2);
+  TEST_ASSERT_FALSE(follower.lastStepped());
+  TEST_ASSERT_INT64_WITHIN(500, 0, disagreementUs(leaderClock, followerClock) - followerClock.pendingSlewUs());
+  TEST_ASSERT_LESS_THAN(AGREE_US, absUs(disagreementUs(leaderClock, followerClock)));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_follower_converges_from_either_side);
+  RUN_TEST(test_small_offset_is_slewed);
+  return UNITY_END();
+}
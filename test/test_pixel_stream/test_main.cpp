@@ -0,0 +1,170 @@
+// PixelStream fed over loopback UDP: DDP and E1.31 frames land in the
+// buffer in GRB order, bad packets are rejected, and the time from
+// sending a frame to service() reporting it complete.
+#include <unity.h>
+
+#include "hal.h"
+#include "pixel_stream.h"
+
+namespace {
+
+const uint16_t LEDS = 60;
+const size_t FRAME_BYTES = LEDS * 3;
+const IPAddress LOOPBACK(127, 0, 0, 1);
+
+uint8_t frame[FRAME_BYTES];
+WiFiUDP sender;
+
+void sendDdp(uint8_t flags, uint32_t offset, const uint8_t* rgb, uint16_t length) {
+  uint8_t header[10] = {flags, 0, 0x0B, 1,
+                        (uint8_t)(offset >> 24), (uint8_t)(offset >> 16), (uint8_t)(offset >> 8), (uint8_t)offset,
+                        (uint8_t)(length >> 8), (uint8_t)length};
+  sender.beginPacket(LOOPBACK, PixelStream::DDP_PORT);
+  sender.write(header, sizeof(header));
+  sender.write(rgb, length);
+  sender.endPacket();
+}
+
+void sendE131(uint16_t universe, uint8_t options, const uint8_t* rgb, uint16_t length) {
+  uint8_t header[126] = {};
+  const char ACN_ID[] = "ASC-E1.17";
+  header[1] = 0x10;
+  memcpy(header + 4, ACN_ID, sizeof(ACN_ID));
+  header[21] = 0x04;  // Root vector: data
+  header[43] = 0x02;  // Framing vector: data
+  header[112] = options;
+  header[113] = (uint8_t)(universe >> 8);
+  header[114] = (uint8_t)universe;
+  header[117] = 0x02;  // DMP vector: set property
+  header[118] = 0xA1;
+  header[123] = (uint8_t)((length + 1) >> 8);  // Property count, with the start code
+  header[124] = (uint8_t)(length + 1);
+  sender.beginPacket(LOOPBACK, PixelStream::E131_PORT);
+  sender.write(header, sizeof(header));
+  sender.write(rgb, length);
+  sender.endPacket();
+}
+
+// Services the stream until it reports a frame or `timeoutMs` passes.
+bool waitForFrame(PixelStream& stream, uint32_t timeoutMs) {
+  uint32_t startMs = millis();
+  while (millis() - startMs < timeoutMs) {
+    if (stream.service(millis())) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void rgbRamp(uint8_t* rgb, size_t length, uint8_t seed) {
+  for (size_t i = 0; i < length; i++) {
+    rgb[i] = (uint8_t)(seed + i);
+  }
+}
+
+void assertGrb(const uint8_t* rgb, size_t offset, size_t length) {
+  for (size_t i = 0; i < length; i += 3) {
+    TEST_ASSERT_EQUAL_HEX8(rgb[i + 1], frame[offset + i]);
+    TEST_ASSERT_EQUAL_HEX8(rgb[i], frame[offset + i + 1]);
+    TEST_ASSERT_EQUAL_HEX8(rgb[i + 2], frame[offset + i + 2]);
+  }
+}
+
+}  // namespace
+
+void setUp() {
+  memset(frame, 0, sizeof(frame));
+}
+
+void tearDown() {}
+
+void test_ddp_frame_in_two_packets() {
+  PixelStream stream(frame, FRAME_BYTES);
+  TEST_ASSERT_TRUE(stream.begin());
+  uint8_t rgb[FRAME_BYTES];
+  rgbRamp(rgb, sizeof(rgb), 7);
+  sendDdp(0x40, 0, rgb, 90);
+  TEST_ASSERT_FALSE(waitForFrame(stream, 50));
+  sendDdp(0x41, 90, rgb + 90, 90);
+  TEST_ASSERT_TRUE(waitForFrame(stream, 1000));
+  assertGrb(rgb, 0, FRAME_BYTES);
+  TEST_ASSERT_EQUAL_UINT32(2, stream.packets());
+  TEST_ASSERT_EQUAL_UINT32(1, stream.frames());
+  TEST_ASSERT_TRUE(stream.active());
+}
+
+void test_ddp_past_the_end_is_clipped() {
+  PixelStream stream(frame, FRAME_BYTES);
+  TEST_ASSERT_TRUE(stream.begin());
+  uint8_t rgb[30];
+  rgbRamp(rgb, sizeof(rgb), 100);
+  sendDdp(0x41, FRAME_BYTES - 15, rgb, sizeof(rgb));
+  TEST_ASSERT_TRUE(waitForFrame(stream, 1000));
+  assertGrb(rgb, FRAME_BYTES - 15, 15);
+}
+
+void test_bad_ddp_rejected() {
+  PixelStream stream(frame, FRAME_BYTES);
+  TEST_ASSERT_TRUE(stream.begin());
+  uint8_t rgb[6] = {1, 2, 3, 4, 5, 6};
+  sendDdp(0x81, 0, rgb, 6);  // Version 2
+  sendDdp(0x41, 1, rgb, 6);  // Not a whole LED
+  sendDdp(0x43, 0, rgb, 6);  // Query
+  TEST_ASSERT_FALSE(waitForFrame(stream, 100));
+  TEST_ASSERT_EQUAL_UINT32(3, stream.rejected());
+  TEST_ASSERT_EQUAL_UINT32(0, stream.packets());
+  TEST_ASSERT_EQUAL_HEX8(0, frame[0]);
+}
+
+void test_e131_universe_and_termination() {
+  PixelStream stream(frame, FRAME_BYTES);
+  TEST_ASSERT_TRUE(stream.begin());
+  uint8_t rgb[FRAME_BYTES];
+  rgbRamp(rgb, sizeof(rgb), 50);
+  sendE131(2, 0, rgb, sizeof(rgb));  // Past the strip: accepted, nothing drawn
+  sendE131(1, 0x80, rgb, sizeof(rgb));  // Preview data
+  TEST_ASSERT_FALSE(waitForFrame(stream, 50));
+  TEST_ASSERT_EQUAL_UINT32(1, stream.rejected());
+  sendE131(1, 0, rgb, sizeof(rgb));
+  TEST_ASSERT_TRUE(waitForFrame(stream, 1000));
+  assertGrb(rgb, 0, FRAME_BYTES);
+  sendE131(1, 0x40, rgb, sizeof(rgb));  // Stream terminated
+  TEST_ASSERT_FALSE(waitForFrame(stream, 50));
+  TEST_ASSERT_FALSE(stream.active());
+  TEST_ASSERT_EQUAL_UINT32(1, stream.rejected());
+}
+
+void test_frame_latency_benchmark() {
+  const uint32_t FRAMES = 5000;
+  PixelStream stream(frame, FRAME_BYTES);
+  TEST_ASSERT_TRUE(stream.begin());
+  uint8_t rgb[FRAME_BYTES];
+  uint64_t serviceUs = 0;
+  uint32_t startAllocations = halAllocationCount();
+  uint64_t startUs = halMicros64();
+  for (uint32_t f = 0; f < FRAMES; f++) {
+    rgbRamp(rgb, sizeof(rgb), (uint8_t)f);
+    sendDdp(0x41, 0, rgb, sizeof(rgb));
+    uint64_t serviceStartUs = halMicros64();
+    TEST_ASSERT_TRUE(waitForFrame(stream, 1000));
+    serviceUs += halMicros64() - serviceStartUs;
+  }
+  uint64_t elapsedUs = halMicros64() - startUs;
+  assertGrb(rgb, 0, FRAME_BYTES);
+  char line[128];
+  snprintf(line, sizeof(line), "DDP %u LEDs: %lu frames/s, %lu ns send to frame, %lu allocs/frame",
+           LEDS, (unsigned long)(FRAMES * 1000000ULL / elapsedUs), (unsigned long)(serviceUs * 1000 / FRAMES),
+           (unsigned long)((halAllocationCount() - startAllocations) / FRAMES));
+  TEST_MESSAGE(line);
+  TEST_ASSERT_EQUAL_UINT32(FRAMES, stream.frames());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_ddp_frame_in_two_packets);
+  RUN_TEST(test_ddp_past_the_end_is_clipped);
+  RUN_TEST(test_bad_ddp_rejected);
+  RUN_TEST(test_e131_universe_and_termination);
+  RUN_TEST(test_frame_latency_benchmark);
+  return UNITY_END();
+}
@@ -0,0 +1,289 @@
+// Schedule driven second by second through simulated days across the
+// Europe/Rome DST changes: skipped and repeated local times, hourly chimes
+// on 23 and 25 hour days, night mode brightness, catch-up after a jump,
+// and a timezone change; night mode at brightness 0 blanking the LEDs
+// through the firmware's frame path, and the next firing past 2038 in
+// the /api/schedule JSON. Plus the cost of service() with nothing due.
+#include <unity.h>
+
+#include <vector>
+
+#include "hal.h"
+#include "json.h"
+#include "schedule.h"
+#include "system_clock.h"
+
+// The firmware's schedule and frame path (main.cpp).
+extern Schedule schedule;
+extern SystemClock systemClock;
+extern Adafruit_NeoPixel ring;
+extern bool clockNeedsRedraw;
+extern uint8_t outputBrightness;
+void serviceSchedule();
+bool displayClock();
+bool outputFrame();
+
+namespace {
+
+const char* const ROME = "CET-1CEST,M3.5.0,M10.5.0/3";
+
+struct Fired {
+  uint8_t slot;
+  int64_t utc;
+};
+
+std::vector<Fired> fired;
+int64_t simulatedUtc = 0;
+
+void onFire(uint8_t slot, const ScheduleEntry&, void*) {
+  fired.push_back({slot, simulatedUtc});
+}
+
+int64_t utcOf(int year, int month, int day, int hour, int minute) {
+  struct tm t = {};
+  t.tm_year = year - 1900;
+  t.tm_mon = month - 1;
+  t.tm_mday = day;
+  t.tm_hour = hour;
+  t.tm_min = minute;
+  return timegm(&t);
+}
+
+// Calls service() once for every second in [from, to).
+void run(Schedule& schedule, int64_t from, int64_t to) {
+  for (simulatedUtc = from; simulatedUtc < to; simulatedUtc++) {
+    schedule.service(simulatedUtc, onFire, nullptr);
+  }
+}
+
+void serviceAt(Schedule& schedule, int64_t utc) {
+  simulatedUtc = utc;
+  schedule.service(utc, onFire, nullptr);
+}
+
+// Lit LEDs in what was last sent to the ring.
+uint16_t litLeds() {
+  uint16_t lit = 0;
+  const uint8_t* pixels = ring.getPixels();
+  for (uint16_t i = 0; i < ring.numPixels(); i++) {
+    if (pixels[3 * i] != 0 || pixels[3 * i + 1] != 0 || pixels[3 * i + 2] != 0) {
+      lit++;
+    }
+  }
+  return lit;
+}
+
+// One loop() pass of the clock: schedule, redraw, output.
+void clockFrameAt(int64_t utc) {
+  systemClock.step(utc * 1000000);
+  serviceSchedule();
+  clockNeedsRedraw = true;
+  displayClock();
+  outputFrame();
+}
+
+}  // namespace
+
+void setUp() {
+  fired.clear();
+}
+
+void tearDown() {}
+
+void test_alarm_in_skipped_and_repeated_hour() {
+  Timezone zone;
+  zone.set(ROME);
+  Schedule schedule(zone);
+  schedule.set(0, {SCHEDULE_ALARM, 2, 30, SCHEDULE_EVERY_DAY, 0});
+
+  run(schedule, utcOf(2026, 3, 27, 0, 0), utcOf(2026, 3, 31, 0, 0));
+  TEST_ASSERT_EQUAL_UINT32(4, fired.size());
+  TEST_ASSERT_EQUAL_INT64(utcOf(2026, 3, 27, 1, 30), fired[0].utc);
+  TEST_ASSERT_EQUAL_INT64(utcOf(2026, 3, 28, 1, 30), fired[1].utc);
+  // 02:30 does not exist on 29 March: fires at the change, 03:00 CEST.
+  TEST_ASSERT_EQUAL_INT64(utcOf(2026, 3, 29, 1, 0), fired[2].utc);
+  TEST_ASSERT_EQUAL_INT64(utcOf(2026, 3, 30, 0, 30), fired[3].utc);
+
+  fired.clear();
+  run(schedule, utcOf(2026, 10, 24, 0, 0), utcOf(2026, 10, 27, 0, 0));
+  TEST_ASSERT_EQUAL_UINT32(3, fired.size());
+  TEST_ASSERT_EQUAL_INT64(utcOf(2026, 10, 24, 0, 30), fired[0].utc);
+  // 02:30 happens twice on 25 October: only the first (CEST) fires.
+  TEST_ASSERT_EQUAL_INT64(utcOf(2026, 10, 25, 0, 30), fired[1].utc);
+  TEST_ASSERT_EQUAL_INT64(utcOf(2026, 10, 26, 1, 30), fired[2].utc);
+}
+
+void test_hourly_chime_on_short_and_long_days() {
+  Timezone zone;
+  zone.set(ROME);
+  Schedule schedule(zone);
+  schedule.set(3, {SCHEDULE_CHIME, SCHEDULE_EVERY_HOUR, 0, SCHEDULE_EVERY_DAY, 0});
+
+  // Local 29 March, 23 hours long: 00:00 to 23:00 inclusive, less 02:00.
+  run(schedule, utcOf(2026, 3, 28, 23, 0) - 1, utcOf(2026, 3, 29, 22, 0) - 1);
+  TEST_ASSERT_EQUAL_UINT32(23, fired.size());
+
+  // Local 25 October, 25 hours long: 02:00 fires the first time only.
+  fired.clear();
+  run(schedule, utcOf(2026, 10, 24, 22, 0) - 1, utcOf(2026, 10, 25, 23, 0) - 1);
+  TEST_ASSERT_EQUAL_UINT32(24, fired.size());
+  for (size_t i = 1; i < fired.size(); i++) {
+    TEST_ASSERT_GREATER_THAN(fired[i - 1].utc, fired[i].utc);
+    TEST_ASSERT_EQUAL_UINT8(3, fired[i].slot);
+  }
+}
+
+void test_night_mode_across_spring_change() {
+  Timezone zone;
+  zone.set(ROME);
+  Schedule schedule(zone);
+  schedule.set(0, {SCHEDULE_BRIGHTNESS, 22, 0, SCHEDULE_EVERY_DAY, 40});
+  schedule.set(1, {SCHEDULE_BRIGHTNESS, 7, 0, SCHEDULE_EVERY_DAY, 255});
+
+  // Starts at 23:30 CET: the brightness follows the 22:00 entry.
+  serviceAt(schedule, utcOf(2026, 3, 28, 22, 30));
+  TEST_ASSERT_EQUAL_UINT8(40, schedule.brightness());
+  run(schedule, utcOf(2026, 3, 28, 22, 30), utcOf(2026, 3, 29, 4, 59));  // To 06:59 CEST
+  TEST_ASSERT_EQUAL_UINT8(40, schedule.brightness());
+  run(schedule, utcOf(2026, 3, 29, 4, 59), utcOf(2026, 3, 29, 5, 0) + 1);
+  TEST_ASSERT_EQUAL_UINT8(255, schedule.brightness());
+  TEST_ASSERT_EQUAL_UINT32(1, fired.size());
+  TEST_ASSERT_EQUAL_INT64(utcOf(2026, 3, 29, 5, 0), fired[0].utc);
+}
+
+void test_jump_and_catch_up() {
+  Timezone zone;
+  zone.set(ROME);
+  Schedule schedule(zone);
+  schedule.set(0, {SCHEDULE_BRIGHTNESS, 22, 0, SCHEDULE_EVERY_DAY, 40});
+  schedule.set(1, {SCHEDULE_BRIGHTNESS, 7, 0, SCHEDULE_EVERY_DAY, 255});
+
+  // Boot in the afternoon, then a jump past 22:00: nothing fires, but the
+  // brightness follows.
+  serviceAt(schedule, utcOf(2026, 7, 1, 13, 0));
+  TEST_ASSERT_EQUAL_UINT8(255, schedule.brightness());
+  serviceAt(schedule, utcOf(2026, 7, 1, 23, 0));
+  TEST_ASSERT_EQUAL_UINT8(40, schedule.brightness());
+  TEST_ASSERT_EQUAL_UINT32(0, fired.size());
+
+  // A jump shorter than MAX_CATCH_UP_S fires what it passes over:
+  // 21:59:30 to 22:00:10 CEST.
+  serviceAt(schedule, utcOf(2026, 7, 2, 19, 59) + 30);
+  TEST_ASSERT_EQUAL_UINT8(255, schedule.brightness());
+  serviceAt(schedule, utcOf(2026, 7, 2, 20, 0) + 10);
+  TEST_ASSERT_EQUAL_UINT8(40, schedule.brightness());
+  TEST_ASSERT_EQUAL_UINT32(1, fired.size());
+  TEST_ASSERT_EQUAL_UINT8(0, fired[0].slot);
+}
+
+void test_weekday_alarm_and_timezone_change() {
+  Timezone zone;
+  zone.set(ROME);
+  Schedule schedule(zone);
+  schedule.set(2, {SCHEDULE_ALARM, 7, 15, 0x3E, 0});  // Monday to Friday
+
+  run(schedule, utcOf(2026, 10, 19, 0, 0), utcOf(2026, 10, 26, 12, 0));  // Mon 19 to Mon 26
+  TEST_ASSERT_EQUAL_UINT32(6, fired.size());
+  TEST_ASSERT_EQUAL_INT64(utcOf(2026, 10, 23, 5, 15), fired[4].utc);  // Friday, CEST
+  TEST_ASSERT_EQUAL_INT64(utcOf(2026, 10, 26, 6, 15), fired[5].utc);  // Monday, CET
+
+  // The same entry in New York after the zone changes.
+  zone.set("EST5EDT,M3.2.0,M11.1.0");
+  schedule.invalidate();
+  fired.clear();
+  run(schedule, utcOf(2026, 11, 2, 0, 0), utcOf(2026, 11, 3, 0, 0));
+  TEST_ASSERT_EQUAL_UINT32(1, fired.size());
+  TEST_ASSERT_EQUAL_INT64(utcOf(2026, 11, 2, 12, 15), fired[0].utc);
+}
+
+void test_brightness_zero_turns_the_leds_off() {
+  // main.cpp's zone is UTC until applyTimezone() runs.
+  schedule.set(0, {SCHEDULE_BRIGHTNESS, 22, 0, SCHEDULE_EVERY_DAY, 0});
+  schedule.set(1, {SCHEDULE_BRIGHTNESS, 7, 0, SCHEDULE_EVERY_DAY, 255});
+
+  clockFrameAt(utcOf(2026, 7, 1, 21, 59) + 59);
+  TEST_ASSERT_EQUAL_UINT8(255, outputBrightness);
+  TEST_ASSERT_GREATER_THAN(0, litLeds());
+
+  // Every frame after 22:00 is dark, temporal dithering included.
+  for (int64_t second = 0; second < 300; second++) {
+    clockFrameAt(utcOf(2026, 7, 1, 22, 0) + second);
+    TEST_ASSERT_EQUAL_UINT8(0, outputBrightness);
+    TEST_ASSERT_EQUAL_UINT16(0, litLeds());
+  }
+
+  clockFrameAt(utcOf(2026, 7, 2, 7, 0));
+  TEST_ASSERT_EQUAL_UINT8(255, outputBrightness);
+  TEST_ASSERT_GREATER_THAN(0, litLeds());
+
+  schedule.set(0, {SCHEDULE_OFF, 0, 0, 0, 0});
+  schedule.set(1, {SCHEDULE_OFF, 0, 0, 0, 0});
+}
+
+void test_next_firing_past_2038_in_json() {
+  Timezone zone;
+  Schedule schedule(zone);
+  schedule.set(0, {SCHEDULE_ALARM, 7, 0, SCHEDULE_EVERY_DAY, 0});
+  serviceAt(schedule, utcOf(2040, 1, 1, 12, 0));
+  uint8_t slot;
+  int64_t utc;
+  TEST_ASSERT_TRUE(schedule.next(&slot, &utc));
+  TEST_ASSERT_EQUAL_INT64(utcOf(2040, 1, 2, 7, 0), utc);
+
+  // As handleApiSchedule() writes it.
+  char buffer[64];
+  JsonWriter json(buffer, sizeof(buffer));
+  json.beginObject();
+  json.beginObject("next");
+  json.add("slot", (uint32_t)slot);
+  json.add("epoch", utc);
+  json.endObject();
+  json.endObject();
+  TEST_ASSERT_EQUAL_STRING("{\"next\":{\"slot\":0,\"epoch\":2209100400}}", json.c_str());
+}
+
+void test_service_benchmark() {
+  Timezone zone;
+  zone.set(ROME);
+  Schedule schedule(zone);
+  schedule.set(0, {SCHEDULE_CHIME, SCHEDULE_EVERY_HOUR, 0, SCHEDULE_EVERY_DAY, 0});
+  schedule.set(1, {SCHEDULE_BRIGHTNESS, 22, 0, SCHEDULE_EVERY_DAY, 40});
+  schedule.set(2, {SCHEDULE_BRIGHTNESS, 7, 0, SCHEDULE_EVERY_DAY, 255});
+  schedule.set(3, {SCHEDULE_ALARM, 6, 45, 0x3E, 0});
+  int64_t start = utcOf(2026, 7, 1, 12, 0) + 1;
+  serviceAt(schedule, start);
+
+  // 50 calls a second, like the frame loop, over 10 minutes.
+  const uint32_t CALLS = 50 * 600;
+  uint64_t startUs = halMicros64();
+  for (uint32_t i = 0; i < CALLS; i++) {
+    schedule.service(start + i / 50, onFire, nullptr);
+  }
+  uint64_t serviceUs = halMicros64() - startUs;
+
+  const uint32_t REBUILDS = 2000;
+  startUs = halMicros64();
+  for (uint32_t i = 0; i < REBUILDS; i++) {
+    schedule.invalidate();
+    schedule.service(start + 600 + i, onFire, nullptr);
+  }
+  uint64_t rebuildUs = halMicros64() - startUs;
+
+  char line[96];
+  snprintf(line, sizeof(line), "service() %lu ns/call, rebuild (4 entries) %lu ns",
+           (unsigned long)(serviceUs * 1000 / CALLS), (unsigned long)(rebuildUs * 1000 / REBUILDS));
+  TEST_MESSAGE(line);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_alarm_in_skipped_and_repeated_hour);
+  RUN_TEST(test_hourly_chime_on_short_and_long_days);
+  RUN_TEST(test_night_mode_across_spring_change);
+  RUN_TEST(test_jump_and_catch_up);
+  RUN_TEST(test_weekday_alarm_and_timezone_change);
+  RUN_TEST(test_brightness_zero_turns_the_leds_off);
+  RUN_TEST(test_next_firing_past_2038_in_json);
+  RUN_TEST(test_service_benchmark);
+  return UNITY_END();
+}
@@ -0,0 +1,90 @@
+// SystemClock read in a tight loop, as serviceEvents() and the second
+// alignment spin do: slew and drift must still be applied at their rates.
+#include <unity.h>
+
+#include "hal.h"
+#include "system_clock.h"
+
+namespace {
+
+const int64_t START_UTC_US = 1710065322000000LL;
+const uint64_t RUN_US = 1000000;
+
+struct Run {
+  int64_t utcUs;   // Clock advance over the run
+  int64_t monoUs;  // Monotonic time over the run
+};
+
+// Reads the clock back to back for RUN_US, checking it never goes back.
+Run readTightly(SystemClock& clock) {
+  int64_t startUtc = clock.nowUs();
+  uint64_t startMono = halMicros64();
+  int64_t last = startUtc;
+  uint64_t mono = startMono;
+  while (mono - startMono < RUN_US) {
+    int64_t now = clock.nowUs();
+    TEST_ASSERT_TRUE(now >= last);
+    last = now;
+    mono = halMicros64();
+  }
+  Run run;
+  run.utcUs = clock.nowUs() - startUtc;
+  run.monoUs = (int64_t)(halMicros64() - startMono);
+  return run;
+}
+
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_slew_progresses_when_read_continuously() {
+  SystemClock clock;
+  clock.step(START_UTC_US);
+  clock.slew(50000);
+  Run run = readTightly(clock);
+  int64_t expected = run.monoUs * SystemClock::SLEW_PPM / 1000000;
+  // The clock and the monotonic counter are read a few us apart; a
+  // stalled slew would be off by 500 us.
+  TEST_ASSERT_INT64_WITHIN(20, 50000 - expected, clock.pendingSlewUs());
+  TEST_ASSERT_INT64_WITHIN(20, run.monoUs + expected, run.utcUs);
+}
+
+void test_negative_slew_progresses_when_read_continuously() {
+  SystemClock clock;
+  clock.step(START_UTC_US);
+  clock.slew(-50000);
+  Run run = readTightly(clock);
+  int64_t expected = run.monoUs * SystemClock::SLEW_PPM / 1000000;
+  TEST_ASSERT_INT64_WITHIN(20, -50000 + expected, clock.pendingSlewUs());
+  TEST_ASSERT_INT64_WITHIN(20, run.monoUs - expected, run.utcUs);
+}
+
+void test_drift_applied_when_read_continuously() {
+  SystemClock clock;
+  clock.step(START_UTC_US);
+  clock.setDriftPpb(100000);  // 100 ppm fast
+  // The pending slew makes nowUs() re-anchor on every read.
+  clock.slew(50000);
+  Run run = readTightly(clock);
+  int64_t slewed = run.monoUs * SystemClock::SLEW_PPM / 1000000;
+  TEST_ASSERT_INT64_WITHIN(20, run.monoUs + run.monoUs / 10000 + slewed, run.utcUs);
+}
+
+void test_slew_finishes() {
+  SystemClock clock;
+  clock.step(START_UTC_US);
+  clock.slew(400);  // 0.8 s at SLEW_PPM
+  readTightly(clock);
+  TEST_ASSERT_EQUAL_INT64(0, clock.pendingSlewUs());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_slew_progresses_when_read_continuously);
+  RUN_TEST(test_negative_slew_progresses_when_read_continuously);
+  RUN_TEST(test_drift_applied_when_read_continuously);
+  RUN_TEST(test_slew_finishes);
+  return UNITY_END();
+}
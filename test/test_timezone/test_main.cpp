@@ -0,0 +1,145 @@
+// Timezone against the C library's own POSIX TZ rules, across the DST
+// transitions of every zone in the database, plus a benchmark of
+// localTime() against setenv()/tzset()/localtime_r().
+#include <unity.h>
+
+#include <stdlib.h>
+
+#include "hal.h"
+#include "timezone.h"
+#include "tz_db.h"
+
+namespace {
+
+// 2024-01-01 .. 2027-01-01 UTC: three years, starting with a leap year.
+const time_t FIRST_UTC = 1704067200;
+const time_t LAST_UTC = 1798761600;
+const time_t STEP_S = 3600;
+
+void useLibcZone(const char* posix) {
+  // Keeps glibc from looking the rule up as a zoneinfo file name.
+  setenv("TZDIR", "/nonexistent", 1);
+  setenv("TZ", posix, 1);
+  tzset();
+}
+
+int32_t libcOffset(time_t utc) {
+  struct tm local;
+  localtime_r(&utc, &local);
+  return (int32_t)local.tm_gmtoff;
+}
+
+// Last second before the libc offset changes, between low (old offset)
+// and high (new offset).
+time_t libcTransition(time_t low, time_t high) {
+  int32_t before = libcOffset(low);
+  while (high - low > 1) {
+    time_t middle = low + (high - low) / 2;
+    if (libcOffset(middle) == before) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+void checkSame(Timezone& zone, const char* name, const char* rule, time_t utc) {
+  struct tm expected;
+  localtime_r(&utc, &expected);
+  struct tm actual;
+  zone.localTime(utc, &actual);
+  if (zone.utcOffset(utc) != expected.tm_gmtoff || actual.tm_hour != expected.tm_hour ||
+      actual.tm_mday != expected.tm_mday || actual.tm_wday != expected.tm_wday ||
+      actual.tm_yday != expected.tm_yday || actual.tm_isdst != (expected.tm_isdst > 0)) {
+    char message[160];
+    snprintf(message, sizeof(message), "%s (%s) at %lld: offset %ld, libc %ld", name, rule, (long long)utc,
+             (long)zone.utcOffset(utc), (long)expected.tm_gmtoff);
+    TEST_FAIL_MESSAGE(message);
+  }
+}
+
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_all_zones_match_libc_across_transitions() {
+  uint32_t transitions = 0;
+  for (uint16_t id = 0; id < TZ_DB_ZONE_COUNT; id++) {
+    char name[TZ_DB_NAME_MAX];
+    char rule[TZ_DB_RULE_MAX];
+    TEST_ASSERT_TRUE(tzDbName(id, name) && tzDbRule(id, rule));
+    Timezone zone;
+    TEST_ASSERT_TRUE_MESSAGE(zone.set(rule), name);
+    useLibcZone(rule);
+    for (time_t utc = FIRST_UTC; utc < LAST_UTC; utc += STEP_S) {
+      checkSame(zone, name, rule, utc);
+      if (libcOffset(utc) != libcOffset(utc + STEP_S)) {
+        // Both sides of the exact second, and out of order so the
+        // offset cache has to be refreshed.
+        time_t last = libcTransition(utc, utc + STEP_S);
+        checkSame(zone, name, rule, last + 1);
+        checkSame(zone, name, rule, last);
+        checkSame(zone, name, rule, last + 1);
+        transitions++;
+      }
+    }
+  }
+  char line[64];
+  snprintf(line, sizeof(line), "%lu transitions checked", (unsigned long)transitions);
+  TEST_MESSAGE(line);
+  TEST_ASSERT_GREATER_THAN(0, transitions);
+}
+
+void test_bad_rule_falls_back_to_utc() {
+  static const char* const BAD[] = {"", "X1", "CET", "CET-1,", "CET-1C", "CET-1CEST,M13.5.0,M10.5.0/3",
+                                    "CET-1CEST,M3.5.0,M10.5.0/x", "CET-1CEST,J0,J100"};
+  for (const char* rule : BAD) {
+    Timezone zone;
+    TEST_ASSERT_TRUE(zone.set("CET-1CEST,M3.5.0,M10.5.0/3"));
+    TEST_ASSERT_FALSE_MESSAGE(zone.set(rule), rule);
+    // Mid-July: would be DST in the zone set before.
+    TEST_ASSERT_EQUAL_INT32_MESSAGE(0, zone.utcOffset(1720000000), rule);
+    TEST_ASSERT_FALSE_MESSAGE(zone.isDst(1720000000), rule);
+  }
+}
+
+void test_local_time_benchmark() {
+  const char* rule = "CET-1CEST,M3.5.0,M10.5.0/3";
+  const uint32_t CALLS = 200000;
+  Timezone zone;
+  zone.set(rule);
+  struct tm local;
+  uint32_t checksum = 0;
+  uint64_t startUs = halMicros64();
+  for (uint32_t i = 0; i < CALLS; i++) {
+    zone.localTime(FIRST_UTC + i, &local);
+    checksum += local.tm_sec;
+  }
+  uint64_t zoneUs = halMicros64() - startUs;
+
+  // What the firmware did before: set the zone, then convert.
+  startUs = halMicros64();
+  for (uint32_t i = 0; i < CALLS / 10; i++) {
+    useLibcZone(rule);
+    time_t utc = FIRST_UTC + i;
+    localtime_r(&utc, &local);
+    checksum += local.tm_sec;
+  }
+  uint64_t libcUs = (halMicros64() - startUs) * 10;
+
+  char line[128];
+  snprintf(line, sizeof(line), "localTime %lu ns/call, setenv+tzset+localtime_r %lu ns/call (checksum %lu)",
+           (unsigned long)(zoneUs * 1000 / CALLS), (unsigned long)(libcUs * 1000 / CALLS), (unsigned long)checksum);
+  TEST_MESSAGE(line);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_all_zones_match_libc_across_transitions);
+  RUN_TEST(test_bad_rule_falls_back_to_utc);
+  RUN_TEST(test_local_time_benchmark);
+  return UNITY_END();
+}
@@ -0,0 +1,144 @@
+// WifiLink against the host's simulated access point (hal_native.h): the
+// first join scans, a short drop rejoins the cached access point directly,
+// a channel change falls back to a scan, the cache survives a warm reset,
+// and failed scans back off 2 s doubling to 64 s.
+#include <unity.h>
+
+#include <stdlib.h>
+
+#include "hal.h"
+#include "wifi_link.h"
+
+namespace {
+
+const char* const RTC_MEM_FILE = "test-wifi-rtcmem.bin";
+const unsigned long SCAN_JOIN_MS = 60;
+const unsigned long DIRECT_JOIN_MS = 30;
+
+// The access point goes away `inMs` from now for `forMs`, and comes back
+// on `channel` (0: the same one).
+void dropAccessPoint(unsigned long inMs, unsigned long forMs, uint8_t channel) {
+  char drops[48];
+  if (channel != 0) {
+    snprintf(drops, sizeof(drops), "%lu+%lu@%u", millis() + inMs, forMs, channel);
+  } else {
+    snprintf(drops, sizeof(drops), "%lu+%lu", millis() + inMs, forMs);
+  }
+  setenv("CLOCK_NATIVE_WIFI_DROPS", drops, 1);
+}
+
+// Services the link in real time until `event` or `timeoutMs`.
+bool waitFor(WifiLink& link, WifiLinkEvent event, unsigned long timeoutMs) {
+  unsigned long startMs = millis();
+  while (millis() - startMs < timeoutMs) {
+    if (link.service(millis()) == event) {
+      return true;
+    }
+    delay(1);
+  }
+  return false;
+}
+
+WifiLink link;
+
+}  // namespace
+
+void setUp() {
+  char ms[16];
+  snprintf(ms, sizeof(ms), "%lu", SCAN_JOIN_MS);
+  setenv("CLOCK_NATIVE_WIFI_JOIN_MS", ms, 1);
+  snprintf(ms, sizeof(ms), "%lu", DIRECT_JOIN_MS);
+  setenv("CLOCK_NATIVE_WIFI_DIRECT_MS", ms, 1);
+  setenv("CLOCK_RTC_MEM_FILE", RTC_MEM_FILE, 1);
+  unsetenv("CLOCK_NATIVE_WIFI_DROPS");
+}
+
+void tearDown() {}
+
+void test_first_join_scans() {
+  remove(RTC_MEM_FILE);  // Power-on: nothing cached
+  link.begin(millis());
+  TEST_ASSERT_EQUAL_UINT8(WIFI_LINK_SCAN, link.state());
+  TEST_ASSERT_TRUE(waitFor(link, WIFI_LINK_CONNECTED, 1000));
+  TEST_ASSERT_TRUE(link.connected());
+  TEST_ASSERT_FALSE(link.lastJoinDirect());
+  TEST_ASSERT_GREATER_OR_EQUAL(SCAN_JOIN_MS, link.lastJoinMs());
+  TEST_ASSERT_EQUAL_UINT32(1, link.scanJoins());
+  TEST_ASSERT_EQUAL_INT32(6, WiFi.channel());
+}
+
+void test_short_drop_rejoins_directly() {
+  // Back before the direct join completes.
+  dropAccessPoint(10, DIRECT_JOIN_MS / 2, 0);
+  TEST_ASSERT_TRUE(waitFor(link, WIFI_LINK_LOST, 1000));
+  TEST_ASSERT_EQUAL_UINT8(WIFI_LINK_DIRECT, link.state());
+  TEST_ASSERT_TRUE(waitFor(link, WIFI_LINK_CONNECTED, 1000));
+  TEST_ASSERT_TRUE(link.lastJoinDirect());
+  TEST_ASSERT_LESS_THAN(SCAN_JOIN_MS, link.lastJoinMs());
+  TEST_ASSERT_EQUAL_UINT32(1, link.losses());
+  TEST_ASSERT_EQUAL_UINT32(1, link.directJoins());
+  TEST_ASSERT_EQUAL_UINT32(0, link.failedAttempts());
+}
+
+void test_channel_change_falls_back_to_scan() {
+  dropAccessPoint(10, DIRECT_JOIN_MS / 2, 11);
+  TEST_ASSERT_TRUE(waitFor(link, WIFI_LINK_LOST, 1000));
+  TEST_ASSERT_TRUE(waitFor(link, WIFI_LINK_CONNECTED, 1000));
+  TEST_ASSERT_FALSE(link.lastJoinDirect());
+  TEST_ASSERT_GREATER_OR_EQUAL(DIRECT_JOIN_MS + SCAN_JOIN_MS, link.lastJoinMs());
+  TEST_ASSERT_EQUAL_UINT32(1, link.failedAttempts());
+  TEST_ASSERT_EQUAL_UINT32(2, link.scanJoins());
+  TEST_ASSERT_EQUAL_INT32(11, WiFi.channel());
+}
+
+void test_warm_reset_joins_cached_access_point() {
+  // A new link reads the cache back from RTC memory: now channel 11.
+  dropAccessPoint(0, 0, 11);
+  WifiLink warm;
+  warm.begin(millis());
+  TEST_ASSERT_EQUAL_UINT8(WIFI_LINK_DIRECT, warm.state());
+  TEST_ASSERT_TRUE(waitFor(warm, WIFI_LINK_CONNECTED, 1000));
+  TEST_ASSERT_TRUE(warm.lastJoinDirect());
+  TEST_ASSERT_EQUAL_UINT32(0, warm.failedAttempts());
+}
+
+void test_failed_scans_back_off() {
+  // Joins complete at once and the access point stays away, so each
+  // attempt fails on the next service(). The link's own timers run on
+  // the time passed to service(), which steps here in simulated ms.
+  setenv("CLOCK_NATIVE_WIFI_JOIN_MS", "0", 1);
+  setenv("CLOCK_NATIVE_WIFI_DIRECT_MS", "0", 1);
+  remove(RTC_MEM_FILE);
+  dropAccessPoint(0, 3600000, 0);
+  WifiLink down;
+  uint32_t nowMs = 1000;
+  down.begin(nowMs);
+  TEST_ASSERT_EQUAL_UINT8(WIFI_LINK_SCAN, down.state());
+  down.service(nowMs);
+  TEST_ASSERT_EQUAL_UINT8(WIFI_LINK_BACKOFF, down.state());
+  uint32_t backoffMs = WifiLink::BACKOFF_MIN_MS;
+  for (uint8_t attempt = 1; attempt <= 8; attempt++) {
+    down.service(nowMs + backoffMs - 1);
+    TEST_ASSERT_EQUAL_UINT8(WIFI_LINK_BACKOFF, down.state());
+    nowMs += backoffMs;
+    down.service(nowMs);
+    TEST_ASSERT_EQUAL_UINT8(WIFI_LINK_SCAN, down.state());
+    down.service(nowMs);
+    TEST_ASSERT_EQUAL_UINT8(WIFI_LINK_BACKOFF, down.state());
+    TEST_ASSERT_EQUAL_UINT32(attempt + 1, down.failedAttempts());
+    backoffMs = backoffMs * 2 < WifiLink::BACKOFF_MAX_MS ? backoffMs * 2 : WifiLink::BACKOFF_MAX_MS;
+  }
+  TEST_ASSERT_EQUAL_UINT32(WifiLink::BACKOFF_MAX_MS, backoffMs);
+  TEST_ASSERT_FALSE(down.connected());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_first_join_scans);
+  RUN_TEST(test_short_drop_rejoins_directly);
+  RUN_TEST(test_channel_change_falls_back_to_scan);
+  RUN_TEST(test_warm_reset_joins_cached_access_point);
+  RUN_TEST(test_failed_scans_back_off);
+  remove(RTC_MEM_FILE);
+  return UNITY_END();
+}
@@ -0,0 +1,115 @@
+// The WS2812 I2S encoder: line bits of every byte value, their timing at
+// 3.2 MHz, the reset gap, the GRB byte order of a NeoPixel buffer, and
+// encoding throughput.
+#include <unity.h>
+
+#include "hal.h"
+#include "ws2812_i2s.h"
+
+namespace {
+
+const uint32_t LINE_HZ = 3200000;
+const uint32_t LINE_BIT_NS = 1000000000 / LINE_HZ;  // 312 ns
+
+// The line bits of one LED byte, one per entry, first bit sent first.
+void lineBits(const uint16_t* words, uint8_t* bits) {
+  for (uint8_t w = 0; w < WS2812_I2S_WORDS_PER_BYTE; w++) {
+    for (int bit = 15; bit >= 0; bit--) {
+      *bits++ = (words[w] >> bit) & 1;
+    }
+  }
+}
+
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_every_byte_value() {
+  for (uint16_t value = 0; value < 256; value++) {
+    uint8_t pixel = (uint8_t)value;
+    uint16_t words[WS2812_I2S_WORDS_PER_BYTE];
+    ws2812EncodeI2s(&pixel, 1, words);
+    uint8_t bits[32];
+    lineBits(words, bits);
+    for (uint8_t dataBit = 0; dataBit < 8; dataBit++) {
+      bool one = (pixel >> (7 - dataBit)) & 1;
+      const uint8_t* symbol = bits + dataBit * 4;
+      TEST_ASSERT_EQUAL_UINT8(1, symbol[0]);
+      TEST_ASSERT_EQUAL_UINT8(one, symbol[1]);
+      TEST_ASSERT_EQUAL_UINT8(one, symbol[2]);
+      TEST_ASSERT_EQUAL_UINT8(0, symbol[3]);
+    }
+  }
+}
+
+void test_timing_within_ws2812b_limits() {
+  // WS2812B datasheet: 1.25 us per bit +-600 ns, T0H 220..380 ns and
+  // T1H 580..1000 ns.
+  TEST_ASSERT_INT_WITHIN(600, 1250, 4 * LINE_BIT_NS);
+  TEST_ASSERT_TRUE(LINE_BIT_NS >= 220 && LINE_BIT_NS <= 380);
+  TEST_ASSERT_TRUE(3 * LINE_BIT_NS >= 580 && 3 * LINE_BIT_NS <= 1000);
+}
+
+void test_reset_gap_latches_ws2812b() {
+  uint32_t gapNs = WS2812_I2S_RESET_BYTES * 8 * LINE_BIT_NS;
+  TEST_ASSERT_GREATER_OR_EQUAL(280000, gapNs);
+}
+
+void test_encoded_size() {
+  TEST_ASSERT_EQUAL_UINT32(4, ws2812I2sEncodedSize(1));
+  TEST_ASSERT_EQUAL_UINT32(60 * 3 * 4, ws2812I2sEncodedSize(60 * 3));
+}
+
+void test_neopixel_buffer_is_sent_grb() {
+  Adafruit_NeoPixel strip(2, 0, NEO_GRB + NEO_KHZ800);
+  strip.setPixelColor(0, 0x11, 0x22, 0x33);
+  strip.setPixelColor(1, 0xAA, 0xBB, 0xCC);
+  uint16_t words[6 * WS2812_I2S_WORDS_PER_BYTE];
+  ws2812EncodeI2s(strip.getPixels(), 6, words);
+  const uint8_t SENT[] = {0x22, 0x11, 0x33, 0xBB, 0xAA, 0xCC};
+  for (uint8_t i = 0; i < sizeof(SENT); i++) {
+    uint16_t expected[WS2812_I2S_WORDS_PER_BYTE];
+    ws2812EncodeI2s(&SENT[i], 1, expected);
+    TEST_ASSERT_EQUAL_HEX16(expected[0], words[i * 2]);
+    TEST_ASSERT_EQUAL_HEX16(expected[1], words[i * 2 + 1]);
+  }
+  // 0x22 = 0010 0010: 1000 1000 1110 1000, twice.
+  TEST_ASSERT_EQUAL_HEX16(0x88E8, words[0]);
+  TEST_ASSERT_EQUAL_HEX16(0x88E8, words[1]);
+}
+
+void test_encode_benchmark() {
+  const size_t BYTES = 241 * 3;
+  const uint32_t FRAMES = 20000;
+  uint8_t pixels[BYTES];
+  for (size_t i = 0; i < BYTES; i++) {
+    pixels[i] = (uint8_t)(i * 37);
+  }
+  static uint16_t encoded[BYTES * WS2812_I2S_WORDS_PER_BYTE];
+  uint32_t checksum = 0;
+  uint64_t startUs = halMicros64();
+  for (uint32_t f = 0; f < FRAMES; f++) {
+    pixels[f % BYTES]++;
+    ws2812EncodeI2s(pixels, BYTES, encoded);
+    checksum += encoded[f % BYTES];
+  }
+  uint64_t elapsedUs = halMicros64() - startUs;
+  char line[112];
+  snprintf(line, sizeof(line), "241 LEDs: %lu ns/frame, %lu MB/s encoded (checksum %lu)",
+           (unsigned long)(elapsedUs * 1000 / FRAMES),
+           (unsigned long)((uint64_t)FRAMES * sizeof(encoded) / (elapsedUs ? elapsedUs : 1)), (unsigned long)checksum);
+  TEST_MESSAGE(line);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_every_byte_value);
+  RUN_TEST(test_timing_within_ws2812b_limits);
+  RUN_TEST(test_reset_gap_latches_ws2812b);
+  RUN_TEST(test_encoded_size);
+  RUN_TEST(test_neopixel_buffer_is_sent_grb);
+  RUN_TEST(test_encode_benchmark);
+  return UNITY_END();
+}
@@ -0,0 +1,88 @@
+# Gzips the files in web/ and embeds them in src/web_assets.cpp (generated,
+# not committed) as PROGMEM arrays with a content-hash URL and ETag.
+#
+# Runs before every PlatformIO build (extra_scripts in platformio.ini); it can
+# also be run by hand: python3 tools/embed_assets.py
+
+import gzip
+import hashlib
+import os
+import re
+
+CONTENT_TYPES = {
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".html": "text/html",
+    ".svg": "image/svg+xml",
+    ".ico": "image/x-icon",
+}
+
+try:
+    Import("env")  # noqa: F821 -- defined when run by PlatformIO
+    PROJECT_DIR = env["PROJECT_DIR"]  # noqa: F821
+except NameError:
+    PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+WEB_DIR = os.path.join(PROJECT_DIR, "web")
+OUTPUT = os.path.join(PROJECT_DIR, "src", "web_assets.cpp")
+
+
+def symbol(name):
+    return re.sub(r"[^A-Za-z0-9]", "_", name).upper() + "_GZ"
+
+
+def byte_lines(data):
+    for i in range(0, len(data), 16):
+        yield "  " + ", ".join("0x%02x" % b for b in data[i:i + 16]) + ","
+
+
+def generate():
+    arrays = []
+    entries = []
+    total_raw = total_gz = 0
+    for name in sorted(os.listdir(WEB_DIR)):
+        stem, ext = os.path.splitext(name)
+        if ext not in CONTENT_TYPES:
+            continue
+        with open(os.path.join(WEB_DIR, name), "rb") as f:
+            raw = f.read()
+        # mtime=0 keeps the output (and so the hash) reproducible.
+        packed = gzip.compress(raw, compresslevel=9, mtime=0)
+        digest = hashlib.sha256(raw).hexdigest()[:8]
+        arrays.append("const uint8_t %s[] PROGMEM = {" % symbol(name))
+        arrays.extend(byte_lines(packed))
+        arrays.append("};")
+        entries.append('  {"%s", "/assets/%s.%s%s", "%s", "\\"%s\\"", %s, %d, %d},' % (
+            name, stem, digest, ext, CONTENT_TYPES[ext], digest, symbol(name), len(packed), len(raw)))
+        total_raw += len(raw)
+        total_gz += len(packed)
+
+    source = "\n".join([
+        "// Generated by tools/embed_assets.py from web/ -- do not edit.",
+        '#include "web_assets.h"',
+        "",
+        "namespace {",
+        "",
+    ] + arrays + [
+        "",
+        "}  // namespace",
+        "",
+        "const WebAsset WEB_ASSETS[] = {",
+    ] + entries + [
+        "};",
+        "const size_t WEB_ASSET_COUNT = %d;" % len(entries),
+        "",
+    ])
+
+    previous = None
+    if os.path.exists(OUTPUT):
+        with open(OUTPUT) as f:
+            previous = f.read()
+    # Rewriting an unchanged file would force a rebuild every time.
+    if source != previous:
+        with open(OUTPUT, "w") as f:
+            f.write(source)
+    print("Web assets: %d files, %d bytes -> %d bytes gzipped" % (len(entries), total_raw, total_gz))
+
+
+generate()
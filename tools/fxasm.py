@@ -0,0 +1,120 @@
+# Assembles the text form of an effect (see effects/) into the binary .fx
+# format played by src/effect_vm.cpp:
+#
+#   python3 tools/fxasm.py effects/rainbow.fxs            # -> effects/rainbow.fx
+#   python3 tools/fxasm.py effects/rainbow.fxs -o out.fx
+#
+# One instruction per line (or several separated by spaces); ';' starts a
+# comment. Mnemonics are the EffectOp names without OP_, in any case.
+# "push" takes an integer, "pushf" a decimal number stored as Q16.16, and
+# "jz"/"jmp" a label defined as "name:". Directives:
+#
+#   .frame_ms <ms>   delay between frames (default 50)
+#   .frames <n>      number of frames (default 1)
+#   .per_led         frames = .frames * LED count
+#   .clear           clear the LEDs before each frame
+
+import argparse
+import os
+import struct
+import sys
+
+# Same order as enum EffectOp in src/effect_vm.h.
+OPS = [
+    "end", "push", "pushf", "index", "count", "step", "frames", "dup", "drop",
+    "swap", "over", "add", "sub", "mul", "div", "mod", "neg", "abs", "min",
+    "max", "lt", "gt", "eq", "not", "sel", "sin", "jz", "jmp", "rgb", "hsv",
+]
+OPERAND_BYTES = {"push": 2, "pushf": 4, "jz": 1, "jmp": 1}
+
+VERSION = 1
+FLAG_CLEAR = 0x01
+FLAG_FRAMES_PER_LED = 0x02
+MAX_SIZE = 256
+
+
+class AsmError(Exception):
+    pass
+
+
+def tokens(source):
+    for number, line in enumerate(source.splitlines(), 1):
+        for token in line.split(";", 1)[0].split():
+            yield number, token
+
+
+def assemble(source):
+    frame_ms, frames, flags = 50, 1, 0
+    program = []  # (line, mnemonic, operand)
+    labels = {}
+    stream = tokens(source)
+
+    def operand(line, name):
+        try:
+            return next(stream)[1]
+        except StopIteration:
+            raise AsmError("line %d: %s needs an operand" % (line, name))
+
+    for line, token in stream:
+        word = token.lower()
+        if word == ".frame_ms":
+            frame_ms = int(operand(line, word), 0)
+        elif word == ".frames":
+            frames = int(operand(line, word), 0)
+        elif word == ".per_led":
+            flags |= FLAG_FRAMES_PER_LED
+        elif word == ".clear":
+            flags |= FLAG_CLEAR
+        elif word.endswith(":"):
+            labels[word[:-1]] = sum(1 + OPERAND_BYTES.get(op, 0) for _, op, _ in program)
+        elif word in OPS:
+            program.append((line, word, operand(line, word) if word in OPERAND_BYTES else None))
+        else:
+            raise AsmError("line %d: unknown instruction %r" % (line, token))
+
+    if not 0 < frame_ms < 65536 or not 0 < frames < 65536:
+        raise AsmError(".frame_ms and .frames must be 1..65535")
+
+    code = bytearray()
+    for line, op, arg in program:
+        code.append(OPS.index(op))
+        if op == "push":
+            value = int(arg, 0)
+            if not -32768 <= value < 32768:
+                raise AsmError("line %d: push takes -32768..32767, use pushf" % line)
+            code += struct.pack("<h", value)
+        elif op == "pushf":
+            code += struct.pack("<i", int(round(float(arg) * 65536)))
+        elif op in ("jz", "jmp"):
+            if arg.lower() not in labels:
+                raise AsmError("line %d: unknown label %r" % (line, arg))
+            offset = labels[arg.lower()] - (len(code) + 1)
+            if not -128 <= offset < 128:
+                raise AsmError("line %d: jump too far" % line)
+            code += struct.pack("<b", offset)
+
+    data = b"FX" + struct.pack("<BBHH", VERSION, flags, frame_ms, frames) + bytes(code)
+    if len(data) > MAX_SIZE:
+        raise AsmError("effect is %d bytes, the limit is %d" % (len(data), MAX_SIZE))
+    return data
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Assemble an LED effect")
+    parser.add_argument("source")
+    parser.add_argument("-o", "--output")
+    args = parser.parse_args()
+
+    output = args.output or os.path.splitext(args.source)[0] + ".fx"
+    with open(args.source) as f:
+        try:
+            data = assemble(f.read())
+        except (AsmError, ValueError) as e:
+            sys.exit("%s: %s" % (args.source, e))
+    with open(output, "wb") as f:
+        f.write(data)
+    print("%s: %d bytes" % (output, len(data)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,167 @@
+# Packs the IANA time zone list (tools/tz_zones.csv: zone name, POSIX rule)
+# into src/tz_data.cpp (generated, not committed), read by src/tz_db.cpp.
+#
+# Runs before every PlatformIO build (extra_scripts in platformio.ini); it can
+# also be run by hand: python3 tools/tz_db.py
+#
+# To update the list from a tzdata installation (the POSIX rule is the footer
+# of each version 2+ TZif file):
+#
+#   python3 tools/tz_db.py --import /usr/share/zoneinfo
+#
+# Layout, all in PROGMEM:
+#   RULES         the distinct rules, NUL-terminated, back to back
+#   RULE_OFFSETS  start of each rule in RULES
+#   NAMES         zone names in byte order, front-coded in blocks of
+#                 BLOCK_SIZE entries: shared:u8 | suffixLen:u8 | suffix | rule:u8
+#                 where shared counts the leading bytes of the previous name
+#                 (0 for the first entry of a block, so a block can be
+#                 decoded on its own)
+#   BLOCK_OFFSETS start of each block in NAMES
+# A zone's id is its position in name order.
+
+import csv
+import hashlib
+import os
+import sys
+
+BLOCK_SIZE = 16  # TZ_DB_BLOCK_SIZE in src/tz_db.h
+NAME_MAX = 40    # TZ_DB_NAME_MAX, including the NUL
+RULE_MAX = 48    # TZ_DB_RULE_MAX
+SKIPPED = {"Factory", "localtime", "posixrules"}
+
+try:
+    Import("env")  # noqa: F821 -- defined when run by PlatformIO
+    PROJECT_DIR = env["PROJECT_DIR"]  # noqa: F821
+except NameError:
+    PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+ZONES_CSV = os.path.join(PROJECT_DIR, "tools", "tz_zones.csv")
+OUTPUT = os.path.join(PROJECT_DIR, "src", "tz_data.cpp")
+
+
+def import_zoneinfo(root):
+    zones = {}
+    for directory, dirs, files in os.walk(root):
+        rel = os.path.relpath(directory, root)
+        if rel.split(os.sep)[0] in ("posix", "right"):
+            dirs[:] = []
+            continue
+        for name in files:
+            zone = os.path.normpath(os.path.join(rel, name)).replace(os.sep, "/")
+            if zone in SKIPPED:
+                continue
+            with open(os.path.join(directory, name), "rb") as f:
+                data = f.read()
+            if data[:4] != b"TZif" or data[4:5] < b"2":
+                continue
+            rule = data.rstrip(b"\n").rsplit(b"\n", 1)[-1].decode("ascii")
+            if rule:
+                zones[zone] = rule
+    version = "unknown"
+    zi = os.path.join(root, "tzdata.zi")
+    if os.path.exists(zi):
+        with open(zi) as f:
+            version = f.readline().split()[-1]
+    with open(ZONES_CSV, "w", newline="") as f:
+        f.write("# tzdata %s, imported by tools/tz_db.py --import\n" % version)
+        writer = csv.writer(f, lineterminator="\n")
+        writer.writerow(["zone", "rule"])
+        for zone in sorted(zones, key=lambda z: z.encode()):
+            writer.writerow([zone, zones[zone]])
+    print("Time zones: imported %d zones (tzdata %s) into %s" % (len(zones), version, ZONES_CSV))
+
+
+def read_zones():
+    with open(ZONES_CSV, newline="") as f:
+        rows = [row for row in csv.reader(line for line in f if not line.startswith("#"))]
+    zones = sorted(((row[0], row[1]) for row in rows[1:]), key=lambda z: z[0].encode())
+    for name, rule in zones:
+        if len(name) >= NAME_MAX or len(rule) >= RULE_MAX or not name.isascii() or not rule.isascii():
+            sys.exit("tz_zones.csv: %s does not fit the table" % name)
+    return zones
+
+
+def c_string(text):
+    return '"%s\\0"' % text.replace("\\", "\\\\").replace('"', '\\"')
+
+
+def byte_lines(data):
+    for i in range(0, len(data), 16):
+        yield "  " + ", ".join("0x%02x" % b for b in data[i:i + 16]) + ","
+
+
+def generate():
+    zones = read_zones()
+    rules = sorted(set(rule for _, rule in zones))
+    if len(rules) > 255:
+        sys.exit("tz_zones.csv: more than 255 distinct rules")
+    rule_index = {rule: i for i, rule in enumerate(rules)}
+    rule_offsets = []
+    offset = 0
+    for rule in rules:
+        rule_offsets.append(offset)
+        offset += len(rule) + 1
+    rules_size = offset
+
+    names = bytearray()
+    block_offsets = []
+    previous = b""
+    for i, (zone, rule) in enumerate(zones):
+        name = zone.encode()
+        shared = 0
+        if i % BLOCK_SIZE == 0:
+            block_offsets.append(len(names))
+        else:
+            while shared < min(len(name), len(previous)) and name[shared] == previous[shared]:
+                shared += 1
+        suffix = name[shared:]
+        names += bytes([shared, len(suffix)]) + suffix + bytes([rule_index[rule]])
+        previous = name
+
+    # Changes whenever the list does; the ETag of /api/timezones.
+    digest = hashlib.sha256("\n".join("%s,%s" % z for z in zones).encode()).hexdigest()[:8]
+    flash = rules_size + 2 * len(rule_offsets) + len(names) + 2 * len(block_offsets)
+    raw = sum(len(z) + 1 + len(r) + 1 for z, r in zones)
+
+    source = "\n".join([
+        "// Generated by tools/tz_db.py from tools/tz_zones.csv -- do not edit.",
+        '#include "tz_db.h"',
+        "",
+        "// %d zones, %d distinct rules: %d bytes of flash (%d as plain strings)." % (
+            len(zones), len(rules), flash, raw),
+        "extern const char TZ_DB_RULES[] PROGMEM =",
+    ] + ["  " + c_string(rule) for rule in rules] + [
+        "  ;",
+        "extern const uint16_t TZ_DB_RULE_OFFSETS[] PROGMEM = {",
+    ] + ["  " + ", ".join(str(o) for o in rule_offsets[i:i + 12]) + ","
+         for i in range(0, len(rule_offsets), 12)] + [
+        "};",
+        "extern const uint8_t TZ_DB_NAMES[] PROGMEM = {",
+    ] + list(byte_lines(names)) + [
+        "};",
+        "extern const uint16_t TZ_DB_BLOCK_OFFSETS[] PROGMEM = {",
+    ] + ["  " + ", ".join(str(o) for o in block_offsets[i:i + 12]) + ","
+         for i in range(0, len(block_offsets), 12)] + [
+        "};",
+        "extern const uint16_t TZ_DB_ZONE_COUNT = %d;" % len(zones),
+        "static_assert(TZ_DB_BLOCK_SIZE == %d, \"tools/tz_db.py and tz_db.h disagree\");" % BLOCK_SIZE,
+        'extern const char TZ_DB_VERSION[] = "\\"%s\\"";' % digest,
+        "",
+    ])
+
+    previous_source = None
+    if os.path.exists(OUTPUT):
+        with open(OUTPUT) as f:
+            previous_source = f.read()
+    # Rewriting an unchanged file would force a rebuild every time.
+    if source != previous_source:
+        with open(OUTPUT, "w") as f:
+            f.write(source)
+    print("Time zones: %d zones, %d rules, %d bytes of flash (%d as plain strings)" % (
+        len(zones), len(rules), flash, raw))
+
+
+if len(sys.argv) == 3 and sys.argv[1] == "--import":
+    import_zoneinfo(sys.argv[2])
+generate()
@@ -0,0 +1,46 @@
+// Keeps the status box live from /api/events, so the page does not have to
+// be reloaded (and re-sent) to follow the time or the NTP state.
+(function () {
+  if (!window.EventSource) {
+    return;
+  }
+  var time = document.getElementById('time');
+  var clock = document.getElementById('clock');
+  var events = new EventSource('/api/events');
+
+  events.addEventListener('time', function (e) {
+    var t = JSON.parse(e.data);
+    time.textContent = t.time === null ? 'not synced (NTP)' : t.time;
+  });
+
+  events.addEventListener('sync', function (e) {
+    var s = JSON.parse(e.data);
+    if (!s.synced) {
+      clock.textContent = (s.clockSet ? 'free running (RTC), ' : 'not set, ') + 'waiting for NTP';
+      return;
+    }
+    clock.textContent = s.server +
+      (s.stepped ? ', stepped' : ', offset ' + s.offsetMs.toFixed(1) + ' ms') +
+      ', delay ' + s.delayMs.toFixed(1) + ' ms, drift ' + s.driftPpm.toFixed(2) + ' ppm' +
+      ', poll ' + s.pollS + ' s';
+  });
+})();
+
+// The page lists only the current timezone; the full list (~600 zones) is
+// fetched once and revalidated by ETag, instead of being sent with every page.
+(function () {
+  var select = document.getElementById('tzPreset');
+  if (!select || !window.fetch) {
+    return;
+  }
+  fetch('/api/timezones').then(function (r) { return r.json(); }).then(function (zones) {
+    var current = select.value;
+    select.textContent = '';
+    zones.forEach(function (zone) {
+      var option = document.createElement('option');
+      option.value = option.textContent = zone;
+      option.selected = zone === current;
+      select.appendChild(option);
+    });
+  });
+})();